@@ -29,7 +29,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "app_ws_client.h"
 
+#include <limits>
 #include <memory>
+#include <vector>
 
 #include "absl/strings/str_cat.h"
 #include "mmal_still_capture.h"
@@ -137,6 +139,38 @@ const char kKeyEventMesg[] = "mesg";
 // 			'filename' : the filename of captured image
 // 			'url' : http url path (excluding protocol, hostname and port)
 //
+// 5. Set motion zones
+//
+// { cmd : request, type: motionzones, data : '...', transaction: '...'  }
+// { cmd : response, type: motionzones, transaction: '...',
+// 		result: 'SUCCESS/FAILED', error: '...' }
+//
+//      data:
+//          string of motion zones in the motion_zones config format,
+//          empty string clears the zones. The zones are not saved in the
+//          motion config file.
+//
+// 6. List motion recordings
+//
+// { cmd : request, type: recordings, data : { ... }, transaction: '...'  }
+//
+//      data:
+//          Json format : (all optional)
+//          'from' : unix time, the recordings started from the time
+//          'to' : unix time, the recordings started until the time
+//
+// { cmd : response, type: recordings, data : [ ... ], transaction: '...',
+// 		result: 'SUCCESS/FAILED', error: '...' }
+//
+// 		data:
+// 			json array of the recordings in the start time order
+// 			'video' : the filename of video, empty when it is removed
+// 			'imv' : the filename of imv, empty when it is not saved
+// 			'start' : unix time of the first frame
+// 			'duration' : duration in ms, 0 when it is not known
+// 			'size' : total size of the video and imv file
+// 			'url' : http url path of the video file
+//
 // - Message format
 //
 // Similar to the send used for signaling. but, forwarding messages
@@ -211,6 +245,24 @@ const char kValueStillDataVerbose[] = "verbose";
 const char kValueStillDataForceCapture[] = "force_capture";
 const char kValueStillDataUrl[] = "url";  // used in response only
 
+//
+//  motion zones
+//
+const char kValueTypeMotionZones[] = "motionzones";
+
+//
+//  motion recordings
+//
+const char kValueTypeRecordings[] = "recordings";
+const char kValueRecordingsDataFrom[] = "from";
+const char kValueRecordingsDataTo[] = "to";
+const char kValueRecordingsDataVideo[] = "video";
+const char kValueRecordingsDataImv[] = "imv";
+const char kValueRecordingsDataStart[] = "start";
+const char kValueRecordingsDataDuration[] = "duration";
+const char kValueRecordingsDataSize[] = "size";
+const char kValueRecordingsDataUrl[] = "url";
+
 //
 //  Media Config Version
 //
@@ -237,6 +289,8 @@ const char kErrUnknownRequestType[] = "Unknown Request Type";
 const char kErrUnknownProtocolMessage[] = "Unknown Protocol Message";
 const char kErrRTCConfig[] = "Failed to get RTC Configuration";
 const char kErrStillDataParse[] = "Failed to parse data of still parameters";
+const char kErrMotionZones[] = "Failed to set motion zones";
+const char kErrRecordings[] = "motion detection is not started";
 
 // delay of message to use for stream release
 const int kStreamReleaseDelay = 1000;
@@ -652,6 +706,77 @@ bool AppWsClient::OnMessage(int sockid, const std::string& message) {
             return true;
         }
 
+        //
+        // Motion zones request
+        //
+        else if (cmd_type.compare(kValueTypeMotionZones) == 0) {
+            // { cmd : request, type: motionzones, data : '...'  }
+            std::string data;
+            if (rtc::GetStringFromJsonObject(json_value, kKeyData, &data) ==
+                false) {
+                RTC_LOG(LS_ERROR) << "Failed to get data key";
+                SendResponse(sockid, false, kValueTypeMotionZones, transaction,
+                             "", kErrDataKeyMissing);
+                return true;
+            }
+            if (SetMotionZones(data) == false) {
+                SendResponse(sockid, false, kValueTypeMotionZones, transaction,
+                             "", kErrMotionZones);
+                return true;
+            }
+            SendResponse(sockid, true, kValueTypeMotionZones, transaction, "",
+                         "");
+            return true;
+        }
+
+        //
+        // Motion recordings request
+        //
+        else if (cmd_type.compare(kValueTypeRecordings) == 0) {
+            // { cmd : request, type: recordings, data : { ... }  }
+            Json::Value json_data_value;
+            int int_value;
+            time_t from_time = 0;
+            time_t to_time = std::numeric_limits<time_t>::max();
+            if (rtc::GetValueFromJsonObject(json_value, kKeyData,
+                                            &json_data_value) == true) {
+                if (rtc::GetIntFromJsonObject(json_data_value,
+                                              kValueRecordingsDataFrom,
+                                              &int_value) == true)
+                    from_time = int_value;
+                if (rtc::GetIntFromJsonObject(json_data_value,
+                                              kValueRecordingsDataTo,
+                                              &int_value) == true)
+                    to_time = int_value;
+            }
+
+            std::vector<RecordingInfo> recordings;
+            if (ListRecordings(from_time, to_time, &recordings) == false) {
+                SendResponse(sockid, false, kValueTypeRecordings, transaction,
+                             "", kErrRecordings);
+                return true;
+            }
+            Json::StyledWriter json_writer;
+            Json::Value json_data(Json::arrayValue);
+            for (const RecordingInfo& recording : recordings) {
+                Json::Value json_recording;
+                json_recording[kValueRecordingsDataVideo] = recording.video;
+                json_recording[kValueRecordingsDataImv] = recording.imv;
+                json_recording[kValueRecordingsDataStart] =
+                    static_cast<Json::Int64>(recording.start_time);
+                json_recording[kValueRecordingsDataDuration] =
+                    recording.duration_ms;
+                json_recording[kValueRecordingsDataSize] =
+                    static_cast<Json::UInt64>(recording.size);
+                json_recording[kValueRecordingsDataUrl] =
+                    absl::StrCat("/motion/", recording.name());
+                json_data.append(json_recording);
+            }
+            SendResponse(sockid, true, kValueTypeRecordings, transaction,
+                         json_writer.write(json_data), "");
+            return true;
+        }
+
         //
         // Still image capture request
         //
@@ -0,0 +1,85 @@
+/*
+Copyright (c) 2021, rpi-webrtc-streamer Lyu,KeunChang
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Helpers shared by the checks in this directory. Each check is a standalone
+// program which reports the failed expectations with the file and the line,
+// and returns non zero from main when any of them failed, so 'make check'
+// stops at the first failing check.
+
+#ifndef CHECK_UTIL_H_
+#define CHECK_UTIL_H_
+
+#include <stdarg.h>
+#include <stdio.h>
+
+namespace check {
+
+// number of the failed expectations of the program
+inline int &failures() {
+    static int failures = 0;
+    return failures;
+}
+
+inline void Fail(const char *file, int line, const char *format, ...) {
+    va_list args;
+
+    fprintf(stderr, "%s:%d: ", file, line);
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+    fprintf(stderr, "\n");
+    failures()++;
+}
+
+// Print the result of the check, the return value is the exit code of main.
+inline int Finish(const char *name) {
+    if (failures()) {
+        fprintf(stderr, "%s: %d checks failed\n", name, failures());
+        return 1;
+    }
+    printf("%s: OK\n", name);
+    return 0;
+}
+
+}  // namespace check
+
+// Expect the condition is true, the expression is reported when it is not.
+#define EXPECT(condition)                                                   \
+    do {                                                                    \
+        if (!(condition)) check::Fail(__FILE__, __LINE__, "%s", #condition); \
+    } while (0)
+
+// Expect the condition is true, the printf like message is reported when it
+// is not.
+#define EXPECT_MSG(condition, ...)                                          \
+    do {                                                                    \
+        if (!(condition)) check::Fail(__FILE__, __LINE__, __VA_ARGS__);     \
+    } while (0)
+
+#endif  // CHECK_UTIL_H_
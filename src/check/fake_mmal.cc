@@ -0,0 +1,200 @@
+/*
+Copyright (c) 2021, rpi-webrtc-streamer Lyu,KeunChang
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "check/fake_mmal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <map>
+
+namespace check {
+
+namespace {
+
+std::map<MMAL_POOL_T *, FakeMmalPool *> fake_pools;
+std::map<const MMAL_BUFFER_HEADER_T *, FakeMmalPool *> fake_headers;
+std::map<MMAL_COMPONENT_T *, int> component_refs;
+
+}  // namespace
+
+FakeMmalPool::FakeMmalPool(int headers_num, size_t payload_size)
+    : headers_(headers_num),
+      states_(headers_num, HeaderState{0, 0}),
+      payloads_(headers_num, std::vector<uint8_t>(payload_size)),
+      callback_(nullptr),
+      userdata_(nullptr),
+      callbacks_(0),
+      destroyed_(false),
+      destroyed_enabled_(false) {
+    for (int index = 0; index < headers_num; index++) {
+        MMAL_BUFFER_HEADER_T *header = &headers_[index];
+        *header = MMAL_BUFFER_HEADER_T();
+        header->data = payloads_[index].data();
+        header->alloc_size = payload_size;
+        header_ptrs_.push_back(header);
+        queue_.headers.push_back(header);
+        fake_headers[header] = this;
+    }
+    pool_ = MMAL_POOL_T();
+    pool_.queue = &queue_;
+    pool_.headers_num = headers_num;
+    pool_.header = header_ptrs_.data();
+    fake_pools[&pool_] = this;
+}
+
+FakeMmalPool::~FakeMmalPool() {
+    fake_pools.erase(&pool_);
+    for (MMAL_BUFFER_HEADER_T *header : header_ptrs_)
+        fake_headers.erase(header);
+}
+
+MMAL_BUFFER_HEADER_T *FakeMmalPool::Get() {
+    if (queue_.headers.empty()) return nullptr;
+    MMAL_BUFFER_HEADER_T *header = queue_.headers.front();
+    queue_.headers.pop_front();
+    states_[IndexOf(header)].refcount = 1;
+    return header;
+}
+
+int FakeMmalPool::refcount(const MMAL_BUFFER_HEADER_T *header) const {
+    return states_[IndexOf(header)].refcount;
+}
+
+int FakeMmalPool::lock_count(const MMAL_BUFFER_HEADER_T *header) const {
+    return states_[IndexOf(header)].lock_count;
+}
+
+FakeMmalPool *FakeMmalPool::FromPool(MMAL_POOL_T *pool) {
+    auto it = fake_pools.find(pool);
+    return it == fake_pools.end() ? nullptr : it->second;
+}
+
+FakeMmalPool *FakeMmalPool::FromHeader(const MMAL_BUFFER_HEADER_T *header) {
+    auto it = fake_headers.find(header);
+    return it == fake_headers.end() ? nullptr : it->second;
+}
+
+void FakeMmalPool::Acquire(MMAL_BUFFER_HEADER_T *header) {
+    states_[IndexOf(header)].refcount++;
+}
+
+// Same with mmal_pool_buffer_header_release of the last reference
+void FakeMmalPool::Release(MMAL_BUFFER_HEADER_T *header) {
+    HeaderState &state = states_[IndexOf(header)];
+    if (state.refcount <= 0) {
+        fprintf(stderr, "Released the header which is not acquired\n");
+        abort();
+    }
+    if (--state.refcount > 0) return;
+    if (callback_) {
+        callbacks_++;
+        if (callback_(&pool_, header, userdata_) == MMAL_FALSE) return;
+    }
+    queue_.headers.push_back(header);
+}
+
+void FakeMmalPool::Lock(MMAL_BUFFER_HEADER_T *header, int count) {
+    states_[IndexOf(header)].lock_count += count;
+}
+
+void FakeMmalPool::SetCallback(MMAL_POOL_BH_CB_T callback, void *userdata) {
+    callback_ = callback;
+    userdata_ = userdata;
+}
+
+void FakeMmalPool::Destroy(MMAL_PORT_T *port) {
+    destroyed_ = true;
+    destroyed_enabled_ = port->is_enabled;
+}
+
+size_t FakeMmalPool::IndexOf(const MMAL_BUFFER_HEADER_T *header) const {
+    return header - headers_.data();
+}
+
+int ComponentRefs(MMAL_COMPONENT_T *component) {
+    return component_refs[component];
+}
+
+}  // namespace check
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Fake MMAL functions
+//
+////////////////////////////////////////////////////////////////////////////////
+extern "C" {
+
+unsigned int mmal_queue_length(MMAL_QUEUE_T *queue) {
+    return queue->headers.size();
+}
+
+void mmal_pool_callback_set(MMAL_POOL_T *pool, MMAL_POOL_BH_CB_T cb,
+                            void *userdata) {
+    check::FakeMmalPool *fake_pool = check::FakeMmalPool::FromPool(pool);
+    if (fake_pool) fake_pool->SetCallback(cb, userdata);
+}
+
+void mmal_port_pool_destroy(MMAL_PORT_T *port, MMAL_POOL_T *pool) {
+    check::FakeMmalPool *fake_pool = check::FakeMmalPool::FromPool(pool);
+    if (fake_pool) fake_pool->Destroy(port);
+}
+
+void mmal_buffer_header_acquire(MMAL_BUFFER_HEADER_T *header) {
+    check::FakeMmalPool::FromHeader(header)->Acquire(header);
+}
+
+void mmal_buffer_header_release(MMAL_BUFFER_HEADER_T *header) {
+    check::FakeMmalPool::FromHeader(header)->Release(header);
+}
+
+MMAL_STATUS_T mmal_buffer_header_mem_lock(MMAL_BUFFER_HEADER_T *header) {
+    check::FakeMmalPool::FromHeader(header)->Lock(header, 1);
+    return MMAL_SUCCESS;
+}
+
+void mmal_buffer_header_mem_unlock(MMAL_BUFFER_HEADER_T *header) {
+    check::FakeMmalPool::FromHeader(header)->Lock(header, -1);
+}
+
+void mmal_component_acquire(MMAL_COMPONENT_T *component) {
+    check::component_refs[component]++;
+}
+
+MMAL_STATUS_T mmal_component_release(MMAL_COMPONENT_T *component) {
+    check::component_refs[component]--;
+    return MMAL_SUCCESS;
+}
+
+// dump_buffer_flag of mmal_util.c, which is linked with the camera functions
+void dump_buffer_flag(char *buf, int buflen, int flags) {
+    snprintf(buf, buflen, "0x%x", flags);
+}
+
+}  // extern "C"
@@ -0,0 +1,109 @@
+/*
+Copyright (c) 2021, rpi-webrtc-streamer Lyu,KeunChang
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Fake MMAL pool of the checks linked without the MMAL libraries. The pool
+// owns the buffer headers and their payload, and the MMAL functions defined
+// in fake_mmal.cc keep the reference count and the lock count of each header.
+// The header released by its last reference goes to the pool callback, and
+// back to the pool queue when the callback returns true, like the MMAL pool.
+
+#ifndef CHECK_FAKE_MMAL_H_
+#define CHECK_FAKE_MMAL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <deque>
+#include <vector>
+
+#include "interface/mmal/mmal.h"
+#include "interface/mmal/util/mmal_util.h"
+#include "rtc_base/constructor_magic.h"
+
+// opaque in the MMAL headers
+struct MMAL_QUEUE_T {
+    std::deque<MMAL_BUFFER_HEADER_T *> headers;
+};
+
+namespace check {
+
+class FakeMmalPool {
+   public:
+    explicit FakeMmalPool(int headers_num, size_t payload_size = 0);
+    ~FakeMmalPool();
+
+    MMAL_POOL_T *pool() { return &pool_; }
+    unsigned int queue_length() const { return queue_.headers.size(); }
+    // Takes a header from the pool queue with one reference, like the encoder
+    // port does before it fills the header. nullptr when the queue is empty.
+    MMAL_BUFFER_HEADER_T *Get();
+    int refcount(const MMAL_BUFFER_HEADER_T *header) const;
+    int lock_count(const MMAL_BUFFER_HEADER_T *header) const;
+    // number of the headers released to the pool callback
+    int callbacks() const { return callbacks_; }
+    bool destroyed() const { return destroyed_; }
+    bool destroyed_enabled() const { return destroyed_enabled_; }
+
+    // Called by the fake MMAL functions
+    static FakeMmalPool *FromPool(MMAL_POOL_T *pool);
+    static FakeMmalPool *FromHeader(const MMAL_BUFFER_HEADER_T *header);
+    void Acquire(MMAL_BUFFER_HEADER_T *header);
+    void Release(MMAL_BUFFER_HEADER_T *header);
+    void Lock(MMAL_BUFFER_HEADER_T *header, int count);
+    void SetCallback(MMAL_POOL_BH_CB_T callback, void *userdata);
+    void Destroy(MMAL_PORT_T *port);
+
+   private:
+    struct HeaderState {
+        int refcount;
+        int lock_count;
+    };
+    size_t IndexOf(const MMAL_BUFFER_HEADER_T *header) const;
+
+    MMAL_POOL_T pool_;
+    MMAL_QUEUE_T queue_;
+    std::vector<MMAL_BUFFER_HEADER_T> headers_;
+    std::vector<MMAL_BUFFER_HEADER_T *> header_ptrs_;
+    std::vector<HeaderState> states_;
+    std::vector<std::vector<uint8_t>> payloads_;
+    MMAL_POOL_BH_CB_T callback_;
+    void *userdata_;
+    int callbacks_;
+    bool destroyed_;
+    bool destroyed_enabled_;
+
+    RTC_DISALLOW_COPY_AND_ASSIGN(FakeMmalPool);
+};
+
+// Reference count of the component kept by mmal_component_acquire/release
+int ComponentRefs(MMAL_COMPONENT_T *component);
+
+}  // namespace check
+
+#endif  // CHECK_FAKE_MMAL_H_
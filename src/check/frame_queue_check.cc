@@ -0,0 +1,270 @@
+/*
+Copyright (c) 2021, rpi-webrtc-streamer Lyu,KeunChang
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Check of the zero copy path of FrameQueue with the fake MMAL pool. The
+// single part frame is passed to the subscribers with the buffer header of
+// the encoder pool, so the header must stay out of the pool while any
+// subscriber holds the frame and go back to the pool exactly once after the
+// last one releases it. The following are verified:
+//
+//  - the single part frame refers to the header payload without copying,
+//    and the header keeps one reference and one memory lock of FrameBuffer
+//  - the header goes back to the pool through the pool callback after the
+//    last subscriber releases the frame, and right away without subscribers
+//  - the coalesced frame(config and multi part frame) is copied, so its
+//    headers go back to the pool after the encoder callback
+//  - the frames dropped by the slow subscriber, flushed by Init and left in
+//    the rings of the removed subscriber release their headers
+//
+// The encoder callback of MMALEncoderWrapper is replayed: the header is
+// written back under the memory lock and released by the callback.
+//
+// Usage: frame_queue_check
+//
+// Build with 'make frame_queue_check' in src directory.
+
+#include <stdio.h>
+#include <string.h>
+
+#include <memory>
+#include <vector>
+
+#include "check/check_util.h"
+#include "check/fake_mmal.h"
+#include "frame_queue.h"
+
+namespace {
+
+const int kPoolHeaders = 8;
+const size_t kPayloadSize = 4096;
+const size_t kQueueCapacity = 16;
+const size_t kFrameSize = 1024;
+
+// FrameQueue with the encoder callback of MMALEncoderWrapper
+class EncoderFrameQueue : public webrtc::FrameQueue {
+   public:
+    EncoderFrameQueue() { Init(kQueueCapacity, kPayloadSize); }
+
+    bool Deliver(MMAL_BUFFER_HEADER_T *header) {
+        mmal_buffer_header_mem_lock(header);
+        bool result = WriteBack(header);
+        mmal_buffer_header_mem_unlock(header);
+        mmal_buffer_header_release(header);
+        return result;
+    }
+    void Reinit() { Init(kQueueCapacity, kPayloadSize); }
+};
+
+// Pool callback of the encoder wrapper when the port is disabled, the header
+// goes back to the pool queue.
+int pool_callbacks = 0;
+MMAL_BOOL_T PoolCallback(MMAL_POOL_T *pool, MMAL_BUFFER_HEADER_T *header,
+                         void *userdata) {
+    pool_callbacks++;
+    return MMAL_TRUE;
+}
+
+struct Fixture {
+    Fixture() : pool(kPoolHeaders, kPayloadSize) {
+        mmal_pool_callback_set(pool.pool(), PoolCallback, nullptr);
+        pool_callbacks = 0;
+    }
+
+    // Fill a header with a NAL unit of the type like the encoder does.
+    MMAL_BUFFER_HEADER_T *Fill(uint32_t flags, uint8_t nal_type,
+                               size_t length = kFrameSize) {
+        MMAL_BUFFER_HEADER_T *header = pool.Get();
+        if (header == nullptr) return nullptr;
+        static const uint8_t kStartCode[] = {0, 0, 0, 1};
+        memset(header->data, 0x55, length);
+        memcpy(header->data, kStartCode, sizeof(kStartCode));
+        header->data[sizeof(kStartCode)] = 0x60 | nal_type;
+        header->offset = 0;
+        header->length = length;
+        header->flags = flags;
+        header->pts = header->dts = MMAL_TIME_UNKNOWN;
+        return header;
+    }
+    MMAL_BUFFER_HEADER_T *FillFrame(bool key_frame = false) {
+        return Fill(MMAL_BUFFER_HEADER_FLAG_FRAME_END |
+                        (key_frame ? MMAL_BUFFER_HEADER_FLAG_KEYFRAME : 0),
+                    key_frame ? 5 : 1);
+    }
+
+    check::FakeMmalPool pool;
+    EncoderFrameQueue queue;
+};
+
+void CheckZeroCopyFrame() {
+    Fixture fixture;
+    std::unique_ptr<webrtc::FrameSubscriber> subscriber =
+        fixture.queue.Subscribe("zero copy");
+
+    MMAL_BUFFER_HEADER_T *header = fixture.FillFrame();
+    EXPECT(fixture.queue.Deliver(header));
+    // held by the frame in the ring of the subscriber
+    EXPECT(fixture.pool.refcount(header) == 1);
+    EXPECT(fixture.pool.lock_count(header) == 1);
+    EXPECT(fixture.pool.queue_length() == kPoolHeaders - 1);
+    EXPECT(pool_callbacks == 0);
+
+    rtc::scoped_refptr<webrtc::FrameBuffer> frame =
+        subscriber->ReadFront(false);
+    EXPECT(frame != nullptr);
+    if (frame == nullptr) return;
+    EXPECT(frame->data() == header->data + header->offset);
+    EXPECT(frame->length() == kFrameSize);
+    EXPECT(frame->isFrameEnd());
+
+    frame = nullptr;
+    EXPECT(fixture.pool.refcount(header) == 0);
+    EXPECT(fixture.pool.lock_count(header) == 0);
+    EXPECT(fixture.pool.queue_length() == kPoolHeaders);
+    EXPECT(pool_callbacks == 1);
+}
+
+void CheckSharedBySubscribers() {
+    Fixture fixture;
+    std::unique_ptr<webrtc::FrameSubscriber> live =
+        fixture.queue.Subscribe("live");
+    std::unique_ptr<webrtc::FrameSubscriber> motion =
+        fixture.queue.Subscribe("motion");
+
+    MMAL_BUFFER_HEADER_T *header = fixture.FillFrame(true);
+    EXPECT(fixture.queue.Deliver(header));
+    rtc::scoped_refptr<webrtc::FrameBuffer> live_frame = live->ReadFront(false);
+    rtc::scoped_refptr<webrtc::FrameBuffer> motion_frame =
+        motion->ReadFront(false);
+    EXPECT(live_frame != nullptr && live_frame == motion_frame);
+    // FrameBuffer holds the header once for all of the subscribers
+    EXPECT(fixture.pool.refcount(header) == 1);
+
+    live_frame = nullptr;
+    EXPECT(fixture.pool.queue_length() == kPoolHeaders - 1);
+    motion_frame = nullptr;
+    EXPECT(fixture.pool.queue_length() == kPoolHeaders);
+    EXPECT(pool_callbacks == 1);
+}
+
+void CheckNoSubscriber() {
+    Fixture fixture;
+
+    MMAL_BUFFER_HEADER_T *header = fixture.FillFrame();
+    EXPECT(fixture.queue.Deliver(header));
+    EXPECT(fixture.pool.refcount(header) == 0);
+    EXPECT(fixture.pool.lock_count(header) == 0);
+    EXPECT(fixture.pool.queue_length() == kPoolHeaders);
+}
+
+void CheckCoalescedFrame() {
+    Fixture fixture;
+    std::unique_ptr<webrtc::FrameSubscriber> subscriber =
+        fixture.queue.Subscribe("coalesced");
+
+    // SPS/PPS config part and the key frame in two parts
+    MMAL_BUFFER_HEADER_T *config =
+        fixture.Fill(MMAL_BUFFER_HEADER_FLAG_CONFIG, 7, 16);
+    EXPECT(fixture.queue.Deliver(config));
+    MMAL_BUFFER_HEADER_T *first =
+        fixture.Fill(MMAL_BUFFER_HEADER_FLAG_KEYFRAME, 5);
+    EXPECT(fixture.queue.Deliver(first));
+    MMAL_BUFFER_HEADER_T *last = fixture.Fill(
+        MMAL_BUFFER_HEADER_FLAG_KEYFRAME | MMAL_BUFFER_HEADER_FLAG_FRAME_END,
+        5);
+    EXPECT(fixture.queue.Deliver(last));
+    // copied, so the headers are back after the encoder callback
+    EXPECT(fixture.pool.queue_length() == kPoolHeaders);
+    EXPECT(pool_callbacks == 3);
+
+    rtc::scoped_refptr<webrtc::FrameBuffer> frame =
+        subscriber->ReadFront(false);
+    EXPECT(frame != nullptr);
+    if (frame == nullptr) return;
+    EXPECT(frame->length() == 16 + 2 * kFrameSize);
+    EXPECT(frame->isKeyFrame());
+    for (MMAL_BUFFER_HEADER_T *header : {config, first, last}) {
+        EXPECT(frame->data() < header->data ||
+               frame->data() >= header->data + kPayloadSize);
+    }
+}
+
+void CheckSlowSubscriber() {
+    Fixture fixture;
+    std::unique_ptr<webrtc::FrameSubscriber> subscriber =
+        fixture.queue.Subscribe("slow");
+    const size_t kDropThreshold = 3;
+
+    fixture.queue.SetDropThreshold(kDropThreshold);
+    EXPECT(fixture.queue.Deliver(fixture.FillFrame(true)));
+    for (int count = 0; count < kPoolHeaders - 1; count++) {
+        MMAL_BUFFER_HEADER_T *header = fixture.FillFrame();
+        EXPECT(header != nullptr);
+        if (header) EXPECT(fixture.queue.Deliver(header));
+    }
+    // only the frames in the ring hold the headers
+    EXPECT(fixture.pool.queue_length() == kPoolHeaders - kDropThreshold);
+    EXPECT(subscriber->chains_dropped() == 1);
+
+    // the queued frames of the dropped chain are dropped by the consumer
+    EXPECT(subscriber->ReadFront(false) == nullptr);
+    EXPECT(fixture.pool.queue_length() == kPoolHeaders);
+}
+
+void CheckFlushAndUnsubscribe() {
+    Fixture fixture;
+    std::unique_ptr<webrtc::FrameSubscriber> subscriber =
+        fixture.queue.Subscribe("flushed");
+
+    EXPECT(fixture.queue.Deliver(fixture.FillFrame(true)));
+    EXPECT(fixture.queue.Deliver(fixture.FillFrame()));
+    EXPECT(fixture.pool.queue_length() == kPoolHeaders - 2);
+    // Init for the new session flushes the rings in the subscriber thread
+    fixture.queue.Reinit();
+    EXPECT(subscriber->ReadFront(false) == nullptr);
+    EXPECT(fixture.pool.queue_length() == kPoolHeaders);
+
+    EXPECT(fixture.queue.Deliver(fixture.FillFrame(true)));
+    EXPECT(fixture.queue.Deliver(fixture.FillFrame()));
+    EXPECT(fixture.pool.queue_length() == kPoolHeaders - 2);
+    subscriber.reset();
+    EXPECT(fixture.pool.queue_length() == kPoolHeaders);
+    EXPECT(pool_callbacks == 4);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    CheckZeroCopyFrame();
+    CheckSharedBySubscribers();
+    CheckNoSubscriber();
+    CheckCoalescedFrame();
+    CheckSlowSubscriber();
+    CheckFlushAndUnsubscribe();
+    return check::Finish("frame_queue_check");
+}
@@ -0,0 +1,186 @@
+/*
+Copyright (c) 2021, rpi-webrtc-streamer Lyu,KeunChang
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Check of the MMAL encoder pool retirement with the fake MMAL pool. The
+// frames passed to the consumers without copying hold the buffer headers of
+// the encoder pool, so MMALPoolReaper must not destroy the pool until all of
+// the headers are back and the port is disabled. The following are verified:
+//
+//  - the pool is destroyed at once when all of the headers are back
+//  - the pool with the held headers is retired, and the component is kept
+//  - the released headers stay in the retired pool queue instead of going to
+//    the pool callback of the encoder wrapper
+//  - the retired pool is destroyed after the last header is back, and after
+//    the port is disabled when it is enabled again with the new pool
+//
+// The check is linked without the MMAL libraries, with the fake MMAL pool of
+// fake_mmal.cc.
+//
+// Usage: mmal_pool_check
+//
+// Build with 'make mmal_pool_check' in src directory.
+
+#include <stdio.h>
+
+#include <vector>
+
+#include "check/check_util.h"
+#include "check/fake_mmal.h"
+#include "mmal_pool_reaper.h"
+
+namespace {
+
+const int kPoolHeaders = 8;
+
+// Pool callback of the encoder wrapper, which sends the header to the port
+int wrapper_callbacks = 0;
+MMAL_BOOL_T WrapperReleaseCallback(MMAL_POOL_T *pool,
+                                   MMAL_BUFFER_HEADER_T *buffer,
+                                   void *userdata) {
+    wrapper_callbacks++;
+    return MMAL_FALSE;
+}
+
+struct Fixture {
+    Fixture() : pool(kPoolHeaders) {
+        mmal_pool_callback_set(pool.pool(), WrapperReleaseCallback, nullptr);
+        component = MMAL_COMPONENT_T();
+        port = MMAL_PORT_T();
+        port.name = const_cast<char *>("vc.ril.video_encode:out:0(H264)");
+        port.is_enabled = MMAL_FALSE;
+        wrapper_callbacks = 0;
+    }
+
+    // The consumers hold the headers of the frames
+    void Hold(int num) {
+        for (int count = 0; count < num; count++) held.push_back(pool.Get());
+    }
+    // The consumer releases the last reference of a held header
+    void ReleaseHeader() {
+        mmal_buffer_header_release(held.back());
+        held.pop_back();
+    }
+
+    check::FakeMmalPool pool;
+    MMAL_COMPONENT_T component;
+    MMAL_PORT_T port;
+    std::vector<MMAL_BUFFER_HEADER_T *> held;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Scenarios
+//
+////////////////////////////////////////////////////////////////////////////////
+void CheckDestroyAtOnce() {
+    Fixture fixture;
+    webrtc::MMALPoolReaper reaper;
+
+    EXPECT(reaper.Release(&fixture.component, &fixture.port,
+                          fixture.pool.pool()) == false);
+    EXPECT(fixture.pool.destroyed());
+    EXPECT(reaper.retired_count() == 0);
+    EXPECT(check::ComponentRefs(&fixture.component) == 0);
+}
+
+void CheckRetireHeldPool() {
+    Fixture fixture;
+    webrtc::MMALPoolReaper reaper;
+
+    fixture.Hold(3);
+    EXPECT(reaper.Release(&fixture.component, &fixture.port,
+                          fixture.pool.pool()) == true);
+    EXPECT(fixture.pool.destroyed() == false);
+    EXPECT(reaper.retired_count() == 1);
+    EXPECT(check::ComponentRefs(&fixture.component) == 1);
+
+    // The released headers stay in the retired pool
+    fixture.ReleaseHeader();
+    fixture.ReleaseHeader();
+    EXPECT(wrapper_callbacks == 0);
+    EXPECT(fixture.pool.queue_length() == kPoolHeaders - 1);
+    EXPECT(reaper.Reap() == 1);
+    EXPECT(fixture.pool.destroyed() == false);
+
+    fixture.ReleaseHeader();
+    EXPECT(reaper.Reap() == 0);
+    EXPECT(fixture.pool.destroyed());
+    EXPECT(fixture.pool.destroyed_enabled() == false);
+    EXPECT(reaper.retired_count() == 0);
+    EXPECT(check::ComponentRefs(&fixture.component) == 0);
+}
+
+void CheckRetireUntilPortDisabled() {
+    Fixture fixture;
+    webrtc::MMALPoolReaper reaper;
+
+    // The pool replaced by the resize, the port is enabled again with the
+    // new pool.
+    fixture.Hold(2);
+    EXPECT(reaper.Release(&fixture.component, &fixture.port,
+                          fixture.pool.pool()) == true);
+    fixture.port.is_enabled = MMAL_TRUE;
+    fixture.ReleaseHeader();
+    fixture.ReleaseHeader();
+    EXPECT(reaper.Reap() == 0);
+    EXPECT(fixture.pool.destroyed() == false);
+    EXPECT(reaper.retired_count() == 1);
+
+    fixture.port.is_enabled = MMAL_FALSE;
+    EXPECT(reaper.Reap() == 0);
+    EXPECT(fixture.pool.destroyed());
+    EXPECT(fixture.pool.destroyed_enabled() == false);
+    EXPECT(reaper.retired_count() == 0);
+    EXPECT(check::ComponentRefs(&fixture.component) == 0);
+}
+
+void CheckRetireEnabledPort() {
+    Fixture fixture;
+    webrtc::MMALPoolReaper reaper;
+
+    // mmal_port_pool_destroy would disable the enabled port
+    fixture.port.is_enabled = MMAL_TRUE;
+    EXPECT(reaper.Release(&fixture.component, &fixture.port,
+                          fixture.pool.pool()) == true);
+    EXPECT(fixture.pool.destroyed() == false);
+    fixture.port.is_enabled = MMAL_FALSE;
+    EXPECT(reaper.Reap() == 0);
+    EXPECT(fixture.pool.destroyed());
+    EXPECT(check::ComponentRefs(&fixture.component) == 0);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    CheckDestroyAtOnce();
+    CheckRetireHeldPool();
+    CheckRetireUntilPortDisabled();
+    CheckRetireEnabledPort();
+    return check::Finish("mmal_pool_check");
+}
@@ -0,0 +1,177 @@
+/*
+Copyright (c) 2021, rpi-webrtc-streamer Lyu,KeunChang
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Labelled replay of the adaptive background model of RaspiMotionVector. The
+// synthetic inline motion vectors are made in segments with the ground truth
+// of each frame, and analysed with the background model enabled. A frame
+// triggers when kTriggerPoints or more moving points pass the background
+// model. For each segment, the misses(motion frames which do not trigger) or
+// the false triggers(static frames which trigger) are counted and checked
+// against the limit of the segment:
+//
+//  - leaves swaying in a corner with the magnitude up to 4, static
+//  - a box moving back and forth in place with the magnitude 3, motion. The
+//    repeated motion must not be absorbed into the background.
+//  - a box crossing the view, motion
+//
+// The SAD of all points has the encoder noise. The first segment lets the
+// background settle and is not counted.
+//
+// Usage: motion_background_check [seed]
+//
+// Build with 'make motion_background_check' in src directory.
+
+#include <glog/logging.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <random>
+#include <vector>
+
+#include "check/check_util.h"
+#include "raspi_motionvector.h"
+
+namespace {
+
+// IMV size of 640x480
+const int kWidth = 640;
+const int kHeight = 480;
+const int kFramerate = 30;
+const int kTriggerPoints = 4;
+
+const int kSadBase = 300;
+const int kSadNoise = 40;
+// leaves region in cells
+const int kLeavesX = 28, kLeavesY = 4, kLeavesSize = 8;
+const int kLeavesMagnitude = 4;
+// box size in cells
+const int kBoxSize = 4;
+const int kBoxInPlaceX = 8, kBoxInPlaceY = 10;
+const int kBoxInPlaceMagnitude = 3;
+const int kBoxCrossingY = 20;
+const int kBoxCrossingMagnitude = 6;
+
+enum class Scene { kStatic, kBoxInPlace, kBoxCrossing };
+
+struct Segment {
+    const char *name;
+    Scene scene;
+    int frames;
+    bool counted;
+    // limit of the misses or the false triggers in percent of the frames
+    int limit_percent;
+};
+
+const Segment kSegments[] = {
+    {"settle", Scene::kStatic, 60, false, 100},
+    {"leaves", Scene::kStatic, 300, true, 1},
+    {"box in place", Scene::kBoxInPlace, 100, true, 5},
+    {"leaves after box", Scene::kStatic, 150, true, 1},
+    {"box crossing", Scene::kBoxCrossing, 60, true, 5},
+    {"leaves after crossing", Scene::kStatic, 150, true, 1},
+    {"box in place again", Scene::kBoxInPlace, 100, true, 5},
+};
+
+void SetBox(int mvx, int mvy, int box_x, int box_y, int mx,
+            std::vector<MotionVector> *imv) {
+    for (int y = box_y; y < box_y + kBoxSize && y < mvy; y++)
+        for (int x = box_x; x < box_x + kBoxSize && x < mvx; x++) {
+            (*imv)[y * mvx + x].mx_ = mx;
+            (*imv)[y * mvx + x].my_ = 0;
+        }
+}
+
+void MakeFrame(std::mt19937 *random, Scene scene, int frame, int mvx,
+               int mvy, std::vector<MotionVector> *imv) {
+    std::uniform_int_distribution<int> sad_dist(-kSadNoise, kSadNoise);
+    std::uniform_int_distribution<int> leaves_dist(0, kLeavesMagnitude);
+    std::uniform_int_distribution<int> sign_dist(0, 1);
+
+    for (MotionVector &mv : *imv) {
+        mv.mx_ = 0;
+        mv.my_ = 0;
+        mv.sad = kSadBase + sad_dist(*random);
+    }
+    for (int y = kLeavesY; y < kLeavesY + kLeavesSize; y++)
+        for (int x = kLeavesX; x < kLeavesX + kLeavesSize; x++) {
+            MotionVector &mv = (*imv)[y * mvx + x];
+            int magnitude = leaves_dist(*random);
+            int mx = magnitude / 2, my = magnitude - mx;
+            mv.mx_ = sign_dist(*random) ? mx : -mx;
+            mv.my_ = sign_dist(*random) ? my : -my;
+        }
+
+    if (scene == Scene::kBoxInPlace) {
+        SetBox(mvx, mvy, kBoxInPlaceX, kBoxInPlaceY,
+               frame % 2 ? kBoxInPlaceMagnitude : -kBoxInPlaceMagnitude,
+               imv);
+    } else if (scene == Scene::kBoxCrossing) {
+        // one cell every two frames from the left edge
+        SetBox(mvx, mvy, frame / 2, kBoxCrossingY, kBoxCrossingMagnitude,
+               imv);
+    }
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    unsigned int seed = argc > 1 ? strtoul(argv[1], nullptr, 0) : 1;
+    std::mt19937 random(seed);
+
+    google::InitGoogleLogging(argv[0]);
+    RaspiMotionVector analyser(kWidth, kHeight, kFramerate, false, 0.5, 15);
+    analyser.SetBackgroundEnable(true);
+    int mvx = kWidth / 16 + 1, mvy = kHeight / 16;
+    std::vector<MotionVector> imv(mvx * mvy);
+    EXPECT(imv.size() * sizeof(MotionVector) == analyser.GetFrameSize());
+
+    printf("%-24s %8s %10s %8s\n", "segment", "frames", "triggered",
+           "errors");
+    for (const Segment &segment : kSegments) {
+        bool motion = segment.scene != Scene::kStatic;
+        int triggered = 0;
+        for (int frame = 0; frame < segment.frames; frame++) {
+            MakeFrame(&random, segment.scene, frame, mvx, mvy, &imv);
+            analyser.Analyse(reinterpret_cast<uint8_t *>(imv.data()),
+                             imv.size() * sizeof(MotionVector));
+            if (analyser.GetMovingPoints() >= kTriggerPoints) triggered++;
+        }
+        // misses of the motion segment, false triggers of the static one
+        int errors = motion ? segment.frames - triggered : triggered;
+        printf("%-24s %8d %10d %8d%s\n", segment.name, segment.frames,
+               triggered, errors, segment.counted ? "" : " (not counted)");
+        if (segment.counted == false) continue;
+        EXPECT_MSG(errors * 100 <= segment.limit_percent * segment.frames,
+                   "%s: %d %s in %d frames, the limit is %d%%",
+                   segment.name, errors,
+                   motion ? "misses" : "false triggers", segment.frames,
+                   segment.limit_percent);
+    }
+    return check::Finish("motion_background_check");
+}
@@ -0,0 +1,274 @@
+/*
+Copyright (c) 2021, rpi-webrtc-streamer Lyu,KeunChang
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Check of the run based blob labelling of RaspiMotionBlob against the flood
+// fill labeller it replaced, which is kept in baseline_motionblob.cc as the
+// reference. Both labellers are fed with the same motion masks and the
+// following are compared in each frame:
+//
+//  - the blob image
+//  - the active blob count and the max update count
+//
+// The masks are moving rectangles, a blinking bar and random noise of
+// increasing density at the IMV sizes of the usual resolutions and a tiny
+// one, or the motion of the .imv file saved with the motion_save_imv_file
+// option, analysed by RaspiMotionVector. The labelling time of both
+// labellers over the same masks is reported per frame.
+//
+// Usage: motion_blob_check [-n frames] [-s seed] [-r rounds]
+//                          [width height file.imv]
+//
+// Build with 'make motion_blob_check' in src directory.
+
+#include <getopt.h>
+#include <glog/logging.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "check/baseline_motionblob.h"
+#include "check/check_util.h"
+#include "raspi_motionblob.h"
+#include "raspi_motionvector.h"
+
+namespace {
+
+const int kDefaultFrames = 400;
+const int kDefaultRounds = 5;
+const float kBlobCancelThreshold = 0.5;
+const int kBlobTrackingThreshold = 15;
+const int kImvSizes[][2] = {{41, 30}, {81, 60}, {103, 77}, {5, 4}};
+// size of a motion vector in pixels, and the framerate of the IMV file
+const int kMacroBlockSize = 16;
+const int kFramerate = 30;
+
+typedef std::vector<std::vector<uint8_t>> MotionMasks;
+
+// results of the timed labelling, so they are not optimized out
+volatile int labelling_sink = 0;
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Synthetic motion masks
+//
+///////////////////////////////////////////////////////////////////////////////
+void MakeMotionMask(std::mt19937 *random, int mvx, int mvy, int frame,
+                    int *box_x, int box_y, std::vector<uint8_t> *motion) {
+    std::uniform_int_distribution<int> percent_dist(0, 99);
+    std::uniform_int_distribution<int> value_dist(1, 255);
+    int noise_percent = (frame / 50) % 4 * 8;
+
+    std::fill(motion->begin(), motion->end(), 0);
+    for (uint8_t &value : *motion)
+        if (percent_dist(*random) < noise_percent) value = value_dist(*random);
+
+    // moving rectangle
+    *box_x = (*box_x + 1) % mvx;
+    for (int y = box_y; y < std::min(mvy, box_y + 8); y++)
+        for (int x = *box_x; x < std::min(mvx, *box_x + 6); x++)
+            (*motion)[y * mvx + x] = 200;
+
+    // blinking bar
+    if (frame % 7)
+        for (int y = 0; y < mvy / 3; y++)
+            for (int x = mvx / 2; x < std::min(mvx, mvx / 2 + 3); x++)
+                (*motion)[y * mvx + x] = 100;
+}
+
+// Motion of the recorded motion vectors, the same mask with the one passed
+// to the blob labelling in RaspiMotionVector::Analyse.
+bool LoadImvMasks(int width, int height, const char *imv_file, int *mvx,
+                  int *mvy, MotionMasks *masks) {
+    std::ifstream imv(imv_file, std::ios::binary);
+    if (!imv.is_open()) {
+        fprintf(stderr, "Failed to open %s\n", imv_file);
+        return false;
+    }
+    RaspiMotionVector analyser(width, height, kFramerate, false,
+                               kBlobCancelThreshold, kBlobTrackingThreshold);
+    *mvx = width / kMacroBlockSize + 1;
+    *mvy = height / kMacroBlockSize;
+    if (*mvx * *mvy != analyser.GetTotalPoints()) return false;
+
+    std::vector<uint8_t> frame(analyser.GetFrameSize());
+    std::vector<uint8_t> motion(*mvx * *mvy);
+    while (imv.read(reinterpret_cast<char *>(frame.data()), frame.size())) {
+        analyser.Analyse(frame.data(), frame.size());
+        analyser.GetMotionImage(motion.data(), motion.size());
+        masks->push_back(motion);
+    }
+    return !masks->empty();
+}
+
+void CompareLabellers(const std::string &name, int mvx, int mvy,
+                      const MotionMasks &masks) {
+    RaspiMotionBlob blob(mvx, mvy, kBlobCancelThreshold,
+                         kBlobTrackingThreshold);
+    baseline::RaspiMotionBlob reference(mvx, mvy, kBlobCancelThreshold,
+                                        kBlobTrackingThreshold);
+    std::vector<uint8_t> motion(mvx * mvy), image(mvx * mvy),
+        reference_image(mvx * mvy);
+
+    for (size_t frame = 0; frame < masks.size(); frame++) {
+        motion = masks[frame];
+        blob.UpdateBlob(motion.data(), motion.size());
+        motion = masks[frame];
+        reference.UpdateBlob(motion.data(), motion.size());
+        blob.GetBlobImage(image.data(), image.size());
+        reference.GetBlobImage(reference_image.data(),
+                               reference_image.size());
+
+        if (blob.GetActiveBlobCount() != reference.GetActiveBlobCount() ||
+            blob.GetActiveBlobUpdateCount() !=
+                reference.GetActiveBlobUpdateCount() ||
+            image != reference_image) {
+            check::Fail(__FILE__, __LINE__,
+                        "%s frame %zu: active %d/%d, update count %d/%d, "
+                        "image %s",
+                        name.c_str(), frame, blob.GetActiveBlobCount(),
+                        reference.GetActiveBlobCount(),
+                        blob.GetActiveBlobUpdateCount(),
+                        reference.GetActiveBlobUpdateCount(),
+                        image == reference_image ? "matched" : "mismatched");
+            return;
+        }
+    }
+}
+
+// Microseconds per frame of the labelling and the results used by
+// RaspiMotionVector, the best of the rounds.
+template <typename Labeller>
+double TimeLabeller(int mvx, int mvy, const MotionMasks &masks, int rounds) {
+    std::vector<uint8_t> motion(mvx * mvy), image(mvx * mvy);
+    double best_us = 0;
+    for (int round = 0; round < rounds; round++) {
+        Labeller labeller(mvx, mvy, kBlobCancelThreshold,
+                          kBlobTrackingThreshold);
+        std::chrono::steady_clock::duration elapsed{};
+        for (const std::vector<uint8_t> &mask : masks) {
+            motion = mask;
+            auto start = std::chrono::steady_clock::now();
+            labeller.UpdateBlob(motion.data(), motion.size());
+            labeller.GetBlobImage(image.data(), image.size());
+            labelling_sink = labeller.GetActiveBlobCount() +
+                             labeller.GetActiveBlobUpdateCount() + image[0];
+            elapsed += std::chrono::steady_clock::now() - start;
+        }
+        double us =
+            std::chrono::duration<double, std::micro>(elapsed).count() /
+            masks.size();
+        if (round == 0 || us < best_us) best_us = us;
+    }
+    return best_us;
+}
+
+void TimeLabellers(const std::string &name, int mvx, int mvy,
+                   const MotionMasks &masks, int rounds) {
+    double baseline_us =
+        TimeLabeller<baseline::RaspiMotionBlob>(mvx, mvy, masks, rounds);
+    double runs_us = TimeLabeller<RaspiMotionBlob>(mvx, mvy, masks, rounds);
+    printf("%s: %zu frames, flood fill %.2f us, runs %.2f us per frame, "
+           "%.1fx\n",
+           name.c_str(), masks.size(), baseline_us, runs_us,
+           runs_us > 0 ? baseline_us / runs_us : 0.0);
+}
+
+void Usage(const char *program) {
+    fprintf(stderr,
+            "Usage: %s [-n frames] [-s seed] [-r rounds] "
+            "[width height file.imv]\n",
+            program);
+    exit(1);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    int frames = kDefaultFrames;
+    unsigned int seed = 1;
+    int rounds = kDefaultRounds;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:s:r:")) != -1) {
+        switch (opt) {
+            case 'n':
+                frames = atoi(optarg);
+                break;
+            case 's':
+                seed = strtoul(optarg, nullptr, 0);
+                break;
+            case 'r':
+                rounds = atoi(optarg);
+                break;
+            default:
+                Usage(argv[0]);
+        }
+    }
+    if ((argc - optind != 0 && argc - optind != 3) || frames <= 0 ||
+        rounds <= 0)
+        Usage(argv[0]);
+
+    google::InitGoogleLogging(argv[0]);
+    if (argc - optind == 3) {
+        int mvx, mvy;
+        MotionMasks masks;
+        const char *imv_file = argv[optind + 2];
+        if (LoadImvMasks(atoi(argv[optind]), atoi(argv[optind + 1]),
+                         imv_file, &mvx, &mvy, &masks) == false) {
+            fprintf(stderr, "No motion vector frame in %s\n", imv_file);
+            return 1;
+        }
+        CompareLabellers(imv_file, mvx, mvy, masks);
+        TimeLabellers(imv_file, mvx, mvy, masks, rounds);
+        return check::Finish("motion_blob_check");
+    }
+
+    std::mt19937 random(seed);
+    for (const int *imv_size : kImvSizes) {
+        int mvx = imv_size[0], mvy = imv_size[1];
+        MotionMasks masks(frames, std::vector<uint8_t>(mvx * mvy));
+        std::uniform_int_distribution<int> x_dist(0, mvx - 1),
+            y_dist(0, mvy - 1);
+        int box_x = x_dist(random), box_y = y_dist(random);
+        for (int frame = 0; frame < frames; frame++)
+            MakeMotionMask(&random, mvx, mvy, frame, &box_x, box_y,
+                           &masks[frame]);
+
+        std::string name = std::to_string(mvx) + "x" + std::to_string(mvy);
+        CompareLabellers(name, mvx, mvy, masks);
+        TimeLabellers(name, mvx, mvy, masks, rounds);
+    }
+    return check::Finish("motion_blob_check");
+}
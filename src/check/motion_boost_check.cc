@@ -0,0 +1,207 @@
+/*
+Copyright (c) 2021, rpi-webrtc-streamer Lyu,KeunChang
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+// Check of the motion boost policy with the simulated clock and the scripted
+// motion events. The following are verified on the 50 ms grid:
+//
+//  - the first trigger starts the boost with a key frame, and the triggers
+//    of the same motion do not request another key frame
+//  - the boosted bitrate is held for the boost period while the motion is
+//    active, and decays back to the target bitrate in 5 steps over the
+//    decay period
+//  - the clear starts the decay early, and the trigger in the decay lifts
+//    the bitrate again without a key frame
+//  - the boosted bitrate is capped by the max bitrate and by the
+//    bandwidth_allocation of the rate control, but not below the target
+//
+// Usage: motion_boost_check
+//
+// Build with 'make motion_boost_check' in src directory.
+
+#include <stdio.h>
+
+#include "api/units/data_rate.h"
+#include "check/check_util.h"
+#include "raspi_motionboost.h"
+#include "system_wrappers/include/clock.h"
+
+namespace {
+
+const int kBoostPercent = 50;
+const int kBoostPeriodMs = 2000;
+const int kDecayPeriodMs = 1000;
+const int kMaxBitrate = 4000;
+const int kDecayStepMs = kDecayPeriodMs / 5;
+const int kGridMs = 50;
+
+struct Fixture {
+    Fixture()
+        : clock(1000000000),
+          boost(&clock, kBoostPercent, kBoostPeriodMs, kDecayPeriodMs,
+                kMaxBitrate),
+          start_ms(clock.TimeInMilliseconds()) {}
+
+    // Same with RaspiEncoderImpl::GetBoostedBitrate, the bandwidth allocation
+    // of the rate control parameters bounds the boosted bitrate.
+    void SetRates(int target_bitrate, webrtc::DataRate bandwidth_allocation) {
+        boost.SetTargetBitrate(target_bitrate,
+                               static_cast<int>(bandwidth_allocation.kbps()));
+    }
+    // Moves the clock to the time from the start of the fixture
+    void At(int64_t time_ms) {
+        clock.AdvanceTimeMilliseconds(start_ms + time_ms -
+                                      clock.TimeInMilliseconds());
+    }
+    // Expects the bitrate of each grid point in [begin_ms, end_ms)
+    void ExpectBitrate(int64_t begin_ms, int64_t end_ms, int bitrate,
+                       int line) {
+        for (int64_t time_ms = begin_ms; time_ms < end_ms;
+             time_ms += kGridMs) {
+            At(time_ms);
+            int result = boost.GetBitrate();
+            if (result != bitrate)
+                check::Fail(__FILE__, line, "at %lld ms: %d kbps != %d kbps",
+                            static_cast<long long>(time_ms), result, bitrate);
+        }
+    }
+    // Expects the decay steps from the boosted bitrate to the target bitrate
+    // which starts at the time
+    void ExpectDecay(int64_t decay_start_ms, int boosted, int target,
+                     int line) {
+        for (int step = 1; step <= 5; step++) {
+            int64_t begin_ms = decay_start_ms + (step - 1) * kDecayStepMs;
+            ExpectBitrate(begin_ms, begin_ms + kDecayStepMs,
+                          boosted - (boosted - target) * step / 5, line);
+        }
+    }
+
+    webrtc::SimulatedClock clock;
+    RaspiMotionBoost boost;
+    const int64_t start_ms;
+};
+
+void CheckBoostAndDecay() {
+    Fixture fixture;
+    RaspiMotionBoost &boost = fixture.boost;
+    fixture.SetRates(1000, webrtc::DataRate::Zero());
+    fixture.ExpectBitrate(0, 500, 1000, __LINE__);
+    EXPECT(boost.IsBoosting() == false);
+
+    // boost with a key frame, the triggers of the active blob changes do not
+    // request another one
+    fixture.At(500);
+    EXPECT(boost.OnMotionTriggered());
+    EXPECT(boost.boost_count() == 1);
+    fixture.ExpectBitrate(500, 800, 1500, __LINE__);
+    fixture.At(800);
+    EXPECT(boost.OnMotionTriggered() == false);
+    // held for the boost period while the motion is active
+    fixture.ExpectBitrate(800, 500 + kBoostPeriodMs, 1500, __LINE__);
+    EXPECT(boost.IsBoosting());
+    fixture.ExpectDecay(500 + kBoostPeriodMs, 1500, 1000, __LINE__);
+    int64_t end_ms = 500 + kBoostPeriodMs + kDecayPeriodMs;
+    fixture.ExpectBitrate(end_ms, end_ms + 500, 1000, __LINE__);
+    EXPECT(boost.IsBoosting() == false);
+
+    // the next motion starts a new boost after the clear
+    EXPECT(boost.OnMotionTriggered() == false);
+    fixture.At(end_ms + 500);
+    boost.OnMotionCleared();
+    EXPECT(boost.OnMotionTriggered());
+    EXPECT(boost.boost_count() == 2);
+    fixture.ExpectBitrate(end_ms + 500, end_ms + 1000, 1500, __LINE__);
+}
+
+void CheckClearAndRetrigger() {
+    Fixture fixture;
+    RaspiMotionBoost &boost = fixture.boost;
+    fixture.SetRates(1000, webrtc::DataRate::Zero());
+
+    // the clear starts the decay before the end of the boost period
+    fixture.At(0);
+    EXPECT(boost.OnMotionTriggered());
+    fixture.ExpectBitrate(0, 600, 1500, __LINE__);
+    fixture.At(600);
+    boost.OnMotionCleared();
+    fixture.ExpectDecay(600, 1500, 1000, __LINE__);
+    fixture.ExpectBitrate(600 + kDecayPeriodMs, 2000, 1000, __LINE__);
+    EXPECT(boost.IsBoosting() == false);
+
+    // the trigger in the decay holds the boost again without a key frame
+    fixture.At(3000);
+    EXPECT(boost.OnMotionTriggered());
+    fixture.At(3300);
+    boost.OnMotionCleared();
+    int64_t hold_ms = 3300 + kDecayStepMs * 2;
+    fixture.ExpectBitrate(3300, 3300 + kDecayStepMs, 1400, __LINE__);
+    fixture.ExpectBitrate(3300 + kDecayStepMs, hold_ms, 1300, __LINE__);
+    fixture.At(hold_ms);
+    EXPECT(boost.OnMotionTriggered() == false);
+    EXPECT(boost.boost_count() == 2);
+    fixture.ExpectBitrate(hold_ms, hold_ms + kBoostPeriodMs, 1500, __LINE__);
+    fixture.ExpectDecay(hold_ms + kBoostPeriodMs, 1500, 1000, __LINE__);
+}
+
+void CheckCap() {
+    Fixture fixture;
+    RaspiMotionBoost &boost = fixture.boost;
+
+    // 3000 * 150% is capped by the max bitrate
+    fixture.SetRates(3000, webrtc::DataRate::Zero());
+    fixture.At(0);
+    EXPECT(boost.OnMotionTriggered());
+    fixture.ExpectBitrate(0, 500, kMaxBitrate, __LINE__);
+
+    // and by the bandwidth allocation below the max bitrate
+    fixture.SetRates(3000, webrtc::DataRate::KilobitsPerSec(3600));
+    fixture.ExpectBitrate(500, 1000, 3600, __LINE__);
+    // but not below the target bitrate
+    fixture.SetRates(3000, webrtc::DataRate::KilobitsPerSec(2500));
+    fixture.ExpectBitrate(1000, 1500, 3000, __LINE__);
+    // the allocation above the boosted bitrate does not lift it
+    fixture.SetRates(2000, webrtc::DataRate::KilobitsPerSec(5000));
+    fixture.ExpectBitrate(1500, kBoostPeriodMs, 3000, __LINE__);
+
+    // the decay follows the capped bitrate
+    fixture.SetRates(3000, webrtc::DataRate::KilobitsPerSec(3600));
+    fixture.ExpectDecay(kBoostPeriodMs, 3600, 3000, __LINE__);
+    fixture.ExpectBitrate(kBoostPeriodMs + kDecayPeriodMs,
+                          kBoostPeriodMs + kDecayPeriodMs + 500, 3000,
+                          __LINE__);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    CheckBoostAndDecay();
+    CheckClearAndRetrigger();
+    CheckCap();
+    return check::Finish("motion_boost_check");
+}
@@ -0,0 +1,184 @@
+/*
+Copyright (c) 2021, rpi-webrtc-streamer Lyu,KeunChang
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Check of the vectorized motion vector analysis kernels. The NEON kernels of
+// RaspiMotionVector are compared bit for bit with the scalar reference
+// kernels on random inline motion vectors:
+//
+//  - UpdateCandidate: the candidate bit history, the candidate min/max and
+//    the number of moving points
+//  - NormalizeMotion: the motion values and the number of active points,
+//    with the scale made from the min/max of UpdateCandidate
+//
+// The candidates are carried over several frames like Analyse does, and the
+// point counts include the tails which are not a multiple of the NEON block.
+// On the hosts without NEON, motion_kernel_check_neon builds the NEON kernels
+// with the lane by lane emulation of check/neon/arm_neon.h, so the
+// de-interleaving load, the popcount and the reciprocal scaling of the NEON
+// path are exercised off the device too. The plain build on those hosts
+// compares the scalar kernels with themselves and says so.
+//
+// Usage: motion_kernel_check [iterations] [seed]
+//
+// Build with 'make motion_kernel_check' or 'make motion_kernel_check_neon'
+// in src directory. On 32 bits Raspbian, NEON has to be enabled with
+// HOST_CXX="g++ -mfpu=neon".
+
+#include <glog/logging.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <random>
+#include <vector>
+
+#include "check/check_util.h"
+#include "raspi_motionvector.h"
+
+namespace {
+
+const int kDefaultIterations = 1000;
+const int kFramesPerIteration = 8;
+// points of the resolutions used with the motion detection, 640x480,
+// 1024x768 and 1280x720 with the extra column of the inline motion vectors
+const size_t kResolutionPoints[] = {41 * 30, 65 * 48, 81 * 45};
+const size_t kMaxRandomPoints = 4096;
+
+// Random motion vectors in the patterns the encoder gives: mostly still,
+// sparse motion, dense motion and the extreme vectors.
+void FillMotionVectors(std::mt19937 *random, std::vector<MotionVector> *imv) {
+    std::uniform_int_distribution<int> pattern_dist(0, 3);
+    std::uniform_int_distribution<int> vector_dist(-128, 127);
+    std::uniform_int_distribution<int> percent_dist(0, 99);
+    std::uniform_int_distribution<int> sad_dist(0, 65535);
+    int pattern = pattern_dist(*random);
+
+    for (MotionVector &mv : *imv) {
+        int moving_percent = pattern == 0 ? 0 : pattern == 1 ? 10 : 80;
+        mv.mx_ = 0;
+        mv.my_ = 0;
+        if (pattern == 3) {
+            mv.mx_ = percent_dist(*random) < 50 ? -128 : 127;
+            mv.my_ = percent_dist(*random) < 50 ? -128 : 127;
+        } else if (percent_dist(*random) < moving_percent) {
+            // the half of the vectors are around the magnitude threshold
+            int range = percent_dist(*random) < 50 ? 2 : 128;
+            mv.mx_ = vector_dist(*random) % range;
+            mv.my_ = vector_dist(*random) % range;
+        }
+        mv.sad = sad_dist(*random);
+    }
+}
+
+// Random candidate history, including the short histories which are below
+// the bit threshold of NormalizeMotion.
+void FillCandidates(std::mt19937 *random, std::vector<uint32_t> *candidate) {
+    std::uniform_int_distribution<int> pattern_dist(0, 2);
+    int pattern = pattern_dist(*random);
+    for (uint32_t &value : *candidate) {
+        if (pattern == 0)
+            value = 0;
+        else if (pattern == 1)
+            value = (*random)() & 0x7;
+        else
+            value = (*random)();
+    }
+}
+
+void CheckPoints(std::mt19937 *random, size_t points) {
+    std::vector<MotionVector> imv(points);
+    std::vector<uint32_t> candidate(points), reference_candidate(points);
+    std::vector<uint8_t> motion(points), reference_motion(points);
+
+    FillCandidates(random, &candidate);
+    reference_candidate = candidate;
+    for (int frame = 0; frame < kFramesPerIteration; frame++) {
+        uint32_t min = UINT32_MAX, max = 0;
+        uint32_t reference_min = UINT32_MAX, reference_max = 0;
+
+        FillMotionVectors(random, &imv);
+        int moving = RaspiMotionVector::UpdateCandidate(
+            imv.data(), candidate.data(), points, &min, &max);
+        int reference_moving = RaspiMotionVector::UpdateCandidateScalar(
+            imv.data(), reference_candidate.data(), points, &reference_min,
+            &reference_max);
+        if (moving != reference_moving || min != reference_min ||
+            max != reference_max || candidate != reference_candidate) {
+            check::Fail(__FILE__, __LINE__,
+                        "UpdateCandidate mismatch, points: %zu, frame: %d, "
+                        "moving: %d/%d, min: %u/%u, max: %u/%u",
+                        points, frame, moving, reference_moving, min,
+                        reference_min, max, reference_max);
+            return;
+        }
+
+        RaspiMotionVector::MotionScale scale =
+            RaspiMotionVector::GetMotionScale(min, max);
+        int active = RaspiMotionVector::NormalizeMotion(
+            candidate.data(), motion.data(), points, scale);
+        int reference_active = RaspiMotionVector::NormalizeMotionScalar(
+            reference_candidate.data(), reference_motion.data(), points,
+            scale);
+        if (active != reference_active || motion != reference_motion) {
+            check::Fail(__FILE__, __LINE__,
+                        "NormalizeMotion mismatch, points: %zu, frame: %d, "
+                        "active: %d/%d, min: %u, max: %u",
+                        points, frame, active, reference_active, min, max);
+            return;
+        }
+    }
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    int iterations = argc > 1 ? atoi(argv[1]) : kDefaultIterations;
+    unsigned int seed = argc > 2 ? strtoul(argv[2], nullptr, 0) : 1;
+    std::mt19937 random(seed);
+    std::uniform_int_distribution<size_t> points_dist(0, kMaxRandomPoints);
+
+    google::InitGoogleLogging(argv[0]);
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+    printf("Comparing the NEON kernels with the scalar kernels, seed: %u\n",
+           seed);
+#else
+    printf("NEON is not available, comparing the scalar kernels only, "
+           "seed: %u\n",
+           seed);
+#endif
+
+    // every tail length of the NEON block
+    for (size_t points = 0; points <= 64; points++)
+        CheckPoints(&random, points);
+    for (size_t points : kResolutionPoints) CheckPoints(&random, points);
+    for (int iteration = 0; iteration < iterations; iteration++)
+        CheckPoints(&random, points_dist(random));
+
+    return check::Finish("motion_kernel_check");
+}
@@ -0,0 +1,361 @@
+/*
+Copyright (c) 2021, rpi-webrtc-streamer Lyu,KeunChang
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+// Box structure parser of the fragmented mp4 files of Mp4Muxer, shared by
+// mp4_check and mp4_muxer_check. The boxes are walked from the buffer, the
+// structure is verified as described in mp4_check.cc, and the parsed fields
+// are kept for the checks comparing them with the muxer input.
+
+#ifndef CHECK_MP4_CHECKER_H_
+#define CHECK_MP4_CHECKER_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace check {
+
+// trun flags
+const uint32_t kTrunDataOffset = 0x000001;
+const uint32_t kTrunFirstSampleFlags = 0x000004;
+const uint32_t kTrunSampleDuration = 0x000100;
+const uint32_t kTrunSampleSize = 0x000200;
+const uint32_t kTrunSampleFlags = 0x000400;
+const uint32_t kTrunSampleCompositionOffset = 0x000800;
+// sample_is_non_sync_sample of the sample flags
+const uint32_t kSampleFlagsNonSync = 0x00010000;
+
+struct Box {
+    std::string type;
+    size_t offset;  // offset of the box header in the file
+    size_t size;    // including the header
+    size_t header_size;
+    inline size_t payload() const { return offset + header_size; }
+    inline size_t end() const { return offset + size; }
+};
+
+// Fields of a moof and mdat pair
+struct Mp4Fragment {
+    uint32_t sequence_number;
+    uint64_t decode_time;
+    size_t moof_offset;
+    int32_t data_offset;  // from the moof to the first sample
+    size_t mdat_payload;  // offset of the mdat payload in the file
+    std::vector<uint32_t> sample_durations;
+    std::vector<uint32_t> sample_sizes;
+    std::vector<uint32_t> sample_flags;
+};
+
+class Mp4Checker {
+   public:
+    explicit Mp4Checker(const std::vector<uint8_t> &data, bool verbose)
+        : data_(data),
+          verbose_(verbose),
+          timescale_(0),
+          width_(0),
+          height_(0),
+          edit_duration_(0),
+          edit_media_time_(0),
+          first_decode_time_(0),
+          next_decode_time_(0) {}
+
+    bool Check() {
+        std::vector<Box> boxes;
+        if (ReadBoxes(0, data_.size(), &boxes) == false) return false;
+        if (boxes.size() < 2 || boxes[0].type != "ftyp" ||
+            boxes[1].type != "moov")
+            return Error("the file does not start with ftyp and moov");
+        if (CheckMoov(boxes[1]) == false) return false;
+        for (size_t index = 2; index < boxes.size(); index += 2) {
+            if (boxes[index].type != "moof" || index + 1 == boxes.size() ||
+                boxes[index + 1].type != "mdat")
+                return Error("moof and mdat are not paired at " +
+                             std::to_string(boxes[index].offset));
+            if (CheckFragment(boxes[index], boxes[index + 1]) == false)
+                return false;
+        }
+        return true;
+    }
+
+    inline uint32_t timescale() const { return timescale_; }
+    inline uint32_t width() const { return width_; }
+    inline uint32_t height() const { return height_; }
+    // payload of the avcC box
+    inline const std::vector<uint8_t> &avcc() const { return avcc_; }
+    // the first entry of elst
+    inline uint64_t edit_duration() const { return edit_duration_; }
+    inline uint64_t edit_media_time() const { return edit_media_time_; }
+    inline const std::vector<Mp4Fragment> &fragments() const {
+        return fragments_;
+    }
+    inline size_t samples() const {
+        size_t samples = 0;
+        for (const Mp4Fragment &fragment : fragments_)
+            samples += fragment.sample_sizes.size();
+        return samples;
+    }
+    // media time of the fragments in the file
+    inline uint64_t duration() const {
+        return next_decode_time_ - first_decode_time_;
+    }
+
+   private:
+    bool Error(const std::string &message) {
+        fprintf(stderr, "error: %s\n", message.c_str());
+        return false;
+    }
+
+    uint32_t U32(size_t offset) const {
+        return (data_[offset] << 24) | (data_[offset + 1] << 16) |
+               (data_[offset + 2] << 8) | data_[offset + 3];
+    }
+    uint64_t U64(size_t offset) const {
+        return (static_cast<uint64_t>(U32(offset)) << 32) | U32(offset + 4);
+    }
+
+    // Reads the boxes in [begin, end), which should fill the range exactly
+    bool ReadBoxes(size_t begin, size_t end, std::vector<Box> *boxes) {
+        size_t offset = begin;
+        while (offset < end) {
+            if (end - offset < 8)
+                return Error("truncated box header at " +
+                             std::to_string(offset));
+            Box box;
+            box.offset = offset;
+            box.size = U32(offset);
+            box.type.assign(reinterpret_cast<const char *>(&data_[offset + 4]),
+                            4);
+            box.header_size = 8;
+            if (box.size == 1) {
+                if (end - offset < 16)
+                    return Error("truncated box header at " +
+                                 std::to_string(offset));
+                box.size = U64(offset + 8);
+                box.header_size = 16;
+            } else if (box.size == 0) {
+                box.size = end - offset;  // to the end of the file
+            }
+            if (box.size < box.header_size || box.size > end - offset)
+                return Error("box " + box.type + " at " +
+                             std::to_string(offset) + " has invalid size " +
+                             std::to_string(box.size));
+            boxes->push_back(box);
+            offset += box.size;
+        }
+        return true;
+    }
+
+    // Finds the child box of the container, payload_skip is the size of the
+    // fields before the child boxes.
+    bool FindBox(const Box &parent, const char *type, Box *found,
+                 size_t payload_skip = 0) {
+        std::vector<Box> boxes;
+        if (parent.payload() + payload_skip > parent.end() ||
+            ReadBoxes(parent.payload() + payload_skip, parent.end(),
+                      &boxes) == false)
+            return false;
+        for (const Box &box : boxes) {
+            if (box.type == type) {
+                *found = box;
+                return true;
+            }
+        }
+        return Error(std::string("no ") + type + " in " + parent.type);
+    }
+
+    bool CheckMoov(const Box &moov) {
+        Box trak, edts, elst, mdia, mdhd, minf, stbl, stsd, avc1, avcc, mvex,
+            trex;
+        if (FindBox(moov, "trak", &trak) == false ||
+            FindBox(trak, "edts", &edts) == false ||
+            FindBox(edts, "elst", &elst) == false ||
+            FindBox(trak, "mdia", &mdia) == false ||
+            FindBox(mdia, "mdhd", &mdhd) == false ||
+            FindBox(mdia, "minf", &minf) == false ||
+            FindBox(minf, "stbl", &stbl) == false ||
+            FindBox(stbl, "stsd", &stsd) == false ||
+            // full box header and entry count
+            FindBox(stsd, "avc1", &avc1, 8) == false ||
+            // visual sample entry fields
+            FindBox(avc1, "avcC", &avcc, 78) == false ||
+            FindBox(moov, "mvex", &mvex) == false ||
+            FindBox(mvex, "trex", &trex) == false)
+            return false;
+        // timescale follows the creation and the modification time
+        size_t times_size = data_[mdhd.payload()] == 1 ? 16 : 8;
+        timescale_ = U32(mdhd.payload() + 4 + times_size);
+
+        // the presentation starts at the media time of the first entry
+        bool elst_v1 = data_[elst.payload()] == 1;
+        size_t entry_size = elst_v1 ? 20 : 12;
+        if (elst.size < elst.header_size + 8 + entry_size ||
+            U32(elst.payload() + 4) == 0)
+            return Error("elst has no entry");
+        size_t entry = elst.payload() + 8;
+        edit_duration_ = elst_v1 ? U64(entry) : U32(entry);
+        edit_media_time_ = elst_v1 ? U64(entry + 8) : U32(entry + 4);
+
+        width_ = U32(avc1.payload() + 24) >> 16;
+        height_ = U32(avc1.payload() + 24) & 0xffff;
+        avcc_.assign(data_.begin() + avcc.payload(),
+                     data_.begin() + avcc.end());
+        if (avcc_.size() < 7 || avcc_[0] != 1)
+            return Error("avcC has no configuration version 1");
+        if (verbose_)
+            printf("moov: %zu bytes, %u x %u, timescale %u, edit %llu\n",
+                   moov.size, width_, height_, timescale_,
+                   static_cast<unsigned long long>(edit_media_time_));
+        return true;
+    }
+
+    bool CheckFragment(const Box &moof, const Box &mdat) {
+        const std::string at = " in moof at " + std::to_string(moof.offset);
+        Box mfhd, traf, tfdt, trun;
+        if (FindBox(moof, "mfhd", &mfhd) == false ||
+            FindBox(moof, "traf", &traf) == false ||
+            FindBox(traf, "tfdt", &tfdt) == false ||
+            FindBox(traf, "trun", &trun) == false)
+            return false;
+
+        Mp4Fragment fragment;
+        fragment.moof_offset = moof.offset;
+        fragment.mdat_payload = mdat.payload();
+        fragment.sequence_number = U32(mfhd.payload() + 4);
+        if (!fragments_.empty() &&
+            fragment.sequence_number <= fragments_.back().sequence_number)
+            return Error("sequence number does not increase" + at);
+
+        uint64_t decode_time = data_[tfdt.payload()] == 1
+                                   ? U64(tfdt.payload() + 4)
+                                   : U32(tfdt.payload() + 4);
+        fragment.decode_time = decode_time;
+        if (fragments_.empty()) {
+            first_decode_time_ = decode_time;
+        } else if (decode_time != next_decode_time_) {
+            return Error("tfdt " + std::to_string(decode_time) +
+                         " does not continue from " +
+                         std::to_string(next_decode_time_) + at);
+        }
+
+        size_t offset = trun.payload();
+        uint32_t flags = U32(offset) & 0xffffff;
+        uint32_t sample_count = U32(offset + 4);
+        offset += 8;
+        if ((flags & kTrunDataOffset) == 0 ||
+            (flags & kTrunSampleSize) == 0)
+            return Error("trun has no data offset or sample size" + at);
+        fragment.data_offset = static_cast<int32_t>(U32(offset));
+        offset += 4;
+        if (moof.offset + fragment.data_offset != mdat.payload())
+            return Error("trun data offset does not point to mdat" + at);
+        uint32_t first_sample_flags = 0;
+        bool has_first_sample_flags = flags & kTrunFirstSampleFlags;
+        if (has_first_sample_flags) {
+            first_sample_flags = U32(offset);
+            offset += 4;
+        }
+
+        size_t sample_size = 0;
+        size_t sample_offset = mdat.payload();
+        uint64_t duration = 0;
+        for (uint32_t index = 0; index < sample_count; index++) {
+            uint32_t sample_flags = first_sample_flags;
+            uint32_t sample_duration = 0;
+            if (flags & kTrunSampleDuration) {
+                sample_duration = U32(offset);
+                offset += 4;
+            }
+            uint32_t size = U32(offset);
+            offset += 4;
+            if (flags & kTrunSampleFlags) {
+                if (index > 0 || has_first_sample_flags == false)
+                    sample_flags = U32(offset);
+                offset += 4;
+            }
+            if (flags & kTrunSampleCompositionOffset) offset += 4;
+            if (offset > trun.end())
+                return Error("trun is shorter than the samples" + at);
+            if (index == 0 && (sample_flags & kSampleFlagsNonSync))
+                return Error("first sample is not a sync sample" + at);
+            if (CheckSample(sample_offset, size) == false)
+                return Error("sample " + std::to_string(index) +
+                             " is not split into NAL units" + at);
+            fragment.sample_durations.push_back(sample_duration);
+            fragment.sample_sizes.push_back(size);
+            fragment.sample_flags.push_back(sample_flags);
+            duration += sample_duration;
+            sample_offset += size;
+            sample_size += size;
+        }
+        if (sample_size != mdat.size - mdat.header_size)
+            return Error("sample sizes do not match the mdat payload" + at);
+
+        next_decode_time_ = decode_time + duration;
+        if (verbose_)
+            printf("fragment %u: tfdt %llu, samples %u, duration %llu, "
+                   "mdat %zu bytes\n",
+                   fragment.sequence_number,
+                   static_cast<unsigned long long>(decode_time), sample_count,
+                   static_cast<unsigned long long>(duration), mdat.size);
+        fragments_.push_back(std::move(fragment));
+        return true;
+    }
+
+    // The sample should be filled with the length prefixed NAL units
+    bool CheckSample(size_t offset, size_t size) {
+        size_t end = offset + size;
+        if (end > data_.size()) return false;
+        while (offset < end) {
+            if (end - offset < 4) return false;
+            size_t nal_size = U32(offset);
+            if (nal_size == 0 || nal_size > end - offset - 4) return false;
+            offset += 4 + nal_size;
+        }
+        return true;
+    }
+
+    const std::vector<uint8_t> &data_;
+    const bool verbose_;
+    uint32_t timescale_;
+    uint32_t width_, height_;
+    std::vector<uint8_t> avcc_;
+    uint64_t edit_duration_;
+    uint64_t edit_media_time_;
+    std::vector<Mp4Fragment> fragments_;
+    uint64_t first_decode_time_;
+    uint64_t next_decode_time_;
+};
+
+}  // namespace check
+
+#endif  // CHECK_MP4_CHECKER_H_
@@ -0,0 +1,394 @@
+/*
+Copyright (c) 2021, rpi-webrtc-streamer Lyu,KeunChang
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+// Check of Mp4Muxer with the synthetic H.264 frames. The SPS, PPS, IDR and
+// P frames are built in the buffer headers of the fake MMAL pool and muxed
+// like the motion file writer does, and the output is parsed with the
+// parser of mp4_check. The following are verified against the input:
+//
+//  - ftyp and moov with avcC of the SPS and PPS, the picture size and the
+//    edit list starting at the first fragment of the file
+//  - one moof and mdat pair for each GOP, with the increasing sequence
+//    numbers and tfdt of the first frame timestamp
+//  - trun data offset to the mdat payload, the sample sizes, durations and
+//    sync flags, and the samples written as the length prefixed NAL units
+//    without the parameter sets and AUD
+//  - the frames before the first key frame with SPS and PPS are dropped,
+//    and Reset restarts the sequence number and the media time
+//
+// Usage: mp4_muxer_check
+//
+// Build with 'make mp4_muxer_check' in src directory.
+
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+
+#include "check/check_util.h"
+#include "check/fake_mmal.h"
+#include "check/mp4_checker.h"
+#include "frame_queue.h"
+#include "mp4_muxer.h"
+
+namespace {
+
+const int kWidth = 1280;
+const int kHeight = 720;
+const int kGopSize = 5;
+const int kGops = 3;
+const int64_t kStartUs = 5000000;
+const int64_t kFrameIntervalUs = 33333;
+const int kPoolHeaders = 4;
+const size_t kPayloadSize = 16 * 1024;
+
+// High profile, level 4.0
+const uint8_t kSps[] = {0x67, 0x64, 0x00, 0x28, 0xac, 0x2b, 0x40,
+                        0x28, 0x02, 0xdd, 0x80, 0xb5, 0x06, 0x06};
+const uint8_t kPps[] = {0x68, 0xee, 0x3c, 0x80};
+const uint8_t kAud[] = {0x09, 0xf0};
+const uint8_t kNalIdr = 0x65;
+const uint8_t kNalSlice = 0x41;
+
+typedef std::vector<uint8_t> Nal;
+
+// Slice NAL unit filled without the start code pattern
+Nal Slice(uint8_t nal_header, size_t size, int frame) {
+    Nal nal(size, static_cast<uint8_t>(0x80 | (frame & 0x3f)));
+    nal[0] = nal_header;
+    return nal;
+}
+
+// Sample of the NAL units in mp4, the 4 bytes length and the payload
+void AppendSample(const Nal &nal, std::vector<uint8_t> *sample) {
+    uint32_t size = nal.size();
+    uint8_t length[4] = {static_cast<uint8_t>(size >> 24),
+                         static_cast<uint8_t>(size >> 16),
+                         static_cast<uint8_t>(size >> 8),
+                         static_cast<uint8_t>(size)};
+    sample->insert(sample->end(), length, length + 4);
+    sample->insert(sample->end(), nal.begin(), nal.end());
+}
+
+// 90 kHz media time from the first frame of the recording
+int64_t MediaTime(int64_t timestamp_us, int64_t base_us) {
+    return (timestamp_us - base_us) * webrtc::kMp4Timescale / 1000000;
+}
+
+// Builds the Annex-B frames in the buffer headers of the fake pool, like the
+// encoder output, and wraps them with FrameBuffer.
+class FrameFactory {
+   public:
+    FrameFactory() : pool_(kPoolHeaders, kPayloadSize) {}
+
+    rtc::scoped_refptr<webrtc::FrameBuffer> Create(
+        const std::vector<Nal> &nals, bool key_frame) {
+        static const uint8_t kStartCode[] = {0, 0, 0, 1};
+        MMAL_BUFFER_HEADER_T *header = pool_.Get();
+        if (header == nullptr) return nullptr;
+        size_t length = 0;
+        for (const Nal &nal : nals) {
+            memcpy(header->data + length, kStartCode, sizeof(kStartCode));
+            length += sizeof(kStartCode);
+            memcpy(header->data + length, nal.data(), nal.size());
+            length += nal.size();
+        }
+        header->offset = 0;
+        header->length = length;
+        header->flags = MMAL_BUFFER_HEADER_FLAG_FRAME_END |
+                        (key_frame ? MMAL_BUFFER_HEADER_FLAG_KEYFRAME : 0);
+        header->pts = header->dts = MMAL_TIME_UNKNOWN;
+
+        rtc::scoped_refptr<webrtc::FrameBuffer> frame =
+            webrtc::FrameBuffer::Create(header);
+        // the frame holds the header until it is released
+        mmal_buffer_header_release(header);
+        frame->IndexNalUnits();
+        return frame;
+    }
+
+   private:
+    check::FakeMmalPool pool_;
+};
+
+// Expected sample of the muxer input
+struct Sample {
+    std::vector<uint8_t> data;
+    int64_t timestamp_us;
+    bool keyframe;
+};
+
+// Muxes the GOPs of the synthetic frames into the fragments, like the motion
+// file writer does, the fragment is finished by the next key frame.
+class Recording {
+   public:
+    Recording() : muxer_(kWidth, kHeight), frame_number_(0) {}
+
+    webrtc::Mp4Muxer &muxer() { return muxer_; }
+
+    bool AddFrame(const std::vector<Nal> &nals, bool key_frame,
+                  int64_t timestamp_us) {
+        rtc::scoped_refptr<webrtc::FrameBuffer> frame =
+            factory_.Create(nals, key_frame);
+        EXPECT(frame != nullptr);
+        if (frame == nullptr) return false;
+        if (key_frame && muxer_.sample_count() > 0) {
+            EXPECT(muxer_.FinishFragment(timestamp_us));
+            AppendFragment();
+        }
+        if (muxer_.AddFrame(*frame, timestamp_us) == false) return false;
+
+        Sample sample;
+        for (const Nal &nal : nals) {
+            uint8_t type = nal[0] & 0x1f;
+            if (type == 1 || type == 5) AppendSample(nal, &sample.data);
+        }
+        sample.timestamp_us = timestamp_us;
+        sample.keyframe = key_frame;
+        if (key_frame) samples_.emplace_back();
+        samples_.back().push_back(sample);
+        return true;
+    }
+
+    // Adds a GOP of the key frame with the parameter sets when config is
+    // true, and the P frames. Every frame starts with AUD.
+    void AddGop(bool config) {
+        for (int index = 0; index < kGopSize; index++, frame_number_++) {
+            bool key_frame = index == 0;
+            std::vector<Nal> nals;
+            nals.push_back(Nal(kAud, kAud + sizeof(kAud)));
+            if (key_frame && config) {
+                nals.push_back(Nal(kSps, kSps + sizeof(kSps)));
+                nals.push_back(Nal(kPps, kPps + sizeof(kPps)));
+            }
+            nals.push_back(key_frame ? Slice(kNalIdr, 3000 + frame_number_ * 7,
+                                             frame_number_)
+                                     : Slice(kNalSlice, 400 + index * 13,
+                                             frame_number_));
+            // the timestamps are not evenly spaced like the camera
+            int64_t timestamp_us = kStartUs +
+                                   frame_number_ * kFrameIntervalUs +
+                                   (frame_number_ % 2) * 500;
+            EXPECT(AddFrame(nals, key_frame, timestamp_us));
+        }
+    }
+
+    // Finishes the last fragment, its last sample takes the duration of the
+    // previous sample.
+    void Finish() {
+        EXPECT(muxer_.FinishFragment());
+        AppendFragment();
+    }
+
+    // Builds the file starting at the fragment of the index
+    std::vector<uint8_t> File(size_t first_fragment) {
+        std::vector<uint8_t> file;
+        EXPECT(muxer_.CreateInitSegment(starts_[first_fragment], &file));
+        for (size_t index = first_fragment; index < fragments_.size(); index++)
+            file.insert(file.end(), fragments_[index].begin(),
+                        fragments_[index].end());
+        return file;
+    }
+
+    // samples of each fragment
+    const std::vector<std::vector<Sample>> &samples() const {
+        return samples_;
+    }
+    size_t header_size(size_t index) const { return header_sizes_[index]; }
+
+   private:
+    void AppendFragment() {
+        std::vector<uint8_t> fragment(muxer_.fragment_header());
+        header_sizes_.push_back(fragment.size());
+        fragment.insert(fragment.end(), muxer_.fragment_payload().begin(),
+                        muxer_.fragment_payload().end());
+        fragments_.push_back(fragment);
+        starts_.push_back(muxer_.fragment_start_us());
+    }
+
+    FrameFactory factory_;
+    webrtc::Mp4Muxer muxer_;
+    int frame_number_;
+    std::vector<std::vector<Sample>> samples_;
+    std::vector<std::vector<uint8_t>> fragments_;
+    std::vector<size_t> header_sizes_;
+    std::vector<int64_t> starts_;
+};
+
+// Compares the fragments of the file with the muxed samples, from the
+// fragment of the first index.
+void CheckFragments(const Recording &recording,
+                    const std::vector<uint8_t> &file,
+                    const check::Mp4Checker &checker, size_t first_fragment,
+                    uint32_t first_sequence_number, int64_t base_us) {
+    const std::vector<check::Mp4Fragment> &fragments = checker.fragments();
+    const std::vector<std::vector<Sample>> &samples = recording.samples();
+    EXPECT_MSG(fragments.size() == samples.size() - first_fragment,
+               "%zu fragments", fragments.size());
+    for (size_t index = 0; index < fragments.size() &&
+                           first_fragment + index < samples.size();
+         index++) {
+        const check::Mp4Fragment &fragment = fragments[index];
+        const std::vector<Sample> &gop = samples[first_fragment + index];
+        EXPECT_MSG(fragment.sequence_number == first_sequence_number + index,
+                   "fragment %zu: sequence number %u", index,
+                   fragment.sequence_number);
+        EXPECT_MSG(static_cast<int64_t>(fragment.decode_time) ==
+                       MediaTime(gop.front().timestamp_us, base_us),
+                   "fragment %zu: tfdt %llu", index,
+                   static_cast<unsigned long long>(fragment.decode_time));
+        EXPECT(static_cast<size_t>(fragment.data_offset) ==
+               recording.header_size(first_fragment + index));
+        EXPECT(fragment.sample_sizes.size() == gop.size());
+        if (fragment.sample_sizes.size() != gop.size()) continue;
+
+        size_t offset = fragment.mdat_payload;
+        for (size_t sample = 0; sample < gop.size(); sample++) {
+            const Sample &expected = gop[sample];
+            EXPECT_MSG(fragment.sample_sizes[sample] == expected.data.size(),
+                       "fragment %zu sample %zu: size %u != %zu", index,
+                       sample, fragment.sample_sizes[sample],
+                       expected.data.size());
+            EXPECT(offset + expected.data.size() <= file.size() &&
+                   memcmp(&file[offset], expected.data.data(),
+                          expected.data.size()) == 0);
+            offset += fragment.sample_sizes[sample];
+            EXPECT(((fragment.sample_flags[sample] &
+                     check::kSampleFlagsNonSync) == 0) == expected.keyframe);
+
+            // the last sample of the recording repeats the previous duration
+            int64_t next_us;
+            if (sample + 1 < gop.size())
+                next_us = gop[sample + 1].timestamp_us;
+            else if (first_fragment + index + 1 < samples.size())
+                next_us = samples[first_fragment + index + 1][0].timestamp_us;
+            else
+                next_us = expected.timestamp_us + expected.timestamp_us -
+                          gop[sample - 1].timestamp_us;
+            int64_t duration = MediaTime(next_us, base_us) -
+                               MediaTime(expected.timestamp_us, base_us);
+            EXPECT_MSG(fragment.sample_durations[sample] == duration,
+                       "fragment %zu sample %zu: duration %u != %lld", index,
+                       sample, fragment.sample_durations[sample],
+                       static_cast<long long>(duration));
+        }
+    }
+}
+
+void CheckInitSegment(const check::Mp4Checker &checker) {
+    std::vector<uint8_t> avcc = {1, kSps[1], kSps[2], kSps[3], 0xff, 0xe1,
+                                 0, sizeof(kSps)};
+    avcc.insert(avcc.end(), kSps, kSps + sizeof(kSps));
+    avcc.insert(avcc.end(), {1, 0, sizeof(kPps)});
+    avcc.insert(avcc.end(), kPps, kPps + sizeof(kPps));
+    // chroma format and bit depth of the high profile
+    avcc.insert(avcc.end(), {0xfd, 0xf8, 0xf8, 0});
+
+    EXPECT(checker.timescale() == webrtc::kMp4Timescale);
+    EXPECT(checker.width() == kWidth && checker.height() == kHeight);
+    EXPECT(checker.avcc() == avcc);
+    EXPECT(checker.edit_duration() == 0);
+}
+
+void CheckRecording() {
+    Recording recording;
+    // dropped until the key frame with the SPS and PPS
+    std::vector<Nal> frame = {Slice(kNalSlice, 100, 0)};
+    EXPECT(recording.AddFrame(frame, false, kStartUs - 2000) == false);
+    frame = {Slice(kNalIdr, 100, 0)};
+    EXPECT(recording.AddFrame(frame, true, kStartUs - 1000) == false);
+    EXPECT(recording.muxer().ready() == false);
+
+    for (int gop = 0; gop < kGops; gop++) recording.AddGop(gop == 0);
+    recording.Finish();
+
+    std::vector<uint8_t> file = recording.File(0);
+    check::Mp4Checker checker(file, false);
+    EXPECT(checker.Check());
+    CheckInitSegment(checker);
+    EXPECT(checker.edit_media_time() == 0);
+    CheckFragments(recording, file, checker, 0, 1, kStartUs);
+
+    // the file of the pre-event ring starts at the later fragment, and the
+    // edit list skips the media time before it
+    std::vector<uint8_t> later = recording.File(1);
+    check::Mp4Checker later_checker(later, false);
+    EXPECT(later_checker.Check());
+    CheckInitSegment(later_checker);
+    EXPECT(static_cast<int64_t>(later_checker.edit_media_time()) ==
+           MediaTime(recording.samples()[1][0].timestamp_us, kStartUs));
+    CheckFragments(recording, later, later_checker, 1, 2, kStartUs);
+}
+
+void CheckReset() {
+    Recording recording;
+    recording.AddGop(true);
+    recording.Finish();
+    recording.muxer().Reset();
+
+    // the cached parameter sets are kept, the P frame waits for the key frame
+    webrtc::Mp4Muxer &muxer = recording.muxer();
+    FrameFactory factory;
+    rtc::scoped_refptr<webrtc::FrameBuffer> frame =
+        factory.Create({Slice(kNalSlice, 200, 1)}, false);
+    EXPECT(muxer.AddFrame(*frame, kStartUs + 10000000) == false);
+    EXPECT(muxer.ready());
+    frame = factory.Create({Slice(kNalIdr, 300, 2)}, true);
+    EXPECT(muxer.AddFrame(*frame, kStartUs + 10100000));
+    frame = factory.Create({Slice(kNalSlice, 200, 3)}, false);
+    EXPECT(muxer.AddFrame(*frame, kStartUs + 10150000));
+    EXPECT(muxer.FinishFragment(kStartUs + 10200000));
+
+    std::vector<uint8_t> file;
+    EXPECT(muxer.CreateInitSegment(muxer.fragment_start_us(), &file));
+    file.insert(file.end(), muxer.fragment_header().begin(),
+                muxer.fragment_header().end());
+    file.insert(file.end(), muxer.fragment_payload().begin(),
+                muxer.fragment_payload().end());
+    check::Mp4Checker checker(file, false);
+    EXPECT(checker.Check());
+    CheckInitSegment(checker);
+    EXPECT(checker.edit_media_time() == 0);
+    EXPECT(checker.fragments().size() == 1);
+    if (checker.fragments().size() != 1) return;
+    const check::Mp4Fragment &fragment = checker.fragments()[0];
+    EXPECT(fragment.sequence_number == 1);
+    EXPECT(fragment.decode_time == 0);
+    EXPECT(fragment.sample_sizes == std::vector<uint32_t>({304, 204}));
+    EXPECT(fragment.sample_durations == std::vector<uint32_t>({4500, 4500}));
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    CheckRecording();
+    CheckReset();
+    return check::Finish("mp4_muxer_check");
+}
@@ -0,0 +1,389 @@
+/*
+Copyright (c) 2021, rpi-webrtc-streamer Lyu,KeunChang
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Lane by lane emulation of the NEON intrinsics used by the motion vector
+// kernels, so the NEON path of RaspiMotionVector runs on the hosts without
+// NEON. Each intrinsic follows the lane semantics of the ARM C Language
+// Extensions: the narrowing and the wrapping arithmetic truncate to the lane
+// width, the comparisons set all bits of the lane, and the shift by register
+// uses the signed low byte of the shift lane, a negative shift is a right
+// shift and a shift out of the lane width gives 0.
+//
+// The check is built with '-D__ARM_NEON -Icheck/neon', so the kernels
+// include this header instead of the compiler one. Only the intrinsics used
+// by raspi_motionvector.cc are defined.
+
+#ifndef CHECK_NEON_ARM_NEON_H_
+#define CHECK_NEON_ARM_NEON_H_
+
+#include <stdint.h>
+#include <string.h>
+
+namespace neon_emulation {
+
+template <typename T, int N>
+struct Vector {
+    T lane[N];
+};
+
+// Same bits in the other lane type
+template <typename To, typename From>
+inline To Reinterpret(const From &from) {
+    static_assert(sizeof(To) == sizeof(From), "vector size mismatch");
+    To to;
+    memcpy(&to, &from, sizeof(to));
+    return to;
+}
+
+template <typename T>
+inline T Mask(bool condition) {
+    return condition ? static_cast<T>(~static_cast<T>(0)) : 0;
+}
+
+}  // namespace neon_emulation
+
+typedef neon_emulation::Vector<uint8_t, 8> uint8x8_t;
+typedef neon_emulation::Vector<int8_t, 8> int8x8_t;
+typedef neon_emulation::Vector<uint8_t, 16> uint8x16_t;
+typedef neon_emulation::Vector<int8_t, 16> int8x16_t;
+typedef neon_emulation::Vector<uint16_t, 4> uint16x4_t;
+typedef neon_emulation::Vector<int16_t, 4> int16x4_t;
+typedef neon_emulation::Vector<uint16_t, 8> uint16x8_t;
+typedef neon_emulation::Vector<int16_t, 8> int16x8_t;
+typedef neon_emulation::Vector<uint32_t, 2> uint32x2_t;
+typedef neon_emulation::Vector<uint32_t, 4> uint32x4_t;
+typedef neon_emulation::Vector<int32_t, 4> int32x4_t;
+
+struct uint8x16x4_t {
+    uint8x16_t val[4];
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Load, store and lane access
+//
+////////////////////////////////////////////////////////////////////////////////
+inline uint16x8_t vdupq_n_u16(uint16_t value) {
+    uint16x8_t result;
+    for (int i = 0; i < 8; i++) result.lane[i] = value;
+    return result;
+}
+
+inline uint32x4_t vdupq_n_u32(uint32_t value) {
+    uint32x4_t result;
+    for (int i = 0; i < 4; i++) result.lane[i] = value;
+    return result;
+}
+
+inline int32x4_t vdupq_n_s32(int32_t value) {
+    int32x4_t result;
+    for (int i = 0; i < 4; i++) result.lane[i] = value;
+    return result;
+}
+
+// De-interleaving load, element i of the structure j goes to val[i] lane j
+inline uint8x16x4_t vld4q_u8(const uint8_t *ptr) {
+    uint8x16x4_t result;
+    for (int j = 0; j < 16; j++)
+        for (int i = 0; i < 4; i++) result.val[i].lane[j] = ptr[j * 4 + i];
+    return result;
+}
+
+inline uint32x4_t vld1q_u32(const uint32_t *ptr) {
+    uint32x4_t result;
+    for (int i = 0; i < 4; i++) result.lane[i] = ptr[i];
+    return result;
+}
+
+inline void vst1q_u32(uint32_t *ptr, uint32x4_t a) {
+    for (int i = 0; i < 4; i++) ptr[i] = a.lane[i];
+}
+
+inline void vst1q_u8(uint8_t *ptr, uint8x16_t a) {
+    for (int i = 0; i < 16; i++) ptr[i] = a.lane[i];
+}
+
+#define vget_lane_u32(a, n) ((a).lane[(n)])
+#define vgetq_lane_u32(a, n) ((a).lane[(n)])
+
+inline int8x8_t vget_low_s8(int8x16_t a) {
+    int8x8_t result;
+    for (int i = 0; i < 8; i++) result.lane[i] = a.lane[i];
+    return result;
+}
+
+inline int8x8_t vget_high_s8(int8x16_t a) {
+    int8x8_t result;
+    for (int i = 0; i < 8; i++) result.lane[i] = a.lane[i + 8];
+    return result;
+}
+
+inline uint16x4_t vget_low_u16(uint16x8_t a) {
+    uint16x4_t result;
+    for (int i = 0; i < 4; i++) result.lane[i] = a.lane[i];
+    return result;
+}
+
+inline uint16x4_t vget_high_u16(uint16x8_t a) {
+    uint16x4_t result;
+    for (int i = 0; i < 4; i++) result.lane[i] = a.lane[i + 4];
+    return result;
+}
+
+inline uint32x2_t vget_low_u32(uint32x4_t a) {
+    uint32x2_t result;
+    for (int i = 0; i < 2; i++) result.lane[i] = a.lane[i];
+    return result;
+}
+
+inline uint32x2_t vget_high_u32(uint32x4_t a) {
+    uint32x2_t result;
+    for (int i = 0; i < 2; i++) result.lane[i] = a.lane[i + 2];
+    return result;
+}
+
+inline uint16x8_t vcombine_u16(uint16x4_t low, uint16x4_t high) {
+    uint16x8_t result;
+    for (int i = 0; i < 4; i++) {
+        result.lane[i] = low.lane[i];
+        result.lane[i + 4] = high.lane[i];
+    }
+    return result;
+}
+
+inline uint8x16_t vcombine_u8(uint8x8_t low, uint8x8_t high) {
+    uint8x16_t result;
+    for (int i = 0; i < 8; i++) {
+        result.lane[i] = low.lane[i];
+        result.lane[i + 8] = high.lane[i];
+    }
+    return result;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Reinterpret, widen and narrow
+//
+////////////////////////////////////////////////////////////////////////////////
+inline int8x16_t vreinterpretq_s8_u8(uint8x16_t a) {
+    return neon_emulation::Reinterpret<int8x16_t>(a);
+}
+
+inline uint16x8_t vreinterpretq_u16_s16(int16x8_t a) {
+    return neon_emulation::Reinterpret<uint16x8_t>(a);
+}
+
+inline int16x4_t vreinterpret_s16_u16(uint16x4_t a) {
+    return neon_emulation::Reinterpret<int16x4_t>(a);
+}
+
+inline uint32x4_t vreinterpretq_u32_s32(int32x4_t a) {
+    return neon_emulation::Reinterpret<uint32x4_t>(a);
+}
+
+inline uint8x16_t vreinterpretq_u8_u32(uint32x4_t a) {
+    return neon_emulation::Reinterpret<uint8x16_t>(a);
+}
+
+inline int32x4_t vmovl_s16(int16x4_t a) {
+    int32x4_t result;
+    for (int i = 0; i < 4; i++) result.lane[i] = a.lane[i];
+    return result;
+}
+
+inline uint16x4_t vmovn_u32(uint32x4_t a) {
+    uint16x4_t result;
+    for (int i = 0; i < 4; i++)
+        result.lane[i] = static_cast<uint16_t>(a.lane[i]);
+    return result;
+}
+
+inline uint8x8_t vmovn_u16(uint16x8_t a) {
+    uint8x8_t result;
+    for (int i = 0; i < 8; i++)
+        result.lane[i] = static_cast<uint8_t>(a.lane[i]);
+    return result;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Arithmetic
+//
+////////////////////////////////////////////////////////////////////////////////
+inline int16x8_t vmull_s8(int8x8_t a, int8x8_t b) {
+    int16x8_t result;
+    for (int i = 0; i < 8; i++) result.lane[i] = a.lane[i] * b.lane[i];
+    return result;
+}
+
+// The accumulation wraps around in the 16 bits lane
+inline int16x8_t vmlal_s8(int16x8_t accumulator, int8x8_t a, int8x8_t b) {
+    int16x8_t result;
+    for (int i = 0; i < 8; i++)
+        result.lane[i] = static_cast<int16_t>(static_cast<uint16_t>(
+            accumulator.lane[i] + a.lane[i] * b.lane[i]));
+    return result;
+}
+
+inline uint16x8_t vsubq_u16(uint16x8_t a, uint16x8_t b) {
+    uint16x8_t result;
+    for (int i = 0; i < 8; i++)
+        result.lane[i] = static_cast<uint16_t>(a.lane[i] - b.lane[i]);
+    return result;
+}
+
+inline uint32x4_t vsubq_u32(uint32x4_t a, uint32x4_t b) {
+    uint32x4_t result;
+    for (int i = 0; i < 4; i++) result.lane[i] = a.lane[i] - b.lane[i];
+    return result;
+}
+
+inline uint32x4_t vmulq_u32(uint32x4_t a, uint32x4_t b) {
+    uint32x4_t result;
+    for (int i = 0; i < 4; i++) result.lane[i] = a.lane[i] * b.lane[i];
+    return result;
+}
+
+inline uint32x4_t vminq_u32(uint32x4_t a, uint32x4_t b) {
+    uint32x4_t result;
+    for (int i = 0; i < 4; i++)
+        result.lane[i] = a.lane[i] < b.lane[i] ? a.lane[i] : b.lane[i];
+    return result;
+}
+
+inline uint32x4_t vmaxq_u32(uint32x4_t a, uint32x4_t b) {
+    uint32x4_t result;
+    for (int i = 0; i < 4; i++)
+        result.lane[i] = a.lane[i] > b.lane[i] ? a.lane[i] : b.lane[i];
+    return result;
+}
+
+// Pairwise min/max, the pairs of a go to the low lane and those of b to the
+// high lane
+inline uint32x2_t vpmin_u32(uint32x2_t a, uint32x2_t b) {
+    uint32x2_t result;
+    result.lane[0] = a.lane[0] < a.lane[1] ? a.lane[0] : a.lane[1];
+    result.lane[1] = b.lane[0] < b.lane[1] ? b.lane[0] : b.lane[1];
+    return result;
+}
+
+inline uint32x2_t vpmax_u32(uint32x2_t a, uint32x2_t b) {
+    uint32x2_t result;
+    result.lane[0] = a.lane[0] > a.lane[1] ? a.lane[0] : a.lane[1];
+    result.lane[1] = b.lane[0] > b.lane[1] ? b.lane[0] : b.lane[1];
+    return result;
+}
+
+// Pairwise add to the lanes of double width
+inline uint16x8_t vpaddlq_u8(uint8x16_t a) {
+    uint16x8_t result;
+    for (int i = 0; i < 8; i++)
+        result.lane[i] = a.lane[2 * i] + a.lane[2 * i + 1];
+    return result;
+}
+
+inline uint32x4_t vpaddlq_u16(uint16x8_t a) {
+    uint32x4_t result;
+    for (int i = 0; i < 4; i++)
+        result.lane[i] = static_cast<uint32_t>(a.lane[2 * i]) +
+                         a.lane[2 * i + 1];
+    return result;
+}
+
+inline uint8x16_t vcntq_u8(uint8x16_t a) {
+    uint8x16_t result;
+    for (int i = 0; i < 16; i++)
+        result.lane[i] = static_cast<uint8_t>(__builtin_popcount(a.lane[i]));
+    return result;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Logical, compare and shift
+//
+////////////////////////////////////////////////////////////////////////////////
+inline uint32x4_t vorrq_u32(uint32x4_t a, uint32x4_t b) {
+    uint32x4_t result;
+    for (int i = 0; i < 4; i++) result.lane[i] = a.lane[i] | b.lane[i];
+    return result;
+}
+
+inline uint32x4_t vandq_u32(uint32x4_t a, uint32x4_t b) {
+    uint32x4_t result;
+    for (int i = 0; i < 4; i++) result.lane[i] = a.lane[i] & b.lane[i];
+    return result;
+}
+
+inline uint16x8_t vcgeq_u16(uint16x8_t a, uint16x8_t b) {
+    uint16x8_t result;
+    for (int i = 0; i < 8; i++)
+        result.lane[i] =
+            neon_emulation::Mask<uint16_t>(a.lane[i] >= b.lane[i]);
+    return result;
+}
+
+inline uint32x4_t vcgeq_u32(uint32x4_t a, uint32x4_t b) {
+    uint32x4_t result;
+    for (int i = 0; i < 4; i++)
+        result.lane[i] =
+            neon_emulation::Mask<uint32_t>(a.lane[i] >= b.lane[i]);
+    return result;
+}
+
+inline uint32x4_t vcgtq_u32(uint32x4_t a, uint32x4_t b) {
+    uint32x4_t result;
+    for (int i = 0; i < 4; i++)
+        result.lane[i] = neon_emulation::Mask<uint32_t>(a.lane[i] > b.lane[i]);
+    return result;
+}
+
+// The shift is the signed low byte of the lane of shift
+inline uint32x4_t vshlq_u32(uint32x4_t a, int32x4_t shift) {
+    uint32x4_t result;
+    for (int i = 0; i < 4; i++) {
+        int count = static_cast<int8_t>(shift.lane[i] & 0xff);
+        if (count >= 32 || count <= -32)
+            result.lane[i] = 0;
+        else if (count >= 0)
+            result.lane[i] = a.lane[i] << count;
+        else
+            result.lane[i] = a.lane[i] >> -count;
+    }
+    return result;
+}
+
+// The shift of vshrq_n is an immediate of 1 to 32
+inline uint32x4_t vshrq_n_u32(uint32x4_t a, int count) {
+    uint32x4_t result;
+    for (int i = 0; i < 4; i++)
+        result.lane[i] = count >= 32 ? 0 : a.lane[i] >> count;
+    return result;
+}
+
+#endif  // CHECK_NEON_ARM_NEON_H_
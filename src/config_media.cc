@@ -235,6 +235,93 @@ DECLARE_METHOD_VALIDATOR(ConfigMedia, fixed_video_fps, int) {
     return true;
 }
 
+DECLARE_METHOD_VALIDATOR(ConfigMedia, frame_queue_drop_threshold, int) {
+    // the queued frames can not exceed the encoder output buffers
+    if ((frame_queue_drop_threshold < 2) || (frame_queue_drop_threshold > 20)) {
+        RTC_LOG(LS_ERROR) << "Error in frame queue drop threshold value: "
+                          << frame_queue_drop_threshold
+                          << " is not a valid frame queue drop threshold";
+        return false;
+    }
+    return true;
+}
+
+DECLARE_METHOD_VALIDATOR(ConfigMedia, video_motion_static_fps, int) {
+    if ((video_motion_static_fps < 1) || (video_motion_static_fps > 30)) {
+        RTC_LOG(LS_ERROR) << "Error in static scene frame rate value: "
+                          << video_motion_static_fps
+                          << " is not a valid video frame rate value";
+        return false;
+    }
+    return true;
+}
+
+DECLARE_METHOD_VALIDATOR(ConfigMedia, video_motion_static_percent, int) {
+    if ((video_motion_static_percent < 0) ||
+        (video_motion_static_percent > 100)) {
+        RTC_LOG(LS_ERROR) << "Error in static scene percent value: "
+                          << video_motion_static_percent
+                          << " is not a valid percent value";
+        return false;
+    }
+    return true;
+}
+
+DECLARE_METHOD_VALIDATOR(ConfigMedia, video_motion_active_percent, int) {
+    if ((video_motion_active_percent < 1) ||
+        (video_motion_active_percent > 100)) {
+        RTC_LOG(LS_ERROR) << "Error in motion active percent value: "
+                          << video_motion_active_percent
+                          << " is not a valid percent value";
+        return false;
+    }
+    return true;
+}
+
+DECLARE_METHOD_VALIDATOR(ConfigMedia, video_motion_static_wait_period, int) {
+    if ((video_motion_static_wait_period < 0) ||
+        (video_motion_static_wait_period > 60000)) {
+        RTC_LOG(LS_ERROR) << "Error in static scene wait period value: "
+                          << video_motion_static_wait_period
+                          << " is not a valid wait period(ms)";
+        return false;
+    }
+    return true;
+}
+
+DECLARE_METHOD_VALIDATOR(ConfigMedia, video_motion_boost_percent, int) {
+    if ((video_motion_boost_percent < 10) ||
+        (video_motion_boost_percent > 300)) {
+        RTC_LOG(LS_ERROR) << "Error in motion boost percent value: "
+                          << video_motion_boost_percent
+                          << " is not a valid boost percent";
+        return false;
+    }
+    return true;
+}
+
+DECLARE_METHOD_VALIDATOR(ConfigMedia, video_motion_boost_period, int) {
+    if ((video_motion_boost_period < 0) ||
+        (video_motion_boost_period > 30000)) {
+        RTC_LOG(LS_ERROR) << "Error in motion boost period value: "
+                          << video_motion_boost_period
+                          << " is not a valid boost period(ms)";
+        return false;
+    }
+    return true;
+}
+
+DECLARE_METHOD_VALIDATOR(ConfigMedia, video_motion_boost_decay_period, int) {
+    if ((video_motion_boost_decay_period < 0) ||
+        (video_motion_boost_decay_period > 30000)) {
+        RTC_LOG(LS_ERROR) << "Error in motion boost decay period value: "
+                          << video_motion_boost_decay_period
+                          << " is not a valid decay period(ms)";
+        return false;
+    }
+    return true;
+}
+
 DECLARE_METHOD_VALIDATOR(ConfigMedia, fixed_video_resolution, std::string) {
     int width, height;
     if (utils::ParseVideoResolution(fixed_video_resolution, &width, &height) ==
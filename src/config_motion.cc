@@ -33,6 +33,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <string>
 
 #include "config_defs.h"
+#include "raspi_motionzone.h"
 #include "rtc_base/checks.h"
 #include "rtc_base/logging.h"
 #include "utils.h"
@@ -41,6 +42,7 @@ namespace {
 
 constexpr int kMaxClearWaitPeriod = 10000;  // 10 seconds
 constexpr int kMinClearWaitPeriod = 2000;   // 10 seconds
+constexpr int kMaxPreEventPeriod = 10000;  // 10 seconds
 constexpr int kMaxClearPercent = 10;
 constexpr int kMinClearPercent = 3;
 constexpr int kMaxMotionFps = 30;
@@ -79,6 +81,17 @@ DECLARE_METHOD_VALIDATOR(ConfigMotion, motion_clear_wait_period, int) {
     return true;
 }
 
+DECLARE_METHOD_VALIDATOR(ConfigMotion, motion_pre_event_period, int) {
+    if (motion_pre_event_period < 0 ||
+        motion_pre_event_period > kMaxPreEventPeriod) {
+        RTC_LOG(LS_ERROR) << "Motion Pre-event period \""
+                          << motion_pre_event_period
+                          << "\" is not valid. using default: " << default_value;
+        return false;
+    }
+    return true;
+}
+
 DECLARE_METHOD_VALIDATOR(ConfigMotion, motion_clear_percent, int) {
     if (motion_clear_percent < kMinClearPercent ||
         motion_clear_percent > kMaxClearPercent) {
@@ -123,6 +136,17 @@ DECLARE_METHOD_VALIDATOR(ConfigMotion, blob_cancel_threshold, float) {
     return true;
 }
 
+DECLARE_METHOD_VALIDATOR(ConfigMotion, motion_zones, std::string) {
+    MotionZones zones;
+    if (zones.Parse(motion_zones) == false) {
+        RTC_LOG(LS_ERROR) << "Motion zones \"" << motion_zones
+                          << "\" is not valid. using default: \""
+                          << default_value << "\"";
+        return false;
+    }
+    return true;
+}
+
 DECLARE_METHOD_VALIDATOR(ConfigMotion, motion_directory, std::string) {
     if (!utils::IsFolder(motion_directory)) {
         RTC_LOG(LS_ERROR) << "Path \"" << motion_directory
@@ -0,0 +1,382 @@
+/*
+Copyright (c) 2021, rpi-webrtc-streamer Lyu,KeunChang
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Throughput benchmark of the motion file writer. The H.264 like frames are
+// queued as fast as possible and written to the directory, with the chunked
+// FileWriterBuffer(copied or referenced frames) and with the previous
+// contiguous buffer drained through the 8 KB copy buffer.
+//
+// Run it on the Raspberry PI with the directory on tmpfs(/dev/shm) and on the
+// SD card to compare the write path with and without the storage latency.
+//
+// Usage: file_writer_bench [-s total_mbytes] [-p p_frame_kbytes]
+//                          [-m legacy|copy|reference|all] [-y] directory
+//
+// Build with 'make file_writer_bench' in src directory.
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "api/video/encoded_image.h"
+#include "file_writer_handle.h"
+
+namespace {
+
+const int kDefaultTotalMBytes = 256;
+const int kDefaultPFrameKBytes = 16;
+// key frame every 3 seconds at 30 fps, 8 times larger than the P frame
+const int kKeyFramePeriod = 90;
+const int kKeyFrameRatio = 8;
+// frames reused by the producer
+const int kFramePoolSize = 16;
+
+// same with the writer thread wait period and the copy buffer size of the
+// previous FileWriterHandle
+const int kLegacyWaitPeriod = 10;  // ms
+const size_t kLegacyCopyBufferSize = 8 * 1024;
+const double kLegacyIncreaseFactor = 0.25;
+
+const char kModeLegacy[] = "legacy";
+const char kModeCopy[] = "copy";
+const char kModeReference[] = "reference";
+const char kModeAll[] = "all";
+
+int64_t TimeMicros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+void Usage(const char *program) {
+    fprintf(stderr,
+            "Usage: %s [-s total_mbytes] [-p p_frame_kbytes] "
+            "[-m legacy|copy|reference|all] [-y] directory\n",
+            program);
+    exit(1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Previous FileWriterBuffer and FileWriterHandle::Write: one contiguous
+// buffer grown by 25% with a copy, and drained through the 8 KB copy buffer.
+//
+////////////////////////////////////////////////////////////////////////////////
+class LegacyWriter {
+   public:
+    explicit LegacyWriter(size_t buffer_size)
+        : buffer_size_(buffer_size),
+          offset_start_(0),
+          offset_end_(0),
+          buffer_(new uint8_t[buffer_size]),
+          fd_(-1),
+          quit_(false),
+          write_calls_(0) {}
+
+    bool Open(const std::string &filename) {
+        fd_ = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd_ < 0) return false;
+        quit_ = false;
+        thread_ = std::thread([this] { WriterProcess(); });
+        return true;
+    }
+
+    void WriteBack(const uint8_t *data, size_t size) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (offset_end_ + size > buffer_size_) Resize(size);
+        memcpy(buffer_.get() + offset_end_, data, size);
+        offset_end_ += size;
+        cond_.notify_one();
+    }
+
+    void Close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            quit_ = true;
+            cond_.notify_one();
+        }
+        thread_.join();
+        Write();
+        ::close(fd_);
+        fd_ = -1;
+    }
+
+    uint64_t write_calls() const { return write_calls_; }
+
+   private:
+    void Resize(size_t size) {
+        size_t new_buffer_size = buffer_size_;
+        while (offset_end_ + size > new_buffer_size)
+            new_buffer_size += new_buffer_size * kLegacyIncreaseFactor;
+        uint8_t *new_buffer = new uint8_t[new_buffer_size];
+        memcpy(new_buffer + offset_start_, buffer_.get() + offset_start_,
+               offset_end_ - offset_start_);
+        buffer_.reset(new_buffer);
+        buffer_size_ = new_buffer_size;
+    }
+
+    size_t ReadFront(uint8_t *buffer, size_t size) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        size_t remaining = offset_end_ - offset_start_;
+        if (remaining > size) {
+            memcpy(buffer, buffer_.get() + offset_start_, size);
+            offset_start_ += size;
+            return size;
+        }
+        memcpy(buffer, buffer_.get() + offset_start_, remaining);
+        offset_start_ = offset_end_ = 0;
+        return remaining;
+    }
+
+    void Write() {
+        uint8_t buf[kLegacyCopyBufferSize];
+        while (size_t read_size = ReadFront(buf, kLegacyCopyBufferSize)) {
+            if (::write(fd_, buf, read_size) < 0) perror("write");
+            write_calls_++;
+        }
+    }
+
+    void WriterProcess() {
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                if (quit_) return;
+                if (offset_end_ == offset_start_)
+                    cond_.wait_for(lock,
+                                   std::chrono::milliseconds(kLegacyWaitPeriod));
+            }
+            Write();
+        }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    size_t buffer_size_;
+    size_t offset_start_, offset_end_;
+    std::unique_ptr<uint8_t[]> buffer_;
+    int fd_;
+    bool quit_;
+    uint64_t write_calls_;
+    std::thread thread_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Benchmark
+//
+////////////////////////////////////////////////////////////////////////////////
+struct BenchResult {
+    const char *mode;
+    uint64_t bytes;
+    uint64_t write_calls;
+    uint64_t syncs;
+    int64_t max_sync_time_us;
+    int64_t elapsed_us;
+};
+
+class FileWriterBench {
+   public:
+    FileWriterBench(const std::string &directory, uint64_t total_bytes,
+                    size_t p_frame_size, bool sync)
+        : directory_(directory), total_bytes_(total_bytes), sync_(sync) {
+        for (int index = 0; index < kFramePoolSize; index++) {
+            size_t size = index == 0 ? p_frame_size * kKeyFrameRatio
+                                     : p_frame_size + (index * 509) % 1024;
+            rtc::scoped_refptr<webrtc::EncodedImageBuffer> frame =
+                webrtc::EncodedImageBuffer::Create(size);
+            memset(frame->data(), index, size);
+            frames_.push_back(frame);
+        }
+        // buffer of one key frame period, same with RaspiMotion
+        buffer_size_ = p_frame_size * (kKeyFramePeriod + kKeyFrameRatio);
+    }
+
+    BenchResult Run(const std::string &mode) {
+        BenchResult result = {nullptr, 0, 0, 0, 0, 0};
+        std::string prefix = "bench_" + mode;
+        int64_t start_us = TimeMicros();
+
+        if (mode == kModeLegacy) {
+            result.mode = kModeLegacy;
+            LegacyWriter writer(buffer_size_);
+            if (writer.Open(directory_ + "/" + prefix + ".h264") == false) {
+                perror("open");
+                return result;
+            }
+            for (int count = 0; result.bytes < total_bytes_; count++) {
+                const rtc::scoped_refptr<webrtc::EncodedImageBuffer> &frame =
+                    GetFrame(count);
+                writer.WriteBack(frame->data(), frame->size());
+                result.bytes += frame->size();
+            }
+            writer.Close();
+            result.write_calls = writer.write_calls();
+        } else {
+            bool reference = mode == kModeReference;
+            result.mode = reference ? kModeReference : kModeCopy;
+            webrtc::FileWriterHandle writer("bench_writer", buffer_size_);
+            if (writer.Open(directory_, prefix, ".h264", 0, false) == false)
+                return result;
+            for (int count = 0; result.bytes < total_bytes_; count++) {
+                const rtc::scoped_refptr<webrtc::EncodedImageBuffer> &frame =
+                    GetFrame(count);
+                if (reference)
+                    writer.WriteBack(frame);
+                else
+                    writer.WriteBack(frame->data(), frame->size());
+                result.bytes += frame->size();
+            }
+            // the rest of the buffer is written by Close
+            writer.Close();
+            webrtc::FileWriterStats stats = writer.GetStats();
+            result.write_calls = stats.write_calls;
+            result.syncs = stats.syncs;
+            result.max_sync_time_us = stats.max_sync_time_us;
+        }
+
+        if (sync_) SyncDirectory();
+        result.elapsed_us = TimeMicros() - start_us;
+        RemoveFiles(prefix);
+        return result;
+    }
+
+   private:
+    const rtc::scoped_refptr<webrtc::EncodedImageBuffer> &GetFrame(int count) {
+        if (count % kKeyFramePeriod == 0) return frames_[0];
+        return frames_[1 + count % (kFramePoolSize - 1)];
+    }
+
+    void SyncDirectory() {
+        int fd = ::open(directory_.c_str(), O_RDONLY | O_DIRECTORY);
+        if (fd < 0) return;
+        ::syncfs(fd);
+        ::close(fd);
+    }
+
+    void RemoveFiles(const std::string &prefix) {
+        DIR *dirp = ::opendir(directory_.c_str());
+        if (dirp == nullptr) return;
+        for (struct dirent *dirent = ::readdir(dirp); dirent;
+             dirent = ::readdir(dirp)) {
+            std::string name = dirent->d_name;
+            if (name.compare(0, prefix.size(), prefix) == 0)
+                ::unlink((directory_ + "/" + name).c_str());
+        }
+        ::closedir(dirp);
+    }
+
+    const std::string directory_;
+    const uint64_t total_bytes_;
+    const bool sync_;
+    size_t buffer_size_;
+    std::vector<rtc::scoped_refptr<webrtc::EncodedImageBuffer>> frames_;
+};
+
+void PrintResult(const BenchResult &result) {
+    double seconds = result.elapsed_us > 0 ? result.elapsed_us / 1000000.0 : 1;
+    double mbytes = result.bytes / (1024.0 * 1024.0);
+    printf("%-10s %8.1f MB %7.2f s %8.1f MB/s %9llu writes %10.0f writes/s "
+           "%8.1f KB/write %5llu syncs %7.1f ms max sync\n",
+           result.mode, mbytes, seconds, mbytes / seconds,
+           static_cast<unsigned long long>(result.write_calls),
+           result.write_calls / seconds,
+           result.write_calls
+               ? result.bytes / 1024.0 / result.write_calls
+               : 0.0,
+           static_cast<unsigned long long>(result.syncs),
+           result.max_sync_time_us / 1000.0);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    int total_mbytes = kDefaultTotalMBytes;
+    int p_frame_kbytes = kDefaultPFrameKBytes;
+    std::string mode = kModeAll;
+    bool sync = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:p:m:y")) != -1) {
+        switch (opt) {
+            case 's':
+                total_mbytes = atoi(optarg);
+                break;
+            case 'p':
+                p_frame_kbytes = atoi(optarg);
+                break;
+            case 'm':
+                mode = optarg;
+                break;
+            case 'y':
+                sync = true;
+                break;
+            default:
+                Usage(argv[0]);
+        }
+    }
+    if (argc - optind != 1 || total_mbytes <= 0 || p_frame_kbytes <= 0)
+        Usage(argv[0]);
+    if (mode != kModeLegacy && mode != kModeCopy && mode != kModeReference &&
+        mode != kModeAll)
+        Usage(argv[0]);
+
+    FileWriterBench bench(argv[optind],
+                          static_cast<uint64_t>(total_mbytes) * 1024 * 1024,
+                          static_cast<size_t>(p_frame_kbytes) * 1024, sync);
+    printf("%s: %d MB, P frame %d KB, key frame %d KB%s\n", argv[optind],
+           total_mbytes, p_frame_kbytes, p_frame_kbytes * kKeyFrameRatio,
+           sync ? ", synced" : "");
+
+    std::vector<std::string> modes;
+    if (mode == kModeAll)
+        modes = {kModeLegacy, kModeCopy, kModeReference};
+    else
+        modes = {mode};
+    for (const std::string &bench_mode : modes) {
+        BenchResult result = bench.Run(bench_mode);
+        if (result.elapsed_us == 0) {
+            fprintf(stderr, "Failed to run %s\n", bench_mode.c_str());
+            return 1;
+        }
+        PrintResult(result);
+    }
+    return 0;
+}
@@ -29,17 +29,24 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "file_writer_handle.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+
 #include "rtc_base/checks.h"
 #include "rtc_base/logging.h"
 #include "rtc_base/string_utils.h"
+#include "rtc_base/time_utils.h"
+#include "system_wrappers/include/metrics.h"
 #include "utils.h"
 
 namespace webrtc {
 
 namespace {
 
-constexpr int kWaitPeriodforMotionWriterThread = 10;
-constexpr size_t kFileWriterBufferSize = 1024 * 8;
 constexpr char kTemporaryFileNameExtension[] = ".saving";
 
 }  // namespace
@@ -50,66 +57,121 @@ constexpr char kTemporaryFileNameExtension[] = ".saving";
 //
 ////////////////////////////////////////////////////////////////////////////////
 FileWriterBuffer::FileWriterBuffer(size_t buffer_size)
-    : buffer_size_(buffer_size), offset_start_(0), offset_end_(0) {
-    buffer_.reset(new uint8_t[buffer_size_]);
+    : buffer_size_(0), size_(0), referenced_frames_(0) {
+    // preallocate the blocks for the frame buffer size
+    size_t block_count =
+        (buffer_size + kFileWriterBlockSize - 1) / kFileWriterBlockSize;
+    free_blocks_.reserve(block_count);
+    for (size_t index = 0; index < block_count; index++)
+        free_blocks_.push_back(AllocateBlock());
     RTC_LOG(INFO) << "FileWriterBuffer buffer size " << buffer_size_;
 }
 
-FileWriterBuffer::~FileWriterBuffer() {}
+FileWriterBuffer::~FileWriterBuffer() {
+    clear();
+    for (uint8_t *block : free_blocks_) delete[] block;
+}
 
-size_t FileWriterBuffer::size() {
-    webrtc::MutexLock lock(&mutex_);
-    return offset_end_ - offset_start_;
+uint8_t *FileWriterBuffer::AllocateBlock() {
+    buffer_size_ += kFileWriterBlockSize;
+    return new uint8_t[kFileWriterBlockSize];
 }
 
-void FileWriterBuffer::Resize(double increase_factor) {
-    size_t new_buffer_size =
-        buffer_size_ + static_cast<size_t>(buffer_size_ * increase_factor);
-    uint8_t *new_buffer = new uint8_t[new_buffer_size];
-    if (offset_end_ - offset_start_ > 0) {
-        // copy
-        std::memcpy(new_buffer + offset_start_, buffer_.get() + offset_start_,
-                    offset_end_ - offset_start_);
+void FileWriterBuffer::ReleaseChunk(Chunk *chunk) {
+    if (chunk->block) {
+        free_blocks_.push_back(chunk->block);
+    } else {
+        referenced_frames_--;
     }
-    buffer_.reset(new_buffer);
-    RTC_LOG(INFO) << "FileWriterBuffer resizing " << buffer_size_ << " to "
-                  << new_buffer_size;
-    buffer_size_ = new_buffer_size;
+    chunk->frame = nullptr;
+}
+
+size_t FileWriterBuffer::size() {
+    webrtc::MutexLock lock(&mutex_);
+    return size_;
 }
 
 size_t FileWriterBuffer::WriteBack(const void *buffer, size_t buffer_size) {
-    RTC_DCHECK(offset_end_ >= offset_start_);
     webrtc::MutexLock lock(&mutex_);
-    if (offset_end_ + buffer_size > buffer_size_) Resize();
-    std::memcpy(buffer_.get() + offset_end_, buffer, buffer_size);
-    offset_end_ += buffer_size;  // increase end offset by size
+    const uint8_t *data = static_cast<const uint8_t *>(buffer);
+    size_t remaining = buffer_size;
+
+    while (remaining > 0) {
+        // fill up the last block before taking a new one
+        if (chunks_.empty() || chunks_.back().block == nullptr ||
+            chunks_.back().block_used == kFileWriterBlockSize) {
+            uint8_t *block;
+            if (free_blocks_.empty()) {
+                block = AllocateBlock();
+                RTC_LOG(INFO) << "FileWriterBuffer growing to " << buffer_size_;
+            } else {
+                block = free_blocks_.back();
+                free_blocks_.pop_back();
+            }
+            chunks_.push_back({block, 0, block, 0, nullptr});
+        }
+        Chunk &chunk = chunks_.back();
+        size_t copy_size =
+            std::min(remaining, kFileWriterBlockSize - chunk.block_used);
+        memcpy(chunk.block + chunk.block_used, data, copy_size);
+        chunk.block_used += copy_size;
+        chunk.size += copy_size;
+        data += copy_size;
+        remaining -= copy_size;
+    }
+    size_ += buffer_size;
     return buffer_size;
 }
 
-void FileWriterBuffer::clear() {
+size_t FileWriterBuffer::WriteBack(
+    rtc::scoped_refptr<EncodedImageBufferInterface> frame) {
+    {
+        webrtc::MutexLock lock(&mutex_);
+        if (referenced_frames_ < kFileWriterMaxReferencedFrames) {
+            referenced_frames_++;
+            size_ += frame->size();
+            chunks_.push_back(
+                {frame->data(), frame->size(), nullptr, 0, frame});
+            return frame->size();
+        }
+    }
+    return WriteBack(frame->data(), frame->size());
+}
+
+int FileWriterBuffer::PeekFront(struct iovec *iov, int iov_count) {
     webrtc::MutexLock lock(&mutex_);
-    offset_start_ = offset_end_ = 0;
+    int count = 0;
+    for (auto it = chunks_.begin(); it != chunks_.end() && count < iov_count;
+         ++it) {
+        iov[count].iov_base = const_cast<uint8_t *>(it->data);
+        iov[count].iov_len = it->size;
+        count++;
+    }
+    return count;
 }
 
-size_t FileWriterBuffer::ReadFront(void *buffer, size_t buffer_size) {
-    RTC_DCHECK(offset_end_ >= offset_start_);
+void FileWriterBuffer::Consume(size_t consume_size) {
     webrtc::MutexLock lock(&mutex_);
-    size_t remaining_amount_to_read = offset_end_ - offset_start_;
-
-    if (remaining_amount_to_read > 0) {
-        if (remaining_amount_to_read > buffer_size) {
-            std::memcpy(buffer, buffer_.get() + offset_start_, buffer_size);
-            offset_start_ += buffer_size;
-            return buffer_size;
-        } else {
-            std::memcpy(buffer, buffer_.get() + offset_start_,
-                        remaining_amount_to_read);
-            // there is noting left
-            offset_end_ = offset_start_ = 0;
-            return remaining_amount_to_read;
+    RTC_DCHECK(consume_size <= size_);
+    size_ -= consume_size;
+    while (consume_size > 0 && !chunks_.empty()) {
+        Chunk &chunk = chunks_.front();
+        if (consume_size < chunk.size) {
+            chunk.data += consume_size;
+            chunk.size -= consume_size;
+            return;
         }
+        consume_size -= chunk.size;
+        ReleaseChunk(&chunk);
+        chunks_.pop_front();
     }
-    return 0;
+}
+
+void FileWriterBuffer::clear() {
+    webrtc::MutexLock lock(&mutex_);
+    for (Chunk &chunk : chunks_) ReleaseChunk(&chunk);
+    chunks_.clear();
+    size_ = 0;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -118,7 +180,19 @@ size_t FileWriterBuffer::ReadFront(void *buffer, size_t buffer_size) {
 //
 ////////////////////////////////////////////////////////////////////////////////
 FileWriterHandle::FileWriterHandle(const std::string name, size_t buffer_size)
-    : Event(false, false) {
+    : Event(false, false),
+      pre_event_ring_(nullptr),
+      pre_event_pending_(false),
+      writer_quit_(false),
+      fd_(-1),
+      file_size_limit_(0),
+      file_written_(0),
+      use_temporary_filename_(true),
+      preallocated_(0),
+      preallocate_supported_(true),
+      sync_started_(0),
+      sync_waited_(0),
+      last_commit_ms_(0) {
     name_ = name;
     buffer_.reset(new FileWriterBuffer(buffer_size));
 }
@@ -140,18 +214,33 @@ bool FileWriterHandle::Open(const std::string dirname, const std::string prefix,
 
     RTC_DCHECK(writerThread_.empty() == true);
 
-    int open_error = 0;
-    if ((file_ = FileWrapper::OpenWriteOnly(
-             use_temporary_filename ? filename + kTemporaryFileNameExtension
-                                    : filename,
-             &open_error))
-            .is_open() == false) {
+    // The file is written with writev on the file descriptor, so there is
+    // no stdio buffer between the chunks and the file.
+    const std::string open_filename =
+        use_temporary_filename ? filename + kTemporaryFileNameExtension
+                               : filename;
+    if ((fd_ = ::open(open_filename.c_str(),
+                      O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) < 0) {
         RTC_LOG(LS_ERROR) << "Writer Handle " << name_
                           << " Failed to open file : " << filename
-                          << ", Error: " << open_error;
+                          << ", Error: " << strerror(errno);
         return false;
     };
 
+    // the writer thread starts with the pre-event frames, so the file
+    // states are set before the thread is spawned
+    writer_quit_ = false;
+    filename_ = filename;
+    file_size_limit_ = file_size_limit;
+    file_written_ = 0;
+    use_temporary_filename_ = use_temporary_filename;
+    preallocated_ = sync_started_ = sync_waited_ = 0;
+    preallocate_supported_ = true;
+    last_commit_ms_ = rtc::TimeMillis();
+    stats_ = FileWriterStats();
+    stats_.open_time_us = rtc::TimeMicros();
+    Preallocate(kFileWriterPreallocateSize);
+
     writerThread_ = rtc::PlatformThread::SpawnJoinable(
         [this] {
             while (WriterProcess()) {
@@ -159,48 +248,171 @@ bool FileWriterHandle::Open(const std::string dirname, const std::string prefix,
         },
         "WriterThread",
         rtc::ThreadAttributes().SetPriority(rtc::ThreadPriority::kHigh));
-
-    writer_quit_ = false;
-    filename_ = filename;
-    file_size_limit_ = file_size_limit;
-    file_written_ = 0;
-    use_temporary_filename_ = use_temporary_filename;
     return true;
 }
 
 bool FileWriterHandle::WriterProcess() {
-    if (is_open() == false || writer_quit_ == true) {
-        return false;
+    int64_t wait_ms;
+    {
+        webrtc::MutexLock lock(&writer_lock_);
+        if (fd_ < 0) return false;
+        if (pre_event_ring_ || !file_header_.empty()) WritePreEvent();
+        // Close only signals the thread, and the rest of the file is
+        // written and synced here, not in the thread calling Close.
+        if (writer_quit_ == true) {
+            FinishFile();
+            return false;
+        }
+        wait_ms = last_commit_ms_ + kFileWriterMaxLatencyMs - rtc::TimeMillis();
     }
 
-    if (size() == 0) {
-        Wait(kWaitPeriodforMotionWriterThread);
+    // WriteBack wakes up the thread when the buffer has the commit size,
+    // otherwise the thread waits until the deadline of the buffered data.
+    if (size() < kFileWriterCommitSize && wait_ms > 0) {
+        Wait(static_cast<int>(wait_ms));
     };
 
-    if (is_open() && size()) {
-        webrtc::MutexLock lock(&writer_lock_);
-        Write();
+    webrtc::MutexLock lock(&writer_lock_);
+    if (fd_ < 0 || writer_quit_ == true) return true;
+    int64_t now_ms = rtc::TimeMillis();
+    size_t pending_size = size();
+    size_t commit_size = now_ms - last_commit_ms_ >= kFileWriterMaxLatencyMs
+                             ? pending_size
+                             : AlignedCommitSize(pending_size);
+    if (commit_size > 0) {
+        WriteBuffer(commit_size);
+        stats_.commits++;
+        SyncRange(false);
     }
-
+    // the deadline starts again when the buffer is empty or written
+    if (commit_size > 0 || pending_size == 0) last_commit_ms_ = now_ms;
     return true;
 }
 
-bool FileWriterHandle::Close() {
-    webrtc::MutexLock lock(&writer_lock_);
-    if (file_.is_open()) {
-        RTC_LOG(INFO) << "Closing File: " << filename_
-                      << " , size: " << file_written_;
-        file_.Close();
-
-        // rename the temporary file name to original filename
-        if (use_temporary_filename_) {
-            utils::MoveFile(filename_ + kTemporaryFileNameExtension, filename_);
-        }
+// Returns the size to write, which makes the file offset the multiple of
+// the commit size, or zero when the buffer is not enough.
+size_t FileWriterHandle::AlignedCommitSize(size_t pending_size) const {
+    size_t aligned_end = (file_written_ + pending_size) /
+                         kFileWriterCommitSize * kFileWriterCommitSize;
+    if (aligned_end <= static_cast<size_t>(file_written_)) return 0;
+    return aligned_end - file_written_;
+}
+
+// Preallocates the file extents up to the file size without changing the
+// file size. The unused extents are released when the file is closed.
+void FileWriterHandle::Preallocate(size_t file_size) {
+    if (preallocate_supported_ == false || file_size <= preallocated_) return;
+    if (file_size_limit_ > 0)
+        file_size = std::min(file_size, static_cast<size_t>(file_size_limit_));
+    if (file_size <= preallocated_) return;
+    if (::fallocate(fd_, FALLOC_FL_KEEP_SIZE, preallocated_,
+                    file_size - preallocated_) < 0) {
+        // e.g. the file system does not support fallocate
+        RTC_LOG(LS_WARNING) << "Writer Handle " << name_
+                            << " disables preallocation: " << strerror(errno);
+        preallocate_supported_ = false;
+        return;
     }
+    preallocated_ = file_size;
+}
+
+// Starts the write-back of the data written since the last sync, and waits
+// for the write-back started by the previous sync. So the dirty pages are
+// limited to about two sync sizes. All of the written data is waited for
+// when wait_all is true.
+void FileWriterHandle::SyncRange(bool wait_all) {
+    size_t written = file_written_;
+    if (wait_all == false && written - sync_started_ < kFileWriterSyncSize)
+        return;
+
+    int64_t start_us = rtc::TimeMicros();
+    if (wait_all) {
+        ::fdatasync(fd_);
+    } else {
+        ::sync_file_range(fd_, sync_started_, written - sync_started_,
+                          SYNC_FILE_RANGE_WRITE);
+        if (sync_started_ > sync_waited_)
+            ::sync_file_range(fd_, sync_waited_, sync_started_ - sync_waited_,
+                              SYNC_FILE_RANGE_WAIT_BEFORE |
+                                  SYNC_FILE_RANGE_WRITE |
+                                  SYNC_FILE_RANGE_WAIT_AFTER);
+        sync_waited_ = sync_started_;
+    }
+    sync_started_ = written;
+    if (wait_all) sync_waited_ = written;
+
+    int64_t sync_time_us = rtc::TimeMicros() - start_us;
+    stats_.syncs++;
+    stats_.sync_time_us += sync_time_us;
+    stats_.max_sync_time_us = std::max(stats_.max_sync_time_us, sync_time_us);
+    RTC_HISTOGRAM_COUNTS_10000("WebRTC.Video.RaspiMotion.WriterSyncTimeMs",
+                               static_cast<int>(sync_time_us / 1000));
+}
+
+void FileWriterHandle::LogStats() {
+    int64_t elapsed_ms =
+        std::max<int64_t>((rtc::TimeMicros() - stats_.open_time_us) / 1000, 1);
+    int throughput_kbps = static_cast<int>(
+        stats_.bytes_written * 1000 / 1024 / static_cast<uint64_t>(elapsed_ms));
+    RTC_LOG(INFO) << "Closing File: " << filename_
+                  << " , size: " << file_written_
+                  << ", writes: " << stats_.write_calls
+                  << ", commits: " << stats_.commits << ", avg write(KB): "
+                  << (stats_.write_calls
+                          ? stats_.bytes_written / 1024 / stats_.write_calls
+                          : 0)
+                  << ", throughput(KB/s): " << throughput_kbps
+                  << ", syncs: " << stats_.syncs << ", avg sync(ms): "
+                  << (stats_.syncs ? stats_.sync_time_us / 1000 / stats_.syncs
+                                   : 0)
+                  << ", max sync(ms): " << stats_.max_sync_time_us / 1000;
+    RTC_HISTOGRAM_COUNTS_100000("WebRTC.Video.RaspiMotion.WriterThroughputKBps",
+                                throughput_kbps);
+}
 
-    if (!writerThread_.empty()) {
+// Writes the rest of the file and closes it, called by the writer thread
+// when the file is closed.
+void FileWriterHandle::FinishFile() {
+    // the pre-event frames are not written yet when the file is closed right
+    // after Open, and the rest of the buffer is written so that it does not
+    // go into the next file
+    if (pre_event_ring_ || !file_header_.empty()) WritePreEvent();
+    Write();
+    SyncRange(true);
+    LogStats();
+    // release the preallocated extents over the file size
+    if (preallocated_ > static_cast<size_t>(file_written_) &&
+        ::ftruncate(fd_, file_written_) < 0)
+        RTC_LOG(LS_WARNING) << "Writer Handle " << name_
+                            << " failed to truncate : " << filename_;
+    ::close(fd_);
+    fd_ = -1;
+
+    // rename the temporary file name to original filename
+    if (use_temporary_filename_) {
+        utils::MoveFile(filename_ + kTemporaryFileNameExtension, filename_);
+    }
+}
+
+bool FileWriterHandle::Close() {
+    {
+        webrtc::MutexLock lock(&writer_lock_);
         writer_quit_ = true;
-        writerThread_.Finalize();
+    }
+    // wake up the writer thread waiting for the deadline, and the thread
+    // finishes the file.
+    Set();
+
+    // The writer thread is joined without the writer lock, since the thread
+    // may be waiting for the lock to find out the file is closed.
+    if (!writerThread_.empty()) writerThread_.Finalize();
+    {
+        webrtc::MutexLock lock(&writer_lock_);
+        if (fd_ >= 0) FinishFile();  // the writer thread is not running
+        pre_event_ring_ = nullptr;
+        pre_event_pending_ = false;
+        file_header_.clear();
+        buffer_->clear();
     }
     filename_.clear();
     file_size_limit_ = file_written_ = 0;
@@ -208,46 +420,143 @@ bool FileWriterHandle::Close() {
     return true;
 }
 
+bool FileWriterHandle::Abort() {
+    const std::string filename = filename_;
+    {
+        webrtc::MutexLock lock(&writer_lock_);
+        pre_event_ring_ = nullptr;
+        pre_event_pending_ = false;
+        file_header_.clear();
+        buffer_->clear();
+    }
+    Close();
+    if (!filename.empty() && utils::DeleteFile(filename) == false)
+        RTC_LOG(LS_ERROR) << "Writer Handle " << name_
+                          << " failed to remove file : " << filename;
+    return true;
+}
+
+// Writes all of the iovecs, writev may write them partially.
+bool FileWriterHandle::WriteVector(struct iovec *iov, int iov_count) {
+    while (iov_count > 0) {
+        ssize_t written = ::writev(fd_, iov, iov_count);
+        stats_.write_calls++;
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        stats_.bytes_written += written;
+        RTC_HISTOGRAM_COUNTS_10000("WebRTC.Video.RaspiMotion.WriterWriteSizeKB",
+                                   static_cast<int>(written / 1024));
+        while (iov_count > 0 && static_cast<size_t>(written) >= iov->iov_len) {
+            written -= iov->iov_len;
+            iov++;
+            iov_count--;
+        }
+        if (iov_count > 0) {
+            iov->iov_base = static_cast<uint8_t *>(iov->iov_base) + written;
+            iov->iov_len -= written;
+        }
+    }
+    return true;
+}
+
 bool FileWriterHandle::Write() {
-    if (file_.is_open() == false) {
+    if (fd_ < 0) {
         RTC_LOG(LS_ERROR) << "Writer Handle " << name_
                           << " file handle is not opened.";
         return false;
     }
+    return WriteBuffer(size());
+}
 
-    uint8_t buf[kFileWriterBufferSize];
-
-    // limit the file size
-    if (file_size_limit_ != 0 /* no limit */ &&
-        file_written_ > file_size_limit_) {
-        // comsume the buffer without file writing
-        while (size_t read_size =
-                   buffer_->ReadFront(buf, kFileWriterBufferSize)) {
+// Writes the front of the buffer up to the write limit
+bool FileWriterHandle::WriteBuffer(size_t write_limit) {
+    struct iovec iov[kFileWriterMaxIovecs];
+    while (write_limit > 0) {
+        int iov_count = buffer_->PeekFront(iov, kFileWriterMaxIovecs);
+        if (iov_count == 0) break;
+        size_t write_size = 0;
+        for (int index = 0; index < iov_count; index++) {
+            if (write_size + iov[index].iov_len >= write_limit) {
+                iov[index].iov_len = write_limit - write_size;
+                iov_count = index + 1;
+            }
+            write_size += iov[index].iov_len;
         }
-        return true;
-    }
-
-    while (size_t read_size = buffer_->ReadFront(buf, kFileWriterBufferSize)) {
-        if (file_.Write(buf, read_size) == false) {
-            RTC_LOG(LS_ERROR)
-                << "Writer Handle " << name_
-                << "Failed to write buffer to file : " << filename_;
-            return false;
+        size_t file_size = file_written_ + write_size;
+        if (file_size > preallocated_)
+            Preallocate(file_size + kFileWriterPreallocateSize);
+
+        // limit the file size, comsume the buffer without file writing
+        if (file_size_limit_ == 0 /* no limit */ ||
+            file_written_ <= file_size_limit_) {
+            if (WriteVector(iov, iov_count) == false) {
+                RTC_LOG(LS_ERROR)
+                    << "Writer Handle " << name_
+                    << "Failed to write buffer to file : " << filename_
+                    << ", Error: " << strerror(errno);
+                return false;
+            }
+            file_written_ += write_size;
         }
-        file_written_ += read_size;
+        buffer_->Consume(write_size);
+        write_limit -= write_size;
     }
     return true;
 }
 
-void FileWriterHandle::Flush() {
-    if (file_.is_open()) {
-        Write();
-        file_.Flush();
+void FileWriterHandle::SetPreEventRing(const GopRing *pre_event_ring) {
+    webrtc::MutexLock lock(&writer_lock_);
+    pre_event_ring_ = pre_event_ring;
+    pre_event_pending_ = pre_event_ring != nullptr;
+}
+
+void FileWriterHandle::SetFileHeader(const std::vector<uint8_t> &file_header) {
+    webrtc::MutexLock lock(&writer_lock_);
+    file_header_ = file_header;
+}
+
+// Writes the file header and the pre-event ring with one writev
+bool FileWriterHandle::WritePreEvent() {
+    GopRing::Span spans[2];
+    struct iovec iov[3];
+    int iov_count = 0;
+    if (!file_header_.empty()) {
+        iov[iov_count].iov_base = file_header_.data();
+        iov[iov_count++].iov_len = file_header_.size();
+    }
+    int span_count = pre_event_ring_ ? pre_event_ring_->GetSpans(spans) : 0;
+    for (int index = 0; index < span_count; index++) {
+        iov[iov_count].iov_base = const_cast<uint8_t *>(spans[index].data);
+        iov[iov_count++].iov_len = spans[index].size;
     }
+
+    size_t write_size = 0;
+    for (int index = 0; index < iov_count; index++)
+        write_size += iov[index].iov_len;
+    bool result = iov_count == 0 || WriteVector(iov, iov_count);
+    pre_event_ring_ = nullptr;
+    pre_event_pending_ = false;
+    file_header_.clear();
+    if (result == false) {
+        RTC_LOG(LS_ERROR) << "Writer Handle " << name_
+                          << "Failed to write pre-event frames to file : "
+                          << filename_ << ", Error: " << strerror(errno);
+        return false;
+    }
+    file_written_ += write_size;
+    return true;
+}
+
+FileWriterStats FileWriterHandle::GetStats() {
+    webrtc::MutexLock lock(&writer_lock_);
+    return stats_;
 }
 
-size_t FileWriterHandle::ReadFront(void *buffer, size_t size) {
-    return buffer_->ReadFront(buffer, size);
+void FileWriterHandle::Flush() {
+    webrtc::MutexLock lock(&writer_lock_);
+    if (fd_ >= 0) Write();
 }
 
 size_t FileWriterHandle::WriteBack(const void *buffer, size_t size) {
@@ -257,10 +566,17 @@ size_t FileWriterHandle::WriteBack(const void *buffer, size_t size) {
             << "Internal Error: FileWriterBuffer size mismatching";
         return write_back_size;
     };
-    Set();
+    if (buffer_->size() >= kFileWriterCommitSize) Set();
     return size;
 }
 
+size_t FileWriterHandle::WriteBack(
+    rtc::scoped_refptr<EncodedImageBufferInterface> frame) {
+    size_t write_back_size = buffer_->WriteBack(frame);
+    if (buffer_->size() >= kFileWriterCommitSize) Set();
+    return write_back_size;
+}
+
 void FileWriterHandle::clear() { return buffer_->clear(); }
 
 size_t FileWriterHandle::size() { return buffer_->size(); }
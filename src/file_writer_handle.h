@@ -30,25 +30,66 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef FILE_WRITER_HANDLE_H_
 #define FILE_WRITER_HANDLE_H_
 
+#include <sys/uio.h>
+
+#include <atomic>
+#include <deque>
 #include <memory>
 #include <mutex>
 #include <thread>
+#include <vector>
 
+#include "api/scoped_refptr.h"
+#include "api/video/encoded_image.h"
+#include "gop_ring.h"
 #include "rtc_base/constructor_magic.h"
 #include "rtc_base/event.h"
 #include "rtc_base/platform_thread.h"
 #include "rtc_base/synchronization/mutex.h"
-#include "rtc_base/system/file_wrapper.h"
 #include "rtc_base/thread.h"
 
 namespace webrtc {
 
-constexpr double kDefaultBufferIncreaaseFactor = 0.25;
+// Size of the pooled blocks of FileWriterBuffer
+constexpr size_t kFileWriterBlockSize = 64 * 1024;
+// Maximum number of frames held by reference in FileWriterBuffer. The frame
+// may hold the encoder buffer, so the frames over the limit are copied.
+constexpr size_t kFileWriterMaxReferencedFrames = 2;
+// Maximum number of chunks written by one writev
+constexpr int kFileWriterMaxIovecs = 64;
+// The writer thread wakes up when the buffer has the commit size, and writes
+// the buffer in the multiple of the commit size aligned to the file offset.
+constexpr size_t kFileWriterCommitSize = 128 * 1024;
+// Maximum time the data stays in the buffer before it is written
+constexpr int kFileWriterMaxLatencyMs = 500;
+// The file extents are preallocated in this size when the file is opened and
+// whenever the file grows over the preallocated size.
+constexpr size_t kFileWriterPreallocateSize = 4 * 1024 * 1024;
+// The write-back of the written data is started in this size, and the
+// previous range is waited for at the same time.
+constexpr size_t kFileWriterSyncSize = 1024 * 1024;
+
+// Writer statistics of the current file
+struct FileWriterStats {
+    uint64_t bytes_written = 0;
+    uint64_t write_calls = 0;
+    uint64_t commits = 0;
+    uint64_t syncs = 0;
+    int64_t sync_time_us = 0;
+    int64_t max_sync_time_us = 0;
+    int64_t open_time_us = 0;
+};
 
 ////////////////////////////////////////////////////////////////////////////////
 //
 // FileWriter Buffer
 //
+// List of chunks waiting for the file writing. The data is copied into the
+// fixed size blocks of the pool, or the frame is held by reference without
+// copying. The writer thread writes the front chunks with one writev and
+// consumes them afterwards, so the producer is not blocked during the file
+// writing.
+//
 ////////////////////////////////////////////////////////////////////////////////
 
 class FileWriterBuffer {
@@ -56,20 +97,39 @@ class FileWriterBuffer {
     explicit FileWriterBuffer(size_t buffer_size /* frame buffer size */);
     ~FileWriterBuffer();
 
-    size_t ReadFront(void *buffer, size_t size);
+    // Copy the data into the pooled blocks
     size_t WriteBack(const void *buffer, size_t size);
+    // Hold the frame by reference, the frame is copied when there are
+    // kFileWriterMaxReferencedFrames frames held already.
+    size_t WriteBack(rtc::scoped_refptr<EncodedImageBufferInterface> frame);
+
+    // Fills the iovecs with the front chunks and returns the number of them.
+    // The chunks stay in the buffer until they are consumed.
+    int PeekFront(struct iovec *iov, int iov_count);
+    void Consume(size_t size);
 
     size_t size();
+    // memory of the block pool
     inline size_t buffer_size() const { return buffer_size_; }
     void clear();
 
    private:
-    void Resize(double increase_factor = kDefaultBufferIncreaaseFactor);
-    webrtc::Mutex mutex_;
+    struct Chunk {
+        const uint8_t *data;
+        size_t size;
+        uint8_t *block;     // pooled block, null for the referenced frame
+        size_t block_used;  // bytes used in the block
+        rtc::scoped_refptr<EncodedImageBufferInterface> frame;
+    };
+    uint8_t *AllocateBlock();
+    void ReleaseChunk(Chunk *chunk);
 
+    webrtc::Mutex mutex_;
     size_t buffer_size_;
-    size_t offset_start_, offset_end_;
-    std::unique_ptr<uint8_t[]> buffer_;
+    size_t size_;
+    size_t referenced_frames_;
+    std::deque<Chunk> chunks_;
+    std::vector<uint8_t *> free_blocks_;
 
     RTC_DISALLOW_COPY_AND_ASSIGN(FileWriterBuffer);
 };
@@ -78,6 +138,13 @@ class FileWriterBuffer {
 //
 // FileWriter Handle
 //
+// The writer thread commits the buffer in the aligned commit size, when the
+// buffer has the commit size or the oldest data in the buffer reaches the
+// maximum latency. The file extents are preallocated with fallocate, and the
+// written data is pushed to the storage with sync_file_range on every sync
+// size, so the write-back is spread over the recording instead of the burst
+// at the file close.
+//
 ////////////////////////////////////////////////////////////////////////////////
 
 class FileWriterHandle : public rtc::Event {
@@ -89,30 +156,66 @@ class FileWriterHandle : public rtc::Event {
               const std::string extension, const int file_size_limit,
               const bool use_temporary_filename = true);
     bool Close();
+    // Closes the file without writing the rest of the buffer, and removes it
+    bool Abort();
     bool Write();
     void Flush();
+    // The contents of the pre-event ring are written to the file by the writer
+    // thread before the buffer, directly from the ring. It is used only by
+    // the next Open and the ring must not be modified until Close.
+    void SetPreEventRing(const GopRing *pre_event_ring);
+    // True until the pre-event ring is written, read without the writer
+    // lock, so the owner of the ring does not wait for the file writing.
+    inline bool pre_event_pending() const { return pre_event_pending_; }
+    // The header is written at the beginning of the file opened next, before
+    // the pre-event ring.
+    void SetFileHeader(const std::vector<uint8_t> &file_header);
     FileWriterBuffer *GetBuffer();
-    inline bool is_open() { return file_.is_open(); }
+    inline bool is_open() { return fd_ >= 0; }
     inline size_t FileSize() { return file_written_; }
+    // full path of the opened file, empty when the file is not opened
+    inline const std::string &filename() const { return filename_; }
+    // number of write system calls of the current file
+    inline uint64_t write_calls() const { return stats_.write_calls; }
+    FileWriterStats GetStats();
 
     // interface for buffer
-    size_t ReadFront(void *buffer, size_t size);
     size_t WriteBack(const void *buffer, size_t size);
+    size_t WriteBack(rtc::scoped_refptr<EncodedImageBufferInterface> frame);
     void clear();   // remove all of contents in file writer buffer
     size_t size();  // file writer buffer size
 
    private:
     bool WriterProcess();
+    bool WritePreEvent();
+    void FinishFile();
+    bool WriteBuffer(size_t write_limit);
+    bool WriteVector(struct iovec *iov, int iov_count);
+    size_t AlignedCommitSize(size_t pending_size) const;
+    void Preallocate(size_t file_size);
+    void SyncRange(bool wait_all);
+    void LogStats();
     std::unique_ptr<FileWriterBuffer> buffer_;
+    const GopRing *pre_event_ring_;     // guarded by writer_lock_
+    std::atomic<bool> pre_event_pending_;
+    std::vector<uint8_t> file_header_;  // guarded by writer_lock_
     // thread for file writing
     rtc::PlatformThread writerThread_;
-    bool writer_quit_;
+    bool writer_quit_;  // guarded by writer_lock_
     webrtc::Mutex writer_lock_;
-    FileWrapper file_;
+    int fd_;
     std::string filename_;
     int file_size_limit_;
     int file_written_;
     bool use_temporary_filename_;
+    // file offsets of the preallocation and the write-back, and the time of
+    // the last commit, guarded by writer_lock_
+    size_t preallocated_;
+    bool preallocate_supported_;
+    size_t sync_started_;
+    size_t sync_waited_;
+    int64_t last_commit_ms_;
+    FileWriterStats stats_;  // guarded by writer_lock_
     std::string name_;
 
     RTC_DISALLOW_COPY_AND_ASSIGN(FileWriterHandle);
@@ -0,0 +1,223 @@
+/*
+Copyright (c) 2021, rpi-webrtc-streamer Lyu,KeunChang
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Benchmark of the copy and the zero copy path of FrameQueue. The frames are
+// written back from the fake MMAL pool like the encoder callback does, and
+// read by a subscriber which reads the whole payload like the packetizer:
+//
+//  - zero copy: single part frames, the subscriber reads the payload of the
+//    buffer header of the pool
+//  - copy: the same frame in two parts like MMAL delivers the frame larger
+//    than the port buffer, coalesced into the frame slab
+//
+// The time of the write back(in the encoder callback thread) and of the read
+// of the frame and its payload(in the subscriber thread) per frame are
+// reported for each frame size, the headers are filled before the timing.
+// The MMAL libraries are not needed, so it runs on the x86 host with the
+// objects built for the host as well as on the Raspberry PI.
+//
+// Usage: frame_copy_bench [-n frames] [-m copy|zero|all] [frame_kbytes ...]
+//
+// Build with 'make frame_copy_bench' in src directory.
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "check/fake_mmal.h"
+#include "frame_queue.h"
+
+namespace {
+
+const int kDefaultFrames = 3000;
+const int kDefaultFrameKBytes[] = {4, 16, 64, 256};
+const int kPoolHeaders = 8;
+const size_t kQueueCapacity = 16;
+
+const char kModeCopy[] = "copy";
+const char kModeZero[] = "zero";
+const char kModeAll[] = "all";
+
+int64_t TimeNanos() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+void Usage(const char *program) {
+    fprintf(stderr,
+            "Usage: %s [-n frames] [-m copy|zero|all] [frame_kbytes ...]\n",
+            program);
+    exit(1);
+}
+
+// FrameQueue with the encoder callback of MMALEncoderWrapper
+class EncoderFrameQueue : public webrtc::FrameQueue {
+   public:
+    explicit EncoderFrameQueue(size_t buffer_size) {
+        Init(kQueueCapacity, buffer_size);
+    }
+
+    bool Deliver(MMAL_BUFFER_HEADER_T *header) {
+        mmal_buffer_header_mem_lock(header);
+        bool result = WriteBack(header);
+        mmal_buffer_header_mem_unlock(header);
+        mmal_buffer_header_release(header);
+        return result;
+    }
+};
+
+MMAL_BOOL_T PoolCallback(MMAL_POOL_T *pool, MMAL_BUFFER_HEADER_T *header,
+                         void *userdata) {
+    return MMAL_TRUE;
+}
+
+// P slice NAL unit filling the header
+void FillHeader(MMAL_BUFFER_HEADER_T *header, size_t length, uint32_t flags,
+                bool nal_start) {
+    static const uint8_t kSliceStart[] = {0, 0, 0, 1, 0x41};
+    memset(header->data, 0x55, length);
+    if (nal_start) memcpy(header->data, kSliceStart, sizeof(kSliceStart));
+    header->offset = 0;
+    header->length = length;
+    header->flags = flags;
+    header->pts = header->dts = MMAL_TIME_UNKNOWN;
+}
+
+struct BenchResult {
+    double write_back_ns;  // per frame
+    double read_ns;        // per frame, reading the frame and its payload
+};
+
+bool Run(bool zero_copy, size_t frame_size, int frames,
+         BenchResult *result) {
+    check::FakeMmalPool pool(kPoolHeaders, frame_size);
+    mmal_pool_callback_set(pool.pool(), PoolCallback, nullptr);
+    EncoderFrameQueue queue(frame_size);
+    std::unique_ptr<webrtc::FrameSubscriber> subscriber =
+        queue.Subscribe("bench");
+    int64_t write_back_ns = 0, read_ns = 0;
+    uint32_t checksum = 0;
+
+    for (int frame = 0; frame < frames; frame++) {
+        // The encoder fills the headers before the callback
+        std::vector<MMAL_BUFFER_HEADER_T *> parts;
+        if (zero_copy) {
+            parts.push_back(pool.Get());
+            FillHeader(parts[0], frame_size,
+                       MMAL_BUFFER_HEADER_FLAG_FRAME_END, true);
+        } else {
+            size_t first_size = frame_size / 2;
+            parts.push_back(pool.Get());
+            FillHeader(parts[0], first_size, 0, true);
+            parts.push_back(pool.Get());
+            FillHeader(parts[1], frame_size - first_size,
+                       MMAL_BUFFER_HEADER_FLAG_FRAME_END, false);
+        }
+
+        int64_t start_ns = TimeNanos();
+        for (MMAL_BUFFER_HEADER_T *header : parts)
+            if (queue.Deliver(header) == false) return false;
+        int64_t read_start_ns = TimeNanos();
+        write_back_ns += read_start_ns - start_ns;
+
+        rtc::scoped_refptr<webrtc::FrameBuffer> buffer =
+            subscriber->ReadFront(false);
+        if (buffer == nullptr) return false;
+        const uint8_t *data = buffer->data();
+        for (size_t index = 0; index < buffer->length(); index++)
+            checksum += data[index];
+        buffer = nullptr;
+        read_ns += TimeNanos() - read_start_ns;
+    }
+
+    // keeps the read of the payload
+    if (checksum == 0) printf("checksum: 0\n");
+    result->write_back_ns = static_cast<double>(write_back_ns) / frames;
+    result->read_ns = static_cast<double>(read_ns) / frames;
+    return pool.queue_length() == kPoolHeaders;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    int frames = kDefaultFrames;
+    std::string mode = kModeAll;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:m:")) != -1) {
+        switch (opt) {
+            case 'n':
+                frames = atoi(optarg);
+                break;
+            case 'm':
+                mode = optarg;
+                break;
+            default:
+                Usage(argv[0]);
+        }
+    }
+    if (frames <= 0) Usage(argv[0]);
+    if (mode != kModeCopy && mode != kModeZero && mode != kModeAll)
+        Usage(argv[0]);
+
+    std::vector<int> frame_kbytes;
+    for (int index = optind; index < argc; index++) {
+        frame_kbytes.push_back(atoi(argv[index]));
+        if (frame_kbytes.back() <= 0) Usage(argv[0]);
+    }
+    if (frame_kbytes.empty())
+        frame_kbytes.assign(std::begin(kDefaultFrameKBytes),
+                            std::end(kDefaultFrameKBytes));
+
+    printf("%-6s %8s %16s %16s\n", "mode", "frame", "write back(ns)",
+           "read(ns)");
+    for (int kbytes : frame_kbytes) {
+        for (const std::string &run :
+             {std::string(kModeZero), std::string(kModeCopy)}) {
+            if (mode != kModeAll && mode != run) continue;
+            BenchResult result;
+            if (Run(run == kModeZero, kbytes * 1024, frames, &result) ==
+                false) {
+                fprintf(stderr, "%s %d KB: frame lost or header leaked\n",
+                        run.c_str(), kbytes);
+                return 1;
+            }
+            printf("%-6s %6dKB %16.0f %16.0f\n", run.c_str(), kbytes,
+                   result.write_back_ns, result.read_ns);
+        }
+    }
+    return 0;
+}
@@ -29,44 +29,186 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "frame_queue.h"
 
+#include <errno.h>
+#include <poll.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <utility>
 
 #include "mmal_wrapper.h"
 #include "rtc_base/checks.h"
 #include "rtc_base/logging.h"
+#include "rtc_base/ref_counted_object.h"
 #include "rtc_base/string_utils.h"
 #include "rtc_base/task_queue.h"
+#include "rtc_base/time_utils.h"
 
 namespace webrtc {
 
+namespace {
+// period renewing the offset between MMAL pts and the system clock
+constexpr int64_t kPtsOffsetWindowUs = 10 * 1000 * 1000;
+// bytes of the slice passed to the parser for the slice header
+constexpr size_t kSliceHeaderParseSize = 128;
+}  // namespace
+
 ////////////////////////////////////////////////////////////////////////////////
 //
 // Frame Buffer
 //
 ////////////////////////////////////////////////////////////////////////////////
-bool FrameBuffer::copy(const MMAL_BUFFER_HEADER_T *buffer) {
+rtc::scoped_refptr<FrameBuffer> FrameBuffer::Create(
+    MMAL_BUFFER_HEADER_T *buffer) {
+    return new rtc::RefCountedObject<FrameBuffer>(buffer);
+}
+
+rtc::scoped_refptr<FrameBuffer> FrameBuffer::Create(
+    rtc::scoped_refptr<FrameSlab> slab, size_t size) {
+    rtc::scoped_refptr<FrameBuffer> buffer =
+        new rtc::RefCountedObject<FrameBuffer>(slab, size);
+    if (buffer->data_ == nullptr) return nullptr;
+    return buffer;
+}
+
+rtc::scoped_refptr<FrameBuffer> FrameBuffer::Create(size_t capacity) {
+    return new rtc::RefCountedObject<FrameBuffer>(capacity);
+}
+
+FrameBuffer::FrameBuffer(MMAL_BUFFER_HEADER_T *buffer)
+    : header_(buffer),
+      flags_(buffer->flags),
+      capacity_(buffer->alloc_size),
+      sequence_(0),
+      pts_(buffer->pts),
+      dts_(buffer->dts),
+      capture_time_us_(-1),
+      nal_count_(0),
+      qp_(-1) {
     RTC_DCHECK(buffer != nullptr)
         << "Internal Error, MMAL Buffer pointer is NULL";
-    RTC_DCHECK(buffer->length < capacity_)
-        << "Internal Error, Frame Buffer capacity is smaller then buffer "
-           "capacity";
-    flags_ = buffer->flags;
-    std::memcpy(data_, buffer->data, buffer->length);
-    length_ = buffer->length;
-    // RTC_LOG(INFO) << "Frame copy : " << toString()
-    //              << ", size: " << buffer->length;
-    return true;
+    // keep the buffer header out of the encoder pool until the frame
+    // is released
+    mmal_buffer_header_acquire(header_);
+    mmal_buffer_header_mem_lock(header_);
+    data_ = header_->data + header_->offset;
+    length_ = header_->length;
+}
+
+FrameBuffer::FrameBuffer(size_t capacity)
+    : header_(nullptr),
+      length_(0),
+      capacity_(capacity),
+      sequence_(0),
+      pts_(MMAL_TIME_UNKNOWN),
+      dts_(MMAL_TIME_UNKNOWN),
+      capture_time_us_(-1),
+      nal_count_(0),
+      qp_(-1) {
+    data_ = static_cast<uint8_t *>(malloc(capacity));
+}
+
+FrameBuffer::FrameBuffer(rtc::scoped_refptr<FrameSlab> slab, size_t size)
+    : header_(nullptr),
+      slab_(slab),
+      length_(0),
+      capacity_(0),
+      sequence_(0),
+      pts_(MMAL_TIME_UNKNOWN),
+      dts_(MMAL_TIME_UNKNOWN),
+      capture_time_us_(-1),
+      nal_count_(0),
+      qp_(-1) {
+    data_ = slab_->Allocate(size, &capacity_);
+}
+
+FrameBuffer::~FrameBuffer() {
+    if (header_) {
+        mmal_buffer_header_mem_unlock(header_);
+        // the buffer header will be sent back to the encoder port by the
+        // encoder pool callback
+        mmal_buffer_header_release(header_);
+    } else if (slab_) {
+        if (data_) slab_->Free(data_, capacity_);
+    } else {
+        free(data_);
+    }
+}
+
+size_t FrameBuffer::IndexNalUnits() {
+    nal_count_ = 0;
+    nal_types_.reset();
+    if (length_ < 3) return 0;
+
+    // Searching the '1' of the '00 00 01' start code with memchr, which is
+    // vectorized in libc, then checks the two zero bytes before it.
+    const uint8_t *end = data_ + length_;
+    const uint8_t *cur = data_ + 2;
+    while (cur < end) {
+        const uint8_t *one =
+            static_cast<const uint8_t *>(memchr(cur, 1, end - cur));
+        if (one == nullptr) break;
+        cur = one + 1;
+        if (one[-1] != 0 || one[-2] != 0) continue;
+        if (nal_count_ == kMaxNalUnitIndex) {
+            RTC_LOG(LS_WARNING) << "Too many NAL units in the frame, "
+                                << "the rest is included in the last one";
+            break;
+        }
+
+        const uint8_t *start = one - 2;
+        // 4 bytes start code
+        if (start > data_ && start[-1] == 0) start--;
+        if (nal_count_ > 0) {
+            NalUnitIndex &prev = nal_units_[nal_count_ - 1];
+            prev.payload_size = (start - data_) - prev.payload_offset;
+        }
+        NalUnitIndex &nal = nal_units_[nal_count_++];
+        nal.start_offset = start - data_;
+        nal.payload_offset = cur - data_;
+        nal.payload_size = 0;
+        nal.type = cur < end ? (*cur & H264::kNaluTypeMask) : 0;
+        nal_types_[nal.type] = true;
+    }
+    if (nal_count_ > 0) {
+        NalUnitIndex &last = nal_units_[nal_count_ - 1];
+        last.payload_size = length_ - last.payload_offset;
+    }
+    return nal_count_;
+}
+
+bool FrameBuffer::copy(const MMAL_BUFFER_HEADER_T *buffer) {
+    length_ = 0;
+    pts_ = dts_ = MMAL_TIME_UNKNOWN;
+    return append(buffer);
 }
 
 bool FrameBuffer::append(const MMAL_BUFFER_HEADER_T *buffer) {
     RTC_DCHECK(buffer != nullptr)
         << "Internal Error, MMAL Buffer pointer is NULL";
-    RTC_DCHECK(buffer->length + length_ < capacity_)
+    RTC_DCHECK(header_ == nullptr)
+        << "Internal Error, MMAL Buffer header can not be appended";
+    if (slab_ && buffer->length + length_ > capacity_) {
+        // grows to the larger size class
+        uint8_t *data =
+            slab_->Grow(data_, length_, buffer->length + length_, &capacity_);
+        if (data == nullptr) return false;
+        data_ = data;
+    }
+    RTC_DCHECK(buffer->length + length_ <= capacity_)
         << "Internal Error, Frame Buffer capacity is smaller then buffer "
            "capacity";
     flags_ = buffer->flags;
-    std::memcpy(data_ + length_, buffer->data, buffer->length);
+    // config frame has no timestamp, so the first known one is used
+    if (pts_ == MMAL_TIME_UNKNOWN) {
+        pts_ = buffer->pts;
+        dts_ = buffer->dts;
+    }
+    std::memcpy(data_ + length_, buffer->data + buffer->offset,
+                buffer->length);
     length_ += buffer->length;
     // RTC_LOG(INFO) << "Frame append : " << toString()
     //              << ", size: " << buffer->length;
@@ -75,77 +217,354 @@ bool FrameBuffer::append(const MMAL_BUFFER_HEADER_T *buffer) {
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Frame Queue
+// Frame Subscriber
 //
 ////////////////////////////////////////////////////////////////////////////////
-int FrameQueue::kEventWaitPeriod = 10;  // minimal wait period between frame
+FrameSubscriber::FrameSubscriber(FrameQueue *queue, const std::string &name,
+                                 int channels)
+    : queue_(queue),
+      name_(name),
+      channels_(channels),
+      event_fd_(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)),
+      // the ring can not hold more frames than the encoder pool
+      video_ring_(VIDEO_ENCODER_OUTPUT_BUFFERS_NUM),
+      imv_ring_(kImvBufferNum),
+      flush_requested_(false),
+      received_(0),
+      dropped_(0),
+      chains_dropped_(0),
+      keyframe_requests_(0),
+      max_lag_(0),
+      keyframe_requested_(false),
+      drop_sequence_(0),
+      chain_dropping_(false) {
+    RTC_CHECK(event_fd_ >= 0) << "Failed to create eventfd: " << errno;
+}
 
-FrameQueue::FrameQueue() : Event(false, false), inited_(false) {}
+FrameSubscriber::~FrameSubscriber() {
+    queue_->Unsubscribe(this);
+    close(event_fd_);
+}
 
-FrameQueue::FrameQueue(size_t capacity, size_t buffer_size)
-    : Event(false, false),
-      inited_(true),
-      capacity_(capacity),
-      buffer_size_(buffer_size) {
-    for (size_t index = 0; index < capacity_; index++) {
-        FrameBuffer *buffer = new FrameBuffer(buffer_size_);
-        free_list_.push_back(buffer);
+rtc::scoped_refptr<FrameBuffer> FrameSubscriber::ReadFront(
+    bool wait_until_timeout) {
+    rtc::scoped_refptr<FrameBuffer> buffer;
+
+    if (keyframe_requested_.exchange(false) == true) {
+        keyframe_requests_++;
+        queue_->RequestKeyFrame();
     }
+    if (flush_requested_.exchange(false) == true) DropAll();
+
+    if (Pop(&buffer) == false) {
+        if (wait_until_timeout == false) return nullptr;
+        // The producer writes eventfd after pushing the frame, so the frame
+        // pushed after the Pop above wakes up the poll immediately.
+        struct pollfd pfd = {event_fd_, POLLIN, 0};
+        if (poll(&pfd, 1, FrameQueue::kEventWaitPeriod) <= 0) return nullptr;
+        uint64_t count;
+        if (read(event_fd_, &count, sizeof(count)) < 0 && errno != EAGAIN)
+            RTC_LOG(LS_ERROR) << "Failed to read eventfd: " << errno;
+        if (flush_requested_.exchange(false) == true) {
+            DropAll();
+            return nullptr;
+        }
+        if (Pop(&buffer) == false) return nullptr;
+    }
+    received_++;
+    return buffer;
 }
 
-void FrameQueue::Init(size_t capacity, size_t buffer_size) {
-    capacity_ = capacity;
-    buffer_size_ = buffer_size;
-    inited_ = true;
-    destroy();
-    for (size_t index = 0; index < capacity_; index++) {
-        FrameBuffer *buffer = new FrameBuffer(buffer_size_);
-        free_list_.push_back(buffer);
+bool FrameSubscriber::Pop(rtc::scoped_refptr<FrameBuffer> *buffer) {
+    while (true) {
+        const rtc::scoped_refptr<FrameBuffer> *video = video_ring_.Front();
+        const rtc::scoped_refptr<FrameBuffer> *imv = imv_ring_.Front();
+        bool popped;
+
+        // The motion vector is read after the video frame of the same
+        // sequence
+        if (imv &&
+            (video == nullptr || (*imv)->sequence() < (*video)->sequence()))
+            popped = imv_ring_.Pop(buffer);
+        else
+            popped = video_ring_.Pop(buffer);
+        if (popped == false) return false;
+
+        // The frames queued before the overflow belong to the dropped
+        // reference chain.
+        if ((*buffer)->sequence() > drop_sequence_.load()) return true;
+        *buffer = nullptr;
+        dropped_++;
     }
 }
 
-void FrameQueue::destroy() {
-    for (FrameBuffer *buffer : pending_) {
-        delete buffer;
+void FrameSubscriber::DropAll() {
+    rtc::scoped_refptr<FrameBuffer> buffer;
+    while (video_ring_.Pop(&buffer)) buffer = nullptr;
+    while (imv_ring_.Pop(&buffer)) buffer = nullptr;
+}
+
+bool FrameSubscriber::Push(int channel, rtc::scoped_refptr<FrameBuffer> buffer,
+                           size_t capacity) {
+    if (channel == kFrameChannelImv) {
+        if (imv_ring_.size() >= capacity ||
+            imv_ring_.Push(std::move(buffer)) == false) {
+            dropped_++;
+            return false;
+        }
+        Notify();
+        return true;
     }
-    pending_.clear();
-    for (FrameBuffer *buffer : free_list_) {
-        delete buffer;
+
+    if (chain_dropping_) {
+        // the frames referencing the dropped frame can not be decoded
+        if (buffer->isKeyFrame() == false) {
+            dropped_++;
+            return false;
+        }
+        chain_dropping_ = false;
+        RTC_LOG(INFO) << "Frame subscriber " << name_
+                      << " resumed at key frame, dropped: " << dropped_.load();
     }
-    free_list_.clear();
-    for (FrameBuffer *buffer : encoded_frame_queue_) {
-        delete buffer;
+
+    size_t lag = video_ring_.size();
+    uint64_t sequence = buffer->sequence();
+    if (lag >= capacity || video_ring_.Push(std::move(buffer)) == false) {
+        dropped_++;
+        chains_dropped_++;
+        chain_dropping_ = true;
+        drop_sequence_ = sequence;
+        keyframe_requested_ = true;
+        RTC_LOG(INFO) << "Frame subscriber " << name_ << " is too slow (lag: "
+                      << lag << "), dropping frames until the next key frame";
+        Notify();
+        return false;
+    }
+    if (lag + 1 > max_lag_) max_lag_ = lag + 1;
+    Notify();
+    return true;
+}
+
+void FrameSubscriber::Notify() {
+    uint64_t count = 1;
+    if (write(event_fd_, &count, sizeof(count)) < 0 && errno != EAGAIN)
+        RTC_LOG(LS_ERROR) << "Failed to write eventfd: " << errno;
+}
+
+void FrameSubscriber::Flush() {
+    flush_requested_ = true;
+    Notify();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Frame Queue
+//
+////////////////////////////////////////////////////////////////////////////////
+// The drain threads check the quit flag at least once in this period
+int FrameQueue::kEventWaitPeriod = 100;  // maximum wait period in ReadFront
+
+FrameQueue::FrameQueue()
+    : inited_(false),
+      capacity_(0),
+      buffer_size_(0),
+      drop_threshold_(kFrameQueueDropThreshold),
+      frame_sequence_(0),
+      slab_(new FrameSlab()),
+      pts_offset_us_(-1),
+      last_pts_(MMAL_TIME_UNKNOWN),
+      pts_window_min_us_(-1),
+      pts_window_start_us_(0),
+      imv_buffer_size_(0),
+      imv_index_(0) {}
+
+FrameQueue::FrameQueue(size_t capacity, size_t buffer_size)
+    : inited_(true),
+      capacity_(capacity),
+      buffer_size_(buffer_size),
+      drop_threshold_(kFrameQueueDropThreshold),
+      frame_sequence_(0),
+      slab_(new FrameSlab()),
+      pts_offset_us_(-1),
+      last_pts_(MMAL_TIME_UNKNOWN),
+      pts_window_min_us_(-1),
+      pts_window_start_us_(0),
+      imv_buffer_size_(0),
+      imv_index_(0) {}
+
+void FrameQueue::Init(size_t capacity, size_t buffer_size,
+                      size_t imv_buffer_size) {
+    clear();
+    webrtc::MutexLock lock(&mutex_);
+    capacity_ = capacity;
+    buffer_size_ = buffer_size;
+    // The cached blocks are sized for the previous resolution
+    RTC_LOG(INFO) << "Frame slab " << slab_->ToString();
+    slab_->Trim();
+    // pts restarts from the new encoder session
+    pts_offset_us_ = -1;
+    last_pts_ = MMAL_TIME_UNKNOWN;
+    // The IMV buffers still held by the subscribers are freed when they are
+    // released.
+    imv_buffers_.clear();
+    imv_buffer_size_ = imv_buffer_size;
+    imv_index_ = 0;
+    if (imv_buffer_size_ > 0) {
+        for (int index = 0; index < kImvBufferNum; index++)
+            imv_buffers_.push_back(
+                new rtc::RefCountedObject<FrameBuffer>(imv_buffer_size_));
     }
-    encoded_frame_queue_.clear();
+    inited_ = true;
+}
+
+void FrameQueue::SetDropThreshold(size_t threshold) {
+    webrtc::MutexLock lock(&mutex_);
+    RTC_DCHECK(threshold > 0);
+    drop_threshold_ = threshold;
 }
 
-FrameQueue::~FrameQueue() { destroy(); }
+bool FrameQueue::RequestKeyFrame() { return false; }
+
+FrameQueue::~FrameQueue() {
+    RTC_DCHECK(subscribers_.empty());
+    clear();
+}
+
+std::unique_ptr<FrameSubscriber> FrameQueue::Subscribe(const std::string &name,
+                                                       int channels) {
+    std::unique_ptr<FrameSubscriber> subscriber(
+        new FrameSubscriber(this, name, channels));
+    webrtc::MutexLock lock(&mutex_);
+    subscribers_.push_back(subscriber.get());
+    RTC_LOG(INFO) << "Frame subscriber added: " << name
+                  << ", subscribers: " << subscribers_.size();
+    return subscriber;
+}
+
+void FrameQueue::Unsubscribe(FrameSubscriber *subscriber) {
+    webrtc::MutexLock lock(&mutex_);
+    auto it = std::find(subscribers_.begin(), subscribers_.end(), subscriber);
+    if (it == subscribers_.end()) return;
+    subscribers_.erase(it);
+    RTC_LOG(INFO) << "Frame subscriber removed: " << subscriber->name_
+                  << ", received: " << subscriber->received_.load()
+                  << ", dropped: " << subscriber->dropped_.load()
+                  << ", chains dropped: " << subscriber->chains_dropped_.load()
+                  << ", key frame requests: "
+                  << subscriber->keyframe_requests_.load()
+                  << ", max lag: " << subscriber->max_lag_.load();
+}
 
 void FrameQueue::clear() {
     webrtc::MutexLock lock(&mutex_);
 
-    while (!encoded_frame_queue_.empty()) {
-        free_list_.push_back(encoded_frame_queue_.front());
-        encoded_frame_queue_.pop_front();
-    }
+    for (FrameSubscriber *subscriber : subscribers_) subscriber->Flush();
+    pending_ = nullptr;
 }
 
-size_t FrameQueue::size() const { return encoded_frame_queue_.size(); }
+size_t FrameQueue::size() const {
+    webrtc::MutexLock lock(&mutex_);
+    size_t size = 0;
+    for (FrameSubscriber *subscriber : subscribers_)
+        size = std::max(size, subscriber->lag());
+    return size;
+}
 
-FrameBuffer *FrameQueue::ReadFront(bool wait_until_timeout) {
-    RTC_DCHECK(inited_ == true);
-    if (encoded_frame_queue_.empty() && wait_until_timeout == true)
-        Wait(kEventWaitPeriod);  // Waiting for Event or Timeout
+void FrameQueue::PushFrame(int channel,
+                           rtc::scoped_refptr<FrameBuffer> buffer) {
+    if (channel == kFrameChannelVideo) {
+        buffer->set_sequence(++frame_sequence_);
+    } else {
+        // motion vectors are uploaded after the video frame
+        buffer->set_sequence(frame_sequence_);
+    }
+    buffer->set_capture_time_us(MapCaptureTime(buffer->pts()));
+    if (channel == kFrameChannelVideo) IndexFrame(buffer.get());
+    // There is no one to consume the frame when there is no subscriber
+    for (FrameSubscriber *subscriber : subscribers_) {
+        if (subscriber->channels() & channel)
+            subscriber->Push(channel, buffer,
+                             channel == kFrameChannelImv
+                                 ? kImvBufferNum
+                                 : std::min(capacity_, drop_threshold_));
+    }
+}
 
-    if (encoded_frame_queue_.empty()) return nullptr;
+void FrameQueue::IndexFrame(FrameBuffer *buffer) {
+    if (buffer->IndexNalUnits() == 0) return;
+
+    for (size_t index = 0; index < buffer->nal_count(); index++) {
+        const NalUnitIndex &nal = buffer->nal(index);
+        size_t size = nal.payload_offset - nal.start_offset + nal.payload_size;
+        bool is_slice = nal.type == H264::NaluType::kIdr ||
+                        nal.type == H264::NaluType::kSlice;
+        if (is_slice == false && nal.type != H264::NaluType::kSps &&
+            nal.type != H264::NaluType::kPps)
+            continue;
+        // Only the slice header is needed for the QP, so the parser does
+        // not scan the whole slice data.
+        if (is_slice) size = std::min(size, kSliceHeaderParseSize);
+        h264_bitstream_parser_.ParseBitstream(rtc::ArrayView<const uint8_t>(
+            buffer->data() + nal.start_offset, size));
+        if (is_slice) {
+            buffer->set_qp(
+                h264_bitstream_parser_.GetLastSliceQp().value_or(-1));
+            break;
+        }
+    }
+}
 
-    webrtc::MutexLock lock(&mutex_);
-    FrameBuffer *buffer = encoded_frame_queue_.front();
-    encoded_frame_queue_.pop_front();
-    // keep the frame buffer in free_list again
-    free_list_.push_back(buffer);
+int64_t FrameQueue::MapCaptureTime(int64_t pts) {
+    if (pts == MMAL_TIME_UNKNOWN) return -1;
+    int64_t now_us = rtc::TimeMicros();
+    int64_t delay_us = now_us - pts;
+
+    if (pts_offset_us_ < 0 ||
+        (last_pts_ != MMAL_TIME_UNKNOWN && pts < last_pts_)) {
+        // the first frame or the pts restarted
+        pts_offset_us_ = delay_us;
+        pts_window_min_us_ = delay_us;
+        pts_window_start_us_ = now_us;
+    }
+    last_pts_ = pts;
+
+    // The frame with the smallest delay has the least encoding and callback
+    // jitter, so the offset follows it. The window lets the offset move up
+    // when the GPU clock drifts slower than the system clock.
+    pts_window_min_us_ = std::min(pts_window_min_us_, delay_us);
+    if (delay_us < pts_offset_us_) pts_offset_us_ = delay_us;
+    if (now_us - pts_window_start_us_ > kPtsOffsetWindowUs) {
+        pts_offset_us_ = pts_window_min_us_;
+        pts_window_min_us_ = delay_us;
+        pts_window_start_us_ = now_us;
+    }
+    return pts + pts_offset_us_;
+}
 
-    return buffer;
+bool FrameQueue::WriteImv(MMAL_BUFFER_HEADER_T *mmal_frame) {
+    if (imv_buffers_.empty()) return false;
+    if (mmal_frame->length > imv_buffer_size_) {
+        RTC_LOG(LS_ERROR) << "Motion vector size error (buffer size: "
+                          << imv_buffer_size_
+                          << "), real size : " << mmal_frame->length;
+        return false;
+    }
+
+    // The IMV buffer which is still held by subscriber can not be reused, so
+    // the next free buffer is used. The subscribers release the buffers in
+    // different order, e.g. the motion fps holds one during the analysis.
+    for (size_t count = 0; count < imv_buffers_.size(); count++) {
+        rtc::scoped_refptr<rtc::RefCountedObject<FrameBuffer>> &buffer =
+            imv_buffers_[imv_index_];
+        imv_index_ = (imv_index_ + 1) % imv_buffers_.size();
+        if (buffer->HasOneRef() == false) continue;
+        buffer->copy(mmal_frame);
+        PushFrame(kFrameChannelImv, buffer);
+        return true;
+    }
+    RTC_LOG(INFO) << "IMV buffers are all busy, dropping the motion vector "
+                  << "of frame: " << frame_sequence_;
+    return false;
 }
 
 // Making FrameBuffer from MMAL Frame
@@ -157,7 +576,14 @@ bool FrameQueue::WriteBack(MMAL_BUFFER_HEADER_T *mmal_frame) {
 
     // ignore the EOS(?)
     if (mmal_frame->length == 0 && mmal_frame->flags == 0) return true;
-    if (mmal_frame->length > buffer_size_ || mmal_frame->length < 0) {
+
+    if (mmal_frame->flags & MMAL_BUFFER_HEADER_FLAG_CODECSIDEINFO) {
+        // The motion vector is copied into the IMV ring, so the buffer header
+        // goes back to the encoder pool immediately.
+        return WriteImv(mmal_frame);
+    }
+
+    if (mmal_frame->length > buffer_size_) {
         char buffer_log[256];
         RTC_LOG(LS_ERROR) << "**** MMAL Frame size error (buffer size: "
                           << buffer_size_
@@ -168,64 +594,42 @@ bool FrameQueue::WriteBack(MMAL_BUFFER_HEADER_T *mmal_frame) {
         return false;
     }
 
-    FrameBuffer *buffer = nullptr;
-    if (!pending_.empty()) {
+    if (pending_) {
         // there is pending frame which need to
-        buffer = pending_.back();
-        if (buffer->length() + mmal_frame->length > buffer_size_) {
+        if (pending_->length() + mmal_frame->length > buffer_size_) {
             RTC_LOG(LS_ERROR)
                 << "Failed to append the frame, buffer size is not enough: "
-                << buffer->length() + mmal_frame->length
+                << pending_->length() + mmal_frame->length
                 << ", buffer_size: " << buffer_size_;
-            free_list_.push_back(pending_.front());
-            pending_.clear();
+            pending_ = nullptr;
             return false;
         }
-        buffer->append(mmal_frame);
-        // FRame Ended, so forward to encoded frame queue
-        if (buffer->isFrameEnd()) {
-            // remove the buffer from pending container
-            pending_.pop_back();
-            encoded_frame_queue_.push_back(buffer);
-            Set();  // Event set to wake up DrainThread
+        if (pending_->append(mmal_frame) == false) {
+            RTC_LOG(LS_ERROR) << "Failed to grow the frame buffer: "
+                              << pending_->length() + mmal_frame->length;
+            pending_ = nullptr;
+            return false;
         }
-        return true;
-    }
-
-    if (free_list_.empty()) {
-        // If there is no buffer in the freelist, a buffer is created and mark
-        // it as tempoary.
-        RTC_LOG(INFO) << "capacity: " << capacity_
-                      << ", encoded queue size: " << encoded_frame_queue_.size()
-                      << ", free_list size: " << free_list_.size()
-                      << ", pending: " << pending_.size();
-
-        buffer = new FrameBuffer(buffer_size_, /* isTemporary */ true);
-    } else {
-        // get one frame buffer from free_list
-        while (free_list_.size() >= 1 /* stop before empty */ &&
-               (buffer = free_list_.front())->isTemporary() == true) {
-            RTC_LOG(INFO) << "Removing temporary frame buffer : "
-                          << ", encoded queue size: "
-                          << encoded_frame_queue_.size()
-                          << ", free_list size: " << free_list_.size()
-                          << ", pending: " << pending_.size();
-            free_list_.pop_front();
-            delete buffer;
+        // Frame Ended, so forward to encoded frame queue
+        if (pending_->isFrameEnd()) {
+            PushFrame(kFrameChannelVideo, std::move(pending_));
+            pending_ = nullptr;
         }
-        free_list_.pop_front();
+        return true;
     }
 
-    buffer->reset();
-    buffer->copy(mmal_frame);
-    if (buffer->isConfig()) {
-        // this is config frame so it need to append the key frame after it
-        pending_.push_back(buffer);
+    if ((mmal_frame->flags & MMAL_BUFFER_HEADER_FLAG_CONFIG) ||
+        !(mmal_frame->flags & MMAL_BUFFER_HEADER_FLAG_FRAME_END)) {
+        // this is config frame(or the first part of the large frame) so it
+        // need to append the rest of the frame after it
+        pending_ = FrameBuffer::Create(slab_, mmal_frame->length);
+        if (pending_ == nullptr) return false;
+        pending_->append(mmal_frame);
         return true;
     }
 
-    encoded_frame_queue_.push_back(buffer);
-    Set();  // Event set to wake up DrainThread
+    // Single part frame is queued without copy
+    PushFrame(kFrameChannelVideo, FrameBuffer::Create(mmal_frame));
     return true;
 }
 
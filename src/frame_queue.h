@@ -30,16 +30,23 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef FRAME_QUEUE_H_
 #define FRAME_QUEUE_H_
 
+#include <atomic>
 #include <bitset>
-#include <deque>
 #include <memory>
 #include <mutex>
+#include <string>
 #include <vector>
 
+#include "api/scoped_refptr.h"
+#include "api/video/encoded_image.h"
+#include "common_video/h264/h264_bitstream_parser.h"
+#include "common_video/h264/h264_common.h"
+#include "frame_slab.h"
 #include "mmal_video.h"
 #include "rtc_base/constructor_magic.h"
-#include "rtc_base/event.h"
+#include "rtc_base/ref_counted_object.h"
 #include "rtc_base/synchronization/mutex.h"
+#include "spsc_ring.h"
 
 namespace webrtc {
 
@@ -57,15 +64,49 @@ constexpr int kFrameFlagKeyFrame = 3;
 constexpr int kFrameFlagConfig = 5;
 constexpr int kFrameFlagIdeInfo = 7;  // inline motion vector
 
-struct FrameBuffer {
-    explicit FrameBuffer(size_t capacity) : FrameBuffer(capacity, false) {}
-    explicit FrameBuffer(size_t capacity, bool temporary) {
-        data_ = static_cast<uint8_t *>(malloc(capacity));
-        capacity_ = capacity;
-        length_ = 0;
-        temporary_ = temporary;
-    }
-    ~FrameBuffer() { free(data_); }
+// Channels of FrameQueue, subscriber receives only the subscribed channels
+constexpr int kFrameChannelVideo = 1 << 0;  // H.264 frames
+constexpr int kFrameChannelImv = 1 << 1;    // inline motion vectors
+// Number of fixed size IMV buffers, the motion vector is dropped when
+// every buffer is still held by the subscribers.
+constexpr int kImvBufferNum = 8;
+// Default drop threshold of the video frames queued in a subscriber
+constexpr size_t kFrameQueueDropThreshold = 8;
+
+// Maximum number of NAL units indexed in a frame, the rest of the frame is
+// included in the last NAL unit.
+constexpr int kMaxNalUnitIndex = 32;
+
+// NAL unit found in the frame by FrameBuffer::IndexNalUnits
+struct NalUnitIndex {
+    uint32_t start_offset;    // offset of the start code
+    uint32_t payload_offset;  // offset of the NAL unit header
+    uint32_t payload_size;
+    uint8_t type;
+};
+
+// FrameBuffer is a reference counted encoded frame which is passed to WebRTC
+// as EncodedImageBufferInterface without copying.
+// Single part frame holds the MMAL buffer header itself, and the header goes
+// back to the encoder pool when the last reference is released.
+// Only the multi part frame (config + IDR frame) is coalesced into the
+// block of FrameSlab, and the block grows with the appended parts.
+class FrameBuffer : public EncodedImageBufferInterface {
+   public:
+    // Wrapping the MMAL buffer header, the header is acquired until the
+    // FrameBuffer is released.
+    static rtc::scoped_refptr<FrameBuffer> Create(
+        MMAL_BUFFER_HEADER_T *buffer);
+    // Coalescing buffer for multi part frame, allocated from the slab
+    static rtc::scoped_refptr<FrameBuffer> Create(
+        rtc::scoped_refptr<FrameSlab> slab, size_t size);
+    // Fixed size buffer
+    static rtc::scoped_refptr<FrameBuffer> Create(size_t capacity);
+
+    // EncodedImageBufferInterface
+    const uint8_t *data() const override { return data_; }
+    uint8_t *data() override { return data_; }
+    size_t size() const override { return length_; }
 
     inline bool isKeyFrame() const { return flags_[kFrameFlagKeyFrame]; }
     inline bool isFrame() const {
@@ -75,63 +116,220 @@ struct FrameBuffer {
     inline bool isMotionVector() const { return flags_[kFrameFlagIdeInfo]; }
     inline bool isConfig() const { return flags_[kFrameFlagConfig]; }
     inline bool isEOS() const { return flags_[kFrameFlagEOS]; }
-    inline void reset() {
-        flags_.reset();
-        length_ = 0;
-    }
     inline size_t length() const { return length_; }
-    inline uint8_t *data() const { return data_; }
+    // Sequence number of the video frame. The motion vector has the same
+    // sequence number with the video frame it belongs to.
+    inline uint64_t sequence() const { return sequence_; }
+    inline void set_sequence(uint64_t sequence) { sequence_ = sequence; }
+    // MMAL timestamps in microseconds, MMAL_TIME_UNKNOWN when the encoder
+    // does not provide them.
+    inline int64_t pts() const { return pts_; }
+    inline int64_t dts() const { return dts_; }
+    // pts mapped to the rtc::TimeMicros clock, -1 when pts is unknown
+    inline int64_t capture_time_us() const { return capture_time_us_; }
+    inline void set_capture_time_us(int64_t capture_time_us) {
+        capture_time_us_ = capture_time_us;
+    }
+
+    // Index the NAL units of the frame in one pass, the index is built once
+    // when the frame is queued and reused by the consumers.
+    size_t IndexNalUnits();
+    inline size_t nal_count() const { return nal_count_; }
+    inline const NalUnitIndex &nal(size_t index) const {
+        return nal_units_[index];
+    }
+    inline bool hasIdr() const { return nal_types_[H264::NaluType::kIdr]; }
+    inline bool hasSps() const { return nal_types_[H264::NaluType::kSps]; }
+    inline bool hasPps() const { return nal_types_[H264::NaluType::kPps]; }
+    // slice QP of the frame, -1 when it is unknown
+    inline int qp() const { return qp_; }
+    inline void set_qp(int qp) { qp_ = qp; }
     inline std::string toString() {
         return flags_.to_string<char, std::string::traits_type,
                                 std::string::allocator_type>();
     }
-    inline bool isTemporary() const { return temporary_; }
-    // disable copy consructor
-    FrameBuffer(const FrameBuffer &) = delete;
-    FrameBuffer &operator=(const FrameBuffer &) = delete;
+    // Only available on the coalescing buffer
     bool copy(const MMAL_BUFFER_HEADER_T *buffer);
     bool append(const MMAL_BUFFER_HEADER_T *buffer);
 
+   protected:
+    explicit FrameBuffer(MMAL_BUFFER_HEADER_T *buffer);
+    explicit FrameBuffer(size_t capacity);
+    FrameBuffer(rtc::scoped_refptr<FrameSlab> slab, size_t size);
+    ~FrameBuffer() override;
+
    private:
-    bool temporary_;
+    MMAL_BUFFER_HEADER_T *header_;  // null in coalescing buffer
+    rtc::scoped_refptr<FrameSlab> slab_;  // null in fixed size buffer
     std::bitset<kFrameBufferFlagSize> flags_;
     uint8_t *data_;
     size_t length_;
     size_t capacity_;
+    uint64_t sequence_;
+    int64_t pts_, dts_;
+    int64_t capture_time_us_;
+
+    NalUnitIndex nal_units_[kMaxNalUnitIndex];
+    size_t nal_count_;
+    std::bitset<32> nal_types_;  // NAL unit types in the frame
+    int qp_;
+
+    RTC_DISALLOW_COPY_AND_ASSIGN(FrameBuffer);
 };
 
-class FrameQueue : public rtc::Event {
+class FrameQueue;  // forward
+
+// FrameSubscriber reads the frames of FrameQueue with its own SPSC rings,
+// so every subscriber(live streaming, motion detection) receives all frames
+// of the single encoder session without locking between the MMAL callback
+// thread and the drain thread. The video frames and the motion vectors have
+// the separate rings, and the subscriber is woken up only by the subscribed
+// channels.
+// When the video ring of a subscriber passes the drop threshold, the rest of
+// the reference chain is useless, so the video frames are dropped until the
+// next key frame and a key frame is requested from the encoder. The frames
+// already queued in the rings belong to the same chain, so the consumer
+// drops them too instead of sending the stale frames. The motion vectors are
+// dropped one by one when the IMV ring is full.
+class FrameSubscriber {
+   public:
+    ~FrameSubscriber();
+
+    // Obtain a frame(or motion vector) from the frame queue in the order of
+    // the sequence number.
+    // If there is no frame to read, it will be blocked until the new frame
+    // is written or the timeout is reached and returns nullptr at timeout.
+    rtc::scoped_refptr<FrameBuffer> ReadFront(bool wait_until_timeout = true);
+
+    inline const std::string &name() const { return name_; }
+    inline int channels() const { return channels_; }
+    // number of frames queued but not read yet
+    inline size_t lag() const { return video_ring_.size() + imv_ring_.size(); }
+    inline uint64_t received() const { return received_.load(); }
+    inline uint64_t dropped() const { return dropped_.load(); }
+    // number of reference chains dropped by the drop threshold
+    inline uint64_t chains_dropped() const { return chains_dropped_.load(); }
+    inline uint64_t keyframe_requests() const {
+        return keyframe_requests_.load();
+    }
+    inline size_t max_lag() const { return max_lag_.load(); }
+
+   private:
+    friend class FrameQueue;
+    explicit FrameSubscriber(FrameQueue *queue, const std::string &name,
+                             int channels);
+
+    // Pop the frame of lower sequence number from the rings
+    bool Pop(rtc::scoped_refptr<FrameBuffer> *buffer);
+    void DropAll();
+    // called in the producer thread
+    bool Push(int channel, rtc::scoped_refptr<FrameBuffer> buffer,
+              size_t capacity);
+    // Wake up the consumer thread waiting in ReadFront
+    void Notify();
+    // Request the consumer to release all frames in the ring
+    void Flush();
+
+    FrameQueue *const queue_;
+    const std::string name_;
+    const int channels_;
+    const int event_fd_;
+    SpscRing<rtc::scoped_refptr<FrameBuffer>> video_ring_;
+    SpscRing<rtc::scoped_refptr<FrameBuffer>> imv_ring_;
+    std::atomic<bool> flush_requested_;
+    std::atomic<uint64_t> received_;
+    std::atomic<uint64_t> dropped_;
+    std::atomic<uint64_t> chains_dropped_;
+    std::atomic<uint64_t> keyframe_requests_;
+    std::atomic<size_t> max_lag_;
+    // set by the producer, the consumer sends the key frame request
+    std::atomic<bool> keyframe_requested_;
+    // set by the producer, the consumer drops the queued frames up to this
+    // sequence number
+    std::atomic<uint64_t> drop_sequence_;
+    bool chain_dropping_;  // producer only
+
+    RTC_DISALLOW_COPY_AND_ASSIGN(FrameSubscriber);
+};
+
+// FrameQueue is a broadcast queue of encoded frames. The frame is queued to
+// the ring of each subscriber, and the capacity limits the number of frames
+// in each ring.
+class FrameQueue {
    public:
     explicit FrameQueue();
-    explicit FrameQueue(size_t capacity /* number of buffers */,
+    explicit FrameQueue(size_t capacity /* number of frames */,
                         size_t buffer_size /* frame buffer size */);
-    ~FrameQueue();
+    virtual ~FrameQueue();
 
-    void Init(size_t capacity, size_t buffer_size);
-    // Obtain a frame from the encoded frame queue.
-    // If there is no frame in FrameQueue, it will be blocked for a certain
-    // period and return nullptr when timeout is reached. If there is a frame,
-    // it returns the corresponding frame.
-    FrameBuffer *ReadFront(bool wait_until_timeout = true);
+    // imv_buffer_size is the size of inline motion vectors per frame,
+    // and it is zero when inline motion vector is not enabled.
+    void Init(size_t capacity, size_t buffer_size, size_t imv_buffer_size = 0);
+    // Number of the video frames queued in a subscriber before it starts
+    // dropping the frames up to the next key frame.
+    void SetDropThreshold(size_t threshold);
+
+    // The subscriber receives the frames of the channels written after
+    // subscribing, and it is unsubscribed when the subscriber is destroyed.
+    std::unique_ptr<FrameSubscriber> Subscribe(
+        const std::string &name, int channels = kFrameChannelVideo);
 
     size_t size() const;
 
    protected:
+    // Release all frames in the queue, so the MMAL buffer headers held by
+    // the queue go back to the encoder pool. The frames in the subscriber
+    // rings are released by the subscriber thread.
     void clear();
     // Make the frame uploaded from MMAL into one H.264 frame,
     // and buffering it in the encoded frame of FrameQueue.
     bool WriteBack(MMAL_BUFFER_HEADER_T *buffer);
+    // Called in the subscriber thread after the subscriber dropped the frames
+    // of a reference chain.
+    virtual bool RequestKeyFrame();
 
    private:
-    static int kEventWaitPeriod;  // minimal wait period between frame
-    webrtc::Mutex mutex_;
-    void destroy();
+    friend class FrameSubscriber;
+    static int kEventWaitPeriod;  // maximum wait period in ReadFront
+
+    void Unsubscribe(FrameSubscriber *subscriber);
+    // Queuing the frame to the subscribers of the channel
+    void PushFrame(int channel, rtc::scoped_refptr<FrameBuffer> buffer);
+    // Copy the motion vectors into the IMV ring and queuing it
+    bool WriteImv(MMAL_BUFFER_HEADER_T *buffer);
+    // Map the MMAL pts to the rtc::TimeMicros clock
+    int64_t MapCaptureTime(int64_t pts);
+    // Build the NAL unit index and the slice QP of the video frame
+    void IndexFrame(FrameBuffer *buffer);
+
+    // guards the subscriber list and the producer state
+    mutable webrtc::Mutex mutex_;
 
     bool inited_;
     size_t capacity_, buffer_size_;
-    std::deque<FrameBuffer *> encoded_frame_queue_;
-    std::deque<FrameBuffer *> free_list_;
-    std::vector<FrameBuffer *> pending_;
+    size_t drop_threshold_;
+    std::vector<FrameSubscriber *> subscribers_;
+    rtc::scoped_refptr<FrameBuffer> pending_;
+    uint64_t frame_sequence_;  // sequence number of the last video frame
+    rtc::scoped_refptr<FrameSlab> slab_;
+
+    // Offset between the MMAL pts and the rtc::TimeMicros clock. It is the
+    // smallest arrival delay of the frames, renewed every period to follow
+    // the clock drift.
+    int64_t pts_offset_us_;
+    int64_t last_pts_;
+    int64_t pts_window_min_us_;
+    int64_t pts_window_start_us_;
+
+    // keeps SPS/PPS of the stream for the slice QP parsing
+    H264BitstreamParser h264_bitstream_parser_;
+
+    // Fixed size buffers for the motion vectors, the buffer is reused when
+    // it is released by all subscribers.
+    size_t imv_buffer_size_;
+    std::vector<rtc::scoped_refptr<rtc::RefCountedObject<FrameBuffer>>>
+        imv_buffers_;
+    size_t imv_index_;
 
     RTC_DISALLOW_COPY_AND_ASSIGN(FrameQueue);
 };
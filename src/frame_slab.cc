@@ -0,0 +1,156 @@
+/*
+Copyright (c) 2021, rpi-webrtc-streamer Lyu,KeunChang
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "frame_slab.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <sstream>
+
+#include "rtc_base/checks.h"
+#include "rtc_base/logging.h"
+
+namespace webrtc {
+
+FrameSlab::FrameSlab(size_t memory_limit)
+    : memory_limit_(memory_limit), allocated_(0) {}
+
+FrameSlab::~FrameSlab() {
+    for (int index = 0; index < kFrameSlabClassNum; index++) {
+        RTC_DCHECK(classes_[index].in_use == 0);
+        for (uint8_t *block : classes_[index].free_list) free(block);
+    }
+}
+
+int FrameSlab::GetClass(size_t size) const {
+    for (int index = 0; index < kFrameSlabClassNum; index++)
+        if (size <= kFrameSlabClasses[index]) return index;
+    return -1;
+}
+
+bool FrameSlab::ReclaimLocked(size_t size) {
+    for (int index = 0; index < kFrameSlabClassNum; index++) {
+        SizeClass &size_class = classes_[index];
+        while (allocated_ + size > memory_limit_ &&
+               !size_class.free_list.empty()) {
+            free(size_class.free_list.back());
+            size_class.free_list.pop_back();
+            allocated_ -= kFrameSlabClasses[index];
+        }
+    }
+    return allocated_ + size <= memory_limit_;
+}
+
+uint8_t *FrameSlab::Allocate(size_t size, size_t *capacity) {
+    int index = GetClass(size);
+    if (index < 0) {
+        RTC_LOG(LS_ERROR) << "Frame size " << size
+                          << " exceeds the largest slab class";
+        return nullptr;
+    }
+
+    webrtc::MutexLock lock(&mutex_);
+    SizeClass &size_class = classes_[index];
+    uint8_t *block = nullptr;
+    if (!size_class.free_list.empty()) {
+        block = size_class.free_list.back();
+        size_class.free_list.pop_back();
+    } else {
+        if (ReclaimLocked(kFrameSlabClasses[index]) == false) {
+            size_class.failed++;
+            RTC_LOG(LS_ERROR) << "Frame slab memory limit " << memory_limit_
+                              << " reached, allocated: " << allocated_;
+            return nullptr;
+        }
+        block = static_cast<uint8_t *>(malloc(kFrameSlabClasses[index]));
+        if (block == nullptr) return nullptr;
+        allocated_ += kFrameSlabClasses[index];
+    }
+    size_class.in_use++;
+    if (size_class.in_use > size_class.high_water)
+        size_class.high_water = size_class.in_use;
+    *capacity = kFrameSlabClasses[index];
+    return block;
+}
+
+uint8_t *FrameSlab::Grow(uint8_t *block, size_t length, size_t size,
+                         size_t *capacity) {
+    if (size <= *capacity) return block;
+    size_t new_capacity;
+    uint8_t *new_block = Allocate(size, &new_capacity);
+    if (new_block == nullptr) return nullptr;
+    memcpy(new_block, block, length);
+    Free(block, *capacity);
+    *capacity = new_capacity;
+    return new_block;
+}
+
+void FrameSlab::Free(uint8_t *block, size_t capacity) {
+    int index = GetClass(capacity);
+    RTC_DCHECK(index >= 0 && kFrameSlabClasses[index] == capacity);
+
+    webrtc::MutexLock lock(&mutex_);
+    RTC_DCHECK(classes_[index].in_use > 0);
+    classes_[index].in_use--;
+    classes_[index].free_list.push_back(block);
+}
+
+void FrameSlab::Trim() {
+    webrtc::MutexLock lock(&mutex_);
+    for (int index = 0; index < kFrameSlabClassNum; index++) {
+        for (uint8_t *block : classes_[index].free_list) {
+            free(block);
+            allocated_ -= kFrameSlabClasses[index];
+        }
+        classes_[index].free_list.clear();
+    }
+}
+
+size_t FrameSlab::allocated() const {
+    webrtc::MutexLock lock(&mutex_);
+    return allocated_;
+}
+
+std::string FrameSlab::ToString() const {
+    webrtc::MutexLock lock(&mutex_);
+    std::ostringstream os;
+    os << "allocated: " << allocated_ << "/" << memory_limit_;
+    for (int index = 0; index < kFrameSlabClassNum; index++) {
+        const SizeClass &size_class = classes_[index];
+        os << ", " << kFrameSlabClasses[index] / 1024 << "K(in use "
+           << size_class.in_use << ", high " << size_class.high_water
+           << ", free " << size_class.free_list.size();
+        if (size_class.failed) os << ", failed " << size_class.failed;
+        os << ")";
+    }
+    return os.str();
+}
+
+}  // namespace webrtc
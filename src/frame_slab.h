@@ -0,0 +1,108 @@
+/*
+Copyright (c) 2021, rpi-webrtc-streamer Lyu,KeunChang
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef FRAME_SLAB_H_
+#define FRAME_SLAB_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "api/ref_counted_base.h"
+#include "rtc_base/constructor_magic.h"
+#include "rtc_base/synchronization/mutex.h"
+
+namespace webrtc {
+
+// Size classes of FrameSlab
+constexpr size_t kFrameSlabClasses[] = {4 * 1024, 16 * 1024, 64 * 1024,
+                                        256 * 1024, 1024 * 1024};
+constexpr int kFrameSlabClassNum =
+    sizeof(kFrameSlabClasses) / sizeof(kFrameSlabClasses[0]);
+// Default hard limit of the memory allocated by FrameSlab
+constexpr size_t kFrameSlabMemoryLimit = 8 * 1024 * 1024;
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Frame Slab
+//
+// Size class allocator for the coalesced frame buffers. The released block is
+// kept in the free list of its class and reused by the next frame, so the
+// memory is bounded by the frames actually in flight instead of the worst
+// case frame size. The blocks are released from the consumer threads, so the
+// slab is reference counted and shared by the buffers allocated from it.
+//
+////////////////////////////////////////////////////////////////////////////////
+class FrameSlab : public rtc::RefCountedBase {
+   public:
+    explicit FrameSlab(size_t memory_limit = kFrameSlabMemoryLimit);
+
+    // Returns the block of the smallest class which can hold the size,
+    // and nullptr when the size exceeds the largest class or the memory
+    // limit is reached. capacity is set to the size of the class.
+    uint8_t *Allocate(size_t size, size_t *capacity);
+    // Move the data to the block of the larger class when the block can not
+    // hold the size. Returns nullptr and keeps the old block on failure.
+    uint8_t *Grow(uint8_t *block, size_t length, size_t size, size_t *capacity);
+    void Free(uint8_t *block, size_t capacity);
+
+    // Release the cached blocks in the free lists
+    void Trim();
+    size_t allocated() const;
+    std::string ToString() const;
+
+   protected:
+    ~FrameSlab() override;
+
+   private:
+    int GetClass(size_t size) const;
+    // Release the free blocks of the other classes until the size can be
+    // allocated within the memory limit.
+    bool ReclaimLocked(size_t size);
+
+    struct SizeClass {
+        std::vector<uint8_t *> free_list;
+        size_t in_use = 0;
+        size_t high_water = 0;  // maximum number of blocks in use
+        uint64_t failed = 0;    // allocations failed by the memory limit
+    };
+
+    mutable webrtc::Mutex mutex_;
+    const size_t memory_limit_;
+    size_t allocated_;  // sum of the blocks in use and in the free lists
+    SizeClass classes_[kFrameSlabClassNum];
+
+    RTC_DISALLOW_COPY_AND_ASSIGN(FrameSlab);
+};
+
+}  // namespace webrtc
+
+#endif  // FRAME_SLAB_H_
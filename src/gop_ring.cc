@@ -0,0 +1,166 @@
+/*
+Copyright (c) 2021, rpi-webrtc-streamer Lyu,KeunChang
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "gop_ring.h"
+
+#include <string.h>
+
+#include "rtc_base/checks.h"
+#include "rtc_base/logging.h"
+
+namespace webrtc {
+
+GopRing::GopRing(size_t capacity, int pre_event_period_ms)
+    : capacity_(capacity),
+      pre_event_period_ms_(pre_event_period_ms),
+      buffer_(new uint8_t[capacity]),
+      gops_(kGopRingMaxGops) {
+    clear();
+    RTC_LOG(INFO) << "GopRing buffer size " << capacity_
+                  << ", pre-event period: " << pre_event_period_ms_;
+}
+
+GopRing::~GopRing() {}
+
+void GopRing::clear() {
+    head_ = tail_ = wrap_end_ = 0;
+    wrapped_ = false;
+    gop_first_ = gop_count_ = 0;
+    gop_started_ = gop_pending_ = false;
+    gop_timestamp_us_ = 0;
+}
+
+size_t GopRing::size() const {
+    if (wrapped_) return (wrap_end_ - head_) + tail_;
+    return tail_ - head_;
+}
+
+int GopRing::GetSpans(Span spans[2]) const {
+    if (gop_count_ == 0) return 0;
+    if (wrapped_) {
+        spans[0] = {buffer_.get() + head_, wrap_end_ - head_};
+        spans[1] = {buffer_.get(), tail_};
+        return tail_ > 0 ? 2 : 1;
+    }
+    spans[0] = {buffer_.get() + head_, tail_ - head_};
+    return 1;
+}
+
+void GopRing::EvictOldest() {
+    RTC_DCHECK(gop_count_ > 0);
+    if (gop_count_ == 1) {
+        // the current GOP has no data yet, so the ring becomes empty
+        head_ = tail_ = wrap_end_ = 0;
+        wrapped_ = false;
+        gop_first_ = gop_count_ = 0;
+        return;
+    }
+    gop_first_ = (gop_first_ + 1) % gops_.size();
+    gop_count_--;
+    size_t next_head = gops_[gop_first_].offset;
+    // the next GOP starts at the beginning of the ring
+    if (wrapped_ && next_head < head_) wrapped_ = false;
+    head_ = next_head;
+}
+
+void GopRing::StartGop(int64_t timestamp_us, int64_t now_us) {
+    // The oldest GOP is evicted only when the GOPs after it, including the
+    // new one, cover the pre-event period by themselves.
+    const int64_t pre_event_start_us = now_us - pre_event_period_ms_ * 1000;
+    while (gop_count_ > 0) {
+        int64_t next_timestamp_us =
+            gop_count_ > 1 ? gops_[(gop_first_ + 1) % gops_.size()].timestamp_us
+                           : timestamp_us;
+        if (next_timestamp_us > pre_event_start_us) break;
+        EvictOldest();
+    }
+    // keep the room for the index of the new GOP
+    if (gop_count_ == gops_.size()) EvictOldest();
+
+    gop_started_ = gop_pending_ = true;
+    gop_timestamp_us_ = timestamp_us;
+}
+
+void GopRing::EvictBefore(int64_t timestamp_us) {
+    while (gop_count_ > 0 && gops_[gop_first_].timestamp_us < timestamp_us) {
+        if (gop_count_ == 1 && gop_pending_ == false) {
+            clear();
+            return;
+        }
+        EvictOldest();
+    }
+}
+
+bool GopRing::Reserve(size_t size, size_t *offset) {
+    if (wrapped_) {
+        if (head_ - tail_ < size) return false;
+        *offset = tail_;
+        return true;
+    }
+    if (capacity_ - tail_ >= size) {
+        *offset = tail_;
+        return true;
+    }
+    if (head_ >= size && tail_ > head_) {
+        // continue at the beginning of the ring
+        wrap_end_ = tail_;
+        wrapped_ = true;
+        *offset = 0;
+        return true;
+    }
+    return false;
+}
+
+bool GopRing::Append(const void *data, size_t size) {
+    if (gop_started_ == false) return true;  // waiting for the key frame
+
+    size_t offset;
+    while (Reserve(size, &offset) == false) {
+        if (gop_count_ == 0 || (gop_count_ == 1 && gop_pending_ == false)) {
+            RTC_LOG(LS_ERROR) << "GopRing: GOP is larger than the ring size "
+                              << capacity_ << ", waiting for next key frame";
+            clear();
+            return false;
+        }
+        EvictOldest();
+    }
+
+    if (gop_pending_) {
+        size_t index = (gop_first_ + gop_count_) % gops_.size();
+        gops_[index] = {offset, gop_timestamp_us_};
+        if (gop_count_ == 0) head_ = offset;
+        gop_count_++;
+        gop_pending_ = false;
+    }
+    memcpy(buffer_.get() + offset, data, size);
+    tail_ = offset + size;
+    return true;
+}
+
+}  // namespace webrtc
@@ -0,0 +1,132 @@
+/*
+Copyright (c) 2021, rpi-webrtc-streamer Lyu,KeunChang
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef GOP_RING_H_
+#define GOP_RING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <vector>
+
+#include "rtc_base/constructor_magic.h"
+
+namespace webrtc {
+
+// Maximum number of GOPs kept in the GopRing
+constexpr size_t kGopRingMaxGops = 64;
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// GOP Ring
+//
+// Preallocated circular buffer which keeps the frames of the last GOPs before
+// the motion is triggered. A GOP is evicted as a whole when the remaining GOPs
+// still cover the pre-event period, or when the room is needed for the new
+// frame, so the ring always starts at the key frame. The frame is never split
+// at the end of the ring, so the contents can be written to the file from at
+// most two contiguous spans without copying them.
+//
+// GopRing is not thread safe. The frames are appended in the drain thread and
+// the ring is read by the file writer thread only while the appending is
+// stopped.
+//
+////////////////////////////////////////////////////////////////////////////////
+class GopRing {
+   public:
+    struct Span {
+        const uint8_t *data;
+        size_t size;
+    };
+
+    explicit GopRing(size_t capacity, int pre_event_period_ms);
+    ~GopRing();
+
+    // Starts a new GOP with the key frame and evicts the old GOPs which are
+    // not needed to cover the pre-event period at now_us. The GOP may start
+    // before now_us when the GOP is appended after it is completed.
+    void StartGop(int64_t timestamp_us, int64_t now_us);
+    inline void StartGop(int64_t timestamp_us) {
+        StartGop(timestamp_us, timestamp_us);
+    }
+    // Appends the data to the current GOP. The data is dropped when there is
+    // no GOP started. Returns false when the current GOP alone does not fit
+    // in the ring, and the ring waits for the next key frame.
+    bool Append(const void *data, size_t size);
+
+    // Returns the number of spans (at most 2) holding the contents of the
+    // ring, the oldest first.
+    int GetSpans(Span spans[2]) const;
+    size_t size() const;
+    inline size_t capacity() const { return capacity_; }
+    inline size_t gop_count() const { return gop_count_; }
+    // timestamp of the oldest GOP, 0 when the ring is empty
+    inline int64_t first_timestamp_us() const {
+        return gop_count_ ? gops_[gop_first_].timestamp_us : 0;
+    }
+    inline bool gop_started() const { return gop_started_; }
+    // Evicts the GOPs started before the timestamp. The ring waits for the
+    // next key frame when the current GOP is evicted.
+    void EvictBefore(int64_t timestamp_us);
+    // Drops all the GOPs and waits for the next key frame.
+    void clear();
+
+   private:
+    struct Gop {
+        size_t offset;
+        int64_t timestamp_us;
+    };
+
+    // Finds the room for the size after the tail without wrapping the
+    // data around the end of the ring.
+    bool Reserve(size_t size, size_t *offset);
+    void EvictOldest();
+
+    const size_t capacity_;
+    const int pre_event_period_ms_;
+    std::unique_ptr<uint8_t[]> buffer_;
+
+    // The contents are [head_, tail_) or [head_, wrap_end_) and [0, tail_)
+    // when wrapped_ is set.
+    size_t head_, tail_, wrap_end_;
+    bool wrapped_;
+
+    std::vector<Gop> gops_;
+    size_t gop_first_, gop_count_;
+    bool gop_started_;  // key frame arrived after clear()
+    bool gop_pending_;  // started GOP has no data yet
+    int64_t gop_timestamp_us_;
+
+    RTC_DISALLOW_COPY_AND_ASSIGN(GopRing);
+};
+
+}  // namespace webrtc
+
+#endif  // GOP_RING_H_
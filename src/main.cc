@@ -16,7 +16,9 @@
  *  be found in the AUTHORS file in the root of the source tree.
  */
 
+#include <algorithm>
 #include <iostream>
+#include <vector>
 
 #include "absl/flags/flag.h"
 #include "absl/flags/parse.h"
@@ -31,6 +33,7 @@
 #include "config_streamer.h"
 #include "direct_socket.h"
 #include "file_log_sink.h"
+#include "mdns_poll.h"
 #include "mdns_publish.h"
 #include "mmal_still_capture.h"
 #include "mmal_wrapper.h"
@@ -49,8 +52,13 @@
 class StreamingSocketServer : public rtc::PhysicalSocketServer {
    public:
     explicit StreamingSocketServer()
-        : mdns_publish_enable_(false), websocket_(nullptr) {}
+        : mdns_publish_enable_(false),
+          mdns_failed_(false),
+          websocket_(nullptr),
+          mdns_poll_(this) {}
     virtual ~StreamingSocketServer() {
+        // websocket server outlives the socket server
+        if (websocket_) websocket_->AttachSocketServer(nullptr);
         if (mdns_publish_enable_ == true) mdns_destroy_clientinfo();
     }
 
@@ -61,28 +69,56 @@ class StreamingSocketServer : public rtc::PhysicalSocketServer {
 
     void set_websocket_server(LibWebSocketServer* websocket) {
         websocket_ = websocket;
+        websocket_->AttachSocketServer(this);
+        sources_.push_back(websocket_);
     }
 
+    // The websocket and mDNS publish fds are registered as dispatchers, so
+    // Wait blocks until there is I/O or the next timer of the sources.
     bool Wait(int cms, bool process_io) override {
-        if (websocket_)
-            websocket_->RunLoop(0);  // Run Websocket loop once per call
-        if (mdns_publish_enable_) {
-            if (mdns_run_loop(0)) {
-                RTC_LOG(LS_ERROR)
-                    << "mDNS: Failed to run mdns publish event loop";
-                mdns_publish_enable_ = false;
-            }
+        if (process_io) {
+            for (PollEventSource* source : sources_)
+                cms = source->GetNextTimeout(cms);
         }
-        return rtc::PhysicalSocketServer::Wait(0 /*cms == -1 ? 1 : cms*/,
-                                               process_io);
+        bool ret = rtc::PhysicalSocketServer::Wait(cms, process_io);
+        if (process_io) {
+            for (PollEventSource* source : sources_) source->ProcessTimeout();
+        }
+        if (mdns_failed_) StopMdnsPublish();
+        return ret;
+    }
+
+    const AvahiPoll* mdns_poll_api() const { return mdns_poll_.GetPollApi(); }
+    void set_mdns_publish_enable(bool enable) {
+        if (enable && !mdns_publish_enable_) sources_.push_back(&mdns_poll_);
+        mdns_publish_enable_ = enable;
+    }
+
+    // The avahi failure is reported in the avahi callback, so the mDNS
+    // publish is stopped after the poll sources are processed.
+    static void OnMdnsFailure(void* userdata) {
+        static_cast<StreamingSocketServer*>(userdata)->mdns_failed_ = true;
     }
-    void set_mdns_publish_enable(bool enable) { mdns_publish_enable_ = enable; }
 
    protected:
+    void StopMdnsPublish() {
+        mdns_failed_ = false;
+        if (mdns_publish_enable_ == false) return;
+        RTC_LOG(LS_ERROR) << "mDNS: Publishing failed, mDNS publish disabled";
+        mdns_destroy_clientinfo();
+        sources_.erase(
+            std::remove(sources_.begin(), sources_.end(), &mdns_poll_),
+            sources_.end());
+        mdns_publish_enable_ = false;
+    }
+
     bool mdns_publish_enable_;
+    bool mdns_failed_;
     rtc::Thread* message_queue_;
     std::unique_ptr<rtc::AsyncSocket> listener_;
     LibWebSocketServer* websocket_;
+    MdnsPoll mdns_poll_;
+    std::vector<PollEventSource*> sources_;
 };
 
 //
@@ -254,8 +290,11 @@ int main(int argc, char** argv) {
         std::string deviceid;
         if (utils::GetHardwareDeviceId(&deviceid) == true &&
             mdns_init_clientinfo(websocket_port, websocket_url_path.c_str(),
-                                 deviceid.c_str()) == MDNS_SUCCESS) {
-            // enabling mDNS publish event loop
+                                 deviceid.c_str(),
+                                 socket_server.mdns_poll_api(),
+                                 StreamingSocketServer::OnMdnsFailure,
+                                 &socket_server) == MDNS_SUCCESS) {
+            // enabling mDNS publish timeouts in the socket server
             socket_server.set_mdns_publish_enable(true);
         } else {
             RTC_LOG(LS_ERROR) << "mDNS: Failed to initialize mdns client info";
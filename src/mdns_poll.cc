@@ -0,0 +1,184 @@
+/*
+Copyright (c) 2021, rpi-webrtc-streamer Lyu,KeunChang
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "mdns_poll.h"
+
+#include <avahi-common/timeval.h>
+#include <sys/time.h>
+
+#include <memory>
+
+#include "rtc_base/checks.h"
+#include "rtc_base/logging.h"
+
+struct AvahiWatch {
+    MdnsPoll* poll;
+    std::unique_ptr<PollDispatcher> dispatcher;
+    AvahiWatchEvent revents;
+    AvahiWatchCallback callback;
+    void* userdata;
+    bool dead;
+};
+
+struct AvahiTimeout {
+    MdnsPoll* poll;
+    bool enabled;
+    struct timeval expiry;
+    AvahiTimeoutCallback callback;
+    void* userdata;
+    bool dead;
+};
+
+MdnsPoll::MdnsPoll(rtc::PhysicalSocketServer* socket_server)
+    : socket_server_(socket_server) {
+    poll_api_.userdata = this;
+    poll_api_.watch_new = WatchNew;
+    poll_api_.watch_update = WatchUpdate;
+    poll_api_.watch_get_events = WatchGetEvents;
+    poll_api_.watch_free = WatchFree;
+    poll_api_.timeout_new = TimeoutNew;
+    poll_api_.timeout_update = TimeoutUpdate;
+    poll_api_.timeout_free = TimeoutFree;
+}
+
+MdnsPoll::~MdnsPoll() { Cleanup(true); }
+
+void MdnsPoll::Cleanup(bool all) {
+    for (auto it = watches_.begin(); it != watches_.end();) {
+        if (all || (*it)->dead) {
+            delete *it;
+            it = watches_.erase(it);
+        } else
+            ++it;
+    }
+    for (auto it = timeouts_.begin(); it != timeouts_.end();) {
+        if (all || (*it)->dead) {
+            delete *it;
+            it = timeouts_.erase(it);
+        } else
+            ++it;
+    }
+}
+
+int MdnsPoll::GetNextTimeout(int cms) {
+    struct timeval now;
+    int timeout = -1;
+
+    Cleanup(false);
+    gettimeofday(&now, nullptr);
+    for (AvahiTimeout* t : timeouts_) {
+        if (t->dead || !t->enabled) continue;
+        AvahiUsec usec = avahi_timeval_diff(&t->expiry, &now);
+        // round up to ms, so the timeout is expired after the wait
+        int expiry_ms = usec <= 0 ? 0 : static_cast<int>((usec + 999) / 1000);
+        timeout = MinTimeout(timeout, expiry_ms);
+    }
+    return MinTimeout(cms, timeout);
+}
+
+void MdnsPoll::ProcessTimeout() {
+    struct timeval now;
+    gettimeofday(&now, nullptr);
+
+    // avahi may add new timeouts in the callback, std::list iterator is not
+    // invalidated by push_back.
+    for (AvahiTimeout* t : timeouts_) {
+        if (t->dead || !t->enabled) continue;
+        if (avahi_timeval_compare(&t->expiry, &now) > 0) continue;
+        // timeout is disabled until avahi updates the timeout again
+        t->enabled = false;
+        t->callback(t, t->userdata);
+    }
+}
+
+AvahiWatch* MdnsPoll::WatchNew(const AvahiPoll* api, int fd,
+                               AvahiWatchEvent event,
+                               AvahiWatchCallback callback, void* userdata) {
+    MdnsPoll* poll = static_cast<MdnsPoll*>(api->userdata);
+    AvahiWatch* watch = new AvahiWatch;
+
+    watch->poll = poll;
+    watch->revents = static_cast<AvahiWatchEvent>(0);
+    watch->callback = callback;
+    watch->userdata = userdata;
+    watch->dead = false;
+    watch->dispatcher.reset(new PollDispatcher(
+        poll->socket_server_, fd, static_cast<short>(event),
+        [watch](int fd, short revents) {
+            watch->revents = static_cast<AvahiWatchEvent>(revents);
+            watch->callback(watch, fd, watch->revents, watch->userdata);
+            watch->revents = static_cast<AvahiWatchEvent>(0);
+        }));
+    poll->watches_.push_back(watch);
+    return watch;
+}
+
+void MdnsPoll::WatchUpdate(AvahiWatch* watch, AvahiWatchEvent event) {
+    RTC_DCHECK(watch->dead == false);
+    watch->dispatcher->SetEvents(static_cast<short>(event));
+}
+
+AvahiWatchEvent MdnsPoll::WatchGetEvents(AvahiWatch* watch) {
+    return watch->revents;
+}
+
+void MdnsPoll::WatchFree(AvahiWatch* watch) {
+    // It can be called in the watch callback, the watch will be deleted
+    // in the next wait cycle.
+    watch->dispatcher->Detach();
+    watch->dead = true;
+}
+
+AvahiTimeout* MdnsPoll::TimeoutNew(const AvahiPoll* api,
+                                   const struct timeval* tv,
+                                   AvahiTimeoutCallback callback,
+                                   void* userdata) {
+    MdnsPoll* poll = static_cast<MdnsPoll*>(api->userdata);
+    AvahiTimeout* timeout = new AvahiTimeout;
+
+    timeout->poll = poll;
+    timeout->callback = callback;
+    timeout->userdata = userdata;
+    timeout->dead = false;
+    TimeoutUpdate(timeout, tv);
+    poll->timeouts_.push_back(timeout);
+    return timeout;
+}
+
+void MdnsPoll::TimeoutUpdate(AvahiTimeout* timeout, const struct timeval* tv) {
+    // null tv means the timeout is disabled
+    timeout->enabled = (tv != nullptr);
+    if (tv) timeout->expiry = *tv;
+}
+
+void MdnsPoll::TimeoutFree(AvahiTimeout* timeout) {
+    // It can be called in the timeout callback, the timeout will be deleted
+    // in the next wait cycle.
+    timeout->dead = true;
+}
@@ -0,0 +1,84 @@
+/*
+Copyright (c) 2021, rpi-webrtc-streamer Lyu,KeunChang
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef MDNS_POLL_H_
+#define MDNS_POLL_H_
+
+#include <avahi-common/watch.h>
+
+#include <list>
+
+#include "poll_dispatcher.h"
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// mDNS Poll
+//
+// Implementation of avahi poll api(AvahiPoll) on top of the socket server.
+// The avahi watches are registered as PollDispatcher and the avahi timeouts
+// are run in the socket server wait cycle, so the mDNS publish does not need
+// its own event loop any more.
+//
+////////////////////////////////////////////////////////////////////////////////
+class MdnsPoll : public PollEventSource {
+   public:
+    explicit MdnsPoll(rtc::PhysicalSocketServer* socket_server);
+    ~MdnsPoll();
+
+    inline const AvahiPoll* GetPollApi() const { return &poll_api_; }
+
+    // PollEventSource
+    int GetNextTimeout(int cms) override;
+    void ProcessTimeout() override;
+
+   private:
+    // AvahiPoll api
+    static AvahiWatch* WatchNew(const AvahiPoll* api, int fd,
+                                AvahiWatchEvent event,
+                                AvahiWatchCallback callback, void* userdata);
+    static void WatchUpdate(AvahiWatch* watch, AvahiWatchEvent event);
+    static AvahiWatchEvent WatchGetEvents(AvahiWatch* watch);
+    static void WatchFree(AvahiWatch* watch);
+    static AvahiTimeout* TimeoutNew(const AvahiPoll* api,
+                                    const struct timeval* tv,
+                                    AvahiTimeoutCallback callback,
+                                    void* userdata);
+    static void TimeoutUpdate(AvahiTimeout* timeout, const struct timeval* tv);
+    static void TimeoutFree(AvahiTimeout* timeout);
+
+    // Removes the watches and timeouts freed by avahi
+    void Cleanup(bool all);
+
+    rtc::PhysicalSocketServer* const socket_server_;
+    AvahiPoll poll_api_;
+    std::list<AvahiWatch*> watches_;
+    std::list<AvahiTimeout*> timeouts_;
+};
+
+#endif  // MDNS_POLL_H_
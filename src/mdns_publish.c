@@ -51,9 +51,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <avahi-common/alternative.h>
 #include <avahi-common/error.h>
 #include <avahi-common/malloc.h>
-#include <avahi-common/simple-watch.h>
 #include <avahi-common/timeval.h>
-#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -62,7 +60,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 typedef struct _MdnsClientInfo {
     AvahiClient *client;
     AvahiEntryGroup *group;
-    AvahiSimplePoll *simple_poll;
+    mdns_failure_callback failure_callback;
+    void *userdata;
+    int failed;
     char *name;
     char *service_name;
     char *ws_url_path;
@@ -79,6 +79,14 @@ static MdnsClientInfo *_mdnsInfo = NULL;
 // forward declaration
 static void mdns_create_service(MdnsClientInfo *mi);
 
+// The poll api is owned by the caller, so the failure is reported to the
+// caller only once.
+static void mdns_quit(MdnsClientInfo *mi) {
+    if (mi->failed) return;
+    mi->failed = 1;
+    if (mi->failure_callback) mi->failure_callback(mi->userdata);
+}
+
 static void mdns_entry_group_callback(AvahiEntryGroup *g,
                                       AvahiEntryGroupState state,
                                       void *userdata) {
@@ -120,7 +128,7 @@ static void mdns_entry_group_callback(AvahiEntryGroup *g,
 
             /* Some kind of failure happened while we were registering our
              * services */
-            avahi_simple_poll_quit(mi->simple_poll);
+            mdns_quit(mi);
             break;
 
         case AVAHI_ENTRY_GROUP_UNCOMMITED:
@@ -142,7 +150,7 @@ static void mdns_create_service(MdnsClientInfo *mi) {
                   mi->client, mdns_entry_group_callback, mi))) {
             fprintf(stderr, "mDNS: avahi_entry_group_new() failed: %s\n",
                     avahi_strerror(avahi_client_errno(mi->client)));
-            avahi_simple_poll_quit(mi->simple_poll);
+            mdns_quit(mi);
         }
     }
 
@@ -175,14 +183,14 @@ static void mdns_create_service(MdnsClientInfo *mi) {
 
             fprintf(stderr, "mDNS: Failed to add _wstreamer._tcp service: %s\n",
                     avahi_strerror(ret));
-            avahi_simple_poll_quit(mi->simple_poll);
+            mdns_quit(mi);
         }
 
         /* Tell the server to register the service */
         if ((ret = avahi_entry_group_commit(mi->group)) < 0) {
             fprintf(stderr, "mDNS: Failed to commit entry group: %s\n",
                     avahi_strerror(ret));
-            avahi_simple_poll_quit(mi->simple_poll);
+            mdns_quit(mi);
         }
     }
     return;
@@ -203,7 +211,7 @@ static void mdns_client_callback(AvahiClient *c, AvahiClientState state,
         case AVAHI_CLIENT_FAILURE:
             fprintf(stderr, "mDNS: Client failure: %s\n",
                     avahi_strerror(avahi_client_errno(c)));
-            avahi_simple_poll_quit(mi->simple_poll);
+            mdns_quit(mi);
 
             break;
 
@@ -222,10 +230,18 @@ static void mdns_client_callback(AvahiClient *c, AvahiClientState state,
 }
 
 int mdns_init_clientinfo(int port_number, const char *ws,
-                         const char *device_id) {
+                         const char *device_id,
+                         const struct AvahiPoll *poll_api,
+                         mdns_failure_callback failure_callback,
+                         void *userdata) {
     int error = 0;
     char strbuf[128];
 
+    if (poll_api == NULL) {
+        fprintf(stderr, "mDNS: poll api is required.\n");
+        return MDNS_FAILED;
+    }
+
     if (_mdnsInfo != NULL) {
         fprintf(stderr, "mDNS: Warning, client info already initialized.\n");
         return MDNS_SUCCESS;
@@ -248,21 +264,15 @@ int mdns_init_clientinfo(int port_number, const char *ws,
     _mdnsInfo->ws_url_path = avahi_strdup(strbuf);
     snprintf(strbuf, sizeof(strbuf), "deviceid=%s", device_id);
     _mdnsInfo->device_id = avahi_strdup(strbuf);
-
-    /* Allocate main loop object */
-    if (!(_mdnsInfo->simple_poll = avahi_simple_poll_new())) {
-        fprintf(stderr, "mDNS: Failed to create simple poll object.\n");
-        mdns_destroy_clientinfo();
-        return MDNS_FAILED;
-    }
+    _mdnsInfo->failure_callback = failure_callback;
+    _mdnsInfo->userdata = userdata;
 
     /* Allocate a new client */
-    _mdnsInfo->client =
-        avahi_client_new(avahi_simple_poll_get(_mdnsInfo->simple_poll), 0,
-                         mdns_client_callback, _mdnsInfo, &error);
+    _mdnsInfo->client = avahi_client_new(poll_api, 0, mdns_client_callback,
+                                         _mdnsInfo, &error);
 
     /* Check wether creating the client object succeeded */
-    if (_mdnsInfo->client == NULL) {
+    if (_mdnsInfo->client == NULL || _mdnsInfo->failed) {
         fprintf(stderr, "mDNS: Failed to create client: %s\n",
                 avahi_strerror(error));
         mdns_destroy_clientinfo();
@@ -274,10 +284,9 @@ int mdns_init_clientinfo(int port_number, const char *ws,
 
 void mdns_destroy_clientinfo(void) {
     if (_mdnsInfo != NULL) {
-        if (_mdnsInfo->client) avahi_client_free(_mdnsInfo->client);
+        // the entry group belongs to the client, so it is freed first
         if (_mdnsInfo->group) avahi_entry_group_free(_mdnsInfo->group);
-        if (_mdnsInfo->simple_poll)
-            avahi_simple_poll_free(_mdnsInfo->simple_poll);
+        if (_mdnsInfo->client) avahi_client_free(_mdnsInfo->client);
 
         if (_mdnsInfo->name) avahi_free(_mdnsInfo->name);
         if (_mdnsInfo->service_name) avahi_free(_mdnsInfo->service_name);
@@ -292,21 +301,3 @@ void mdns_destroy_clientinfo(void) {
             "mDNS: Error, Trying to destroy mDNS client info without "
             "initialization.\n");
 }
-
-// timeout unit is ms.
-int mdns_run_loop(int timeout) {
-    int retvalue;
-    assert(_mdnsInfo);
-    assert(_mdnsInfo->client);
-    assert(_mdnsInfo->simple_poll);
-
-    if (timeout == 0) timeout = 5;
-    if ((retvalue =
-             avahi_simple_poll_iterate(_mdnsInfo->simple_poll, timeout)) != 0) {
-        if (retvalue >= 0 || errno != EINTR)
-            fprintf(stderr, "mDNS: simple poll returned non-zero value: %d\n",
-                    retvalue);
-        return MDNS_FAILED;
-    }
-    return MDNS_SUCCESS;
-}
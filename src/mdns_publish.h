@@ -37,10 +37,20 @@ extern "C" {
 #define MDNS_SUCCESS 0
 #define MDNS_FAILED 1
 
+struct AvahiPoll;  // forward
+
+// Called when the avahi client or the service registration fails after
+// mdns_init_clientinfo. It is called from the avahi callback, so the client
+// info should be destroyed after the callback returns.
+typedef void (*mdns_failure_callback)(void *userdata);
+
+// The avahi event loop runs with poll_api of the caller.
 int mdns_init_clientinfo(int port_number, const char *ws,
-                         const char *device_id);
+                         const char *device_id,
+                         const struct AvahiPoll *poll_api,
+                         mdns_failure_callback failure_callback,
+                         void *userdata);
 void mdns_destroy_clientinfo(void);
-int mdns_run_loop(int timeout);
 
 #ifdef __cplusplus
 }  // extern "C"
@@ -71,6 +71,9 @@ extern "C" {
 #define SPLITTER_OUTPUT_PORT 0
 #define SPLITTER_PREVIEW_PORT 1
 
+// ISP component used as the resizer between the camera and the encoder
+#define MMAL_COMPONENT_ISP "vc.ril.isp"
+
 // Video format information
 // 0 implies variable
 #define VIDEO_FRAME_RATE_NUM 30
@@ -78,6 +81,9 @@ extern "C" {
 
 /// Video render needs at least 2 buffers.
 #define VIDEO_OUTPUT_BUFFERS_NUM 3
+/// Encoder output buffers are held by the frame queue until the frames are
+/// released by the consumers, so it needs more buffers than recommended.
+#define VIDEO_ENCODER_OUTPUT_BUFFERS_NUM 24
 #define VIDEO_INTRAFRAME_PERIOD 3  /// 3 seconds
 
 // Stills format information
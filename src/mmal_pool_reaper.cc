@@ -0,0 +1,103 @@
+/*
+Copyright (c) 2021, rpi-webrtc-streamer Lyu,KeunChang
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "mmal_pool_reaper.h"
+
+#include "interface/mmal/util/mmal_util.h"
+#include "rtc_base/logging.h"
+
+namespace webrtc {
+
+MMALPoolReaper::MMALPoolReaper() {}
+
+MMALPoolReaper::~MMALPoolReaper() {
+    // The held headers would point to the freed payloads, so the pools
+    // still retired are left to the process exit.
+    webrtc::MutexLock lock(&mutex_);
+    if (!retired_pools_.empty())
+        RTC_LOG(LS_WARNING) << "MMAL pools still retired: "
+                            << retired_pools_.size();
+}
+
+MMAL_BOOL_T MMALPoolReaper::RetiredBufferReleaseCallback(
+    MMAL_POOL_T *pool, MMAL_BUFFER_HEADER_T *buffer, void *userdata) {
+    return MMAL_TRUE;
+}
+
+bool MMALPoolReaper::IsPoolFull(MMAL_POOL_T *pool) {
+    return mmal_queue_length(pool->queue) >= pool->headers_num;
+}
+
+bool MMALPoolReaper::Release(MMAL_COMPONENT_T *component, MMAL_PORT_T *port,
+                             MMAL_POOL_T *pool) {
+    // The headers released from now on stay in the pool queue instead of
+    // being sent to the port.
+    mmal_pool_callback_set(pool, RetiredBufferReleaseCallback, nullptr);
+    if (port->is_enabled == MMAL_FALSE && IsPoolFull(pool)) {
+        mmal_port_pool_destroy(port, pool);
+        return false;
+    }
+
+    RTC_LOG(INFO) << "Retiring MMAL pool of " << port->name
+                  << ", held buffers: "
+                  << pool->headers_num - mmal_queue_length(pool->queue);
+    mmal_component_acquire(component);
+    webrtc::MutexLock lock(&mutex_);
+    retired_pools_.push_back({component, port, pool});
+    return true;
+}
+
+size_t MMALPoolReaper::Reap() {
+    webrtc::MutexLock lock(&mutex_);
+    size_t waiting = 0;
+    for (auto it = retired_pools_.begin(); it != retired_pools_.end();) {
+        if (IsPoolFull(it->pool) == false) {
+            waiting++;
+            ++it;
+            continue;
+        }
+        if (it->port->is_enabled) {
+            ++it;  // the port is disabled later
+            continue;
+        }
+        RTC_LOG(INFO) << "Destroying the retired MMAL pool of "
+                      << it->port->name;
+        mmal_port_pool_destroy(it->port, it->pool);
+        mmal_component_release(it->component);
+        it = retired_pools_.erase(it);
+    }
+    return waiting;
+}
+
+size_t MMALPoolReaper::retired_count() {
+    webrtc::MutexLock lock(&mutex_);
+    return retired_pools_.size();
+}
+
+}  // namespace webrtc
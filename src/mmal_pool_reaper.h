@@ -0,0 +1,91 @@
+/*
+Copyright (c) 2021, rpi-webrtc-streamer Lyu,KeunChang
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef MMAL_POOL_REAPER_H_
+#define MMAL_POOL_REAPER_H_
+
+#include <vector>
+
+#include "interface/mmal/mmal.h"
+#include "rtc_base/constructor_magic.h"
+#include "rtc_base/synchronization/mutex.h"
+
+namespace webrtc {
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// MMAL Pool Reaper
+//
+// The frames are passed to the consumers without copying, so the consumers
+// hold the buffer headers of the encoder pool. When the pool is replaced or
+// the encoder is destroyed while the headers are still held, the pool is
+// retired instead of being destroyed. The retired pool keeps the released
+// headers in its queue, and it is destroyed by Reap after all of its headers
+// are back. mmal_port_pool_destroy disables the enabled port, so the pool of
+// the port which is enabled again with the new pool waits until the port is
+// disabled. The component of the pool port is acquired until then, so the
+// port used to free the payloads stays valid after the component is
+// destroyed.
+//
+////////////////////////////////////////////////////////////////////////////////
+class MMALPoolReaper {
+   public:
+    MMALPoolReaper();
+    ~MMALPoolReaper();
+
+    // Destroys the pool of the disabled port when all of the headers are in
+    // the pool queue, otherwise the pool is retired. Returns true when the
+    // pool is retired.
+    bool Release(MMAL_COMPONENT_T *component, MMAL_PORT_T *port,
+                 MMAL_POOL_T *pool);
+    // Destroys the retired pools which have all of the headers back, and
+    // returns the number of the pools still waiting for the held headers.
+    size_t Reap();
+    size_t retired_count();
+
+   private:
+    struct RetiredPool {
+        MMAL_COMPONENT_T *component;
+        MMAL_PORT_T *port;
+        MMAL_POOL_T *pool;
+    };
+    // Keeps the released header in the pool queue
+    static MMAL_BOOL_T RetiredBufferReleaseCallback(
+        MMAL_POOL_T *pool, MMAL_BUFFER_HEADER_T *buffer, void *userdata);
+    static bool IsPoolFull(MMAL_POOL_T *pool);
+
+    webrtc::Mutex mutex_;
+    std::vector<RetiredPool> retired_pools_;  // guarded by mutex_
+
+    RTC_DISALLOW_COPY_AND_ASSIGN(MMALPoolReaper);
+};
+
+}  // namespace webrtc
+
+#endif  // MMAL_POOL_REAPER_H_
@@ -261,6 +261,9 @@ MMAL_STATUS_T create_camera_component(RASPIVID_STATE *state) {
     MMAL_ES_FORMAT_T *format;
     MMAL_PORT_T *preview_port = NULL, *video_port = NULL, *still_port = NULL;
     MMAL_STATUS_T status;
+    // The camera captures at the capture resolution when the resizer is used
+    int width = state->capture_width ? state->capture_width : state->width;
+    int height = state->capture_height ? state->capture_height : state->height;
 
     /* Create the component */
     status = mmal_component_create(MMAL_COMPONENT_DEFAULT_CAMERA, &camera);
@@ -334,12 +337,12 @@ MMAL_STATUS_T create_camera_component(RASPIVID_STATE *state) {
     {
         MMAL_PARAMETER_CAMERA_CONFIG_T cam_config = {
             {MMAL_PARAMETER_CAMERA_CONFIG, sizeof(cam_config)},
-            .max_stills_w = state->width,
-            .max_stills_h = state->height,
+            .max_stills_w = width,
+            .max_stills_h = height,
             .stills_yuv422 = 0,
             .one_shot_stills = 0,
-            .max_preview_video_w = state->width,
-            .max_preview_video_h = state->height,
+            .max_preview_video_w = width,
+            .max_preview_video_h = height,
             .num_preview_video_frames =
                 3 + vcos_max(0, (state->framerate - 30) / 10),
             .stills_capture_circular_buffer_height = 0,
@@ -386,12 +389,12 @@ MMAL_STATUS_T create_camera_component(RASPIVID_STATE *state) {
     }
 
     format->encoding = MMAL_ENCODING_OPAQUE;
-    format->es->video.width = VCOS_ALIGN_UP(state->width, 32);
-    format->es->video.height = VCOS_ALIGN_UP(state->height, 16);
+    format->es->video.width = VCOS_ALIGN_UP(width, 32);
+    format->es->video.height = VCOS_ALIGN_UP(height, 16);
     format->es->video.crop.x = 0;
     format->es->video.crop.y = 0;
-    format->es->video.crop.width = state->width;
-    format->es->video.crop.height = state->height;
+    format->es->video.crop.width = width;
+    format->es->video.crop.height = height;
     format->es->video.frame_rate.num = PREVIEW_FRAME_RATE_NUM;
     format->es->video.frame_rate.den = PREVIEW_FRAME_RATE_DEN;
 
@@ -421,13 +424,15 @@ MMAL_STATUS_T create_camera_component(RASPIVID_STATE *state) {
         mmal_port_parameter_set(video_port, &fps_range.hdr);
     }
 
-    format->encoding = MMAL_ENCODING_OPAQUE;
-    format->es->video.width = VCOS_ALIGN_UP(state->width, 32);
-    format->es->video.height = VCOS_ALIGN_UP(state->height, 16);
+    // The resizer takes the I420 frames from the camera
+    format->encoding =
+        state->capture_width ? MMAL_ENCODING_I420 : MMAL_ENCODING_OPAQUE;
+    format->es->video.width = VCOS_ALIGN_UP(width, 32);
+    format->es->video.height = VCOS_ALIGN_UP(height, 16);
     format->es->video.crop.x = 0;
     format->es->video.crop.y = 0;
-    format->es->video.crop.width = state->width;
-    format->es->video.crop.height = state->height;
+    format->es->video.crop.width = width;
+    format->es->video.crop.height = height;
     format->es->video.frame_rate.num = state->framerate;
     format->es->video.frame_rate.den = VIDEO_FRAME_RATE_DEN;
 
@@ -449,12 +454,12 @@ MMAL_STATUS_T create_camera_component(RASPIVID_STATE *state) {
     format->encoding = MMAL_ENCODING_OPAQUE;
     format->encoding_variant = MMAL_ENCODING_I420;
 
-    format->es->video.width = VCOS_ALIGN_UP(state->width, 32);
-    format->es->video.height = VCOS_ALIGN_UP(state->height, 16);
+    format->es->video.width = VCOS_ALIGN_UP(width, 32);
+    format->es->video.height = VCOS_ALIGN_UP(height, 16);
     format->es->video.crop.x = 0;
     format->es->video.crop.y = 0;
-    format->es->video.crop.width = state->width;
-    format->es->video.crop.height = state->height;
+    format->es->video.crop.width = width;
+    format->es->video.crop.height = height;
     format->es->video.frame_rate.num = 0;
     format->es->video.frame_rate.den = 1;
 
@@ -665,6 +670,95 @@ void destroy_splitter_component(RASPIVID_STATE *state) {
     }
 }
 
+/**
+ * Create the resizer(ISP) component between the camera and the encoder
+ *
+ * The camera keeps capturing at the capture resolution, and only the
+ * resizer output format is changed when the encoding resolution changes.
+ * The input format is set by the connection from the camera video port.
+ *
+ * @param state Pointer to state control struct
+ *
+ * @return MMAL_SUCCESS if all OK, something else otherwise
+ *
+ */
+MMAL_STATUS_T create_resizer_component(RASPIVID_STATE *state) {
+    MMAL_COMPONENT_T *resizer = 0;
+    MMAL_STATUS_T status;
+
+    status = mmal_component_create(MMAL_COMPONENT_ISP, &resizer);
+    if (status != MMAL_SUCCESS) {
+        vcos_log_error("Unable to create resizer component");
+        goto error;
+    }
+
+    if (!resizer->input_num || !resizer->output_num) {
+        status = MMAL_ENOSYS;
+        vcos_log_error("Resizer doesn't have input/output ports");
+        goto error;
+    }
+
+    status = mmal_component_enable(resizer);
+    if (status != MMAL_SUCCESS) {
+        vcos_log_error("Unable to enable resizer component");
+        goto error;
+    }
+
+    state->resizer_component = resizer;
+    return status;
+
+error:
+    if (resizer) mmal_component_destroy(resizer);
+
+    return status;
+}
+
+/**
+ * Set the resizer output format to the encoding resolution
+ *
+ * The resizer output port must be disabled.
+ *
+ * @param state Pointer to state control struct
+ *
+ * @return MMAL_SUCCESS if all OK, something else otherwise
+ *
+ */
+MMAL_STATUS_T set_resizer_output_format(RASPIVID_STATE *state) {
+    MMAL_PORT_T *output = state->resizer_component->output[0];
+    MMAL_ES_FORMAT_T *format = output->format;
+    MMAL_STATUS_T status;
+
+    format->encoding = MMAL_ENCODING_I420;
+    format->encoding_variant = MMAL_ENCODING_I420;
+    format->es->video.width = VCOS_ALIGN_UP(state->width, 32);
+    format->es->video.height = VCOS_ALIGN_UP(state->height, 16);
+    format->es->video.crop.x = 0;
+    format->es->video.crop.y = 0;
+    format->es->video.crop.width = state->width;
+    format->es->video.crop.height = state->height;
+    format->es->video.frame_rate.num = state->framerate;
+    format->es->video.frame_rate.den = VIDEO_FRAME_RATE_DEN;
+
+    status = mmal_port_format_commit(output);
+    if (status != MMAL_SUCCESS)
+        vcos_log_error("resizer output format couldn't be set");
+
+    return status;
+}
+
+/**
+ * Destroy the resizer component
+ *
+ * @param state Pointer to state control struct
+ *
+ */
+void destroy_resizer_component(RASPIVID_STATE *state) {
+    if (state->resizer_component) {
+        mmal_component_destroy(state->resizer_component);
+        state->resizer_component = NULL;
+    }
+}
+
 /**
  * Create the encoder component, set up its ports
  *
@@ -731,6 +825,9 @@ MMAL_STATUS_T create_encoder_component(RASPIVID_STATE *state) {
     if (encoder_output->buffer_num < encoder_output->buffer_num_min)
         encoder_output->buffer_num = encoder_output->buffer_num_min;
 
+    if (encoder_output->buffer_num < VIDEO_ENCODER_OUTPUT_BUFFERS_NUM)
+        encoder_output->buffer_num = VIDEO_ENCODER_OUTPUT_BUFFERS_NUM;
+
     // We need to set the frame rate on output to 0, to ensure it gets
     // updated correctly from the input framerate when port connected
     encoder_output->format->es->video.frame_rate.num = 0;
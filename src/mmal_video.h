@@ -67,13 +67,16 @@ struct RASPIVID_STATE_S {
     MMAL_COMPONENT_T *camera_component;    /// Pointer to the camera component
     MMAL_COMPONENT_T *splitter_component;  /// Pointer to the splitter component
     MMAL_COMPONENT_T *encoder_component;   /// Pointer to the encoder component
+    MMAL_COMPONENT_T *resizer_component;   /// Pointer to the resizer component
 
     MMAL_CONNECTION_T *preview_connection;   /// Pointer to the connection from
                                              /// camera or splitter to preview
     MMAL_CONNECTION_T *splitter_connection;  /// Pointer to the connection from
                                              /// camera to splitter
     MMAL_CONNECTION_T *encoder_connection;   /// Pointer to the connection from
-                                             /// camera to encoder
+                                             /// camera(or resizer) to encoder
+    MMAL_CONNECTION_T *resizer_connection;   /// Pointer to the connection from
+                                             /// camera to resizer
 
     MMAL_POOL_T *splitter_pool;  /// Pointer to the pool of buffers used by
                                  /// splitter output port 0
@@ -86,6 +89,8 @@ struct RASPIVID_STATE_S {
     int inlineMotionVectors;  /// Encoder outputs inline Motion Vectors
 
     int cameraNum;           /// Camera number
+    int capture_width;       /// Camera output size when the resizer is used,
+    int capture_height;      /// zero when the camera feeds the encoder
     int settings;            /// Request settings from the camera
     int sensor_mode;         /// Sensor mode. 0=auto. Check docs/forum for modes
                              /// selected by other values.
@@ -112,6 +117,9 @@ MMAL_STATUS_T create_camera_component(RASPIVID_STATE *state);
 void destroy_camera_component(RASPIVID_STATE *state);
 MMAL_STATUS_T create_splitter_component(RASPIVID_STATE *state);
 void destroy_splitter_component(RASPIVID_STATE *state);
+MMAL_STATUS_T create_resizer_component(RASPIVID_STATE *state);
+MMAL_STATUS_T set_resizer_output_format(RASPIVID_STATE *state);
+void destroy_resizer_component(RASPIVID_STATE *state);
 MMAL_STATUS_T create_encoder_component(RASPIVID_STATE *state);
 void destroy_encoder_component(RASPIVID_STATE *state);
 MMAL_STATUS_T connect_ports(MMAL_PORT_T *output_port, MMAL_PORT_T *input_port,
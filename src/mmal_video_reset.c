@@ -317,6 +317,9 @@ MMAL_STATUS_T reset_encoder_component(RASPIVID_STATE *state) {
     if (encoder_output->buffer_num < encoder_output->buffer_num_min)
         encoder_output->buffer_num = encoder_output->buffer_num_min;
 
+    if (encoder_output->buffer_num < VIDEO_ENCODER_OUTPUT_BUFFERS_NUM)
+        encoder_output->buffer_num = VIDEO_ENCODER_OUTPUT_BUFFERS_NUM;
+
     // We need to set the frame rate on output to 0, to ensure it gets
     // updated correctly from the input framerate when port connected
     encoder_output->format->es->video.frame_rate.num = 0;
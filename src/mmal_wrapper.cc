@@ -30,12 +30,16 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "mmal_wrapper.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
+#include <algorithm>
+
 #include "rtc_base/checks.h"
 #include "rtc_base/logging.h"
 #include "rtc_base/string_utils.h"
 #include "rtc_base/task_queue.h"
+#include "rtc_base/time_utils.h"
 
 namespace webrtc {
 
@@ -52,6 +56,22 @@ constexpr int kDelayTaskIdleInterval = 1000;
 constexpr int kInitCoolingDownPeriodMs = 2000;
 constexpr int kInitDelayingPeriodMs = 2000;
 
+// Encoder output buffers which are not held by the frame queue
+constexpr size_t kEncoderPortMinBuffers = 4;
+// Interval checking the retired encoder pools
+constexpr int kPoolReapIntervalMs = 100;
+
+// The resizer scales the whole camera frame, so the aspect ratio of the
+// encoding resolution should be within 1/50 of the capture resolution.
+constexpr int kAspectRatioTolerance = 50;
+
+bool IsSameAspectRatio(int width, int height, int other_width,
+                       int other_height) {
+    int64_t lhs = static_cast<int64_t>(width) * other_height;
+    int64_t rhs = static_cast<int64_t>(height) * other_width;
+    return std::abs(lhs - rhs) * kAspectRatioTolerance <= rhs;
+}
+
 }  // namespace
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -68,6 +88,9 @@ constexpr int kInitDelayingPeriodMs = 2000;
 // bandwidth decision of BWE. Therefore, after 2 seconds after InitEncode,
 // it is necessary to reset the resolution according to the BWE bitrate.
 //
+// When the resizer is used and the new resolution is covered by the capture
+// resolution, only the resizer output is changed, so the delay is skipped.
+//
 ///////////////////////////////////////////////////////////////////////////////
 
 class EncoderDelayedInit::DelayInitTask : public webrtc::QueuedTask {
@@ -107,12 +130,9 @@ bool EncoderDelayedInit::IsEncodingActive() {
     return mmal_encoder_ && mmal_encoder_->IsInited();
 }
 
-bool EncoderDelayedInit::InitEncoder(wstreamer::VideoEncodingParams config) {
-    if (mmal_encoder_->IsInited()) {
-        RTC_LOG(LS_ERROR) << "MMAL Encoder already initialized.";
-        return true;
-    };
-
+bool EncoderDelayedInit::InitEncoder(
+    wstreamer::VideoEncodingParams config,
+    const wstreamer::EncoderSettings &settings) {
     RTC_LOG(INFO) << "InitEncoder " << config.ToString();
     RTC_LOG(LS_INFO)
         << "Created EncoderDelayedInit Task, Scheduling on queue...";
@@ -123,7 +143,10 @@ bool EncoderDelayedInit::InitEncoder(wstreamer::VideoEncodingParams config) {
     // InitEncoder does not need to do any init delay
     RTC_LOG(INFO) << "EncoderDelay state changed from IDLE to COOLINGDOWN";
     state_ = INIT_COOLINGDOWN;
-    return mmal_encoder_->InitEncoder(config);
+    // The encoder may be already initialized by motion detection,
+    // so live streaming joins the encoder session.
+    return mmal_encoder_->OpenEncoderSession(MMALEncoderWrapper::CLIENT_LIVE,
+                                             config, settings);
 }
 
 bool EncoderDelayedInit::ReinitEncoder(wstreamer::VideoEncodingParams config) {
@@ -133,6 +156,17 @@ bool EncoderDelayedInit::ReinitEncoder(wstreamer::VideoEncodingParams config) {
     };
     RTC_LOG(INFO) << "ReinitEncoder " << config.ToString();
 
+    if (mmal_encoder_->CanResize(config)) {
+        // Resizing does not rebuild the camera and encoder components,
+        // so it does not need to be delayed.
+        if (mmal_encoder_->ReinitEncoder(config) == false) {
+            RTC_LOG(LS_ERROR) << "Failed to resize MMAL encoder";
+            return false;
+        };
+        mmal_encoder_->StartCapture();
+        return true;
+    }
+
     if (state_ == IDLE) {
         state_ = INIT_COOLINGDOWN;
         RTC_LOG(INFO) << "EncoderDelay state changed from IDLE to COOLINGDOWN";
@@ -188,16 +222,38 @@ bool EncoderDelayedInit::UpdateStateOrMayInit() {
 // MMAL Encoder Wrapper
 //
 ////////////////////////////////////////////////////////////////////////////////
+class MMALEncoderWrapper::ReapPoolTask : public webrtc::QueuedTask {
+   public:
+    explicit ReapPoolTask(MMALPoolReaper *pool_reaper)
+        : pool_reaper_(pool_reaper) {}
+
+   private:
+    bool Run() override {
+        if (pool_reaper_->Reap() == 0) {
+            return true;  // TaskQueue will free this task.
+        }
+        webrtc::TaskQueueBase::Current()->PostDelayedTask(
+            std::unique_ptr<webrtc::QueuedTask>(this), kPoolReapIntervalMs);
+        return false;  // Retain the task in order to reuse it.
+    }
+
+    MMALPoolReaper *const pool_reaper_;
+};
 
 MMALEncoderWrapper::MMALEncoderWrapper()
     : encoder_delayed_init_(this),
       mmal_initialized_(false),
+      motion_observer_(nullptr),
+      motion_imv_observer_(nullptr),
       camera_preview_port_(nullptr),
       camera_video_port_(nullptr),
       camera_still_port_(nullptr),
       preview_input_port_(nullptr),
       encoder_input_port_(nullptr),
-      encoder_output_port_(nullptr) {
+      encoder_output_port_(nullptr),
+      task_queue_factory_(webrtc::CreateDefaultTaskQueueFactory()),
+      pool_task_queue_(task_queue_factory_->CreateTaskQueue(
+          "EncoderPool", webrtc::TaskQueueFactory::Priority::LOW)) {
     bcm_host_init();
 
     // Register our application with the logging system
@@ -221,6 +277,7 @@ void MMALEncoderWrapper::SetEncoderConfigParams(
     // cameraNum sets the config value as it is.
     // There is no need to change or use this value internally.
     state_.cameraNum = config_media_->GetCameraSelect();
+    SetDropThreshold(config_media_->GetFrameQueueDropThreshold());
 
     // Setting Video ROI
     {
@@ -324,6 +381,214 @@ void MMALEncoderWrapper::SetEncoderConfigParams(
     }
 }
 
+////////////////////////////////////////////////////////////////////////////////
+//
+// Encoder Session Arbitration
+//
+// - resolution: motion detection requires the fixed resolution for motion
+//   vector analysis, so the motion client resolution is used when it is active
+// - framerate: the highest framerate of the clients
+// - bitrate: live streaming bitrate is used when it is active, because the
+//   bitrate is decided by the bandwidth estimation of WebRTC
+// - inline motion vector: enabled when any client requires it
+// - intra period: the shortest intra period of the clients
+// - annotation: the first client which has the annotation settings
+//
+////////////////////////////////////////////////////////////////////////////////
+bool MMALEncoderWrapper::MergeSessionRequests(
+    wstreamer::VideoEncodingParams *config,
+    wstreamer::EncoderSettings *settings) {
+    bool has_active = false;
+    bool imv_enable = false;
+
+    *settings = wstreamer::EncoderSettings();
+    for (int client = CLIENT_MAX - 1; client >= 0; client--) {
+        const SessionRequest &request = session_requests_[client];
+        if (request.active == false) continue;
+
+        if (has_active == false) {
+            // the motion client has the priority in resolution
+            *config = request.config;
+        } else {
+            config->framerate_ =
+                std::max(config->framerate_, request.config.framerate_);
+        }
+        if (client == CLIENT_LIVE) config->bitrate_ = request.config.bitrate_;
+        has_active = true;
+
+        imv_enable |= request.settings.imv_enable.value_or(false);
+        if (request.settings.intra_period) {
+            settings->intra_period = std::min(
+                settings->intra_period.value_or(
+                    request.settings.intra_period.value()),
+                request.settings.intra_period.value());
+        }
+        if (!settings->annotation_enable &&
+            request.settings.annotation_enable) {
+            settings->annotation_enable = request.settings.annotation_enable;
+            settings->annotation_text = request.settings.annotation_text;
+            settings->annotation_text_size =
+                request.settings.annotation_text_size;
+        }
+    }
+    settings->imv_enable = imv_enable;
+    return has_active;
+}
+
+bool MMALEncoderWrapper::OpenEncoderSession(
+    EncoderClient client, wstreamer::VideoEncodingParams config,
+    const wstreamer::EncoderSettings &settings) {
+    webrtc::MutexLock lock(&session_mutex_);
+    wstreamer::VideoEncodingParams merged_config;
+    wstreamer::EncoderSettings merged_settings;
+
+    RTC_DCHECK(client >= CLIENT_LIVE && client < CLIENT_MAX);
+    session_requests_[client].active = true;
+    session_requests_[client].config = config;
+    session_requests_[client].settings = settings;
+    MergeSessionRequests(&merged_config, &merged_settings);
+    RTC_LOG(INFO) << "Encoder session opened by client " << client
+                  << ", merged config: " << merged_config.ToString();
+
+    if (mmal_initialized_ == true) {
+        if (CanUpdateEncoderSession(merged_config, merged_settings)) {
+            // no need to reinitialize the encoder
+            if (UpdateEncoderSession(merged_config, merged_settings))
+                return true;
+            session_requests_[client].active = false;
+            return false;
+        }
+        // intra period can not be changed with ReinitEncoder, so the encoder
+        // is initialized again.
+        RTC_LOG(INFO) << "Restarting the encoder session for the new client";
+        StopCapture();
+        UninitEncoder();
+    }
+
+    SetEncoderConfigParams(&merged_settings);
+    if (InitEncoder(merged_config) == false) {
+        session_requests_[client].active = false;
+        return false;
+    }
+    session_settings_ = merged_settings;
+    return StartCapture();
+}
+
+void MMALEncoderWrapper::CloseEncoderSession(EncoderClient client) {
+    webrtc::MutexLock lock(&session_mutex_);
+    wstreamer::VideoEncodingParams merged_config;
+    wstreamer::EncoderSettings merged_settings;
+
+    RTC_DCHECK(client >= CLIENT_LIVE && client < CLIENT_MAX);
+    if (session_requests_[client].active == false) return;
+    session_requests_[client].active = false;
+    RTC_LOG(INFO) << "Encoder session closed by client " << client;
+
+    if (MergeSessionRequests(&merged_config, &merged_settings) == false) {
+        // last client of the session
+        StopCapture();
+        UninitEncoder();
+        return;
+    }
+    // The remaining client keeps the encoder session. Its resolution and
+    // inline motion vectors are restored with the resizer, otherwise only its
+    // rate is restored.
+    if (CanUpdateEncoderSession(merged_config, merged_settings)) {
+        if (UpdateEncoderSession(merged_config, merged_settings) == false)
+            RTC_LOG(LS_ERROR) << "Failed to restore the encoder session of "
+                              << "the remaining client";
+        return;
+    }
+    SetRate(merged_config.framerate_, merged_config.bitrate_);
+}
+
+bool MMALEncoderWrapper::CanUpdateEncoderSession(
+    const wstreamer::VideoEncodingParams &config,
+    const wstreamer::EncoderSettings &settings) {
+    wstreamer::VideoEncodingParams current(state_.width, state_.height,
+                                           state_.framerate,
+                                           state_.bitrate / 1000);
+    if (settings.intra_period != session_settings_.intra_period) return false;
+    if (config.IsSameResolution(current) &&
+        settings.imv_enable == session_settings_.imv_enable)
+        return true;
+    // the inline motion vectors are switched with the encoder output port,
+    // which is reconfigured by the resizer path.
+    return CanResize(config);
+}
+
+bool MMALEncoderWrapper::UpdateEncoderSession(
+    const wstreamer::VideoEncodingParams &config,
+    const wstreamer::EncoderSettings &settings) {
+    wstreamer::VideoEncodingParams current(state_.width, state_.height,
+                                           state_.framerate,
+                                           state_.bitrate / 1000);
+    if (config.IsSameResolution(current) &&
+        settings.imv_enable == session_settings_.imv_enable)
+        return SetRate(config.framerate_, config.bitrate_);
+
+    if (ResizeEncoder(config, settings.imv_enable.value_or(false)) == false)
+        return false;
+    session_settings_.imv_enable = settings.imv_enable;
+    SetRate(config.framerate_, config.bitrate_);
+    return StartCapture();
+}
+
+bool MMALEncoderWrapper::SetSessionRate(EncoderClient client, int framerate,
+                                        int bitrate) {
+    webrtc::MutexLock lock(&session_mutex_);
+    wstreamer::VideoEncodingParams merged_config;
+    wstreamer::EncoderSettings merged_settings;
+
+    RTC_DCHECK(client >= CLIENT_LIVE && client < CLIENT_MAX);
+    session_requests_[client].config.framerate_ = framerate;
+    session_requests_[client].config.bitrate_ = bitrate;
+    if (MergeSessionRequests(&merged_config, &merged_settings) == false)
+        return false;
+    return SetRate(merged_config.framerate_, merged_config.bitrate_);
+}
+
+bool MMALEncoderWrapper::GetEncoderResolution(int *width, int *height) {
+    webrtc::MutexLock lock(&mutex_);
+    if (mmal_initialized_ == false || encoder_input_port_ == nullptr)
+        return false;
+    MMAL_VIDEO_FORMAT_T &video = encoder_input_port_->format->es->video;
+    *width = video.crop.width;
+    *height = video.crop.height;
+    return true;
+}
+
+bool MMALEncoderWrapper::IsResolutionFixed() {
+    webrtc::MutexLock lock(&session_mutex_);
+    return session_requests_[CLIENT_MOTION].active;
+}
+
+void MMALEncoderWrapper::RegisterMotionObserver(
+    MotionBlobObserver *blob_observer, MotionImvObserver *imv_observer) {
+    webrtc::MutexLock lock(&motion_observer_mutex_);
+    motion_observer_ = blob_observer;
+    motion_imv_observer_ = imv_observer;
+}
+
+void MMALEncoderWrapper::NotifyMotionTriggered(int active_nums) {
+    webrtc::MutexLock lock(&motion_observer_mutex_);
+    if (motion_observer_) motion_observer_->OnMotionTriggered(active_nums);
+}
+
+void MMALEncoderWrapper::NotifyMotionCleared(int updates) {
+    webrtc::MutexLock lock(&motion_observer_mutex_);
+    if (motion_observer_) motion_observer_->OnMotionCleared(updates);
+}
+
+void MMALEncoderWrapper::NotifyActivePoints(int total_points,
+                                            int active_points,
+                                            int moving_points) {
+    webrtc::MutexLock lock(&motion_observer_mutex_);
+    if (motion_imv_observer_)
+        motion_imv_observer_->OnActivePoints(total_points, active_points,
+                                             moving_points);
+}
+
 bool MMALEncoderWrapper::InitEncoder(wstreamer::VideoEncodingParams config) {
     MMAL_STATUS_T status = MMAL_SUCCESS;
 
@@ -337,11 +602,14 @@ bool MMALEncoderWrapper::InitEncoder(wstreamer::VideoEncodingParams config) {
     state_.height = config.height_;
     state_.framerate = config.framerate_;
     state_.bitrate = config.bitrate_ * 1000;
+    SetCaptureResolution(config);
 
     // set annotation text size ratio based on video resolution
+    // The annotation is drawn by the camera, so it is based on the capture
+    // resolution when the resizer is used.
     if (state_.camera_parameters.annotate_text_size_ratio != 0) {
         state_.camera_parameters.annotate_text_size =
-            (config.width_ *
+            ((state_.capture_width ? state_.capture_width : config.width_) *
              state_.camera_parameters.annotate_text_size_ratio) /
                 100 +
             1;
@@ -357,6 +625,12 @@ bool MMALEncoderWrapper::InitEncoder(wstreamer::VideoEncodingParams config) {
         RTC_LOG(LS_ERROR) << "Failed to create encode component";
         raspipreview_destroy(&state_.preview_parameters);
         destroy_camera_component(&state_);
+    } else if (state_.capture_width &&
+               (status = create_resizer_component(&state_)) != MMAL_SUCCESS) {
+        RTC_LOG(LS_ERROR) << "Failed to create resizer component";
+        destroy_encoder_component(&state_);
+        raspipreview_destroy(&state_.preview_parameters);
+        destroy_camera_component(&state_);
     } else {
         if (state_.verbose)
             RTC_LOG(INFO) << "Starting component connection stage";
@@ -389,18 +663,22 @@ bool MMALEncoderWrapper::InitEncoder(wstreamer::VideoEncodingParams config) {
             }
         }
 
-        if (state_.verbose)
-            RTC_LOG(INFO)
-                << "Connecting camera video port to encoder input port";
+        if (state_.resizer_component) {
+            if (ConnectResizer() == false) return false;
+        } else {
+            if (state_.verbose)
+                RTC_LOG(INFO)
+                    << "Connecting camera video port to encoder input port";
 
-        // Now connect the camera to the encoder
-        status = connect_ports(camera_video_port_, encoder_input_port_,
-                               &state_.encoder_connection);
-        if (status != MMAL_SUCCESS) {
-            state_.encoder_connection = nullptr;
-            RTC_LOG(LS_ERROR)
-                << "Failed to connect camera video port to encoder input";
-            return false;
+            // Now connect the camera to the encoder
+            status = connect_ports(camera_video_port_, encoder_input_port_,
+                                   &state_.encoder_connection);
+            if (status != MMAL_SUCCESS) {
+                state_.encoder_connection = nullptr;
+                RTC_LOG(LS_ERROR)
+                    << "Failed to connect camera video port to encoder input";
+                return false;
+            }
         }
 
         encoder_output_port_->userdata = (struct MMAL_PORT_USERDATA_T *)this;
@@ -412,7 +690,10 @@ bool MMALEncoderWrapper::InitEncoder(wstreamer::VideoEncodingParams config) {
         recommanded_buffer_num_ = GetRecommandedBufferNum(encoder_output_port_);
         RTC_LOG(INFO) << "Queue Buffer size: " << recommanded_buffer_size_
                       << ", Buffer num: " << recommanded_buffer_num_;
-        Init(recommanded_buffer_num_, recommanded_buffer_size_);
+        Init(recommanded_buffer_num_, recommanded_buffer_size_,
+             GetImvBufferSize());
+        mmal_pool_callback_set(state_.encoder_pool, BufferReleaseCallback,
+                               this);
 
         // Enable the encoder output port and tell it its callback function
         status = mmal_port_enable(encoder_output_port_, BufferCallback);
@@ -445,6 +726,29 @@ bool MMALEncoderWrapper::ReinitEncoder(wstreamer::VideoEncodingParams config) {
                              "initialized before";
         return false;
     }
+    {
+        // Only the live streaming changes the resolution, and its resolution
+        // is restored when the motion detection leaves the session.
+        webrtc::MutexLock lock(&session_mutex_);
+        session_requests_[CLIENT_LIVE].config = config;
+    }
+
+    if (state_.resizer_component) {
+        if (CanResize(config)) {
+            if (ResizeEncoder(config, state_.inlineMotionVectors != 0) == false)
+                return false;
+            return SetRate(config.framerate_, config.bitrate_);
+        }
+        // The capture resolution can not cover the new resolution, so the
+        // components are created again with the new capture resolution.
+        int64_t start_ms = rtc::TimeMillis();
+        StopCapture();
+        UninitEncoder();
+        if (InitEncoder(config) == false) return false;
+        RTC_LOG(INFO) << "Encoder components rebuilt in "
+                      << rtc::TimeMillis() - start_ms << " ms";
+        return true;
+    }
 
     state_.width = config.width_;
     state_.height = config.height_;
@@ -569,7 +873,10 @@ bool MMALEncoderWrapper::ReinitEncoder(wstreamer::VideoEncodingParams config) {
             GetRecommandedBufferSize(encoder_output_port_);
         recommanded_buffer_num_ = GetRecommandedBufferNum(encoder_output_port_);
         // Init Frame Queue with recommended frame buffer size
-        Init(recommanded_buffer_num_, recommanded_buffer_size_);
+        Init(recommanded_buffer_num_, recommanded_buffer_size_,
+             GetImvBufferSize());
+        mmal_pool_callback_set(state_.encoder_pool, BufferReleaseCallback,
+                               this);
 
         // Enable the encoder output port and tell it its callback function
         status = mmal_port_enable(encoder_output_port_, BufferCallback);
@@ -586,6 +893,196 @@ bool MMALEncoderWrapper::ReinitEncoder(wstreamer::VideoEncodingParams config) {
     return false;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+//
+// Resizer
+//
+// The resizer(ISP) sits between the camera and the encoder, so the camera
+// keeps capturing at the capture resolution and the resolution change only
+// reconfigures the resizer output and the encoder input. It costs one IDR
+// frame instead of rebuilding the camera and encoder components.
+//
+////////////////////////////////////////////////////////////////////////////////
+void MMALEncoderWrapper::SetCaptureResolution(
+    const wstreamer::VideoEncodingParams &config) {
+    int width, height;
+
+    state_.capture_width = state_.capture_height = 0;
+    if (config_media_->GetVideoResizerEnable() == false) return;
+
+    config_media_->GetMaxVideoResolution(width, height);
+    if (config.width_ > width || config.height_ > height ||
+        !IsSameAspectRatio(config.width_, config.height_, width, height)) {
+        // The requested resolution is not in the resolution list(e.g. motion
+        // detection), so the camera captures at the requested resolution.
+        width = config.width_;
+        height = config.height_;
+    }
+    state_.capture_width = width;
+    state_.capture_height = height;
+    RTC_LOG(INFO) << "Camera capture resolution: " << width << "x" << height;
+}
+
+bool MMALEncoderWrapper::CanResize(
+    const wstreamer::VideoEncodingParams &config) {
+    if (mmal_initialized_ == false || state_.resizer_component == nullptr)
+        return false;
+    if (config.width_ > state_.capture_width ||
+        config.height_ > state_.capture_height)
+        return false;
+    return IsSameAspectRatio(config.width_, config.height_,
+                             state_.capture_width, state_.capture_height);
+}
+
+bool MMALEncoderWrapper::ConnectResizer() {
+    MMAL_STATUS_T status;
+
+    if (state_.resizer_connection == nullptr) {
+        if (state_.verbose)
+            RTC_LOG(INFO) << "Connecting camera video port to resizer input";
+        status = connect_ports(camera_video_port_,
+                               state_.resizer_component->input[0],
+                               &state_.resizer_connection);
+        if (status != MMAL_SUCCESS) {
+            state_.resizer_connection = nullptr;
+            RTC_LOG(LS_ERROR)
+                << "Failed to connect camera video port to resizer input";
+            return false;
+        }
+    }
+
+    if (set_resizer_output_format(&state_) != MMAL_SUCCESS) {
+        RTC_LOG(LS_ERROR) << "Failed to set resizer output format";
+        return false;
+    }
+
+    // The connection copies the resizer output format to the encoder input
+    if (state_.verbose)
+        RTC_LOG(INFO) << "Connecting resizer output to encoder input port";
+    status = connect_ports(state_.resizer_component->output[0],
+                           encoder_input_port_, &state_.encoder_connection);
+    if (status != MMAL_SUCCESS) {
+        state_.encoder_connection = nullptr;
+        RTC_LOG(LS_ERROR)
+            << "Failed to connect resizer output to encoder input";
+        return false;
+    }
+    return true;
+}
+
+bool MMALEncoderWrapper::ResizeEncoder(
+    const wstreamer::VideoEncodingParams &config, bool imv_enable) {
+    webrtc::MutexLock lock(&mutex_);
+    MMAL_VIDEO_FORMAT_T &current =
+        state_.resizer_component->output[0]->format->es->video;
+    int64_t start_ms = rtc::TimeMillis();
+
+    // state_ may have the pending resolution of the delayed init, so the
+    // resizer output format is compared.
+    if (current.crop.width == config.width_ &&
+        current.crop.height == config.height_ &&
+        (state_.inlineMotionVectors != 0) == imv_enable)
+        return true;
+    const int prev_width = current.crop.width;
+    const int prev_height = current.crop.height;
+    const bool prev_imv_enable = state_.inlineMotionVectors != 0;
+
+    RTC_LOG(INFO) << "Resizing the encoder input to " << config.ToString()
+                  << ", inline motion vectors: " << imv_enable;
+    if (StopCapture() == false) {
+        RTC_LOG(LS_ERROR) << "Unable to unset capture start";
+        return false;
+    }
+
+    if (ConfigureEncoderOutput(config.width_, config.height_, imv_enable) ==
+        false) {
+        RTC_LOG(LS_ERROR) << "Failed to resize the encoder, restoring "
+                          << prev_width << "x" << prev_height;
+        if (ConfigureEncoderOutput(prev_width, prev_height,
+                                   prev_imv_enable) == false) {
+            RTC_LOG(LS_ERROR) << "Failed to restore the encoder resolution";
+            return false;
+        }
+        StartCapture();
+        return false;
+    }
+    RTC_LOG(INFO) << "Encoder resized in " << rtc::TimeMillis() - start_ms
+                  << " ms";
+    return true;
+}
+
+bool MMALEncoderWrapper::ConfigureEncoderOutput(int width, int height,
+                                                bool imv_enable) {
+    // The encoder buffers go back to the pool while the port is disabled
+    check_disable_port(encoder_output_port_);
+    if (state_.encoder_connection) {
+        mmal_connection_destroy(state_.encoder_connection);
+        state_.encoder_connection = nullptr;
+    }
+    // The retired pools of this port can be destroyed only while the port
+    // is disabled.
+    pool_reaper_.Reap();
+
+    state_.width = width;
+    state_.height = height;
+    if (ConnectResizer() == false) return false;
+
+    // The encoder output follows the new input format
+    mmal_format_copy(encoder_output_port_->format,
+                     encoder_input_port_->format);
+    encoder_output_port_->format->encoding = state_.encoding;
+    encoder_output_port_->format->bitrate = state_.bitrate;
+    encoder_output_port_->format->es->video.frame_rate.num = 0;
+    encoder_output_port_->format->es->video.frame_rate.den = 1;
+    if (mmal_port_format_commit(encoder_output_port_) != MMAL_SUCCESS) {
+        RTC_LOG(LS_ERROR) << "Unable to set format on encoder output port";
+        return false;
+    }
+
+    // The pool is replaced only when the new resolution requires the larger
+    // buffer than the pool has. The frames of the previous resolution may
+    // still hold the buffers of the old pool.
+    if (encoder_output_port_->buffer_size <
+        encoder_output_port_->buffer_size_min)
+        encoder_output_port_->buffer_size =
+            encoder_output_port_->buffer_size_min;
+    if (state_.encoder_pool->header[0]->alloc_size <
+        encoder_output_port_->buffer_size) {
+        MMAL_POOL_T *pool = mmal_port_pool_create(
+            encoder_output_port_, state_.encoder_pool->headers_num,
+            encoder_output_port_->buffer_size);
+        if (pool == nullptr) {
+            RTC_LOG(LS_ERROR) << "Failed to create the encoder pool";
+            return false;
+        }
+        ReleaseEncoderPool();
+        state_.encoder_pool = pool;
+        mmal_pool_callback_set(state_.encoder_pool, BufferReleaseCallback,
+                               this);
+    }
+
+    // The inline motion vectors can be switched while the port is disabled,
+    // same with create_encoder_component.
+    if (mmal_port_parameter_set_boolean(
+            encoder_output_port_, MMAL_PARAMETER_VIDEO_ENCODE_INLINE_VECTORS,
+            imv_enable) != MMAL_SUCCESS) {
+        RTC_LOG(LS_ERROR) << "Failed to set the inline motion vectors";
+        return false;
+    }
+    state_.inlineMotionVectors = imv_enable;
+
+    recommanded_buffer_size_ = GetRecommandedBufferSize(encoder_output_port_);
+    Init(recommanded_buffer_num_, recommanded_buffer_size_,
+         GetImvBufferSize());
+
+    if (mmal_port_enable(encoder_output_port_, BufferCallback) !=
+        MMAL_SUCCESS) {
+        RTC_LOG(LS_ERROR) << "Failed to setup encoder output";
+        return false;
+    }
+    return true;
+}
+
 bool MMALEncoderWrapper::Zoom(wstreamer::ZoomOptions options) {
     RTC_DCHECK(options.cmd >= wstreamer::ZoomOptions::IS_ACTIVE &&
                options.cmd <= wstreamer::ZoomOptions::RESET);
@@ -624,6 +1121,34 @@ void MMALEncoderWrapper::BufferCallback(MMAL_PORT_T *port,
         ->OnBufferCallback(port, buffer);
 }
 
+MMAL_BOOL_T MMALEncoderWrapper::BufferReleaseCallback(
+    MMAL_POOL_T *pool, MMAL_BUFFER_HEADER_T *buffer, void *userdata) {
+    return reinterpret_cast<MMALEncoderWrapper *>(userdata)->OnBufferRelease(
+        buffer);
+}
+
+MMAL_BOOL_T MMALEncoderWrapper::OnBufferRelease(MMAL_BUFFER_HEADER_T *buffer) {
+    // send the released buffer back to the port (if still open),
+    // otherwise keep it in the pool queue.
+    if (encoder_output_port_->is_enabled) {
+        if (mmal_port_send_buffer(encoder_output_port_, buffer) ==
+            MMAL_SUCCESS)
+            return MMAL_FALSE;
+        RTC_LOG(LS_ERROR) << "Unable to return a buffer to the encoder port";
+    }
+    return MMAL_TRUE;
+}
+
+void MMALEncoderWrapper::ReleaseEncoderPool() {
+    clear();
+    if (state_.encoder_pool == nullptr) return;
+    if (pool_reaper_.Release(state_.encoder_component, encoder_output_port_,
+                             state_.encoder_pool))
+        pool_task_queue_.PostTask(
+            std::make_unique<ReapPoolTask>(&pool_reaper_));
+    state_.encoder_pool = nullptr;
+}
+
 size_t MMALEncoderWrapper::GetRecommandedBufferSize(MMAL_PORT_T *port) {
     RTC_LOG(INFO) << "MMAL Port Recommanded buffer size: "
                   << port->buffer_size_recommended;
@@ -633,14 +1158,17 @@ size_t MMALEncoderWrapper::GetRecommandedBufferSize(MMAL_PORT_T *port) {
 }
 
 size_t MMALEncoderWrapper::GetRecommandedBufferNum(MMAL_PORT_T *port) {
-    RTC_LOG(INFO) << "MMAL Port Recommanded buffer size: "
-                  << port->buffer_num_recommended;
-    // normally, it required  the doube of port recommanded size
-    // for safety,,
-    if (state_.inlineMotionVectors)
-        return port->buffer_num_recommended * 3 * 2;
-    else
-        return port->buffer_num_recommended * 3;
+    RTC_LOG(INFO) << "MMAL Port buffer num: " << port->buffer_num;
+    // The queued frames hold the buffer headers of the encoder pool,
+    // so some of the buffers are left for the encoder output port.
+    if (port->buffer_num <= kEncoderPortMinBuffers) return 1;
+    return port->buffer_num - kEncoderPortMinBuffers;
+}
+
+size_t MMALEncoderWrapper::GetImvBufferSize() {
+    if (!state_.inlineMotionVectors) return 0;
+    // one 4 bytes vector per macroblock, plus one extra column per row
+    return ((state_.width + 15) / 16 + 1) * ((state_.height + 15) / 16) * 4;
 }
 
 bool MMALEncoderWrapper::UninitEncoder() {
@@ -652,6 +1180,10 @@ bool MMALEncoderWrapper::UninitEncoder() {
     // Disable all our ports that are not handled by connections
     check_disable_port(camera_still_port_);
     check_disable_port(encoder_output_port_);
+    // The encoder pool is destroyed after the frames held by the consumers
+    // are released, so it is not destroyed with the encoder component.
+    pool_reaper_.Reap();
+    ReleaseEncoderPool();
 
     if (state_.preview_parameters.wantPreview && state_.preview_connection)
         mmal_connection_destroy(state_.preview_connection);
@@ -659,10 +1191,18 @@ bool MMALEncoderWrapper::UninitEncoder() {
     if (state_.encoder_connection)
         mmal_connection_destroy(state_.encoder_connection);
 
+    if (state_.resizer_connection) {
+        mmal_connection_destroy(state_.resizer_connection);
+        state_.resizer_connection = nullptr;
+    }
+
     /* Disable components */
     if (state_.encoder_component)
         mmal_component_disable(state_.encoder_component);
 
+    if (state_.resizer_component)
+        mmal_component_disable(state_.resizer_component);
+
     if (state_.preview_parameters.preview_component)
         mmal_component_disable(state_.preview_parameters.preview_component);
 
@@ -670,6 +1210,7 @@ bool MMALEncoderWrapper::UninitEncoder() {
         mmal_component_disable(state_.camera_component);
 
     destroy_encoder_component(&state_);
+    destroy_resizer_component(&state_);
     raspipreview_destroy(&state_.preview_parameters);
     destroy_camera_component(&state_);
     mmal_initialized_ = false;
@@ -686,29 +1227,18 @@ void MMALEncoderWrapper::OnBufferCallback(MMAL_PORT_T *port,
 
     mmal_buffer_header_mem_lock(buffer);
     if (pData) {
+        // FrameQueue acquires the buffer header when the frame is queued
+        // without copy.
         WriteBack(buffer);
     } else {
         vcos_log_error("Received a encoder buffer callback with no state");
     }
     mmal_buffer_header_mem_unlock(buffer);
 
-    // release buffer back to the pool
+    // release buffer, it will be sent back to the port in
+    // BufferReleaseCallback when it is not held by the frame queue.
     mmal_buffer_header_release(buffer);
 
-    // and send one back to the port (if still open)
-    if (port->is_enabled) {
-        MMAL_BUFFER_HEADER_T *new_buffer = nullptr;
-        MMAL_STATUS_T status;
-
-        new_buffer = mmal_queue_get(state_.encoder_pool->queue);
-
-        if (new_buffer) status = mmal_port_send_buffer(port, new_buffer);
-
-        if (!new_buffer || status != MMAL_SUCCESS)
-            RTC_LOG(LS_ERROR)
-                << "Unable to return a buffer to the encoder port";
-    }
-
     // See if the second count has changed and we need to update any annotation
     if (current_time / 1000 != last_second) {
         update_annotation_data(&state_);
@@ -33,7 +33,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "api/task_queue/default_task_queue_factory.h"
 #include "config_media.h"
 #include "frame_queue.h"
+#include "mmal_pool_reaper.h"
 #include "mmal_video.h"
+#include "raspi_motionvector.h"
 #include "rtc_base/event.h"
 #include "rtc_base/synchronization/mutex.h"
 #include "rtc_base/task_queue.h"
@@ -66,7 +68,9 @@ struct EncoderDelayedInit {
     explicit EncoderDelayedInit(MMALEncoderWrapper *mmal_encoder);
     ~EncoderDelayedInit();
 
-    bool InitEncoder(wstreamer::VideoEncodingParams config);
+    bool InitEncoder(wstreamer::VideoEncodingParams config,
+                     const wstreamer::EncoderSettings &settings =
+                         wstreamer::EncoderSettings());
     bool ReinitEncoder(wstreamer::VideoEncodingParams config);
     bool UpdateStateOrMayInit();
     bool IsEncodingActive();
@@ -89,6 +93,11 @@ struct EncoderDelayedInit {
 ////////////////////////////////////////////////////////////////////////////////
 class MMALEncoderWrapper : public FrameQueue {
    public:
+    // Live streaming and motion detection share the single MMAL encoder
+    // session. Each client requests its own encoding params and settings,
+    // and the requests are merged into one encoder configuration.
+    enum EncoderClient { CLIENT_LIVE = 0, CLIENT_MOTION, CLIENT_MAX };
+
     MMALEncoderWrapper();
     ~MMALEncoderWrapper();
 
@@ -96,6 +105,10 @@ class MMALEncoderWrapper : public FrameQueue {
 
     inline int GetEncodingWidth() const { return state_.width; }
     inline int GetEncodingHeight() const { return state_.height; }
+    // Resolution of the frames being encoded, taken from the encoder input
+    // format because state_ may have the pending resolution of the delayed
+    // init. Returns false when the encoder is not initialized.
+    bool GetEncoderResolution(int *width, int *height);
 
     bool InitEncoder(wstreamer::VideoEncodingParams config);
     bool UninitEncoder();
@@ -105,6 +118,9 @@ class MMALEncoderWrapper : public FrameQueue {
     // TODO: merge the ReinitEncoder to SetParam and Reinit Internal
     bool ReinitEncoder(wstreamer::VideoEncodingParams config);
     bool ReinitEncoderInternal();
+    // Whether the resolution can be changed only by the resizer output,
+    // without rebuilding the camera and encoder components.
+    bool CanResize(const wstreamer::VideoEncodingParams &config);
 
     bool StartCapture();
     bool StopCapture();
@@ -115,7 +131,31 @@ class MMALEncoderWrapper : public FrameQueue {
     // When there is a KeyFrame request, it requests the MMAL to generate a key
     // frame. MMAL generates a key frame, and then operates as it is currently
     // set.
-    bool RequestKeyFrame();
+    bool RequestKeyFrame() override;
+
+    // Open the encoder session of the client. The encoder is initialized
+    // when it is the first client, otherwise the encoder is reinitialized
+    // only when the merged configuration requires it.
+    bool OpenEncoderSession(EncoderClient client,
+                            wstreamer::VideoEncodingParams config,
+                            const wstreamer::EncoderSettings &settings);
+    // The encoder is uninitialized when the last client closes the session.
+    void CloseEncoderSession(EncoderClient client);
+    // Updates the framerate and bitrate requested by the client.
+    bool SetSessionRate(EncoderClient client, int framerate, int bitrate);
+    // The resolution of the encoder can not be changed while motion detection
+    // is active, because motion vector analysis uses the fixed resolution.
+    bool IsResolutionFixed();
+    // The motion detection relays its motion events and the active points of
+    // each frame to the observers, so the live streaming can react to the
+    // motion without analysing the motion vectors again. nullptr unregisters
+    // the observer, and no event is delivered after it returns.
+    void RegisterMotionObserver(MotionBlobObserver *blob_observer,
+                                MotionImvObserver *imv_observer = nullptr);
+    void NotifyMotionTriggered(int active_nums);
+    void NotifyMotionCleared(int updates);
+    void NotifyActivePoints(int total_points, int active_points,
+                            int moving_points);
 
     // Set the necessary media config information.
     void SetEncoderConfigParams(wstreamer::EncoderSettings *params = nullptr);
@@ -126,15 +166,64 @@ class MMALEncoderWrapper : public FrameQueue {
     // Callback Functions
     void OnBufferCallback(MMAL_PORT_T *port, MMAL_BUFFER_HEADER_T *buffer);
     static void BufferCallback(MMAL_PORT_T *port, MMAL_BUFFER_HEADER_T *buffer);
+    // Called when the encoder buffer header is released to the pool.
+    MMAL_BOOL_T OnBufferRelease(MMAL_BUFFER_HEADER_T *buffer);
+    static MMAL_BOOL_T BufferReleaseCallback(MMAL_POOL_T *pool,
+                                             MMAL_BUFFER_HEADER_T *buffer,
+                                             void *userdata);
 
     EncoderDelayedInit encoder_delayed_init_;
 
    private:
     size_t GetRecommandedBufferSize(MMAL_PORT_T *port);
     size_t GetRecommandedBufferNum(MMAL_PORT_T *port);
+    // Size of the inline motion vectors per frame, 0 when IMV is disabled
+    size_t GetImvBufferSize();
+    // Releases the queued frames and hands over the encoder pool to the pool
+    // reaper, the pool is destroyed after the frames held by the consumers
+    // are released.
+    void ReleaseEncoderPool();
     void CheckCameraConfig();
+    // The camera captures at the largest resolution of the config when the
+    // resizer is enabled.
+    void SetCaptureResolution(const wstreamer::VideoEncodingParams &config);
+    // Connect camera -> resizer -> encoder, the camera side connection is
+    // kept when it is already connected.
+    bool ConnectResizer();
+    // Change the resolution with the resizer output and encoder input format,
+    // and switch the inline motion vectors of the encoder output. The
+    // previous resolution and inline motion vectors are restored when it
+    // fails.
+    bool ResizeEncoder(const wstreamer::VideoEncodingParams &config,
+                       bool imv_enable);
+    // Reconnects the resizer with the resolution and enables the encoder
+    // output port again with the new format and inline motion vectors.
+    bool ConfigureEncoderOutput(int width, int height, bool imv_enable);
+    // Applies the merged requests to the running encoder with the resizer,
+    // without initializing the encoder again. UpdateEncoderSession is valid
+    // only when CanUpdateEncoderSession returns true.
+    bool CanUpdateEncoderSession(const wstreamer::VideoEncodingParams &config,
+                                 const wstreamer::EncoderSettings &settings);
+    bool UpdateEncoderSession(const wstreamer::VideoEncodingParams &config,
+                              const wstreamer::EncoderSettings &settings);
+    // Merge the requests of active clients, returns false when there is no
+    // active client.
+    bool MergeSessionRequests(wstreamer::VideoEncodingParams *config,
+                              wstreamer::EncoderSettings *settings);
     bool mmal_initialized_;
 
+    struct SessionRequest {
+        bool active = false;
+        wstreamer::VideoEncodingParams config;
+        wstreamer::EncoderSettings settings;
+    };
+    webrtc::Mutex session_mutex_;
+    SessionRequest session_requests_[CLIENT_MAX];
+    wstreamer::EncoderSettings session_settings_;  // applied settings
+    webrtc::Mutex motion_observer_mutex_;
+    MotionBlobObserver *motion_observer_;
+    MotionImvObserver *motion_imv_observer_;
+
     MMAL_PORT_T *camera_preview_port_, *camera_video_port_, *camera_still_port_;
     MMAL_PORT_T *preview_input_port_;
     MMAL_PORT_T *encoder_input_port_, *encoder_output_port_;
@@ -144,6 +233,12 @@ class MMALEncoderWrapper : public FrameQueue {
     webrtc::Mutex mutex_;
     size_t recommanded_buffer_size_;
     size_t recommanded_buffer_num_;
+
+    // The retired encoder pools are destroyed in the pool task queue
+    class ReapPoolTask;
+    MMALPoolReaper pool_reaper_;
+    std::unique_ptr<webrtc::TaskQueueFactory> task_queue_factory_;
+    rtc::TaskQueue pool_task_queue_;
     RTC_DISALLOW_COPY_AND_ASSIGN(MMALEncoderWrapper);
 };
 
@@ -0,0 +1,272 @@
+/*
+Copyright (c) 2021, rpi-webrtc-streamer Lyu,KeunChang
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Standalone replay of the inline motion vector(.imv) files saved with the
+// motion_save_imv_file option, to tune the motion thresholds and to catch
+// the performance regressions of the motion analysis without a camera.
+//
+// The motion vectors are analysed with the baseline and/or the adaptive
+// background model as fast as possible, and the trigger/clear timeline, the
+// analysis frame rate and the time of each analysis stage are reported.
+//
+// Usage: motion_replay [-f fps] [-c blob_cancel_threshold]
+//                      [-t blob_tracking_threshold] [-z motion_zones]
+//                      [-m baseline|background|both] [-q]
+//                      width height file.imv
+//
+// Build on the host with 'make motion_replay' in src directory.
+
+#include <getopt.h>
+#include <glog/logging.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "raspi_motionvector.h"
+
+namespace {
+
+// defaults of the motion config
+const int kDefaultFps = 30;
+const float kDefaultBlobCancelThreshold = 0.5;
+const int kDefaultBlobTrackingThreshold = 15;
+
+const char kModeBaseline[] = "baseline";
+const char kModeBackground[] = "background";
+const char kModeBoth[] = "both";
+
+struct ReplayEvent {
+    int frame;
+    bool triggered;
+    int value;  // active blobs when triggered, blob updates when cleared
+};
+
+class ReplayObserver : public MotionBlobObserver {
+   public:
+    explicit ReplayObserver(const int *frame)
+        : frame_(frame), triggered_(false) {}
+
+    void OnMotionTriggered(int active_nums) override {
+        // triggered again when the number of active blobs is changed
+        if (triggered_) return;
+        triggered_ = true;
+        events_.push_back({*frame_, true, active_nums});
+    }
+    void OnMotionCleared(int updates) override {
+        triggered_ = false;
+        events_.push_back({*frame_, false, updates});
+    }
+
+    bool triggered() const { return triggered_; }
+    const std::vector<ReplayEvent> &events() const { return events_; }
+
+   private:
+    const int *frame_;
+    bool triggered_;
+    std::vector<ReplayEvent> events_;
+};
+
+struct Replay {
+    Replay(const char *replay_name, bool adaptive_background, const int *frame)
+        : name(replay_name),
+          background(adaptive_background),
+          observer(frame),
+          triggered_frames(0),
+          moving_points(0),
+          background_points(0),
+          elapsed_us(0) {}
+
+    const char *name;
+    bool background;
+    std::unique_ptr<RaspiMotionVector> analyser;
+    ReplayObserver observer;
+    int triggered_frames;
+    long moving_points;
+    long background_points;
+    int64_t elapsed_us;
+};
+
+int64_t TimeMicros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+void Usage(const char *program) {
+    fprintf(stderr,
+            "Usage: %s [-f fps] [-c blob_cancel_threshold] "
+            "[-t blob_tracking_threshold] [-z motion_zones] "
+            "[-m baseline|background|both] [-q] width height file.imv\n",
+            program);
+    exit(1);
+}
+
+void PrintTimeline(const Replay &replay, int fps) {
+    printf("\n%s timeline:\n", replay.name);
+    for (const ReplayEvent &event : replay.observer.events()) {
+        printf("  frame %6d %9.2fs %-9s %s %d\n", event.frame,
+               static_cast<double>(event.frame) / fps,
+               event.triggered ? "TRIGGERED" : "CLEARED",
+               event.triggered ? "active blobs" : "blob updates", event.value);
+    }
+}
+
+void PrintReport(const Replay &replay, int frames, int fps) {
+    const RaspiMotionVector::StageTimes &times =
+        replay.analyser->GetStageTimes();
+    int triggers = 0;
+    for (const ReplayEvent &event : replay.observer.events())
+        if (event.triggered) triggers++;
+    double elapsed = replay.elapsed_us > 0 ? replay.elapsed_us : 1;
+    double analysis_fps = frames * 1000000.0 / elapsed;
+
+    printf("\n%s:\n", replay.name);
+    printf("  triggers: %d, clears: %d, triggered frames: %d\n", triggers,
+           static_cast<int>(replay.observer.events().size()) - triggers,
+           replay.triggered_frames);
+    printf("  moving points: %ld, background points: %ld\n",
+           replay.moving_points, replay.background_points);
+    printf("  analysis: %.1f fps, %.1fx real time, %.1f us/frame\n",
+           analysis_fps, analysis_fps / fps, elapsed / frames);
+    printf(
+        "  stages(us/frame): filter %.1f, candidate %.1f, normalize %.1f, "
+        "blob %.1f\n",
+        static_cast<double>(times.filter_us) / frames,
+        static_cast<double>(times.candidate_us) / frames,
+        static_cast<double>(times.normalize_us) / frames,
+        static_cast<double>(times.blob_us) / frames);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    int fps = kDefaultFps;
+    float blob_cancel_threshold = kDefaultBlobCancelThreshold;
+    int blob_tracking_threshold = kDefaultBlobTrackingThreshold;
+    std::string mode = kModeBoth;
+    bool print_timeline = true;
+    MotionZones zones;
+    int opt;
+
+    google::InitGoogleLogging(argv[0]);
+    while ((opt = getopt(argc, argv, "f:c:t:z:m:q")) != -1) {
+        switch (opt) {
+            case 'f':
+                fps = atoi(optarg);
+                break;
+            case 'c':
+                blob_cancel_threshold = atof(optarg);
+                break;
+            case 't':
+                blob_tracking_threshold = atoi(optarg);
+                break;
+            case 'z':
+                if (zones.Parse(optarg) == false) Usage(argv[0]);
+                break;
+            case 'm':
+                mode = optarg;
+                break;
+            case 'q':
+                print_timeline = false;
+                break;
+            default:
+                Usage(argv[0]);
+        }
+    }
+    if (argc - optind != 3 || fps <= 0) Usage(argv[0]);
+    if (mode != kModeBaseline && mode != kModeBackground && mode != kModeBoth)
+        Usage(argv[0]);
+    int width = atoi(argv[optind]);
+    int height = atoi(argv[optind + 1]);
+    const char *imv_file = argv[optind + 2];
+
+    std::ifstream imv(imv_file, std::ios::binary);
+    if (!imv.is_open()) {
+        fprintf(stderr, "Failed to open %s\n", imv_file);
+        return 1;
+    }
+
+    int frames = 0;
+    std::vector<std::unique_ptr<Replay>> replays;
+    if (mode != kModeBackground)
+        replays.emplace_back(new Replay("baseline", false, &frames));
+    if (mode != kModeBaseline)
+        replays.emplace_back(new Replay("adaptive background", true, &frames));
+    for (std::unique_ptr<Replay> &replay : replays) {
+        replay->analyser.reset(new RaspiMotionVector(
+            width, height, fps, false, blob_cancel_threshold,
+            blob_tracking_threshold));
+        replay->analyser->SetBlobEnable(true);
+        replay->analyser->SetBackgroundEnable(replay->background);
+        replay->analyser->SetMotionZones(zones);
+        replay->analyser->SetStageTiming(true);
+        replay->analyser->RegisterBlobObserver(&replay->observer);
+    }
+
+    // the whole file is loaded first, so the file reading is not measured
+    size_t frame_size = replays[0]->analyser->GetFrameSize();
+    std::vector<uint8_t> motion_vectors;
+    std::vector<uint8_t> frame(frame_size);
+    while (imv.read(reinterpret_cast<char *>(frame.data()), frame_size))
+        motion_vectors.insert(motion_vectors.end(), frame.begin(),
+                              frame.end());
+    if (imv.gcount() != 0)
+        fprintf(stderr, "Ignoring %ld bytes of the partial frame at the end\n",
+                static_cast<long>(imv.gcount()));
+
+    for (const std::unique_ptr<Replay> &replay : replays) {
+        frames = 0;
+        for (size_t offset = 0; offset < motion_vectors.size();
+             offset += frame_size) {
+            int64_t start_us = TimeMicros();
+            replay->analyser->Analyse(motion_vectors.data() + offset,
+                                      frame_size);
+            replay->elapsed_us += TimeMicros() - start_us;
+            replay->moving_points += replay->analyser->GetMovingPoints();
+            replay->background_points +=
+                replay->analyser->GetBackgroundPoints();
+            if (replay->observer.triggered()) replay->triggered_frames++;
+            frames++;
+        }
+    }
+
+    printf("%s: %dx%d, %d fps, %d frames(%.1fs)\n", imv_file, width, height,
+           fps, frames, static_cast<double>(frames) / fps);
+    if (frames == 0) return 1;
+    for (const std::unique_ptr<Replay> &replay : replays) {
+        if (print_timeline) PrintTimeline(*replay, fps);
+        PrintReport(*replay, frames, fps);
+    }
+    return 0;
+}
@@ -0,0 +1,107 @@
+/*
+Copyright (c) 2021, rpi-webrtc-streamer Lyu,KeunChang
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Standalone check of the fragmented mp4 files saved with the motion_mp4_file
+// option. The box structure is walked from the file and the following are
+// verified, so a regression of the muxer or of the pre-event ring shows up
+// without a player:
+//
+//  - ftyp and moov come first, and moov has the edit list, the avc1 sample
+//    entry with avcC and mvex
+//  - moof and mdat follow in pairs with the increasing sequence numbers
+//  - trun data offset points to the mdat payload, and the sample sizes add
+//    up to the payload which is split into the length prefixed NAL units
+//  - the first sample of every fragment is a sync sample
+//  - tfdt of a fragment continues from the durations of the previous one
+//
+// Usage: mp4_check [-v] file.mp4 ...
+//
+// Build on the host with 'make mp4_check' in src directory.
+
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+#include "check/mp4_checker.h"
+
+namespace {
+
+void Usage(const char *program) {
+    fprintf(stderr, "Usage: %s [-v] file.mp4 ...\n", program);
+    exit(1);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    bool verbose = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "v")) != -1) {
+        switch (opt) {
+            case 'v':
+                verbose = true;
+                break;
+            default:
+                Usage(argv[0]);
+        }
+    }
+    if (optind >= argc) Usage(argv[0]);
+
+    int failed = 0;
+    for (int index = optind; index < argc; index++) {
+        std::ifstream file(argv[index], std::ios::binary);
+        if (!file) {
+            fprintf(stderr, "Failed to open %s\n", argv[index]);
+            failed++;
+            continue;
+        }
+        std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)),
+                                  std::istreambuf_iterator<char>());
+        printf("%s: ", argv[index]);
+        fflush(stdout);
+        check::Mp4Checker checker(data, verbose);
+        if (checker.Check() == false) {
+            failed++;
+            continue;
+        }
+        printf("fragments: %zu, samples: %zu, duration: %.3f sec\n",
+               checker.fragments().size(), checker.samples(),
+               checker.timescale() ? static_cast<double>(checker.duration()) /
+                                         checker.timescale()
+                                   : 0.0);
+    }
+    return failed > 0 ? 1 : 0;
+}
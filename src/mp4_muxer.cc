@@ -0,0 +1,406 @@
+/*
+Copyright (c) 2021, rpi-webrtc-streamer Lyu,KeunChang
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "mp4_muxer.h"
+
+#include <string.h>
+
+#include "common_video/h264/h264_common.h"
+#include "rtc_base/checks.h"
+#include "rtc_base/logging.h"
+
+namespace webrtc {
+
+namespace {
+
+// default duration of the sample before the second sample, 30 fps
+constexpr int64_t kDefaultSampleDuration = kMp4Timescale / 30;
+// initial capacity of the fragment payload, one GOP of 3500 kbps
+constexpr size_t kInitialPayloadSize = 3500 * 1000 / 8 * 3;
+constexpr uint32_t kTrackId = 1;
+
+// sample flags of trun
+constexpr uint32_t kSampleFlagsSync = 0x02000000;  // depends on no other
+constexpr uint32_t kSampleFlagsNonSync = 0x01010000;
+
+// tfhd: default-base-is-moof
+constexpr uint32_t kTfhdDefaultBaseIsMoof = 0x020000;
+// trun: data-offset, sample-duration, sample-size, sample-flags
+constexpr uint32_t kTrunFlags = 0x000001 | 0x000100 | 0x000200 | 0x000400;
+
+const uint32_t kUnityMatrix[9] = {0x00010000, 0, 0, 0, 0x00010000, 0,
+                                  0,          0, 0x40000000};
+
+// Big endian box writer, the size of the box is patched by EndBox.
+class BoxWriter {
+   public:
+    explicit BoxWriter(std::vector<uint8_t> *buffer) : buffer_(buffer) {}
+
+    size_t BeginBox(const char *type) {
+        size_t offset = buffer_->size();
+        U32(0);
+        Bytes(type, 4);
+        return offset;
+    }
+    size_t BeginFullBox(const char *type, uint8_t version, uint32_t flags) {
+        size_t offset = BeginBox(type);
+        U32((version << 24) | (flags & 0xffffff));
+        return offset;
+    }
+    void EndBox(size_t offset) {
+        Patch32(offset, static_cast<uint32_t>(buffer_->size() - offset));
+    }
+
+    void U8(uint8_t value) { buffer_->push_back(value); }
+    void U16(uint16_t value) {
+        U8(value >> 8);
+        U8(value);
+    }
+    void U32(uint32_t value) {
+        U16(value >> 16);
+        U16(value);
+    }
+    void U64(uint64_t value) {
+        U32(value >> 32);
+        U32(value);
+    }
+    void Zeros(size_t size) { buffer_->insert(buffer_->end(), size, 0); }
+    void Bytes(const void *data, size_t size) {
+        const uint8_t *bytes = static_cast<const uint8_t *>(data);
+        buffer_->insert(buffer_->end(), bytes, bytes + size);
+    }
+    void Matrix() {
+        for (uint32_t value : kUnityMatrix) U32(value);
+    }
+    void Patch32(size_t offset, uint32_t value) {
+        uint8_t *data = buffer_->data() + offset;
+        data[0] = value >> 24;
+        data[1] = value >> 16;
+        data[2] = value >> 8;
+        data[3] = value;
+    }
+    size_t size() const { return buffer_->size(); }
+
+   private:
+    std::vector<uint8_t> *buffer_;
+};
+
+bool IsParameterSet(uint8_t type) {
+    return type == H264::NaluType::kSps || type == H264::NaluType::kPps ||
+           type == H264::NaluType::kAud;
+}
+
+}  // namespace
+
+Mp4Muxer::Mp4Muxer(int width, int height)
+    : width_(width),
+      height_(height),
+      started_(false),
+      base_timestamp_us_(0),
+      last_duration_(kDefaultSampleDuration),
+      sequence_number_(0),
+      fragment_start_us_(0),
+      fragment_finished_(false) {
+    payload_.reserve(kInitialPayloadSize);
+}
+
+Mp4Muxer::~Mp4Muxer() {}
+
+void Mp4Muxer::Reset() {
+    started_ = false;
+    samples_.clear();
+    payload_.clear();
+    fragment_finished_ = false;
+    last_duration_ = kDefaultSampleDuration;
+}
+
+int64_t Mp4Muxer::ToMediaTime(int64_t timestamp_us) const {
+    return (timestamp_us - base_timestamp_us_) * kMp4Timescale / 1000000;
+}
+
+bool Mp4Muxer::AddFrame(const FrameBuffer &frame, int64_t timestamp_us) {
+    // the finished fragment is not needed anymore
+    if (fragment_finished_) {
+        samples_.clear();
+        payload_.clear();
+        fragment_finished_ = false;
+    }
+
+    // caching the SPS and PPS for avcC
+    if (frame.hasSps() || frame.hasPps()) {
+        for (size_t index = 0; index < frame.nal_count(); index++) {
+            const NalUnitIndex &nal = frame.nal(index);
+            const uint8_t *payload = frame.data() + nal.payload_offset;
+            if (nal.type == H264::NaluType::kSps)
+                sps_.assign(payload, payload + nal.payload_size);
+            else if (nal.type == H264::NaluType::kPps)
+                pps_.assign(payload, payload + nal.payload_size);
+        }
+    }
+
+    if (started_ == false) {
+        if (frame.isKeyFrame() == false || ready() == false) return false;
+        started_ = true;
+        base_timestamp_us_ = timestamp_us;
+        sequence_number_ = 0;
+    }
+    // the timestamp should not go backward
+    if (!samples_.empty() && timestamp_us <= samples_.back().timestamp_us)
+        timestamp_us = samples_.back().timestamp_us + 1;
+    if (samples_.empty()) fragment_start_us_ = timestamp_us;
+
+    // Annex-B start code to the 4 bytes NAL unit length, the parameter sets
+    // are in avcC
+    size_t sample_start = payload_.size();
+    for (size_t index = 0; index < frame.nal_count(); index++) {
+        const NalUnitIndex &nal = frame.nal(index);
+        if (IsParameterSet(nal.type) || nal.payload_size == 0) continue;
+        uint32_t size = nal.payload_size;
+        uint8_t length[4] = {static_cast<uint8_t>(size >> 24),
+                             static_cast<uint8_t>(size >> 16),
+                             static_cast<uint8_t>(size >> 8),
+                             static_cast<uint8_t>(size)};
+        payload_.insert(payload_.end(), length, length + 4);
+        payload_.insert(payload_.end(), frame.data() + nal.payload_offset,
+                        frame.data() + nal.payload_offset + size);
+    }
+    if (payload_.size() == sample_start) return false;
+
+    samples_.push_back({static_cast<uint32_t>(payload_.size() - sample_start),
+                        timestamp_us, frame.isKeyFrame()});
+    return true;
+}
+
+bool Mp4Muxer::FinishFragment(int64_t next_timestamp_us) {
+    if (samples_.empty() || fragment_finished_) return false;
+
+    fragment_header_.clear();
+    BoxWriter writer(&fragment_header_);
+
+    size_t moof = writer.BeginBox("moof");
+    size_t mfhd = writer.BeginFullBox("mfhd", 0, 0);
+    writer.U32(++sequence_number_);
+    writer.EndBox(mfhd);
+
+    size_t traf = writer.BeginBox("traf");
+    size_t tfhd = writer.BeginFullBox("tfhd", 0, kTfhdDefaultBaseIsMoof);
+    writer.U32(kTrackId);
+    writer.EndBox(tfhd);
+    size_t tfdt = writer.BeginFullBox("tfdt", 1, 0);
+    writer.U64(ToMediaTime(samples_.front().timestamp_us));
+    writer.EndBox(tfdt);
+
+    size_t trun = writer.BeginFullBox("trun", 0, kTrunFlags);
+    writer.U32(samples_.size());
+    size_t data_offset = writer.size();
+    writer.U32(0);  // patched after the moof size is known
+    for (size_t index = 0; index < samples_.size(); index++) {
+        int64_t duration;
+        if (index + 1 < samples_.size()) {
+            duration = ToMediaTime(samples_[index + 1].timestamp_us) -
+                       ToMediaTime(samples_[index].timestamp_us);
+        } else if (next_timestamp_us > samples_[index].timestamp_us) {
+            duration = ToMediaTime(next_timestamp_us) -
+                       ToMediaTime(samples_[index].timestamp_us);
+        } else {
+            duration = last_duration_;
+        }
+        last_duration_ = duration;
+        writer.U32(static_cast<uint32_t>(duration));
+        writer.U32(samples_[index].size);
+        writer.U32(samples_[index].keyframe ? kSampleFlagsSync
+                                            : kSampleFlagsNonSync);
+    }
+    writer.EndBox(trun);
+    writer.EndBox(traf);
+    writer.EndBox(moof);
+
+    // data offset from the moof to the first sample in mdat
+    writer.Patch32(data_offset, writer.size() - moof + 8);
+    writer.U32(payload_.size() + 8);
+    writer.Bytes("mdat", 4);
+
+    fragment_finished_ = true;
+    return true;
+}
+
+bool Mp4Muxer::CreateInitSegment(int64_t start_timestamp_us,
+                                 std::vector<uint8_t> *init_segment) const {
+    if (ready() == false || sps_.size() < 4) return false;
+    init_segment->clear();
+    BoxWriter writer(init_segment);
+
+    size_t ftyp = writer.BeginBox("ftyp");
+    writer.Bytes("isom", 4);
+    writer.U32(0x200);
+    writer.Bytes("isomiso2avc1iso6mp41", 20);
+    writer.EndBox(ftyp);
+
+    size_t moov = writer.BeginBox("moov");
+    size_t mvhd = writer.BeginFullBox("mvhd", 0, 0);
+    writer.U32(0);  // creation time
+    writer.U32(0);  // modification time
+    writer.U32(1000);
+    writer.U32(0);  // duration is in the fragments
+    writer.U32(0x00010000);  // rate
+    writer.U16(0x0100);      // volume
+    writer.Zeros(10);
+    writer.Matrix();
+    writer.Zeros(24);
+    writer.U32(kTrackId + 1);  // next track id
+    writer.EndBox(mvhd);
+
+    size_t trak = writer.BeginBox("trak");
+    size_t tkhd = writer.BeginFullBox("tkhd", 0, 0x000003);  // enabled
+    writer.U32(0);
+    writer.U32(0);
+    writer.U32(kTrackId);
+    writer.U32(0);
+    writer.U32(0);  // duration
+    writer.Zeros(8);
+    writer.U16(0);  // layer
+    writer.U16(0);  // alternate group
+    writer.U16(0);  // volume
+    writer.U16(0);
+    writer.Matrix();
+    writer.U32(width_ << 16);
+    writer.U32(height_ << 16);
+    writer.EndBox(tkhd);
+
+    // The presentation starts at the first fragment of the file, the media
+    // time before it belongs to the fragments not in this file.
+    size_t edts = writer.BeginBox("edts");
+    size_t elst = writer.BeginFullBox("elst", 1, 0);
+    writer.U32(1);
+    writer.U64(0);  // segment duration, the whole media
+    writer.U64(ToMediaTime(start_timestamp_us));
+    writer.U16(1);  // media rate
+    writer.U16(0);
+    writer.EndBox(elst);
+    writer.EndBox(edts);
+
+    size_t mdia = writer.BeginBox("mdia");
+    size_t mdhd = writer.BeginFullBox("mdhd", 0, 0);
+    writer.U32(0);
+    writer.U32(0);
+    writer.U32(kMp4Timescale);
+    writer.U32(0);
+    writer.U16(0x55c4);  // 'und'
+    writer.U16(0);
+    writer.EndBox(mdhd);
+
+    size_t hdlr = writer.BeginFullBox("hdlr", 0, 0);
+    writer.U32(0);
+    writer.Bytes("vide", 4);
+    writer.Zeros(12);
+    writer.Bytes("VideoHandler", 13);
+    writer.EndBox(hdlr);
+
+    size_t minf = writer.BeginBox("minf");
+    size_t vmhd = writer.BeginFullBox("vmhd", 0, 1);
+    writer.Zeros(8);
+    writer.EndBox(vmhd);
+    size_t dinf = writer.BeginBox("dinf");
+    size_t dref = writer.BeginFullBox("dref", 0, 0);
+    writer.U32(1);
+    size_t url = writer.BeginFullBox("url ", 0, 1);  // in the same file
+    writer.EndBox(url);
+    writer.EndBox(dref);
+    writer.EndBox(dinf);
+
+    size_t stbl = writer.BeginBox("stbl");
+    size_t stsd = writer.BeginFullBox("stsd", 0, 0);
+    writer.U32(1);
+    size_t avc1 = writer.BeginBox("avc1");
+    writer.Zeros(6);
+    writer.U16(1);  // data reference index
+    writer.Zeros(16);
+    writer.U16(width_);
+    writer.U16(height_);
+    writer.U32(0x00480000);  // 72 dpi
+    writer.U32(0x00480000);
+    writer.U32(0);
+    writer.U16(1);  // frame count
+    writer.Zeros(32);
+    writer.U16(0x0018);  // depth
+    writer.U16(0xffff);
+
+    size_t avcc = writer.BeginBox("avcC");
+    writer.U8(1);        // configuration version
+    writer.U8(sps_[1]);  // profile
+    writer.U8(sps_[2]);  // profile compatibility
+    writer.U8(sps_[3]);  // level
+    writer.U8(0xff);     // 4 bytes NAL unit length
+    writer.U8(0xe1);     // 1 SPS
+    writer.U16(sps_.size());
+    writer.Bytes(sps_.data(), sps_.size());
+    writer.U8(1);  // 1 PPS
+    writer.U16(pps_.size());
+    writer.Bytes(pps_.data(), pps_.size());
+    uint8_t profile = sps_[1];
+    if (profile == 100 || profile == 110 || profile == 122 || profile == 144) {
+        // the camera encodes 8 bits 4:2:0 only
+        writer.U8(0xfc | 1);
+        writer.U8(0xf8);
+        writer.U8(0xf8);
+        writer.U8(0);
+    }
+    writer.EndBox(avcc);
+    writer.EndBox(avc1);
+    writer.EndBox(stsd);
+
+    // the samples are in the fragments
+    for (const char *type : {"stts", "stsc", "stco"}) {
+        size_t box = writer.BeginFullBox(type, 0, 0);
+        writer.U32(0);
+        writer.EndBox(box);
+    }
+    size_t stsz = writer.BeginFullBox("stsz", 0, 0);
+    writer.U32(0);
+    writer.U32(0);
+    writer.EndBox(stsz);
+    writer.EndBox(stbl);
+    writer.EndBox(minf);
+    writer.EndBox(mdia);
+    writer.EndBox(trak);
+
+    size_t mvex = writer.BeginBox("mvex");
+    size_t trex = writer.BeginFullBox("trex", 0, 0);
+    writer.U32(kTrackId);
+    writer.U32(1);  // sample description index
+    writer.U32(0);
+    writer.U32(0);
+    writer.U32(0);
+    writer.EndBox(trex);
+    writer.EndBox(mvex);
+    writer.EndBox(moov);
+    return true;
+}
+
+}  // namespace webrtc
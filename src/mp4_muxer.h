@@ -0,0 +1,124 @@
+/*
+Copyright (c) 2021, rpi-webrtc-streamer Lyu,KeunChang
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef MP4_MUXER_H_
+#define MP4_MUXER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "frame_queue.h"
+#include "rtc_base/constructor_magic.h"
+
+namespace webrtc {
+
+// Time scale of the video track, 90 kHz same with the RTP video clock
+constexpr int kMp4Timescale = 90000;
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Fragmented MP4 Muxer
+//
+// Muxing the H.264 frames into the fragmented MP4 of one video track. The
+// init segment(ftyp, moov) is built with the avcC of the cached SPS/PPS, and
+// the frames of each GOP become one fragment(moof, mdat) with the sample
+// durations taken from the frame timestamps. The fragment is completed by
+// the next key frame, so the file can be played and seeked without the
+// remuxing, even when the recording stops at any fragment.
+//
+// The media time is counted from the first frame after Reset, and the init
+// segment has the edit list which starts the presentation at the first
+// fragment of the file.
+//
+////////////////////////////////////////////////////////////////////////////////
+class Mp4Muxer {
+   public:
+    Mp4Muxer(int width, int height);
+    ~Mp4Muxer();
+
+    // Adds the frame to the current fragment. The frames are dropped until
+    // the key frame after the SPS and PPS. Returns false when dropped.
+    bool AddFrame(const FrameBuffer &frame, int64_t timestamp_us);
+    // Completes the current fragment, the duration of the last sample is
+    // taken from the next timestamp, or the previous sample when it is 0.
+    // The fragment is valid until the next AddFrame.
+    bool FinishFragment(int64_t next_timestamp_us = 0);
+    // moof and mdat header of the finished fragment
+    inline const std::vector<uint8_t> &fragment_header() const {
+        return fragment_header_;
+    }
+    // mdat payload of the finished fragment
+    inline const std::vector<uint8_t> &fragment_payload() const {
+        return payload_;
+    }
+    inline int64_t fragment_start_us() const { return fragment_start_us_; }
+    inline size_t sample_count() const { return samples_.size(); }
+
+    // The init segment can be built after the SPS and PPS are cached.
+    inline bool ready() const { return !sps_.empty() && !pps_.empty(); }
+    // Builds the init segment of the file which starts at the fragment of
+    // the start timestamp.
+    bool CreateInitSegment(int64_t start_timestamp_us,
+                           std::vector<uint8_t> *init_segment) const;
+
+    // Drops the current fragment and restarts the media time with the next
+    // key frame. The cached SPS and PPS are kept.
+    void Reset();
+
+   private:
+    struct Sample {
+        uint32_t size;
+        int64_t timestamp_us;
+        bool keyframe;
+    };
+    int64_t ToMediaTime(int64_t timestamp_us) const;
+
+    const int width_, height_;
+    std::vector<uint8_t> sps_, pps_;  // without the start code
+
+    bool started_;
+    int64_t base_timestamp_us_;
+    int64_t last_duration_;  // media time of the last sample duration
+    uint32_t sequence_number_;
+
+    // current fragment
+    std::vector<Sample> samples_;
+    std::vector<uint8_t> payload_;
+    int64_t fragment_start_us_;
+    bool fragment_finished_;
+    std::vector<uint8_t> fragment_header_;
+
+    RTC_DISALLOW_COPY_AND_ASSIGN(Mp4Muxer);
+};
+
+}  // namespace webrtc
+
+#endif  // MP4_MUXER_H_
@@ -0,0 +1,230 @@
+/*
+Copyright (c) 2021, rpi-webrtc-streamer Lyu,KeunChang
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Microbenchmark of the NAL unit indexing of the encoded frames. The frames
+// of the H.264 byte stream are indexed with FrameBuffer::IndexNalUnits and
+// the slice header parsing of FrameQueue, and with the previous DrainProcess
+// which parsed the whole frame with H264BitstreamParser and searched the NAL
+// units again with H264::FindNaluIndices. The time per frame is reported and
+// the NAL unit count and the slice QP of both are compared.
+//
+// The byte stream is split into the frames after each slice, and SPS/PPS are
+// kept in front of the next slice like the config frame of the encoder. The
+// recordings of the streamer or of raspivid can be used.
+//
+// Usage: nal_bench [-r repeat] file.h264
+//
+// Build with 'make nal_bench' in src directory.
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+#include "common_video/h264/h264_bitstream_parser.h"
+#include "common_video/h264/h264_common.h"
+#include "frame_queue.h"
+
+using webrtc::FrameBuffer;
+using webrtc::H264BitstreamParser;
+using webrtc::NalUnitIndex;
+namespace H264 = webrtc::H264;
+
+namespace {
+
+const int kDefaultRepeat = 10;
+// same with the slice header size parsed by FrameQueue
+const size_t kSliceHeaderParseSize = 128;
+
+int64_t TimeMicros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+void Usage(const char *program) {
+    fprintf(stderr, "Usage: %s [-r repeat] file.h264\n", program);
+    exit(1);
+}
+
+bool IsSlice(uint8_t type) {
+    return type == H264::NaluType::kIdr || type == H264::NaluType::kSlice;
+}
+
+bool ReadFrames(const char *filename,
+                std::vector<rtc::scoped_refptr<FrameBuffer>> *frames) {
+    std::ifstream file(filename, std::ios::binary);
+    if (file.is_open() == false) return false;
+    std::vector<uint8_t> stream((std::istreambuf_iterator<char>(file)),
+                                std::istreambuf_iterator<char>());
+    std::vector<H264::NaluIndex> nalus =
+        H264::FindNaluIndices(stream.data(), stream.size());
+
+    size_t frame_start = 0;
+    for (const H264::NaluIndex &nalu : nalus) {
+        uint8_t type = stream[nalu.payload_start_offset] & H264::kNaluTypeMask;
+        if (IsSlice(type) == false) continue;
+        size_t frame_end = nalu.payload_start_offset + nalu.payload_size;
+        MMAL_BUFFER_HEADER_T header = {};
+        header.data = stream.data() + frame_start;
+        header.length = frame_end - frame_start;
+        header.pts = header.dts = MMAL_TIME_UNKNOWN;
+        rtc::scoped_refptr<FrameBuffer> frame =
+            FrameBuffer::Create(header.length);
+        frame->copy(&header);
+        frames->push_back(frame);
+        frame_start = frame_end;
+    }
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Indexing
+//
+////////////////////////////////////////////////////////////////////////////////
+struct FrameIndex {
+    size_t nal_count;
+    int qp;
+};
+
+// Previous DrainProcess: the whole frame is parsed for the QP, and the NAL
+// units are searched again.
+FrameIndex IndexLegacy(H264BitstreamParser *parser, const FrameBuffer &frame) {
+    FrameIndex index;
+    parser->ParseBitstream(
+        rtc::ArrayView<const uint8_t>(frame.data(), frame.length()));
+    index.qp = parser->GetLastSliceQp().value_or(-1);
+    index.nal_count =
+        H264::FindNaluIndices(frame.data(), frame.length()).size();
+    return index;
+}
+
+// FrameQueue::IndexFrame: the NAL units are indexed in one pass, and only
+// SPS/PPS and the slice header are parsed.
+FrameIndex IndexFrame(H264BitstreamParser *parser, FrameBuffer *frame) {
+    FrameIndex index = {frame->IndexNalUnits(), -1};
+    for (size_t count = 0; count < frame->nal_count(); count++) {
+        const NalUnitIndex &nal = frame->nal(count);
+        size_t size = nal.payload_offset - nal.start_offset + nal.payload_size;
+        bool is_slice = IsSlice(nal.type);
+        if (is_slice == false && nal.type != H264::NaluType::kSps &&
+            nal.type != H264::NaluType::kPps)
+            continue;
+        if (is_slice) size = std::min(size, kSliceHeaderParseSize);
+        parser->ParseBitstream(rtc::ArrayView<const uint8_t>(
+            frame->data() + nal.start_offset, size));
+        if (is_slice) {
+            index.qp = parser->GetLastSliceQp().value_or(-1);
+            break;
+        }
+    }
+    return index;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    int repeat = kDefaultRepeat;
+    std::vector<rtc::scoped_refptr<FrameBuffer>> frames;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "r:")) != -1) {
+        switch (opt) {
+            case 'r':
+                repeat = atoi(optarg);
+                break;
+            default:
+                Usage(argv[0]);
+        }
+    }
+    if (argc - optind != 1 || repeat <= 0) Usage(argv[0]);
+    if (ReadFrames(argv[optind], &frames) == false) {
+        fprintf(stderr, "Failed to open %s\n", argv[optind]);
+        return 1;
+    }
+    if (frames.empty()) {
+        fprintf(stderr, "No frame in %s\n", argv[optind]);
+        return 1;
+    }
+
+    uint64_t bytes = 0;
+    for (const rtc::scoped_refptr<FrameBuffer> &frame : frames)
+        bytes += frame->length();
+    printf("%zu frames, %.1f KB per frame, %d times\n", frames.size(),
+           bytes / 1024.0 / frames.size(), repeat);
+
+    // the results of both are compared in the first round
+    std::vector<FrameIndex> legacy_index, frame_index;
+    int64_t legacy_us = 0, index_us = 0;
+    for (int round = 0; round < repeat; round++) {
+        H264BitstreamParser legacy_parser, parser;
+        int64_t start_us = TimeMicros();
+        for (const rtc::scoped_refptr<FrameBuffer> &frame : frames) {
+            FrameIndex index = IndexLegacy(&legacy_parser, *frame);
+            if (round == 0) legacy_index.push_back(index);
+        }
+        legacy_us += TimeMicros() - start_us;
+
+        start_us = TimeMicros();
+        for (const rtc::scoped_refptr<FrameBuffer> &frame : frames) {
+            FrameIndex index = IndexFrame(&parser, frame.get());
+            if (round == 0) frame_index.push_back(index);
+        }
+        index_us += TimeMicros() - start_us;
+    }
+
+    int mismatch = 0;
+    for (size_t count = 0; count < frames.size(); count++) {
+        if (legacy_index[count].nal_count == frame_index[count].nal_count &&
+            legacy_index[count].qp == frame_index[count].qp)
+            continue;
+        if (mismatch++ < 5)
+            fprintf(stderr, "frame %zu: nal count %zu/%zu, qp %d/%d\n", count,
+                    legacy_index[count].nal_count,
+                    frame_index[count].nal_count, legacy_index[count].qp,
+                    frame_index[count].qp);
+    }
+
+    double frame_count = static_cast<double>(frames.size()) * repeat;
+    printf("legacy %8.2f us per frame %8.1f MB/s\n", legacy_us / frame_count,
+           bytes * repeat / (legacy_us ? legacy_us : 1) / 1.048576);
+    printf("index  %8.2f us per frame %8.1f MB/s\n", index_us / frame_count,
+           bytes * repeat / (index_us ? index_us : 1) / 1.048576);
+    if (mismatch) {
+        fprintf(stderr, "%d frames mismatched\n", mismatch);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,83 @@
+/*
+Copyright (c) 2021, rpi-webrtc-streamer Lyu,KeunChang
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "poll_dispatcher.h"
+
+#include <utility>
+
+#include "rtc_base/checks.h"
+
+PollDispatcher::PollDispatcher(rtc::PhysicalSocketServer* socket_server,
+                               int fd, short events, Callback callback)
+    : socket_server_(socket_server),
+      fd_(fd),
+      events_(events),
+      callback_(std::move(callback)) {
+    RTC_DCHECK(socket_server_ != nullptr);
+    socket_server_->Add(this);
+}
+
+PollDispatcher::~PollDispatcher() { Detach(); }
+
+void PollDispatcher::Detach() {
+    if (socket_server_ == nullptr) return;
+    socket_server_->Remove(this);
+    socket_server_ = nullptr;
+    callback_ = nullptr;
+}
+
+void PollDispatcher::SetEvents(short events) {
+    if (events_ == events) return;
+    events_ = events;
+    if (socket_server_) socket_server_->Update(this);
+}
+
+uint32_t PollDispatcher::GetRequestedEvents() {
+    uint32_t requested = 0;
+    if (events_ & POLLIN) requested |= rtc::DE_READ;
+    if (events_ & POLLOUT) requested |= rtc::DE_WRITE;
+    return requested;
+}
+
+void PollDispatcher::OnEvent(uint32_t ff, int err) {
+    short revents = 0;
+
+    // Detached, but the socket server still has the dispatcher in the
+    // current Wait cycle
+    if (callback_ == nullptr) return;
+
+    if (ff & rtc::DE_READ) revents |= POLLIN;
+    if (ff & rtc::DE_WRITE) revents |= POLLOUT;
+    if (ff & rtc::DE_CLOSE) revents |= (POLLIN | POLLHUP);
+    if (err) revents |= POLLERR;
+
+    // only report the events which are requested by the library
+    revents &= (events_ | POLLHUP | POLLERR);
+    if (revents) callback_(fd_, revents);
+}
@@ -0,0 +1,110 @@
+/*
+Copyright (c) 2021, rpi-webrtc-streamer Lyu,KeunChang
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef POLL_DISPATCHER_H_
+#define POLL_DISPATCHER_H_
+
+#include <poll.h>
+
+#include <functional>
+
+#include "rtc_base/physical_socket_server.h"
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Poll Dispatcher
+//
+// PollDispatcher registers a file descriptor owned by another event library
+// (libwebsockets, avahi) into the PhysicalSocketServer, so the signaling
+// thread can block in the socket server until there is real I/O instead of
+// running each library event loop in turn.
+// The events are translated from/to the poll(2) event mask which both of
+// the libraries use.
+//
+////////////////////////////////////////////////////////////////////////////////
+class PollDispatcher : public rtc::Dispatcher {
+   public:
+    typedef std::function<void(int fd, short revents)> Callback;
+
+    explicit PollDispatcher(rtc::PhysicalSocketServer* socket_server, int fd,
+                            short events, Callback callback);
+    ~PollDispatcher() override;
+
+    void SetEvents(short events);
+    inline short GetEvents() const { return events_; }
+    inline int fd() const { return fd_; }
+
+    // Removes the dispatcher from the socket server.
+    // The socket server may still hold the dispatcher pointer in the current
+    // Wait cycle, so the owner should delete the detached dispatcher only
+    // after the Wait cycle is finished.
+    void Detach();
+
+    // rtc::Dispatcher
+    uint32_t GetRequestedEvents() override;
+    void OnPreEvent(uint32_t ff) override {}
+    void OnEvent(uint32_t ff, int err) override;
+    int GetDescriptor() override { return fd_; }
+    bool IsDescriptorClosed() override { return false; }
+
+   private:
+    rtc::PhysicalSocketServer* socket_server_;
+    const int fd_;
+    short events_;
+    Callback callback_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Poll Event Source
+//
+// The event library which has its own timers(timeouts) implements this
+// interface, the socket server limits the wait period to the next timer of
+// each source and run the expired timers after the wait.
+//
+////////////////////////////////////////////////////////////////////////////////
+struct PollEventSource {
+    // Returns the wait period in ms limited by the next timer of the source.
+    // cms is the current wait period, and -1 means waiting forever.
+    virtual int GetNextTimeout(int cms) = 0;
+    // Called after every wait of the socket server to run expired timers.
+    virtual void ProcessTimeout() = 0;
+
+    // Returns the shorter wait period of the two, -1 means forever.
+    static inline int MinTimeout(int cms, int timeout) {
+        if (timeout < 0) return cms;
+        if (cms < 0) return timeout;
+        return cms < timeout ? cms : timeout;
+    }
+
+   protected:
+    virtual ~PollEventSource() {}
+};
+
+#endif  // POLL_DISPATCHER_H_
@@ -0,0 +1,266 @@
+/*
+Copyright (c) 2021, rpi-webrtc-streamer Lyu,KeunChang
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Offline simulator of the QualityConfig rate/quality model. The bitrate
+// updates and the encoded frames recorded in the verbose log of the streamer
+// (the 'QualityTrace' lines) are replayed with the simulated clock, and the
+// switch count and the mean QP of the replay are reported.
+//
+// The recorded frame is encoded at the resolution of the recording, so its
+// complexity at the reference QP is scaled to the resolution chosen in the
+// replay, and the frame is replayed with the size of the frame budget and
+// the QP the encoder would settle at. The trace lines are
+//
+//  QualityTrace b <time_ms> <bitrate_kbps> <framerate>
+//  QualityTrace f <time_ms> <width> <height> <frame_size> <qp> <keyframe>
+//
+// and the other lines of the log are skipped.
+//
+// Usage: quality_sim [-r resolution_list] [-v] trace_file
+//
+// Build with 'make quality_sim' in src directory.
+
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <fstream>
+#include <list>
+#include <map>
+#include <sstream>
+#include <string>
+
+#include "raspi_quality_config.h"
+#include "system_wrappers/include/clock.h"
+#include "wstreamer_types.h"
+
+namespace {
+
+// default video_resolution_list_4_3 of the media config
+const char kDefaultResolutionList[] =
+    "320x240,400x300,512x384,640x480,1024x768,1152x864,1296x972,1640x1232";
+const char kQualityTrace[] = "QualityTrace";
+
+// same with the rate model of QualityConfig
+const int kReferenceQp = 26;
+const double kQpPerOctave = 6.0;
+const double kMinQp = 10.0;
+const double kMaxQp = 51.0;
+const double kResolutionScaleExponent = 0.25;
+
+void Usage(const char *program) {
+    fprintf(stderr, "Usage: %s [-r resolution_list] [-v] trace_file\n",
+            program);
+    exit(1);
+}
+
+bool ParseResolutionList(const std::string &list_str,
+                         std::list<wstreamer::VideoResolution> *list) {
+    std::stringstream stream(list_str);
+    std::string token;
+    while (std::getline(stream, token, ',')) {
+        wstreamer::VideoResolution resolution;
+        if (resolution.FromString(token) == false) return false;
+        list->push_back(resolution);
+    }
+    return list->empty() == false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Replay
+//
+////////////////////////////////////////////////////////////////////////////////
+class QualityReplay {
+   public:
+    QualityReplay(const std::list<wstreamer::VideoResolution> &list,
+                  bool verbose)
+        : clock_(0),
+          quality_config_(list, &clock_),
+          verbose_(verbose),
+          bitrate_(0),
+          framerate_(0),
+          width_(0),
+          height_(0),
+          last_time_ms_(-1),
+          last_change_ms_(0),
+          rate_updates_(0),
+          frames_(0),
+          qp_frames_(0),
+          qp_sum_(0.0) {}
+
+    void Replay(std::istream &input) {
+        std::string line;
+        while (std::getline(input, line)) {
+            size_t pos = line.find(kQualityTrace);
+            if (pos == std::string::npos) continue;
+            std::stringstream record(
+                line.substr(pos + sizeof(kQualityTrace) - 1));
+            std::string type;
+            int64_t time_ms;
+            if (!(record >> type >> time_ms)) continue;
+            AdvanceTime(time_ms);
+            if (type == "b") {
+                int bitrate, framerate;
+                if (record >> bitrate >> framerate)
+                    OnRateUpdate(time_ms, bitrate, framerate);
+            } else if (type == "f") {
+                int width, height, frame_size, qp, keyframe;
+                if (record >> width >> height >> frame_size >> qp >> keyframe)
+                    OnFrame(width, height, frame_size, qp, keyframe != 0);
+            }
+        }
+        if (width_ > 0)
+            resolution_time_ms_[Key()] += last_time_ms_ - last_change_ms_;
+    }
+
+    void Report() {
+        printf("rate updates: %d, frames: %d, switches: %d\n", rate_updates_,
+               frames_, quality_config_.switch_count());
+        if (qp_frames_ > 0)
+            printf("mean qp: %.2f\n", qp_sum_ / qp_frames_);
+        for (const auto &time : resolution_time_ms_)
+            printf("%-10s %8.1f s\n", time.first.c_str(),
+                   time.second / 1000.0);
+    }
+
+   private:
+    std::string Key() const {
+        return std::to_string(width_) + "x" + std::to_string(height_);
+    }
+
+    void AdvanceTime(int64_t time_ms) {
+        if (last_time_ms_ < 0) last_change_ms_ = time_ms;
+        if (last_time_ms_ >= 0 && time_ms > last_time_ms_)
+            clock_.AdvanceTimeMilliseconds(time_ms - last_time_ms_);
+        if (time_ms > last_time_ms_) last_time_ms_ = time_ms;
+    }
+
+    void OnRateUpdate(int64_t time_ms, int bitrate, int framerate) {
+        quality_config_.ReportFrameRate(framerate);
+        quality_config_.ReportTargetBitrate(bitrate);
+        wstreamer::VideoEncodingParams &params =
+            quality_config_.GetBestMatch();
+        rate_updates_++;
+        if (params.width_ != width_ || params.height_ != height_) {
+            if (width_ > 0)
+                resolution_time_ms_[Key()] += time_ms - last_change_ms_;
+            last_change_ms_ = time_ms;
+            if (verbose_)
+                printf("%lld ms: %d kbps -> %s\n",
+                       static_cast<long long>(time_ms), bitrate,
+                       params.ToString().c_str());
+        }
+        width_ = params.width_;
+        height_ = params.height_;
+        framerate_ = params.framerate_;
+        bitrate_ = params.bitrate_;
+    }
+
+    // The recorded frame is replayed at the resolution of the replay
+    void OnFrame(int width, int height, int frame_size, int qp,
+                 bool is_keyframe) {
+        if (width_ == 0 || framerate_ <= 0 || bitrate_ <= 0) return;
+        if (width <= 0 || height <= 0 || frame_size <= 0 || qp < 0) return;
+        frames_++;
+
+        double pixels = static_cast<double>(width_) * height_;
+        double complexity =
+            frame_size * 8.0 / (static_cast<double>(width) * height) *
+            pow(2.0, (qp - kReferenceQp) / kQpPerOctave) *
+            pow(static_cast<double>(width) * height / pixels,
+                kResolutionScaleExponent);
+        double target_bpp = bitrate_ * 1000.0 / (pixels * framerate_);
+        double replay_qp =
+            kReferenceQp + kQpPerOctave * log2(complexity / target_bpp);
+        replay_qp = std::min(std::max(replay_qp, kMinQp), kMaxQp);
+        int replay_size = bitrate_ * 1000 / 8 / framerate_;
+
+        quality_config_.ReportFrameSize(width_, height_, replay_size,
+                                        static_cast<int>(replay_qp + 0.5),
+                                        is_keyframe);
+        if (is_keyframe) return;
+        qp_frames_++;
+        qp_sum_ += replay_qp;
+    }
+
+    webrtc::SimulatedClock clock_;
+    QualityConfig quality_config_;
+    const bool verbose_;
+    int bitrate_, framerate_;
+    int width_, height_;
+    int64_t last_time_ms_;
+    int64_t last_change_ms_;
+    int rate_updates_;
+    int frames_;
+    int qp_frames_;
+    double qp_sum_;
+    std::map<std::string, int64_t> resolution_time_ms_;
+};
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    std::string resolution_list_str = kDefaultResolutionList;
+    bool verbose = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "r:v")) != -1) {
+        switch (opt) {
+            case 'r':
+                resolution_list_str = optarg;
+                break;
+            case 'v':
+                verbose = true;
+                break;
+            default:
+                Usage(argv[0]);
+        }
+    }
+    if (argc - optind != 1) Usage(argv[0]);
+
+    std::list<wstreamer::VideoResolution> resolution_list;
+    if (ParseResolutionList(resolution_list_str, &resolution_list) == false) {
+        fprintf(stderr, "Invalid resolution list: %s\n",
+                resolution_list_str.c_str());
+        return 1;
+    }
+    std::ifstream input(argv[optind]);
+    if (!input) {
+        fprintf(stderr, "Failed to open %s\n", argv[optind]);
+        return 1;
+    }
+
+    QualityReplay replay(resolution_list, verbose);
+    replay.Replay(input);
+    replay.Report();
+    return 0;
+}
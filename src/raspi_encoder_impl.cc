@@ -52,6 +52,9 @@ enum H264EncoderImplEvent {
     kH264EncoderEventError = 1,
     kH264EncoderEventMax = 16,
 };
+
+// RTP timestamp of video is 90kHz
+constexpr int64_t kRtpTicksPerMs = 90;
 }  // namespace
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -69,7 +72,8 @@ RaspiEncoderImpl::RaspiEncoderImpl(const cricket::VideoCodec& codec)
       mode_(VideoCodecMode::kRealtimeVideo),
       max_payload_size_(0),
       key_frame_interval_(0),
-      packetization_mode_(H264PacketizationMode::SingleNalUnit) {
+      packetization_mode_(H264PacketizationMode::SingleNalUnit),
+      session_framerate_(0) {
     RTC_CHECK(absl::EqualsIgnoreCase(codec.name, cricket::kH264CodecName));
     std::string packetization_mode_string;
     if (codec.GetParam(cricket::kH264FmtpPacketizationMode,
@@ -139,8 +143,26 @@ int32_t RaspiEncoderImpl::InitEncode(const VideoCodec* codec_settings,
         return WEBRTC_VIDEO_CODEC_ERROR;
     }
 
-    // Set media config params
-    mmal_encoder_->SetEncoderConfigParams();
+    // The motion adaptive fps and the motion boost use the motion events of
+    // the motion detection, the motion vectors are not analysed again here.
+    wstreamer::EncoderSettings encoder_settings;
+    if (config_media_->GetVideoMotionAdaptiveFps())
+        motion_fps_.reset(new RaspiMotionFps(config_media_, mmal_encoder_));
+
+    if (config_media_->GetVideoMotionBoostEnable()) {
+        motion_boost_.reset(new RaspiMotionBoost(
+            clock_, config_media_->GetVideoMotionBoostPercent(),
+            config_media_->GetVideoMotionBoostPeriod(),
+            config_media_->GetVideoMotionBoostDecayPeriod(),
+            config_media_->GetMaxBitrate() / 1000 /* kbps */));
+    }
+    if (motion_fps_ || motion_boost_)
+        mmal_encoder_->RegisterMotionObserver(this,
+                                              motion_fps_ ? this : nullptr);
+
+    // Subscribing before the encoder session is opened, so the first key
+    // frame of the session is not missed.
+    frame_subscriber_ = mmal_encoder_->Subscribe("live", kFrameChannelVideo);
 
     // Settings for Quality
     // GetInitialBestMatch should be used only when initializing
@@ -149,15 +171,13 @@ int32_t RaspiEncoderImpl::InitEncode(const VideoCodec* codec_settings,
         quality_config_.GetInitialBestMatch();
 
     RTC_LOG(INFO) << "InitEncode request: " << initial_res.ToString();
-    if (mmal_encoder_->encoder_delayed_init_.InitEncoder(initial_res) ==
-        false) {
+    if (mmal_encoder_->encoder_delayed_init_.InitEncoder(
+            initial_res, encoder_settings) == false) {
         Release();
         ReportError();
         return WEBRTC_VIDEO_CODEC_ERROR;
     }
 
-    mmal_encoder_->StartCapture();
-
     // start drain thread ;
     if (drainThread_.empty()) {
         drain_quit_ = false;
@@ -182,23 +202,33 @@ int32_t RaspiEncoderImpl::InitEncode(const VideoCodec* codec_settings,
 
 int32_t RaspiEncoderImpl::Release() {
     bool thread_finalize_required = false;
+    // No motion event is delivered after the observer is unregistered
+    if (mmal_encoder_ && (motion_fps_ || motion_boost_))
+        mmal_encoder_->RegisterMotionObserver(nullptr);
+
     if (!drainThread_.empty()) {
         MutexLock lock(&drain_lock_);
         drain_quit_ = true;
         thread_finalize_required = true;
     }
 
+    //  The drain thread wakes up at least once in the wait period of
+    //  ReadFront, so the thread can be finalized before releasing the
+    //  encoder resource. The subscriber should be removed before the encoder
+    //  pool is destroyed, because the frames in the subscriber ring hold the
+    //  buffer headers of the pool.
+    if (thread_finalize_required == true) drainThread_.Finalize();
+    frame_subscriber_.reset();
+
     if (mmal_encoder_) {
-        mmal_encoder_->StopCapture();
-        mmal_encoder_->UninitEncoder();
+        // The encoder will be released when the motion detection does not
+        // use the encoder session.
+        mmal_encoder_->CloseEncoderSession(MMALEncoderWrapper::CLIENT_LIVE);
         mmal_encoder_ = nullptr;
     }
-
-    //  Thread finalize should be done after stopping the thread and releasing
-    //  the encoder resource.
-    //  If the thread is stopped first, the process may be stopped
-    //  before releasing the encoder resouce.
-    if (thread_finalize_required == true) drainThread_.Finalize();
+    motion_fps_.reset();
+    motion_boost_.reset();
+    session_framerate_ = 0;
     encoded_image_.clear();
     return WEBRTC_VIDEO_CODEC_OK;
 }
@@ -249,7 +279,13 @@ void RaspiEncoderImpl::SetRates(const RateControlParameters& parameters) {
     quality_config_.ReportFrameRate(static_cast<int>(framerate));
     quality_config_.ReportTargetBitrate(target_bitrate);
     resolution = quality_config_.GetBestMatch();
-    if (resolution.width_ != mmal_encoder_->GetEncodingWidth() &&
+    // The session rate is updated here, with the framerate lowered by the
+    // motion adaptive fps while the scene is static and the bitrate lifted
+    // by the motion boost.
+    resolution.framerate_ = SetSessionRate(
+        resolution.framerate_, GetBoostedBitrate(target_bitrate, parameters));
+    if (mmal_encoder_->IsResolutionFixed() == false &&
+        resolution.width_ != mmal_encoder_->GetEncodingWidth() &&
         resolution.height_ != mmal_encoder_->GetEncodingHeight()) {
         RTC_LOG(INFO) << "Resolution Changing by Bitrate Changing "
                       << "To : " << resolution.width_ << "x"
@@ -259,9 +295,7 @@ void RaspiEncoderImpl::SetRates(const RateControlParameters& parameters) {
             false) {
             RTC_LOG(LS_ERROR) << "Failed to reinit MMAL encoder";
         }
-    } else
-        mmal_encoder_->SetRate(static_cast<uint32_t>(framerate),
-                               target_bitrate);
+    }
 }
 
 int32_t RaspiEncoderImpl::Encode(
@@ -325,6 +359,70 @@ VideoEncoder::EncoderInfo RaspiEncoderImpl::GetEncoderInfo() const {
     return info;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+//
+// Raspi Encoder Motion Boost and Motion Adaptive Fps
+//
+// The motion events come from the analysis thread of the motion detection.
+// A key frame is requested when a new boost starts, and the boosted bitrate
+// decays in the drain thread of the encoder.
+//
+///////////////////////////////////////////////////////////////////////////////
+void RaspiEncoderImpl::OnMotionTriggered(int active_nums) {
+    if (motion_fps_) motion_fps_->OnMotionTriggered(active_nums);
+    if (!motion_boost_) return;
+    if (motion_boost_->OnMotionTriggered()) mmal_encoder_->RequestKeyFrame();
+    SetSessionBitrate(motion_boost_->GetBitrate());
+}
+
+void RaspiEncoderImpl::OnMotionCleared(int updates) {
+    if (motion_fps_) motion_fps_->OnMotionCleared(updates);
+    if (!motion_boost_) return;
+    motion_boost_->OnMotionCleared();
+    SetSessionBitrate(motion_boost_->GetBitrate());
+}
+
+void RaspiEncoderImpl::OnActivePoints(int total_points, int active_points,
+                                      int moving_points) {
+    if (motion_fps_)
+        motion_fps_->OnActivePoints(total_points, active_points,
+                                    moving_points);
+}
+
+int RaspiEncoderImpl::GetBoostedBitrate(
+    int target_bitrate, const RateControlParameters& parameters) {
+    if (!motion_boost_) return target_bitrate;
+    // The boosted bitrate is bounded by the bandwidth estimation
+    motion_boost_->SetTargetBitrate(
+        target_bitrate,
+        static_cast<int>(parameters.bandwidth_allocation.kbps()));
+    return motion_boost_->GetBitrate();
+}
+
+void RaspiEncoderImpl::UpdateBoostedBitrate() {
+    if (!motion_boost_) return;
+    SetSessionBitrate(motion_boost_->GetBitrate());
+}
+
+int RaspiEncoderImpl::SetSessionRate(int framerate, int bitrate) {
+    if (motion_fps_) return motion_fps_->SetRate(framerate, bitrate);
+    session_framerate_ = framerate;
+    mmal_encoder_->SetSessionRate(MMALEncoderWrapper::CLIENT_LIVE, framerate,
+                                  bitrate);
+    return framerate;
+}
+
+void RaspiEncoderImpl::SetSessionBitrate(int bitrate) {
+    if (motion_fps_) {
+        motion_fps_->SetBitrate(bitrate);
+        return;
+    }
+    // no session rate before the first SetRates
+    if (session_framerate_ == 0) return;
+    mmal_encoder_->SetSessionRate(MMALEncoderWrapper::CLIENT_LIVE,
+                                  session_framerate_, bitrate);
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 //
 // Raspi Encoder Frame Flow Control
@@ -386,41 +484,25 @@ bool RaspiEncoderImpl::FrameFlowCtl::CheckKeyframe(bool is_keyframe) {
 //
 ///////////////////////////////////////////////////////////////////////////////
 bool RaspiEncoderImpl::DrainProcess() {
-    FrameBuffer* buf = nullptr;
+    rtc::scoped_refptr<FrameBuffer> buf;
 
     if (drain_quit_ == true) return false;  // quit drain thread
 
     //  The GetEncodedFrame function will wait in block state
     //  until there is a new buf or timeout.
-    buf = mmal_encoder_->ReadFront();
+    buf = frame_subscriber_->ReadFront();
 
     // encoded_image_callback must be registered before pass
     // the frame to WebRTC native stack.
     // If it is timout, buf will have null.
-    // In addition, only the normal frame is transmitted to the WebRTC
-    // native stack, and the Motion Vector(CODECSIDEINFO) is not
-    // transmitted.
     //
-    if (encoded_image_callback_ && buf && !buf->isMotionVector()) {
+
+    if (encoded_image_callback_ && buf) {
         MutexLock lock(&drain_lock_);
-        auto encoded_image_buffer =
-            EncodedImageBuffer::Create(buf->data(), buf->length());
         CodecSpecificInfo codec_specific;
 
-        // Parsing h264 frame
-        h264_bitstream_parser_.ParseBitstream(
-            rtc::ArrayView<const uint8_t>(buf->data(), buf->length()));
-        encoded_image_[0].SetEncodedData(encoded_image_buffer);
-        encoded_image_[0].set_size(buf->length());
-
-        encoded_image_[0].qp_ =
-            h264_bitstream_parser_.GetLastSliceQp().value_or(-1);
-
-        // Search the NAL unit in the stream
-        const std::vector<H264::NaluIndex> nalu_indexes =
-            H264::FindNaluIndices(buf->data(), buf->length());
-
-        if (nalu_indexes.empty()) {
+        // The NAL units and the slice QP are indexed when the frame is queued
+        if (buf->nal_count() == 0) {
             // could not find the nal unit in the buffer, so do nothing.
             RTC_LOG(INFO) << "NAL unit length is zero!!!";
             RTC_LOG(INFO) << "Frame length : " << buf->length()
@@ -428,18 +510,33 @@ bool RaspiEncoderImpl::DrainProcess() {
             return true;
         };
 
+        // FrameBuffer is passed to WebRTC without copy, MMAL buffer header
+        // of the frame is released when the encoded image is released.
+        encoded_image_[0].SetEncodedData(buf);
+        encoded_image_[0].set_size(buf->length());
+
+        encoded_image_[0].qp_ = buf->qp();
+
+        // The capture time comes from the MMAL pts of the frame, which is
+        // mapped to the system clock when the frame is queued, so the queueing
+        // delay does not make the timestamp jitter.
         // In native code, there is DCHECK-related logic for capture_time
-        // and ntp_time. Currently, RWS does not use video frame capture and
-        // encoding, so DCHECK generates an error message in time.
-        // the '-10' value is for the part to prevent this.
-        // it is tempoary measure, but it happens the '-10' will be
-        // removed when this issue fixed
-        int64_t capture_time_ms = clock_->TimeInMilliseconds() - 10;
-        int64_t ntp_capture_time_ms = clock_->CurrentNtpInMilliseconds() - 10;
+        // and ntp_time, the capture time must be earlier than the current
+        // time. The '-10' value is for the frame without pts.
+        int64_t now_ms = clock_->TimeInMilliseconds();
+        int64_t capture_time_ms = buf->capture_time_us() >= 0
+                                      ? buf->capture_time_us() / 1000
+                                      : now_ms - 10;
+        int64_t ntp_capture_time_ms =
+            clock_->CurrentNtpInMilliseconds() - (now_ms - capture_time_ms);
+        RTC_HISTOGRAM_COUNTS_1000(
+            "WebRTC.Video.RaspiEncoder.CaptureToDrainDelayMs",
+            static_cast<int>(now_ms - capture_time_ms));
 
         encoded_image_[0]._encodedWidth = mmal_encoder_->GetEncodingWidth();
         encoded_image_[0]._encodedHeight = mmal_encoder_->GetEncodingHeight();
-        encoded_image_[0].SetTimestamp(capture_time_ms);
+        encoded_image_[0].SetTimestamp(
+            static_cast<uint32_t>(capture_time_ms * kRtpTicksPerMs));
         encoded_image_[0].ntp_time_ms_ = ntp_capture_time_ms;
         encoded_image_[0].capture_time_ms_ = capture_time_ms;
         encoded_image_[0]._frameType = buf->isKeyFrame()
@@ -464,7 +561,13 @@ bool RaspiEncoderImpl::DrainProcess() {
         if (result.error == EncodedImageCallback::Result::ERROR_SEND_FAILED) {
             RTC_LOG(LS_ERROR) << "Error in passng EncodedImage";
         }
-        quality_config_.ReportFrameSize(buf->length());
+        // Do not keep the MMAL buffer header until the next frame
+        encoded_image_[0].ClearEncodedData();
+        int width, height;
+        if (mmal_encoder_->GetEncoderResolution(&width, &height))
+            quality_config_.ReportFrameSize(width, height, buf->length(),
+                                            buf->qp(), buf->isKeyFrame());
+        UpdateBoostedBitrate();
     }
     return true;
 }
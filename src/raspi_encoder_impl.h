@@ -30,14 +30,16 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef RASPI_ENCODER_IMPL_H_
 #define RASPI_ENCODER_IMPL_H_
 
+#include <atomic>
 #include <memory>
 #include <vector>
 
-#include "common_video/h264/h264_bitstream_parser.h"
 #include "common_video/h264/h264_common.h"
 #include "mmal_wrapper.h"
 #include "modules/video_coding/include/video_codec_interface.h"
 #include "raspi_encoder.h"
+#include "raspi_motionboost.h"
+#include "raspi_motionfps.h"
 #include "raspi_quality_config.h"
 #include "rtc_base/platform_thread.h"
 #include "rtc_base/synchronization/mutex.h"
@@ -45,7 +47,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 namespace webrtc {
 
-class RaspiEncoderImpl : public RaspiEncoder {
+class RaspiEncoderImpl : public RaspiEncoder,
+                         public MotionBlobObserver,
+                         public MotionImvObserver {
    public:
     struct FrameFlowCtl {
         enum FLOWCTL_STATE {
@@ -93,12 +97,27 @@ class RaspiEncoderImpl : public RaspiEncoder {
 
     VideoEncoder::EncoderInfo GetEncoderInfo() const override;
 
+    // Motion events relayed from the motion detection
+    void OnMotionTriggered(int active_nums) override;
+    void OnMotionCleared(int updates) override;
+    void OnActivePoints(int total_points, int active_points,
+                        int moving_points) override;
+
    private:
     bool IsInitialized() const;
 
     bool drain_quit_;
     bool DrainProcess();
 
+    // Target bitrate with the motion boost, and the decay of the boost
+    int GetBoostedBitrate(int target_bitrate,
+                          const RateControlParameters& parameters);
+    void UpdateBoostedBitrate();
+    // Updates the live session rate, through the motion adaptive fps only
+    // when it is enabled. Returns the framerate applied to the session.
+    int SetSessionRate(int framerate, int bitrate);
+    void SetSessionBitrate(int bitrate);
+
     // Reports statistics with histograms.
     void ReportInit();
     void ReportError();
@@ -113,13 +132,11 @@ class RaspiEncoderImpl : public RaspiEncoder {
     // Encoded frame process thread
     rtc::PlatformThread drainThread_;
     Mutex drain_lock_;
+    std::unique_ptr<FrameSubscriber> frame_subscriber_;
 
     EncodedImageCallback* encoded_image_callback_;
     std::vector<EncodedImage> encoded_image_;
 
-    // H264 bitstream parser, used to extract QP from encoded bitstreams.
-    H264BitstreamParser h264_bitstream_parser_;
-
     Clock* const clock_;
 
     VideoCodecMode mode_;
@@ -132,6 +149,13 @@ class RaspiEncoderImpl : public RaspiEncoder {
 
     // Quality Config
     QualityConfig quality_config_;
+    // Lowers the framerate while the scene is static, nullptr when the
+    // motion adaptive fps is disabled.
+    std::unique_ptr<RaspiMotionFps> motion_fps_;
+    // framerate of the live session without the motion adaptive fps
+    std::atomic<int> session_framerate_;
+    // Lifts the bitrate when the motion detection triggers
+    std::unique_ptr<RaspiMotionBoost> motion_boost_;
     VideoCodec codec_;
 
     // Frame Flow Control
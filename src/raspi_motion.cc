@@ -37,6 +37,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "rtc_base/logging.h"
 #include "rtc_base/platform_thread.h"
 #include "rtc_base/thread.h"
+#include "system_wrappers/include/metrics.h"
 
 namespace {
 
@@ -50,14 +51,20 @@ const int kDefaultMotionActiveClearPercent = 5;
 const int kDefaultMotionClearWaitPeriod = 5000;   // 5 seconds
 const int kDefaultMotionAveragePrintDiff = 1000;  // 1 second
 
-#ifdef PRINT_PROCESS_DELAYS
 const int kDefaultMotionFrameProcessingSize = 30 * 3;
-#endif  // PRINT_PROCESS_DELAYS
+const int kProcessDelayLogPeriod = 60000;  // 1 minute
+
+// The motion vectors waiting for the analysis, the oldest one is dropped
+// when the queue is full. The queue holds the IMV buffers of the encoder,
+// so it should be smaller than the IMV buffers(kImvBufferNum).
+const size_t kMaxAnalysisQueueSize = 3;
+const int kAnalysisWaitPeriod = 100;  // ms
 
 }  // namespace
 
 RaspiMotionHolder::RaspiMotionHolder(ConfigMotion *config_motion)
-    : config_motion_(config_motion) {}
+    : config_motion_(config_motion),
+      motion_zones_(config_motion->GetZones()) {}
 
 RaspiMotionHolder::~RaspiMotionHolder() {}
 
@@ -68,7 +75,18 @@ bool RaspiMotionHolder::Start() {
                   << (raspi_motion_ && raspi_motion_->IsActive());
     if (!raspi_motion_) {
         RTC_LOG(INFO) << "Starting RaspiMotion Detection";
-        raspi_motion_.reset(new RaspiMotion(config_motion_));
+        if (!recording_index_) {
+            recording_index_.reset(
+                new RecordingIndex(config_motion_->GetDirectory(),
+                                   config_motion_->GetFilePrefix()));
+            if (recording_index_->Load() == false)
+                RTC_LOG(LS_WARNING)
+                    << "Failed to load the recording index, the directory "
+                       "will be scanned again at the next retention";
+        }
+        raspi_motion_.reset(
+            new RaspiMotion(config_motion_, recording_index_.get()));
+        raspi_motion_->SetMotionZones(motion_zones_);
         return raspi_motion_->StartCapture();
     }
     RTC_LOG(LS_ERROR) << "RaspiMotion is already running!";
@@ -94,9 +112,27 @@ bool RaspiMotionHolder::SetNotificationUrl(bool enable, const std::string url) {
     return true;
 }
 
+bool RaspiMotionHolder::SetMotionZones(const std::string &zones) {
+    MotionZones motion_zones;
+    if (motion_zones.Parse(zones) == false) return false;
+    motion_zones_ = zones;
+    if (raspi_motion_) return raspi_motion_->SetMotionZones(zones);
+    return true;
+}
+
+bool RaspiMotionHolder::ListRecordings(time_t from_time, time_t to_time,
+                                       std::vector<RecordingInfo> *recordings) {
+    if (!recording_index_) return false;
+    recording_index_->ListRecordings(from_time, to_time, recordings);
+    return true;
+}
+
 RaspiMotion::RaspiMotion(ConfigMotion *config_motion, int width, int height,
-                         int framerate, int bitrate)
+                         int framerate, int bitrate,
+                         RecordingIndex *recording_index)
     : Event(false, false),
+      analysis_event_(false, false),
+      analysis_quit_(false),
       motion_active_(false),
       motion_drain_quit_(false),
       width_(width),
@@ -109,11 +145,13 @@ RaspiMotion::RaspiMotion(ConfigMotion *config_motion, int width, int height,
                        config_motion->GetBlobCancelThreshold(),
                        config_motion->GetBlobTrackingThreshold()),
       motion_active_average_(kDefaultMotionAverageSize),
-#ifdef PRINT_PROCESS_DELAYS
-      imv_process_delay_(kDefaultMotionFrameProcessingSize),
+      drain_wait_delay_(kDefaultMotionFrameProcessingSize),
       frame_process_delay_(kDefaultMotionFrameProcessingSize),
-      drain_process_delay_(kDefaultMotionFrameProcessingSize),
-#endif  // PRINT_PROCESS_DELAYS
+      imv_process_delay_(kDefaultMotionFrameProcessingSize),
+      analysis_queue_delay_(kDefaultMotionFrameProcessingSize),
+      analysis_process_delay_(kDefaultMotionFrameProcessingSize),
+      analysis_dropped_(0),
+      last_delay_log_timestamp_(0),
       notification_enable_(false),
       config_motion_(config_motion),
       task_queue_factory_(webrtc::CreateDefaultTaskQueueFactory()),
@@ -131,11 +169,26 @@ RaspiMotion::RaspiMotion(ConfigMotion *config_motion, int width, int height,
     RTC_LOG(INFO) << "Frame Queue Size: " << frame_buffer_size_
                   << ", MV Queue Size: " << mv_buffer_size_;
 
+    // The pre-event ring keeps the GOPs covering the pre-event period and the
+    // current GOP.
+    const int gop_period_ms = VIDEO_INTRAFRAME_PERIOD * 1000;
+    int pre_event_gops =
+        (config_motion->GetPreEventPeriod() + gop_period_ms - 1) /
+            gop_period_ms +
+        1;
+    RTC_LOG(INFO) << "Pre-event Ring Size: "
+                  << frame_buffer_size_ * pre_event_gops
+                  << ", MV Ring Size: " << mv_buffer_size_ * pre_event_gops;
+
     motion_file_.reset(new RaspiMotionFile(
         config_motion, config_motion->GetDirectory(),
-        config_motion->GetFilePrefix(), frame_buffer_size_, mv_buffer_size_));
+        config_motion->GetFilePrefix(), frame_buffer_size_, mv_buffer_size_,
+        frame_buffer_size_ * pre_event_gops, mv_buffer_size_ * pre_event_gops,
+        recording_index, &worker_queue_));
 
     motion_analysis_.SetBlobEnable(true);
+    motion_analysis_.SetBackgroundEnable(
+        config_motion->GetAdaptiveBackground());
     motion_analysis_.RegisterBlobObserver(this);
     motion_analysis_.RegisterImvObserver(this);
 
@@ -148,10 +201,11 @@ RaspiMotion::RaspiMotion(ConfigMotion *config_motion, int width, int height,
     motion_active_percent_clear_threshold_ = kDefaultMotionActiveClearPercent;
 }
 
-RaspiMotion::RaspiMotion(ConfigMotion *config_motion)
+RaspiMotion::RaspiMotion(ConfigMotion *config_motion,
+                         RecordingIndex *recording_index)
     : RaspiMotion(config_motion, config_motion->GetWidth(),
                   config_motion->GetHeight(), config_motion->GetFps(),
-                  config_motion->GetBitrate()) {}
+                  config_motion->GetBitrate(), recording_index) {}
 
 bool RaspiMotion::IsActive() const { return motion_active_; }
 bool RaspiMotion::IsEnabled() const {
@@ -175,18 +229,35 @@ bool RaspiMotion::StartCapture() {
         params.annotation_text_size = config_motion_->GetAnnotateTextSize();
     }
 
-    // Set media config params at first.
-    mmal_encoder_->SetEncoderConfigParams(&params);
+    // Subscribing before the encoder session is opened, so the first key
+    // frame of the session is not missed.
+    // Motion detection needs both the video frames and the motion vectors
+    frame_subscriber_ = mmal_encoder_->Subscribe(
+        "motion", kFrameChannelVideo | kFrameChannelImv);
 
     RTC_LOG(INFO) << "Motion Video Params: " << width_ << " x " << height_
                   << "@" << framerate_ << ", " << bitrate_ << " kbps";
-    if (mmal_encoder_->InitEncoder(wstreamer::VideoEncodingParams(
-            width_, height_, framerate_, bitrate_)) == false) {
+    if (mmal_encoder_->OpenEncoderSession(
+            webrtc::MMALEncoderWrapper::CLIENT_MOTION,
+            wstreamer::VideoEncodingParams(width_, height_, framerate_,
+                                           bitrate_),
+            params) == false) {
+        frame_subscriber_.reset();
+        mmal_encoder_ = nullptr;
         return false;
     }
 
-    // start capture in here
-    mmal_encoder_->StartCapture();
+    // start analysis thread before the drain thread queues the motion vectors
+    if (analysisThread_.empty()) {
+        RTC_LOG(INFO) << "Motion analysis thread initialized.";
+        analysis_quit_ = false;
+        analysisThread_ = rtc::PlatformThread::SpawnJoinable(
+            [this] {
+                while (AnalysisProcess()) {
+                }
+            },
+            "MotionAnalysis");
+    }
 
     // start drain thread ;
     if (drainThread_.empty()) {
@@ -213,10 +284,21 @@ void RaspiMotion::StopCapture() {
         motion_drain_quit_ = true;
         drainThread_.Finalize();
     }
+    // The closing writers may still hold the encoder frames, so wait for
+    // the worker queue before the encoder session is closed.
+    rtc::Event closed;
+    worker_queue_.PostTask([&closed] { closed.Set(); });
+    closed.Wait(rtc::Event::kForever);
+    StopAnalysis();
+    // The frames in the subscriber ring should be released before the
+    // encoder pool is destroyed.
+    frame_subscriber_.reset();
 
     if (mmal_encoder_) {
-        mmal_encoder_->StopCapture();
-        mmal_encoder_->UninitEncoder();
+        // The encoder will be released when the live streaming does not
+        // use the encoder session.
+        mmal_encoder_->CloseEncoderSession(
+            webrtc::MMALEncoderWrapper::CLIENT_MOTION);
         mmal_encoder_ = nullptr;
     }
 }
@@ -226,6 +308,17 @@ RaspiMotion::~RaspiMotion() {
     StopCapture();
 }
 
+bool RaspiMotion::SetMotionZones(const std::string &zones) {
+    MotionZones motion_zones;
+    if (motion_zones.Parse(zones) == false) {
+        RTC_LOG(LS_ERROR) << "Failed to parse motion zones: " << zones;
+        return false;
+    }
+    // the mask is swapped atomically, the analysis thread keeps analysing
+    motion_analysis_.SetMotionZones(motion_zones);
+    return true;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 //
 // Motion Observer and State management
@@ -242,6 +335,8 @@ void RaspiMotion::OnMotionTriggered(int active_nums) {
             << active_nums;
     }
     motion_state_ = TRIGGERED;
+    // the live streaming may boost the quality when the motion starts
+    if (mmal_encoder_) mmal_encoder_->NotifyMotionTriggered(active_nums);
 }
 
 void RaspiMotion::OnMotionCleared(int updates) {
@@ -254,12 +349,19 @@ void RaspiMotion::OnMotionCleared(int updates) {
     } else if (motion_state_ == CLEARED) {
         RTC_LOG(INFO) << "Invalid Motion state changing CLEARED to WAIT_CLEAR ";
     }
+    if (mmal_encoder_) mmal_encoder_->NotifyMotionCleared(updates);
 }
 
-void RaspiMotion::OnActivePoints(int total_points, int active_points) {
+void RaspiMotion::OnActivePoints(int total_points, int active_points,
+                                 int moving_points) {
     double active_percent = active_points * 100 / total_points;
     uint64_t current_timestamp;
 
+    // the live streaming may lower the framerate while the scene is static
+    if (mmal_encoder_)
+        mmal_encoder_->NotifyActivePoints(total_points, active_points,
+                                          moving_points);
+
     motion_active_average_.AddSample((int)active_percent);
     absl::optional<int> moving_average =
         motion_active_average_.GetAverageRoundedDown();
@@ -271,21 +373,6 @@ void RaspiMotion::OnActivePoints(int total_points, int active_points) {
             if (motion_state_ == TRIGGERED || motion_state_ == WAIT_CLEAR) {
                 RTC_LOG(INFO) << "Motion active percent:  " << *moving_average;
             };
-
-#ifdef PRINT_PROCESS_DELAYS
-            // printing average delay in processing
-            absl::optional<int> frame_process_delay =
-                frame_process_delay_.GetAverageRoundedDown();
-            absl::optional<int> imv_process_delay =
-                imv_process_delay_.GetAverageRoundedDown();
-            absl::optional<int> drain_waiting_delay =
-                drain_process_delay_.GetAverageRoundedDown();
-            if (frame_process_delay) {
-                RTC_LOG(INFO) << "Process Delay Frame: " << *frame_process_delay
-                              << ", IMV: " << *imv_process_delay
-                              << ", Drain(w/ wait): " << *drain_waiting_delay;
-            }
-#endif  // PRINT_PROCESS_DELAYS
         }
         if (motion_state_ == WAIT_CLEAR) {
             if (*moving_average < motion_active_percent_clear_threshold_ &&
@@ -300,34 +387,98 @@ void RaspiMotion::OnActivePoints(int total_points, int active_points) {
 
 ///////////////////////////////////////////////////////////////////////////////
 //
-// Raspi Encoder frame drain processing
+// Motion analysis processing
 //
 ///////////////////////////////////////////////////////////////////////////////
-#ifdef PRINT_PROCESS_DELAYS
-#define __CLOCK_MARK_START__ start_time = clock_->TimeInMicroseconds();
-#define __CLOCK_MARK_FRAME_END__              \
-    mark_time = clock_->TimeInMicroseconds(); \
-    frame_process_delay_.AddSample(mark_time - start_time);
-
-#define __CLOCK_MARK_IMV_END__                \
-    mark_time = clock_->TimeInMicroseconds(); \
-    imv_process_delay_.AddSample(mark_time - start_time);
-
-#define __CLOCK_MARK_DRAIN_END__              \
-    mark_time = clock_->TimeInMicroseconds(); \
-    drain_process_delay_.AddSample(mark_time - start_time);
-#else
-#define __CLOCK_MARK_START__
-#define __CLOCK_MARK_FRAME_END__
-#define __CLOCK_MARK_IMV_END__
-#define __CLOCK_MARK_DRAIN_END__
-#endif  // PRINT_PROCESS_DELAYS
+void RaspiMotion::QueueAnalysis(
+    rtc::scoped_refptr<webrtc::FrameBuffer> buffer) {
+    bool dropped = false;
+    {
+        webrtc::MutexLock lock(&analysis_lock_);
+        if (analysis_queue_.size() >= kMaxAnalysisQueueSize) {
+            // the latest motion vector is more useful than the oldest one
+            analysis_queue_.pop_front();
+            dropped = true;
+        }
+        analysis_queue_.push_back({buffer, clock_->TimeInMicroseconds()});
+    }
+    if (dropped) {
+        webrtc::MutexLock lock(&metrics_lock_);
+        analysis_dropped_++;
+    }
+    analysis_event_.Set();
+}
+
+bool RaspiMotion::AnalysisProcess() {
+    analysis_event_.Wait(kAnalysisWaitPeriod);
+    while (analysis_quit_ == false) {
+        AnalysisItem item;
+        {
+            webrtc::MutexLock lock(&analysis_lock_);
+            if (analysis_queue_.empty()) break;
+            item = std::move(analysis_queue_.front());
+            analysis_queue_.pop_front();
+        }
+
+        // The motion state is changed in the observers called by Analyse
+        int64_t start_us = clock_->TimeInMicroseconds();
+        motion_analysis_.Analyse(item.buffer->data(), item.buffer->length());
+        int64_t end_us = clock_->TimeInMicroseconds();
+        // release the IMV buffer to the encoder as soon as possible
+        item.buffer = nullptr;
+
+        RTC_HISTOGRAM_COUNTS_100000("WebRTC.Video.RaspiMotion.AnalysisTimeUs",
+                                    end_us - start_us);
+        {
+            webrtc::MutexLock lock(&metrics_lock_);
+            analysis_queue_delay_.AddSample(start_us - item.queued_us);
+            analysis_process_delay_.AddSample(end_us - start_us);
+        }
+        LogProcessDelays();
+    }
+    return analysis_quit_ == false;
+}
+
+void RaspiMotion::StopAnalysis() {
+    if (analysisThread_.empty() == false) {
+        analysis_quit_ = true;
+        analysis_event_.Set();
+        analysisThread_.Finalize();
+    }
+    // release the IMV buffers before the encoder pool is destroyed
+    webrtc::MutexLock lock(&analysis_lock_);
+    analysis_queue_.clear();
+}
 
+void RaspiMotion::LogProcessDelays() {
+    int64_t now_ms = clock_->TimeInMilliseconds();
+    if (now_ms - last_delay_log_timestamp_ < kProcessDelayLogPeriod) return;
+    last_delay_log_timestamp_ = now_ms;
+
+    webrtc::MutexLock lock(&metrics_lock_);
+    RTC_LOG(INFO) << "Motion process delay(us) drain wait: "
+                  << drain_wait_delay_.GetAverageRoundedDown().value_or(0)
+                  << ", frame: "
+                  << frame_process_delay_.GetAverageRoundedDown().value_or(0)
+                  << ", imv: "
+                  << imv_process_delay_.GetAverageRoundedDown().value_or(0)
+                  << ", analysis queue: "
+                  << analysis_queue_delay_.GetAverageRoundedDown().value_or(0)
+                  << ", analysis: "
+                  << analysis_process_delay_.GetAverageRoundedDown().value_or(0)
+                  << ", analysis dropped: " << analysis_dropped_;
+    RTC_HISTOGRAM_COUNTS_10000("WebRTC.Video.RaspiMotion.AnalysisDropped",
+                               static_cast<int>(analysis_dropped_));
+    analysis_dropped_ = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Raspi Encoder frame drain processing
+//
+///////////////////////////////////////////////////////////////////////////////
 bool RaspiMotion::DrainProcess() {
-#ifdef PRINT_PROCESS_DELAYS
-    uint64_t start_time, mark_time;
-#endif  // PRINT_PROCESS_DELAYS
-    webrtc::FrameBuffer *buf = nullptr;
+    rtc::scoped_refptr<webrtc::FrameBuffer> buf;
     size_t length;
 
     if (motion_drain_quit_ == true) {
@@ -340,50 +491,49 @@ bool RaspiMotion::DrainProcess() {
         return false;
     };
 
-    __CLOCK_MARK_START__;
-    buf = mmal_encoder_->ReadFront();
-    __CLOCK_MARK_DRAIN_END__;
+    int64_t start_us = clock_->TimeInMicroseconds();
+    buf = frame_subscriber_->ReadFront();
+    int64_t read_us = clock_->TimeInMicroseconds();
     if (buf && buf->length() > 0) {
-        __CLOCK_MARK_START__;
-
-        bool is_keyframe = buf->isKeyFrame();
-
         if (buf->isMotionVector()) {
             // queuing the motion vector for file writer
-            if (motion_file_->ImvQueuing(buf->data(), buf->length(), &length,
-                                         is_keyframe) == false) {
+            if (motion_file_->ImvQueuing(buf->data(), buf->length(),
+                                         &length) == false) {
                 RTC_LOG(LS_ERROR) << "Failed to WriteBack in MV queue ";
             };
 
-            // Doing motion analysis based on the new MV
-            motion_analysis_.Analyse(buf->data(), buf->length());
-            __CLOCK_MARK_IMV_END__;
+            // The motion analysis runs in the analysis thread, and the
+            // motion state changed by the analysis is applied to the file
+            // writer with the next motion vectors.
+            QueueAnalysis(buf);
 
-            if ((motion_state_ == CLEARED) &&
+            MOTION_STATE motion_state = motion_state_;
+            if ((motion_state == CLEARED) &&
                 (motion_file_->IsWriterActive() == true)) {
+                // the files are closed and added to the recording index in
+                // the worker queue
                 motion_file_->StopWriter();
-                // After the file writer ends, old files are deleted so that the
-                // directory where the file is stored does not exceed the
-                // specified size limit.
-                worker_queue_.PostTask(std::make_unique<LimitTotalDirSizeTask>(
-                    config_motion_->GetDirectory(),
-                    config_motion_->GetFilePrefix(),
-                    (size_t)config_motion_->GetTotalFileSizeLimit() * 1000000));
-
-            } else if ((motion_state_ == TRIGGERED) &&
+            } else if ((motion_state == TRIGGERED) &&
                        (motion_file_->IsWriterActive() == false)) {
                 motion_file_->StartWriter();
             }
+            webrtc::MutexLock lock(&metrics_lock_);
+            drain_wait_delay_.AddSample(read_us - start_us);
+            imv_process_delay_.AddSample(clock_->TimeInMicroseconds() -
+                                         read_us);
 
         } else if (buf->isFrameEnd()) {
-            if (motion_file_->FrameQueuing(buf->data(), buf->length(), &length,
-                                           is_keyframe) == false) {
+            if (motion_file_->FrameQueuing(buf, &length) == false) {
                 RTC_LOG(LS_ERROR) << "Failed to WriteBack in frame buffer ";
-            };
-            RTC_DCHECK(buf->length() == length)
-                << "Failed to FrameQueueing buffer: " << buf->length()
-                << ", length: " << length;
-            __CLOCK_MARK_FRAME_END__;
+            } else {
+                RTC_DCHECK(buf->length() == length)
+                    << "Failed to FrameQueueing buffer: " << buf->length()
+                    << ", length: " << length;
+            }
+            webrtc::MutexLock lock(&metrics_lock_);
+            drain_wait_delay_.AddSample(read_us - start_us);
+            frame_process_delay_.AddSample(clock_->TimeInMicroseconds() -
+                                           read_us);
 
         } else {
             RTC_LOG(LS_ERROR) << "FrameBuffer is not frame nor motionvector : "
@@ -392,4 +542,3 @@ bool RaspiMotion::DrainProcess() {
     }
     return true;
 }
-
@@ -30,9 +30,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef RASPI_MOTION_H_
 #define RASPI_MOTION_H_
 
-// to print average delays of processing
-// #define PRINT_PROCESS_DELAYS
-
+#include <atomic>
+#include <deque>
 #include <memory>
 #include <vector>
 
@@ -44,7 +43,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "raspi_httpnoti.h"
 #include "raspi_motionfile.h"
 #include "raspi_motionvector.h"
+#include "recording_index.h"
 #include "rtc_base/buffer_queue.h"
+#include "rtc_base/event.h"
 #include "rtc_base/numerics/moving_average.h"
 #include "rtc_base/platform_thread.h"
 #include "rtc_base/synchronization/mutex.h"
@@ -55,8 +56,10 @@ class RaspiMotion : public MotionBlobObserver,
                     public rtc::Event {
    public:
     explicit RaspiMotion(ConfigMotion* config_motion, int width, int height,
-                         int framerate, int bitrate);
-    explicit RaspiMotion(ConfigMotion* config_motion);
+                         int framerate, int bitrate,
+                         RecordingIndex* recording_index);
+    explicit RaspiMotion(ConfigMotion* config_motion,
+                         RecordingIndex* recording_index);
     ~RaspiMotion();
 
     bool IsEnabled() const;
@@ -66,10 +69,15 @@ class RaspiMotion : public MotionBlobObserver,
     bool StartCapture();
     void StopCapture();
 
+    // Updates the motion zones while capturing, returns false when the zones
+    // string is not valid.
+    bool SetMotionZones(const std::string& zones);
+
     // Motion Observers
     void OnMotionTriggered(int active_nums) override;
     void OnMotionCleared(int updates) override;
-    void OnActivePoints(int total_points, int active_points) override;
+    void OnActivePoints(int total_points, int active_points,
+                        int moving_points) override;
 
     enum MOTION_STATE {
         CLEARED = 0,
@@ -83,6 +91,22 @@ class RaspiMotion : public MotionBlobObserver,
     rtc::PlatformThread drainThread_;
     webrtc::Mutex drain_lock_;
 
+    // The drain thread only queues the motion vectors, and the analysis
+    // thread runs the motion analysis and changes the motion state. The
+    // oldest motion vector is dropped when the analysis can not keep up.
+    struct AnalysisItem {
+        rtc::scoped_refptr<webrtc::FrameBuffer> buffer;
+        int64_t queued_us;
+    };
+    void QueueAnalysis(rtc::scoped_refptr<webrtc::FrameBuffer> buffer);
+    bool AnalysisProcess();
+    void StopAnalysis();
+    rtc::PlatformThread analysisThread_;
+    webrtc::Mutex analysis_lock_;  // guards analysis_queue_
+    rtc::Event analysis_event_;
+    std::deque<AnalysisItem> analysis_queue_;
+    std::atomic<bool> analysis_quit_;
+
     bool motion_active_;
     bool motion_drain_quit_;
 
@@ -90,6 +114,7 @@ class RaspiMotion : public MotionBlobObserver,
     int width_, height_, framerate_, bitrate_;
 
     webrtc::MMALEncoderWrapper* mmal_encoder_;
+    std::unique_ptr<webrtc::FrameSubscriber> frame_subscriber_;
     webrtc::Clock* const clock_;
 
     // motion file
@@ -101,17 +126,25 @@ class RaspiMotion : public MotionBlobObserver,
 
     // MotionVector Analysis
     RaspiMotionVector motion_analysis_;
-    MOTION_STATE motion_state_;
+    // changed in the analysis thread, and read in the drain thread
+    std::atomic<MOTION_STATE> motion_state_;
     uint64_t last_average_print_timestamp_;
     uint64_t motion_clear_wait_timestamp_;
     uint32_t motion_clear_wait_period_;
 
     rtc::MovingAverage motion_active_average_;
-#ifdef PRINT_PROCESS_DELAYS
-    rtc::MovingAverage imv_process_delay_;
+
+    // Processing delays in microseconds, updated in both of the drain and
+    // the analysis thread, guarded by metrics_lock_.
+    void LogProcessDelays();
+    webrtc::Mutex metrics_lock_;
+    rtc::MovingAverage drain_wait_delay_;
     rtc::MovingAverage frame_process_delay_;
-    rtc::MovingAverage drain_process_delay_;
-#endif  // PRINT_PROCESS_DELAYS
+    rtc::MovingAverage imv_process_delay_;
+    rtc::MovingAverage analysis_queue_delay_;
+    rtc::MovingAverage analysis_process_delay_;
+    uint64_t analysis_dropped_;
+    int64_t last_delay_log_timestamp_;
     int motion_active_percent_clear_threshold_;
     int motion_active_percent_trigger_threshold_;
     bool notification_enable_;
@@ -130,10 +163,21 @@ struct RaspiMotionHolder {
     bool Start();
     bool Stop();
     bool SetNotificationUrl(bool enable, const std::string url);
+    // The motion zones are kept in the holder, and used again when the
+    // motion detection restarts.
+    bool SetMotionZones(const std::string& zones);
+    // Lists the motion recordings started in the time range, returns false
+    // when the motion detection has not been started.
+    bool ListRecordings(time_t from_time, time_t to_time,
+                        std::vector<RecordingInfo>* recordings);
 
    private:
+    // The recording index is loaded when the motion detection starts first,
+    // and outlives the RaspiMotion.
+    std::unique_ptr<RecordingIndex> recording_index_;
     std::unique_ptr<RaspiMotion> raspi_motion_;
     ConfigMotion* config_motion_;
+    std::string motion_zones_;
 };
 
 #endif  // RASPI_MOTION_H_
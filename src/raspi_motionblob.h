@@ -30,45 +30,64 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef RASPI_MOTIONBLOB_H_
 #define RASPI_MOTIONBLOB_H_
 
-#include <list>
-#include <memory>
+#include <stdint.h>
 
-#define MAX_BLOB_LIST_SIZE 256
+#include <vector>
 
+// Horizontal run of the motion points in a row, end_x_ is exclusive.
+struct MotionRun {
+    MotionRun(uint16_t y, uint16_t start_x, uint16_t end_x)
+        : y_(y), start_x_(start_x), end_x_(end_x){};
+    inline int length() const { return end_x_ - start_x_; };
+    uint16_t y_, start_x_, end_x_;
+};
+
+// Motion points connected with the '+' neighbors in a frame. The points of
+// the blob are kept as the runs in raster order.
 struct MotionBlob {
-    enum MotionBlobStatus {
-        UNUSED = 0,
-        COLLECTING,
-        ACTIVE,
-    };
-    MotionBlob()
-        : sx_(0),
-          sy_(0),
-          status_(UNUSED),
-          size_(0),
+    explicit MotionBlob(const MotionRun &run)
+        : area_(0),
+          min_x_(run.start_x_),
+          min_y_(run.y_),
+          max_x_(run.start_x_),
+          max_y_(run.y_),
+          sum_x_(0),
+          sum_y_(0),
           overlap_size_(0),
-          update_counter_(0),
-          blob_(nullptr){};
-    uint8_t sx_, sy_;
-    MotionBlobStatus status_;
-    int size_;
+          update_counter_(1),
+          active_(false),
+          run_offset_(0),
+          run_count_(0){};
+    inline void AddRun(const MotionRun &run) {
+        int length = run.length();
+        area_ += length;
+        if (run.start_x_ < min_x_) min_x_ = run.start_x_;
+        if (run.end_x_ - 1 > max_x_) max_x_ = run.end_x_ - 1;
+        max_y_ = run.y_;  // runs are added in raster order
+        sum_x_ += (run.start_x_ + run.end_x_ - 1) * length / 2;
+        sum_y_ += run.y_ * length;
+        run_count_++;
+    };
+    inline bool Intersects(const MotionBlob &other) const {
+        return min_x_ <= other.max_x_ && other.min_x_ <= max_x_ &&
+               min_y_ <= other.max_y_ && other.min_y_ <= max_y_;
+    };
+    inline int CenterX() const { return area_ ? sum_x_ / area_ : 0; };
+    inline int CenterY() const { return area_ ? sum_y_ / area_ : 0; };
+
+    int area_;
+    uint16_t min_x_, min_y_, max_x_, max_y_;  // bounding box
+    uint32_t sum_x_, sum_y_;                  // centroid * area
+    // number of points overlapped with the active blobs of previous frame,
+    // counted only for the active blob
     int overlap_size_;
+    // number of frames which the active blob has been tracked
     int update_counter_;
-    uint8_t bid;
-    uint8_t *blob_;
-};
-
-struct BlobPoint {
-    BlobPoint(uint8_t x, uint8_t y) : x_(x), y_(y){};
-    virtual ~BlobPoint() {}
-    uint8_t x_;
-    uint8_t y_;
-};
-
-struct ActiveBlob {
-    uint8_t id_;
-    int size_;  // percent
-    uint32_t frame_update_count_;
+    // false when the blob is smaller than the cancel threshold
+    bool active_;
+    // runs of the blob in the blob run list
+    size_t run_offset_;
+    size_t run_count_;
 };
 
 class RaspiMotionBlob {
@@ -81,6 +100,12 @@ class RaspiMotionBlob {
     void GetBlobImage(uint8_t *buffer, size_t buflen);
     int GetActiveBlobCount(void);
     int GetActiveBlobUpdateCount(void);
+    // blobs of the last frame, including the blobs smaller than the cancel
+    // threshold.
+    inline const std::vector<MotionBlob> &GetBlobs() const { return blobs_; }
+    inline const MotionRun *GetBlobRuns(const MotionBlob &blob) const {
+        return blob_runs_.data() + blob.run_offset_;
+    }
 
     void SetBlobCancelThreshold(int cancel_min);
 
@@ -89,30 +114,35 @@ class RaspiMotionBlob {
     RaspiMotionBlob(const RaspiMotionBlob &) = delete;
 
    private:
-    bool AccquireBlobId(int *blob_id);
-    void UnaccquireBlobId(int blob_id);
-
-    size_t SearchConnectedBlob(uint8_t x, uint8_t y, int blob_id);
-    bool SearchConnectedNeighbor(uint8_t x, uint8_t y, int blob_id,
-                                 std::list<BlobPoint> &connected_list);
-
-    void MergeActiveBlob(std::list<int> &active_blob_list);
-    void TrackingBlob(std::list<int> &active_blob_list);
-
-    void DumpBlobBuffer(const char *header, uint8_t *buffer);
-    void DumpList(std::list<BlobPoint> &connected_list);
-    void DumpBlobIdList(const char *header);
+    // Extracts the runs of the motion points, and unions the runs connected
+    // with the runs of the previous row.
+    void ExtractRuns(const uint8_t *motion);
+    // Resolves the runs to the blobs, and groups the runs by the blob.
+    void ResolveBlobs();
+    // Tracks the blobs with the overlapping blobs of the previous frame.
+    void TrackBlobs();
+    uint32_t FindRoot(uint32_t run);
+    void UnionRuns(uint32_t run, uint32_t other);
+    static int CountOverlap(const MotionRun *runs, size_t count,
+                            const MotionRun *other_runs, size_t other_count);
+
+    void DumpBlobList(const char *header);
 
     uint32_t mvx_, mvy_;
     float blob_cancel_threshold_;
     uint32_t blob_tracking_threshold_;
 
-    uint8_t *extracted_;
-    uint8_t *extracted_previous_;
-    uint8_t *source_;
-
-    MotionBlob blob_list_[MAX_BLOB_LIST_SIZE];
-    std::list<int> active_blob_list_;
+    // runs of the frame in raster order, and their union-find parents and
+    // blob index. These buffers only grow to the largest number of runs.
+    std::vector<MotionRun> runs_;
+    std::vector<uint32_t> parent_;
+    std::vector<uint32_t> run_blob_;
+
+    // runs grouped by the blob, the previous frame is kept for tracking
+    std::vector<MotionRun> blob_runs_;
+    std::vector<MotionRun> previous_blob_runs_;
+    std::vector<MotionBlob> blobs_;
+    std::vector<MotionBlob> previous_blobs_;
 };
 
 #endif  // RASPI_MOTIONBLOB_H_
@@ -0,0 +1,143 @@
+/*
+Copyright (c) 2021, rpi-webrtc-streamer Lyu,KeunChang
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "raspi_motionboost.h"
+
+#include <algorithm>
+
+#include "rtc_base/checks.h"
+#include "rtc_base/logging.h"
+
+namespace {
+
+// The boosted bitrate decays to the target bitrate in steps, so the encoder
+// rate is not changed on every frame.
+const int kDecaySteps = 5;
+
+}  // namespace
+
+RaspiMotionBoost::RaspiMotionBoost(webrtc::Clock* clock, int boost_percent,
+                                   int boost_period, int decay_period,
+                                   int max_bitrate)
+    : clock_(clock),
+      boost_percent_(boost_percent),
+      boost_period_(boost_period),
+      decay_period_(decay_period),
+      max_bitrate_(max_bitrate),
+      target_bitrate_(0),
+      bandwidth_(0),
+      motion_active_(false),
+      boost_start_ms_(-1),
+      decay_start_ms_(-1),
+      boost_count_(0) {
+    RTC_DCHECK(clock_ != nullptr);
+}
+
+RaspiMotionBoost::~RaspiMotionBoost() {}
+
+void RaspiMotionBoost::SetTargetBitrate(int target_bitrate, int bandwidth) {
+    webrtc::MutexLock lock(&mutex_);
+    target_bitrate_ = target_bitrate;
+    bandwidth_ = bandwidth;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// The motion detection reports the trigger whenever the number of active
+// blobs changes, so only the first trigger after the clear starts the boost.
+// A trigger in the middle of the decay restarts the boost period without
+// another key frame.
+///////////////////////////////////////////////////////////////////////////////
+bool RaspiMotionBoost::OnMotionTriggered() {
+    webrtc::MutexLock lock(&mutex_);
+    if (motion_active_) return false;
+
+    int64_t now_ms = clock_->TimeInMilliseconds();
+    bool keyframe_required = !IsBoostingLocked(now_ms);
+    motion_active_ = true;
+    if (keyframe_required) {
+        boost_start_ms_ = now_ms;
+        boost_count_++;
+        RTC_LOG(INFO) << "Motion boost started, bitrate: " << target_bitrate_
+                      << " -> " << GetBoostedBitrateLocked()
+                      << " kbps, boost count: " << boost_count_;
+    }
+    decay_start_ms_ = now_ms + boost_period_;
+    return keyframe_required;
+}
+
+void RaspiMotionBoost::OnMotionCleared() {
+    webrtc::MutexLock lock(&mutex_);
+    motion_active_ = false;
+    if (boost_start_ms_ < 0) return;
+    decay_start_ms_ =
+        std::min(decay_start_ms_, clock_->TimeInMilliseconds());
+}
+
+bool RaspiMotionBoost::IsBoostingLocked(int64_t now_ms) const {
+    return boost_start_ms_ >= 0 && now_ms < decay_start_ms_ + decay_period_;
+}
+
+bool RaspiMotionBoost::IsBoosting() {
+    webrtc::MutexLock lock(&mutex_);
+    return IsBoostingLocked(clock_->TimeInMilliseconds());
+}
+
+int RaspiMotionBoost::boost_count() const {
+    webrtc::MutexLock lock(&mutex_);
+    return boost_count_;
+}
+
+int RaspiMotionBoost::GetBoostedBitrateLocked() const {
+    int bitrate = target_bitrate_ * (100 + boost_percent_) / 100;
+    bitrate = std::min(bitrate, max_bitrate_);
+    if (bandwidth_ > 0) bitrate = std::min(bitrate, bandwidth_);
+    return std::max(bitrate, target_bitrate_);
+}
+
+int RaspiMotionBoost::GetBitrate() {
+    webrtc::MutexLock lock(&mutex_);
+    int64_t now_ms = clock_->TimeInMilliseconds();
+
+    if (boost_start_ms_ < 0) return target_bitrate_;
+    if (IsBoostingLocked(now_ms) == false) {
+        RTC_LOG(INFO) << "Motion boost ended after "
+                      << now_ms - boost_start_ms_ << " ms";
+        boost_start_ms_ = -1;
+        return target_bitrate_;
+    }
+
+    int boosted_bitrate = GetBoostedBitrateLocked();
+    if (now_ms < decay_start_ms_) return boosted_bitrate;
+
+    int step = static_cast<int>((now_ms - decay_start_ms_) * kDecaySteps /
+                                std::max(decay_period_, 1)) +
+               1;
+    return boosted_bitrate -
+           (boosted_bitrate - target_bitrate_) * step / kDecaySteps;
+}
@@ -0,0 +1,89 @@
+/*
+Copyright (c) 2021, rpi-webrtc-streamer Lyu,KeunChang
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef RASPI_MOTIONBOOST_H_
+#define RASPI_MOTIONBOOST_H_
+
+#include "rtc_base/synchronization/mutex.h"
+#include "system_wrappers/include/clock.h"
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// RaspiMotionBoost
+//
+// Bitrate policy of the live streaming for the motion events of the motion
+// detection. When the motion starts, the target bitrate is lifted by the
+// boost percent for the boost period, bounded by the bandwidth estimation and
+// the max bitrate, and then decays back to the target bitrate in steps over
+// the decay period. The boost ends early when the motion is cleared.
+// It only depends on the clock, so the policy can be driven by a simulated
+// clock and motion events.
+//
+////////////////////////////////////////////////////////////////////////////////
+class RaspiMotionBoost {
+   public:
+    // bitrates are in kbps, periods are in milliseconds.
+    explicit RaspiMotionBoost(webrtc::Clock* clock, int boost_percent,
+                              int boost_period, int decay_period,
+                              int max_bitrate);
+    ~RaspiMotionBoost();
+
+    // Bitrate requested by the rate control, and the bandwidth estimation
+    // which bounds the boosted bitrate. 0 bandwidth means no bound.
+    void SetTargetBitrate(int target_bitrate, int bandwidth);
+
+    // Returns true when a new boost starts and a key frame is required.
+    bool OnMotionTriggered();
+    void OnMotionCleared();
+
+    // Returns the target bitrate with the boost applied at the current time.
+    int GetBitrate();
+    bool IsBoosting();
+    int boost_count() const;
+
+   private:
+    bool IsBoostingLocked(int64_t now_ms) const;
+    int GetBoostedBitrateLocked() const;
+
+    webrtc::Clock* const clock_;
+    const int boost_percent_;
+    const int boost_period_;
+    const int decay_period_;
+    const int max_bitrate_;
+
+    mutable webrtc::Mutex mutex_;
+    int target_bitrate_;
+    int bandwidth_;
+    bool motion_active_;
+    int64_t boost_start_ms_;  // -1 when there is no boost
+    int64_t decay_start_ms_;
+    int boost_count_;
+};
+
+#endif  // RASPI_MOTIONBOOST_H_
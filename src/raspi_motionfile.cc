@@ -29,10 +29,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "raspi_motionfile.h"
 
-#include <dirent.h>
-
+#include <algorithm>
 #include <limits>
-#include <list>
 #include <string>
 
 #include "config_motion.h"
@@ -45,72 +43,80 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 namespace {
 
 constexpr char kVideoFileExtension[] = ".h264";
+constexpr char kMp4FileExtension[] = ".mp4";
 constexpr char kImvFileExtension[] = ".imv";
-// minimal wait period
 
-struct FileInfo {
-    std::string filename;
-    size_t size;
-};
+}  // namespace
+
+CloseRecordingTask::CloseRecordingTask(
+    RaspiMotionFile* motion_file,
+    std::unique_ptr<webrtc::FileWriterHandle> frame_writer,
+    std::unique_ptr<webrtc::FileWriterHandle> imv_writer, bool release_rings,
+    bool discard, RecordingIndex* recording_index, time_t start_time,
+    int duration_ms, size_t size_limit)
+    : motion_file_(motion_file),
+      frame_writer_(std::move(frame_writer)),
+      imv_writer_(std::move(imv_writer)),
+      release_rings_(release_rings),
+      discard_(discard),
+      recording_index_(recording_index),
+      start_time_(start_time),
+      duration_ms_(duration_ms),
+      size_limit_(size_limit) {}
 
-static bool FilenameCompare(const FileInfo& a, const FileInfo& b) {
-    return a.filename.compare(b.filename) < 0;
+CloseRecordingTask::~CloseRecordingTask() { Close(); }
+
+bool CloseRecordingTask::Run() {
+    Close();
+    return true;  // always return true to stop task
 }
 
-}  // namespace
+void CloseRecordingTask::Close() {
+    if (!frame_writer_) return;  // already closed
 
-bool LimitTotalDirSizeTask::Run() {
-    std::list<FileInfo> file_list;
-    std::string file_folder;
-    size_t total_dir_size = 0;
-    size_t file_counter = 0;
-
-    // check video path is folder
-    if (!utils::GetFolderWithTailingDelimiter(base_path_, file_folder)) {
-        RTC_LOG(LS_ERROR) << "Motion file path is not folder : " << file_folder;
-        return true;  // always return true to stop task
-    };
-
-    DIR* dirp = ::opendir(file_folder.c_str());
-    if (dirp == nullptr) return true;
-    for (struct dirent* dirent = ::readdir(dirp); dirent;
-         dirent = ::readdir(dirp)) {
-        std::string name = dirent->d_name;
-        if (name.compare(0, prefix_.size(), prefix_) == 0) {
-            FileInfo file_info;
-            file_info.filename = name;
-            file_info.size = utils::GetFileSize(file_folder + name).value_or(0);
-            file_list.emplace_back(file_info);
-
-            file_counter++;
-            total_dir_size += file_info.size;
-        }
+    const std::string video_filename = frame_writer_->filename();
+    const std::string imv_filename = imv_writer_->filename();
+    if (discard_) {
+        frame_writer_->Abort();
+        imv_writer_->Abort();
+        if (recording_index_) recording_index_->RemoveRecording(video_filename);
+        motion_file_->ReleaseWriters(std::move(frame_writer_),
+                                     std::move(imv_writer_), release_rings_);
+        return;
     }
-    // not needed it anymore
-    ::closedir(dirp);
-    file_list.sort(FilenameCompare);
-
-    RTC_LOG(INFO) << "Directory \"" << file_folder << "\" " << file_counter
-                  << " files, total size: " << total_dir_size;
-
-    while (file_list.size() > 0 &&
-           ((total_dir_size - file_list.front().size) > size_limit_)) {
-        total_dir_size -= file_list.front().size;
-        std::string file_full_path = file_folder + file_list.front().filename;
-        RTC_LOG(INFO) << "Removing Video File :" << file_list.front().filename;
-        utils::DeleteFile(file_full_path);
-        file_list.pop_front();
-    };
-    return true;  // always return true to stop task
+    frame_writer_->Close();
+    imv_writer_->Close();
+
+    // After the file writer ends, old files are deleted so that the
+    // directory where the file is stored does not exceed the specified size
+    // limit.
+    if (recording_index_) {
+        recording_index_->CloseRecording(video_filename, imv_filename,
+                                         start_time_, duration_ms_);
+        recording_index_->EvictToSizeLimit(size_limit_);
+    }
+    motion_file_->ReleaseWriters(std::move(frame_writer_),
+                                 std::move(imv_writer_), release_rings_);
 }
 
 RaspiMotionFile::RaspiMotionFile(ConfigMotion* config_motion,
                                  const std::string base_path,
                                  const std::string prefix, int frame_queue_size,
-                                 int motion_queue_size)
+                                 int motion_queue_size, size_t frame_ring_size,
+                                 size_t imv_ring_size,
+                                 RecordingIndex* recording_index,
+                                 rtc::TaskQueue* worker_queue)
     : base_path_(base_path),
       prefix_(prefix),
       writer_active_(false),
+      frame_queue_size_(frame_queue_size),
+      motion_queue_size_(motion_queue_size),
+      worker_queue_(worker_queue),
+      rings_busy_(false),
+      rings_need_clear_(false),
+      recording_index_(recording_index),
+      recording_start_time_(0),
+      recording_start_us_(0),
       clock_(webrtc::Clock::GetRealTimeClock()),
       config_motion_(config_motion) {
     frame_writer_handle_.reset(
@@ -118,6 +124,16 @@ RaspiMotionFile::RaspiMotionFile(ConfigMotion* config_motion,
     imv_writer_handle_.reset(
         new webrtc::FileWriterHandle("imv_writer", motion_queue_size));
 
+    frame_ring_.reset(new webrtc::GopRing(
+        frame_ring_size, config_motion_->GetPreEventPeriod()));
+    if (config_motion_->GetSaveImvFile())
+        imv_ring_.reset(new webrtc::GopRing(
+            imv_ring_size, config_motion_->GetPreEventPeriod()));
+    if (config_motion_->GetMp4File())
+        mp4_muxer_.reset(new webrtc::Mp4Muxer(config_motion_->GetWidth(),
+                                              config_motion_->GetHeight()));
+    init_segment_pending_ = false;
+
     // Since the imv file is relatively small compared to the video file size,
     // the size limit is used only for the video file.
     frame_file_size_limit_ = config_motion_->GetFileSizeLimit() * 1024;
@@ -130,20 +146,39 @@ RaspiMotionFile::~RaspiMotionFile() {}
 // Queuing the video and imv frame in buffer queue
 //
 ///////////////////////////////////////////////////////////////////////////////
-bool RaspiMotionFile::FrameQueuing(const void* data, size_t bytes,
-                                   size_t* bytes_written, bool is_keyframe) {
-    // When saving a video file, the keyframe must be saved at the beginning, so
-    // when the keyframe arrives, the buffer is cleared. Later, when the video
-    // file starts to be saved, what is in the buffer is saved first, and
-    // frames are added afterwards.
-    if (is_keyframe == true) {
-        // reset both of frame_queue and imv_queue
-        if (frame_writer_handle_->is_open() == false)
-            frame_writer_handle_->clear();
-        if (imv_writer_handle_->is_open() == false) imv_writer_handle_->clear();
-    }
-
-    size_t written = frame_writer_handle_->WriteBack(data, bytes);
+bool RaspiMotionFile::FrameQueuing(
+    rtc::scoped_refptr<webrtc::FrameBuffer> frame, size_t* bytes_written) {
+    int64_t timestamp_us = frame->capture_time_us() >= 0
+                               ? frame->capture_time_us()
+                               : clock_->TimeInMicroseconds();
+    if (mp4_muxer_) return Mp4Queuing(frame, timestamp_us, bytes_written);
+
+    // While the writer is not active, the frames are kept in the pre-event
+    // ring, which starts the new GOP of both the video and imv at the
+    // keyframe. The imv of the keyframe arrives after the keyframe. When the
+    // writer starts, the contents of the ring are saved first, and the frames
+    // are added to the writer buffer afterwards.
+    if (writer_active_ == false) {
+        if (PreEventRingsReady() == false) {
+            *bytes_written = frame->length();
+            return true;
+        }
+        if (frame->isKeyFrame() == true) {
+            frame_ring_->StartGop(timestamp_us);
+            if (imv_ring_) imv_ring_->StartGop(timestamp_us);
+        }
+        if (frame_ring_->Append(frame->data(), frame->length()) == false) {
+            // drop the imv GOP together to keep both of them aligned
+            if (imv_ring_) imv_ring_->clear();
+            *bytes_written = 0;
+            return false;
+        }
+        *bytes_written = frame->length();
+        return true;
+    }
+
+    size_t bytes = frame->length();
+    size_t written = frame_writer_handle_->WriteBack(frame);
     if (written != bytes) {
         RTC_LOG(LS_ERROR) << "Failed to WriteBack on frame writer buffer";
         return false;
@@ -152,8 +187,82 @@ bool RaspiMotionFile::FrameQueuing(const void* data, size_t bytes,
     return true;
 }
 
+// The frames of a GOP are muxed into one fragment, and the fragment is
+// queued when the next keyframe arrives. So the pre-event ring has the
+// completed GOPs only, and the GOP in the muxer is queued to the writer
+// after the writer starts.
+bool RaspiMotionFile::Mp4Queuing(rtc::scoped_refptr<webrtc::FrameBuffer> frame,
+                                 int64_t timestamp_us, size_t* bytes_written) {
+    bool result = true;
+    if (frame->isKeyFrame() == true) {
+        if (mp4_muxer_->FinishFragment(timestamp_us))
+            result = QueueFragment(timestamp_us);
+        if (writer_active_ == false && imv_ring_ && PreEventRingsReady())
+            imv_ring_->StartGop(timestamp_us);
+    }
+    mp4_muxer_->AddFrame(*frame, timestamp_us);
+    *bytes_written = frame->length();
+    return result;
+}
+
+bool RaspiMotionFile::QueueFragment(int64_t now_us) {
+    const std::vector<uint8_t>& header = mp4_muxer_->fragment_header();
+    const std::vector<uint8_t>& payload = mp4_muxer_->fragment_payload();
+
+    if (writer_active_ == false) {
+        if (PreEventRingsReady() == false) return true;
+        frame_ring_->StartGop(mp4_muxer_->fragment_start_us(), now_us);
+        if (frame_ring_->Append(header.data(), header.size()) == false ||
+            frame_ring_->Append(payload.data(), payload.size()) == false) {
+            frame_ring_->clear();
+            if (imv_ring_) imv_ring_->clear();
+            return false;
+        }
+        return true;
+    }
+
+    // the muxer was not ready when the writer started
+    if (init_segment_pending_) {
+        if (mp4_muxer_->CreateInitSegment(mp4_muxer_->fragment_start_us(),
+                                          &init_segment_) == false) {
+            // the file can not be played without the init segment
+            RTC_LOG(LS_ERROR) << "Failed to create the mp4 init segment, "
+                                 "removing the recording";
+            init_segment_pending_ = false;
+            writer_active_ = false;
+            CloseWriters(true /* discard */);
+            return false;
+        }
+        frame_writer_handle_->WriteBack(init_segment_.data(),
+                                        init_segment_.size());
+        init_segment_pending_ = false;
+    }
+    frame_writer_handle_->WriteBack(header.data(), header.size());
+    frame_writer_handle_->WriteBack(payload.data(), payload.size());
+    return true;
+}
+
 bool RaspiMotionFile::ImvQueuing(const void* data, size_t bytes,
-                                 size_t* bytes_written, bool is_keyframe) {
+                                 size_t* bytes_written) {
+    if (config_motion_->GetSaveImvFile() == false) {
+        *bytes_written = bytes;
+        return true;
+    }
+
+    if (writer_active_ == false) {
+        if (PreEventRingsReady() == false) {
+            *bytes_written = bytes;
+            return true;
+        }
+        if (imv_ring_->Append(data, bytes) == false) {
+            frame_ring_->clear();
+            *bytes_written = 0;
+            return false;
+        }
+        *bytes_written = bytes;
+        return true;
+    }
+
     size_t written = imv_writer_handle_->WriteBack(data, bytes);
     if (written != bytes) {
         RTC_LOG(LS_ERROR) << "Failed to WriteBack on imv writer buffer";
@@ -165,18 +274,72 @@ bool RaspiMotionFile::ImvQueuing(const void* data, size_t bytes,
 
 bool RaspiMotionFile::StartWriter() {
     if (writer_active_ == false) {
+        // The closing writers may still have the pre-event rings, then the
+        // recording starts without the pre-event.
+        bool use_rings = PreEventRingsReady();
+        if (use_rings) AlignPreEventRings();
         // start motion file writer thread ;
-        if (frame_writer_handle_->Open(base_path_, prefix_, kVideoFileExtension,
-                                       frame_file_size_limit_) == false) {
+        frame_writer_handle_->SetPreEventRing(use_rings ? frame_ring_.get()
+                                                        : nullptr);
+        if (mp4_muxer_) {
+            // The file starts with the oldest GOP in the ring, or the GOP
+            // in the muxer when the ring is empty.
+            if (mp4_muxer_->ready() && mp4_muxer_->sample_count() > 0) {
+                int64_t start_us = use_rings && frame_ring_->gop_count() > 0
+                                       ? frame_ring_->first_timestamp_us()
+                                       : mp4_muxer_->fragment_start_us();
+                if (mp4_muxer_->CreateInitSegment(start_us, &init_segment_) ==
+                    false) {
+                    RTC_LOG(LS_ERROR)
+                        << "Failed to create the mp4 init segment";
+                    return false;
+                }
+                frame_writer_handle_->SetFileHeader(init_segment_);
+                init_segment_pending_ = false;
+            } else {
+                init_segment_pending_ = true;
+            }
+        }
+        if (frame_writer_handle_->Open(
+                base_path_, prefix_,
+                mp4_muxer_ ? kMp4FileExtension : kVideoFileExtension,
+                frame_file_size_limit_) == false) {
             return false;
         };
+        // the recording starts with the oldest GOP in the pre-event ring
+        int64_t now_us = clock_->TimeInMicroseconds();
+        int64_t pre_event_us =
+            use_rings && frame_ring_->gop_count() > 0
+                ? std::max<int64_t>(now_us - frame_ring_->first_timestamp_us(),
+                                    0)
+                : 0;
+        recording_start_us_ = now_us - pre_event_us;
+        recording_start_time_ = time(nullptr) - pre_event_us / 1000000;
+
         if (config_motion_->GetSaveImvFile()) {
+            imv_writer_handle_->SetPreEventRing(use_rings ? imv_ring_.get()
+                                                          : nullptr);
             if (imv_writer_handle_->Open(base_path_, prefix_, kImvFileExtension,
                                          0 /* no limit */) == false) {
+                // the video file is closed in the worker queue, and saved
+                // without the imv file
+                CloseWriters(false);
                 return false;
             };
         }
         writer_active_ = true;
+        if (recording_index_) {
+            // the recording is listed while it is being written
+            RecordingIndex* recording_index = recording_index_;
+            std::string video_filename = frame_writer_handle_->filename();
+            std::string imv_filename = imv_writer_handle_->filename();
+            time_t start_time = recording_start_time_;
+            worker_queue_->PostTask([recording_index, video_filename,
+                                     imv_filename, start_time] {
+                recording_index->OpenRecording(video_filename, imv_filename,
+                                               start_time);
+            });
+        }
         RTC_LOG(LS_VERBOSE) << "Motion File Writer started.";
         return true;
     }
@@ -186,16 +349,103 @@ bool RaspiMotionFile::StartWriter() {
 
 bool RaspiMotionFile::StopWriter() {
     if (writer_active_ == true) {
+        // the GOP in the muxer is the last fragment of the file
+        if (mp4_muxer_) {
+            if (mp4_muxer_->FinishFragment()) QueueFragment(0);
+            mp4_muxer_->Reset();
+            init_segment_pending_ = false;
+        }
         writer_active_ = false;
         RTC_LOG(INFO) << "Motion File Writer stopped.";
-
-        // stop motion file writer thread ;
-        frame_writer_handle_->Close();
-        if (imv_writer_handle_) imv_writer_handle_->Close();
+        CloseWriters(false);
         return true;
     }
     return false;
 }
 
+// Hands over the writers to the worker queue, and takes the spare writers
+// for the next recording. Only the writers are swapped in the caller thread.
+void RaspiMotionFile::CloseWriters(bool discard) {
+    // The pre-event ring is saved in the closed file, and the next pre-event
+    // starts with the next keyframe. The rings are cleared after the closing
+    // writers release them, when the pre-event is not written yet.
+    bool release_rings = frame_writer_handle_->pre_event_pending() ||
+                         imv_writer_handle_->pre_event_pending();
+    if (release_rings) {
+        rings_busy_ = true;
+        rings_need_clear_ = true;
+    } else {
+        frame_ring_->clear();
+        if (imv_ring_) imv_ring_->clear();
+    }
+
+    int duration_ms = static_cast<int>(
+        (clock_->TimeInMicroseconds() - recording_start_us_) / 1000);
+    worker_queue_->PostTask(std::make_unique<CloseRecordingTask>(
+        this, std::move(frame_writer_handle_), std::move(imv_writer_handle_),
+        release_rings, discard, recording_index_, recording_start_time_,
+        duration_ms,
+        static_cast<size_t>(config_motion_->GetTotalFileSizeLimit()) *
+            1000000));
+    frame_writer_handle_ =
+        TakeWriter(&spare_frame_writers_, "frame_writer", frame_queue_size_);
+    imv_writer_handle_ =
+        TakeWriter(&spare_imv_writers_, "imv_writer", motion_queue_size_);
+}
+
+std::unique_ptr<webrtc::FileWriterHandle> RaspiMotionFile::TakeWriter(
+    std::vector<std::unique_ptr<webrtc::FileWriterHandle>>* spare_writers,
+    const char* name, size_t buffer_size) {
+    {
+        webrtc::MutexLock lock(&mutex_);
+        if (!spare_writers->empty()) {
+            std::unique_ptr<webrtc::FileWriterHandle> writer =
+                std::move(spare_writers->back());
+            spare_writers->pop_back();
+            return writer;
+        }
+    }
+    // the previous writers are still closing
+    return std::make_unique<webrtc::FileWriterHandle>(name, buffer_size);
+}
+
+void RaspiMotionFile::ReleaseWriters(
+    std::unique_ptr<webrtc::FileWriterHandle> frame_writer,
+    std::unique_ptr<webrtc::FileWriterHandle> imv_writer, bool release_rings) {
+    {
+        webrtc::MutexLock lock(&mutex_);
+        spare_frame_writers_.push_back(std::move(frame_writer));
+        spare_imv_writers_.push_back(std::move(imv_writer));
+    }
+    if (release_rings) rings_busy_ = false;
+}
+
+// The GOPs evicted from one of the rings are dropped from the other one, so
+// the video file and the imv file start at the same GOP. In the mp4 file, the
+// GOP in the muxer follows the frame ring.
+void RaspiMotionFile::AlignPreEventRings() {
+    if (!imv_ring_) return;
+    int64_t start_us;
+    if (frame_ring_->gop_count() > 0)
+        start_us = frame_ring_->first_timestamp_us();
+    else if (mp4_muxer_ && mp4_muxer_->sample_count() > 0)
+        start_us = mp4_muxer_->fragment_start_us();
+    else
+        return;
+    imv_ring_->EvictBefore(start_us);
+    if (imv_ring_->gop_count() > 0)
+        frame_ring_->EvictBefore(imv_ring_->first_timestamp_us());
+}
+
+bool RaspiMotionFile::PreEventRingsReady() {
+    if (rings_busy_) return false;
+    if (rings_need_clear_) {
+        frame_ring_->clear();
+        if (imv_ring_) imv_ring_->clear();
+        rings_need_clear_ = false;
+    }
+    return true;
+}
+
 bool RaspiMotionFile::IsWriterActive() { return writer_active_; }
 
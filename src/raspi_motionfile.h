@@ -30,28 +30,55 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef RASPI_MOTIONFIE_H_
 #define RASPI_MOTIONFIE_H_
 
+#include <atomic>
 #include <ctime>
 #include <memory>
+#include <vector>
 
 #include "api/task_queue/default_task_queue_factory.h"
 #include "api/task_queue/queued_task.h"
 #include "api/task_queue/task_queue_base.h"
 #include "config_motion.h"
 #include "file_writer_handle.h"
+#include "frame_queue.h"
+#include "gop_ring.h"
+#include "mp4_muxer.h"
+#include "recording_index.h"
 #include "rtc_base/platform_thread.h"
 #include "rtc_base/synchronization/mutex.h"
+#include "rtc_base/task_queue.h"
 #include "system_wrappers/include/clock.h"
 
-class LimitTotalDirSizeTask : public webrtc::QueuedTask {
+class RaspiMotionFile;
+
+// Closes the files of the recording in the worker queue, and removes the
+// oldest recordings of the recording index, so that the directory does not
+// exceed the size limit. The writers are returned to the motion file
+// afterwards. The files are closed also when the task is deleted without
+// running, e.g. the worker queue is deleted.
+class CloseRecordingTask : public webrtc::QueuedTask {
    public:
-    explicit LimitTotalDirSizeTask(const std::string& base_path,
-                                   const std::string& prefix, size_t size_limit)
-        : base_path_(base_path), prefix_(prefix), size_limit_(size_limit) {}
+    explicit CloseRecordingTask(
+        RaspiMotionFile* motion_file,
+        std::unique_ptr<webrtc::FileWriterHandle> frame_writer,
+        std::unique_ptr<webrtc::FileWriterHandle> imv_writer,
+        bool release_rings, bool discard, RecordingIndex* recording_index,
+        time_t start_time, int duration_ms, size_t size_limit);
+    ~CloseRecordingTask() override;
 
    private:
     bool Run() override;
-    const std::string base_path_, prefix_;
-    size_t size_limit_;
+    void Close();
+
+    RaspiMotionFile* motion_file_;
+    std::unique_ptr<webrtc::FileWriterHandle> frame_writer_;
+    std::unique_ptr<webrtc::FileWriterHandle> imv_writer_;
+    const bool release_rings_;
+    const bool discard_;  // the files are removed instead of being indexed
+    RecordingIndex* recording_index_;
+    const time_t start_time_;
+    const int duration_ms_;
+    const size_t size_limit_;
 };
 
 class RaspiMotionFile {
@@ -59,31 +86,85 @@ class RaspiMotionFile {
     explicit RaspiMotionFile(ConfigMotion* config_motion,
                              const std::string base_path,
                              const std::string prefix, int frame_queue_size,
-                             int motion_queue_size);
+                             int motion_queue_size, size_t frame_ring_size,
+                             size_t imv_ring_size,
+                             RecordingIndex* recording_index,
+                             rtc::TaskQueue* worker_queue);
     ~RaspiMotionFile();
 
-    // Frame queuing
-    bool FrameQueuing(const void* data, size_t bytes, size_t* bytes_written,
-                      bool is_keyframe);
-    // Inline Motion Vector queuing
-    bool ImvQueuing(const void* data, size_t bytes, size_t* bytes_written,
-                    bool is_keyframe);
+    // Frame queuing, the frame is held by the writer buffer without copying
+    // while the writer is active.
+    bool FrameQueuing(rtc::scoped_refptr<webrtc::FrameBuffer> frame,
+                      size_t* bytes_written);
+    // Inline Motion Vector queuing, the motion vector is always copied since
+    // the IMV buffers of the encoder are limited.
+    bool ImvQueuing(const void* data, size_t bytes, size_t* bytes_written);
 
     bool IsWriterActive(void);
     bool StartWriter(void);
+    // The files are closed in the worker queue, so the caller is not blocked
+    // by the file writing.
     bool StopWriter(void);
 
    private:
+    friend class CloseRecordingTask;
+    // Posts the closing of the writers to the worker queue, the files are
+    // removed when discard is set.
+    void CloseWriters(bool discard);
+    // Called by CloseRecordingTask when the files are closed
+    void ReleaseWriters(std::unique_ptr<webrtc::FileWriterHandle> frame_writer,
+                        std::unique_ptr<webrtc::FileWriterHandle> imv_writer,
+                        bool release_rings);
+    std::unique_ptr<webrtc::FileWriterHandle> TakeWriter(
+        std::vector<std::unique_ptr<webrtc::FileWriterHandle>>* spare_writers,
+        const char* name, size_t buffer_size);
+    // Returns false while the closing writers still have the pre-event rings
+    bool PreEventRingsReady();
+    void AlignPreEventRings();
+
+    bool Mp4Queuing(rtc::scoped_refptr<webrtc::FrameBuffer> frame,
+                    int64_t timestamp_us, size_t* bytes_written);
+    // Queue the finished fragment of the muxer to the ring or the writer
+    bool QueueFragment(int64_t now_us);
+
     std::string base_path_;
     std::string prefix_;
     bool writer_active_;
 
-    // Frame and MV queue for saving frame and mv
+    // Frame and MV queue for saving frame and mv. The writers are swapped
+    // with the spare writers when the recording stops, and the closed
+    // writers come back to the spare writers.
     std::unique_ptr<webrtc::FileWriterHandle> frame_writer_handle_;
     std::unique_ptr<webrtc::FileWriterHandle> imv_writer_handle_;
+    std::vector<std::unique_ptr<webrtc::FileWriterHandle>>
+        spare_frame_writers_;  // guarded by mutex_
+    std::vector<std::unique_ptr<webrtc::FileWriterHandle>>
+        spare_imv_writers_;  // guarded by mutex_
+    const size_t frame_queue_size_;
+    const size_t motion_queue_size_;
+    rtc::TaskQueue* worker_queue_;
+
+    // Pre-event GOPs kept while the writer is not active. The imv ring is
+    // created only when the imv file is saved.
+    std::unique_ptr<webrtc::GopRing> frame_ring_;
+    std::unique_ptr<webrtc::GopRing> imv_ring_;
+    // The rings are used by the closing writers until the pre-event is
+    // written, and cleared by the drain thread after they are released.
+    std::atomic<bool> rings_busy_;
+    bool rings_need_clear_;
+
+    // Muxer of the mp4 file, null when the raw H.264 file is saved
+    std::unique_ptr<webrtc::Mp4Muxer> mp4_muxer_;
+    std::vector<uint8_t> init_segment_;
+    bool init_segment_pending_;
 
     size_t frame_file_size_limit_;
 
+    // The closed recording is added to the recording index
+    RecordingIndex* recording_index_;
+    time_t recording_start_time_;
+    int64_t recording_start_us_;
+
     webrtc::Mutex mutex_;
     webrtc::Clock* const clock_;
     ConfigMotion* config_motion_;
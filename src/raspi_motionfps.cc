@@ -0,0 +1,202 @@
+/*
+Copyright (c) 2021, rpi-webrtc-streamer Lyu,KeunChang
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "raspi_motionfps.h"
+
+#include <algorithm>
+
+#include "rtc_base/checks.h"
+#include "rtc_base/logging.h"
+#include "system_wrappers/include/metrics.h"
+
+namespace {
+
+const int kActiveAverageSize = 32;
+const int kDefaultFramerate = 30;
+const int kDefaultBitrate = 300;          // kbps
+const int64_t kStatsReportPeriod = 60000;  // 1 minute
+
+}  // namespace
+
+RaspiMotionFps::RaspiMotionFps(ConfigMedia* config_media,
+                               webrtc::MMALEncoderWrapper* mmal_encoder)
+    : mmal_encoder_(mmal_encoder),
+      clock_(webrtc::Clock::GetRealTimeClock()),
+      enabled_(config_media->GetVideoMotionAdaptiveFps()),
+      static_framerate_(config_media->GetVideoMotionStaticFps()),
+      static_percent_(config_media->GetVideoMotionStaticPercent()),
+      active_percent_(config_media->GetVideoMotionActivePercent()),
+      static_wait_period_(config_media->GetVideoMotionStaticWaitPeriod()),
+      target_framerate_(kDefaultFramerate),
+      target_bitrate_(kDefaultBitrate),
+      static_scene_(false),
+      active_average_(kActiveAverageSize),
+      active_blobs_(0),
+      static_wait_start_ms_(-1),
+      start_time_ms_(clock_->TimeInMilliseconds()),
+      static_start_ms_(0),
+      static_duration_ms_(0),
+      static_switches_(0),
+      last_report_ms_(start_time_ms_) {
+    if (enabled_) {
+        RTC_LOG(INFO) << "Motion adaptive fps enabled, static fps: "
+                      << static_framerate_
+                      << ", static percent: " << static_percent_
+                      << ", active percent: " << active_percent_
+                      << ", wait period: " << static_wait_period_;
+    }
+}
+
+RaspiMotionFps::~RaspiMotionFps() {
+    if (enabled_ == false) return;
+    int64_t now_ms = clock_->TimeInMilliseconds();
+    int64_t static_duration_ms = static_duration_ms_;
+    if (static_scene_) static_duration_ms += now_ms - static_start_ms_;
+    if (now_ms > start_time_ms_) {
+        RTC_HISTOGRAM_PERCENTAGE(
+            "WebRTC.Video.RaspiEncoder.StaticScenePercent",
+            static_cast<int>(static_duration_ms * 100 /
+                             (now_ms - start_time_ms_)));
+    }
+    RTC_HISTOGRAM_COUNTS_1000("WebRTC.Video.RaspiEncoder.StaticSceneSwitches",
+                              static_switches_);
+}
+
+bool RaspiMotionFps::IsEnabled() const { return enabled_; }
+
+int RaspiMotionFps::GetFramerateLocked() const {
+    if (static_scene_) return std::min(target_framerate_, static_framerate_);
+    return target_framerate_;
+}
+
+int RaspiMotionFps::GetBitrateLocked() const {
+    // the bits per frame is kept with the lowered framerate
+    if (static_scene_ && target_framerate_ > 0)
+        return target_bitrate_ * GetFramerateLocked() / target_framerate_;
+    return target_bitrate_;
+}
+
+int RaspiMotionFps::SetRate(int framerate, int bitrate) {
+    webrtc::MutexLock lock(&mutex_);
+    target_framerate_ = framerate;
+    target_bitrate_ = bitrate;
+    int session_framerate = GetFramerateLocked();
+    mmal_encoder_->SetSessionRate(webrtc::MMALEncoderWrapper::CLIENT_LIVE,
+                                  session_framerate, GetBitrateLocked());
+    return session_framerate;
+}
+
+void RaspiMotionFps::SetBitrate(int bitrate) {
+    webrtc::MutexLock lock(&mutex_);
+    if (target_bitrate_ == bitrate) return;
+    target_bitrate_ = bitrate;
+    mmal_encoder_->SetSessionRate(webrtc::MMALEncoderWrapper::CLIENT_LIVE,
+                                  GetFramerateLocked(), GetBitrateLocked());
+}
+
+void RaspiMotionFps::SetStaticScene(bool static_scene, int moving_percent) {
+    webrtc::MutexLock lock(&mutex_);
+    int64_t now_ms = clock_->TimeInMilliseconds();
+
+    static_scene_ = static_scene;
+    static_wait_start_ms_ = -1;
+    if (static_scene) {
+        static_start_ms_ = now_ms;
+        static_switches_++;
+    } else {
+        static_duration_ms_ += now_ms - static_start_ms_;
+    }
+    RTC_LOG(INFO) << "Motion adaptive fps: scene is "
+                  << (static_scene ? "static" : "moving")
+                  << ", moving percent: " << moving_percent
+                  << ", framerate: " << GetFramerateLocked()
+                  << ", bitrate: " << GetBitrateLocked();
+    mmal_encoder_->SetSessionRate(webrtc::MMALEncoderWrapper::CLIENT_LIVE,
+                                  GetFramerateLocked(), GetBitrateLocked());
+}
+
+void RaspiMotionFps::ReportStats(int64_t now_ms) {
+    if (now_ms - last_report_ms_ < kStatsReportPeriod) return;
+    last_report_ms_ = now_ms;
+
+    webrtc::MutexLock lock(&mutex_);
+    int64_t static_duration_ms = static_duration_ms_;
+    if (static_scene_) static_duration_ms += now_ms - static_start_ms_;
+    RTC_LOG(INFO) << "Motion adaptive fps: static "
+                  << static_duration_ms * 100 / (now_ms - start_time_ms_)
+                  << "% of " << (now_ms - start_time_ms_) / 1000
+                  << " seconds, switches: " << static_switches_;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Motion Observers
+//
+// The blob events of a frame come after its active points, so the active
+// blobs of the previous frame are used in the static scene decision.
+//
+///////////////////////////////////////////////////////////////////////////////
+void RaspiMotionFps::OnMotionTriggered(int active_nums) {
+    active_blobs_ = active_nums;
+}
+
+void RaspiMotionFps::OnMotionCleared(int updates) { active_blobs_ = 0; }
+
+void RaspiMotionFps::OnActivePoints(int total_points, int active_points,
+                                    int moving_points) {
+    if (enabled_ == false || total_points == 0) return;
+    active_average_.AddSample(active_points * 100 / total_points);
+
+    int64_t now_ms = clock_->TimeInMilliseconds();
+    int moving_percent = moving_points * 100 / total_points;
+    bool static_scene;
+    {
+        webrtc::MutexLock lock(&mutex_);
+        static_scene = static_scene_;
+    }
+
+    if (static_scene) {
+        // the full framerate is restored with the first moving frame
+        if (moving_percent >= active_percent_)
+            SetStaticScene(false, moving_percent);
+    } else {
+        absl::optional<int> active_average =
+            active_average_.GetAverageRoundedDown();
+        if (active_average && *active_average < static_percent_ &&
+            active_blobs_ == 0 && moving_percent < active_percent_) {
+            if (static_wait_start_ms_ < 0)
+                static_wait_start_ms_ = now_ms;
+            else if (now_ms - static_wait_start_ms_ >= static_wait_period_)
+                SetStaticScene(true, moving_percent);
+        } else {
+            static_wait_start_ms_ = -1;
+        }
+    }
+    ReportStats(now_ms);
+}
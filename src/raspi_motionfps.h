@@ -0,0 +1,112 @@
+/*
+Copyright (c) 2021, rpi-webrtc-streamer Lyu,KeunChang
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef RASPI_MOTIONFPS_H_
+#define RASPI_MOTIONFPS_H_
+
+#include "config_media.h"
+#include "mmal_wrapper.h"
+#include "raspi_motionvector.h"
+#include "rtc_base/numerics/moving_average.h"
+#include "rtc_base/synchronization/mutex.h"
+#include "system_wrappers/include/clock.h"
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// RaspiMotionFps
+//
+// Lowers the framerate of the live streaming while the inline motion vectors
+// of the encoder show a static scene. The scene becomes static when the
+// average active points percent stays below the static percent without any
+// active blob for the wait period, and the full framerate is restored with
+// the first frame whose moving points percent reaches the active percent.
+// The bitrate is lowered with the framerate while the scene is static.
+// The motion vectors are not analysed here, the active points and the blob
+// events come from the analysis thread of the motion detection through the
+// motion observers of MMALEncoderWrapper. The scene stays moving while the
+// motion detection is not running.
+//
+////////////////////////////////////////////////////////////////////////////////
+class RaspiMotionFps : public MotionBlobObserver, public MotionImvObserver {
+   public:
+    explicit RaspiMotionFps(ConfigMedia* config_media,
+                            webrtc::MMALEncoderWrapper* mmal_encoder);
+    ~RaspiMotionFps();
+
+    bool IsEnabled() const;
+
+    // Updates the framerate and bitrate of the live session requested by the
+    // rate control. Returns the framerate applied to the session, which is
+    // limited to the static framerate while the scene is static. The bitrate
+    // is scaled down by the same ratio with the framerate.
+    int SetRate(int framerate, int bitrate);
+    // Updates only the bitrate, keeping the framerate of the last SetRate
+    void SetBitrate(int bitrate);
+
+    // Motion Observers, called in the analysis thread of the motion detection
+    void OnMotionTriggered(int active_nums) override;
+    void OnMotionCleared(int updates) override;
+    void OnActivePoints(int total_points, int active_points,
+                        int moving_points) override;
+
+   private:
+    void SetStaticScene(bool static_scene, int moving_percent);
+    int GetFramerateLocked() const;
+    int GetBitrateLocked() const;
+    void ReportStats(int64_t now_ms);
+
+    webrtc::MMALEncoderWrapper* mmal_encoder_;
+    webrtc::Clock* const clock_;
+    bool enabled_;
+    int static_framerate_;
+    int static_percent_;
+    int active_percent_;
+    int static_wait_period_;
+
+    webrtc::Mutex mutex_;
+    int target_framerate_;
+    int target_bitrate_;
+    bool static_scene_;
+
+    // used only in the analysis thread of the motion detection
+    rtc::MovingAverage active_average_;
+    int active_blobs_;
+    int64_t static_wait_start_ms_;
+
+    // telemetry
+    int64_t start_time_ms_;
+    int64_t static_start_ms_;
+    int64_t static_duration_ms_;
+    int static_switches_;
+    int64_t last_report_ms_;
+
+    RTC_DISALLOW_COPY_AND_ASSIGN(RaspiMotionFps);
+};
+
+#endif  // RASPI_MOTIONFPS_H_
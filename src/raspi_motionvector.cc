@@ -30,7 +30,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <stdio.h>
 
 #include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <cstdlib>
 #include <cstring>
 #include <limits>
 #include <string>
@@ -40,6 +42,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <type_traits>
 #define RTC_DCHECK CHECK
+#define RTC_LOG(severity) LOG(severity)
 #define RTC_ERROR LOG(ERROR)
 #else
 #include "rtc_base/checks.h"
@@ -49,6 +52,11 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "raspi_motionvector.h"
 
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define MOTION_VECTOR_NEON
+#endif
+
 // Inline Motion Vector Debugging Macros
 // #define DEBUG_IMV
 
@@ -69,11 +77,83 @@ const int kMvPixelWidth = 16;
 
 // Bit Operation
 const int kMotionBitSetNumber = 31;
-const int kMotionCutBitThreshold = 2;
+const uint32_t kMotionLatestBit = 1u << kMotionBitSetNumber;
+const uint32_t kMotionCutBitThreshold = 2;
+
+// A point is moving when the squared magnitude of its motion vector reaches
+// the threshold, which is the same as the non-zero floor(sqrt(magnitude)).
+const int kMotionMagnitudeThreshold = 1;
+// Normalized motion value less than this is removed
+const uint32_t kMotionCutValue = 3;
+// The candidate is reduced to this bits before the fixed-point scaling
+const int kMotionScaleBits = 16;
+#ifdef MOTION_VECTOR_NEON
+// Number of points processed in an iteration of the NEON kernels
+const size_t kNeonBlockSize = 16;
+#endif  // MOTION_VECTOR_NEON
 
 // Default Motion Active Max/Min Treshold
 const int kDefaultMotionCoolingDown = 3000;  // ms
 
+// Adaptive background model, the mean and the variance are kept in the
+// fixed point with the fraction bits(the variance uses twice of them).
+const int kBackgroundFractionBits = 8;
+// SAD of a macroblock is reduced with the shift before modeling
+const int kSadScaleShift = 4;
+// The background adapts to 1/2^shift of the difference in a frame. While
+// the point departs from the background, the variance is frozen and only the
+// mean adapts much slower, so the motion repeated in place keeps departing
+// and an object stopped in the view still becomes background eventually.
+const int kBackgroundAdaptShift = 6;
+const int kForegroundAdaptShift = 10;
+// A point departs from its background when the difference is larger than
+// the minimum deviation plus kBackgroundDeviation times of the standard
+// deviation.
+const int64_t kBackgroundDeviation = 3;
+const uint32_t kMinSadDeviation = 4;  // 64 of SAD
+const uint32_t kMinMagnitudeDeviation = 2;
+
+// Returns true when the value departs from the background of the point, and
+// adapts the mean and the variance to the value. The variance is adapted only
+// to the values within the background, otherwise the squared difference of
+// the departing value widens the deviation in a few frames and the motion is
+// absorbed.
+bool UpdateBackground(uint32_t value, uint32_t min_deviation, uint32_t *mean,
+                      uint32_t *variance) {
+    int64_t difference =
+        (static_cast<int64_t>(value) << kBackgroundFractionBits) - *mean;
+    int64_t excess =
+        difference -
+        (static_cast<int64_t>(min_deviation) << kBackgroundFractionBits);
+    bool depart = excess > 0 && excess * excess > kBackgroundDeviation *
+                                                      kBackgroundDeviation *
+                                                      (*variance);
+    if (depart) {
+        *mean += difference / (1 << kForegroundAdaptShift);
+        return true;
+    }
+    int64_t square =
+        std::min<int64_t>(difference * difference,
+                          std::numeric_limits<uint32_t>::max());
+    *mean += difference / (1 << kBackgroundAdaptShift);
+    *variance += (square - *variance) / (1 << kBackgroundAdaptShift);
+    return false;
+}
+
+int64_t TimeMicros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+// Adds the time since the start to the stage, and returns the start time of
+// the next stage.
+int64_t AddStageTime(int64_t *stage_us, int64_t start_us) {
+    int64_t now_us = TimeMicros();
+    *stage_us += now_us - start_us;
+    return now_us;
+}
+
 }  // namespace
 
 RaspiMotionVector::RaspiMotionVector(int x, int y, int framerate,
@@ -83,31 +163,39 @@ RaspiMotionVector::RaspiMotionVector(int x, int y, int framerate,
     if (use_imv_coordination) {
         mvx_ = x + 1;
         mvy_ = y;
+        cell_size_ = 1;
     } else {
         mvx_ = x / kMvPixelWidth + 1;
         mvy_ = y / kMvPixelWidth;
+        cell_size_ = kMvPixelWidth;
     }
     valid_mv_frame_size_ = mvx_ * mvy_ * sizeof(MotionVector);
     blob_enable_ = false;
-    binary_oper_ = 0b1;
-    binary_oper_ <<= kMotionBitSetNumber;
+    background_enable_ = false;
+    background_initialized_ = false;
 
-    candidate_ = new uint32_t[mvx_ * mvy_];
-    motion_ = new uint8_t[mvx_ * mvy_];
+    // the bit history starts without any motion
+    candidate_ = new uint32_t[mvx_ * mvy_]();
+    motion_ = new uint8_t[mvx_ * mvy_]();
+    filtered_imv_.resize(mvx_ * mvy_);
     update_counter_ = 0;
+    moving_points_ = 0;
+    background_points_ = 0;
     initial_coolingdown_ = (framerate * kDefaultMotionCoolingDown) / 1000;
     enable_observer_callback_ = false;
     blob_observer_ = nullptr;
     imv_observer_ = nullptr;
     blob_active_count_ = 0;
     blob_active_updates_ = 0;
+    stage_timing_ = false;
+    stage_times_ = StageTimes();
     blob_cancel_threshold_ = blob_cancel_threshold;
     blob_tracking_threshold_ = blob_tracking_threshold;
 }
 
 RaspiMotionVector::~RaspiMotionVector() {
-    delete candidate_;
-    delete motion_;
+    delete[] candidate_;
+    delete[] motion_;
 }
 
 void RaspiMotionVector::RegisterBlobObserver(MotionBlobObserver *observer) {
@@ -118,90 +206,288 @@ void RaspiMotionVector::RegisterImvObserver(MotionImvObserver *observer) {
     imv_observer_ = observer;
 }
 
-int RaspiMotionVector::BitCount(uint32_t motion_value) {
-    static const int S[] = {1, 2, 4, 8, 16};  // Magic Binary Numbers
-    static const int B[] = {0x55555555, 0x33333333, 0x0F0F0F0F, 0x00FF00FF,
-                            0x0000FFFF};
+///////////////////////////////////////////////////////////////////////////////
+//
+// Analysis kernels
+//
+///////////////////////////////////////////////////////////////////////////////
+int RaspiMotionVector::UpdateCandidateScalar(const MotionVector *imv,
+                                             uint32_t *candidate, size_t count,
+                                             uint32_t *min, uint32_t *max) {
+    int moving = 0;
+    for (size_t index = 0; index < count; index++) {
+        int magnitude = imv[index].mx_ * imv[index].mx_ +
+                        imv[index].my_ * imv[index].my_;
+        uint32_t value = candidate[index] >> 1;
+        if (magnitude >= kMotionMagnitudeThreshold) {
+            value |= kMotionLatestBit;
+            moving++;
+        }
+        candidate[index] = value;
+        *min = std::min(*min, value);
+        *max = std::max(*max, value);
+    }
+    return moving;
+}
 
-    uint32_t bit_value = motion_value;
-    uint32_t bit_count;
+int RaspiMotionVector::UpdateCandidate(const MotionVector *imv,
+                                       uint32_t *candidate, size_t count,
+                                       uint32_t *min, uint32_t *max) {
+    size_t index = 0;
+    int moving = 0;
+#ifdef MOTION_VECTOR_NEON
+    if (count >= kNeonBlockSize) {
+        const uint16x8_t threshold = vdupq_n_u16(kMotionMagnitudeThreshold);
+        const uint32x4_t latest_bit = vdupq_n_u32(kMotionLatestBit);
+        uint32x4_t vmin = vdupq_n_u32(*min);
+        uint32x4_t vmax = vdupq_n_u32(*max);
+        uint16x8_t vmoving = vdupq_n_u16(0);
+
+        for (; index + kNeonBlockSize <= count; index += kNeonBlockSize) {
+            // de-interleave mx, my and sad of 16 points
+            uint8x16x4_t mv =
+                vld4q_u8(reinterpret_cast<const uint8_t *>(imv + index));
+            int8x16_t mx = vreinterpretq_s8_u8(mv.val[0]);
+            int8x16_t my = vreinterpretq_s8_u8(mv.val[1]);
+
+            // the squared magnitude is at most 2 * 128 * 128, so it fits
+            // in the unsigned 16 bits
+            int16x8_t square_low =
+                vmull_s8(vget_low_s8(mx), vget_low_s8(mx));
+            square_low =
+                vmlal_s8(square_low, vget_low_s8(my), vget_low_s8(my));
+            int16x8_t square_high =
+                vmull_s8(vget_high_s8(mx), vget_high_s8(mx));
+            square_high =
+                vmlal_s8(square_high, vget_high_s8(my), vget_high_s8(my));
+            uint16x8_t moving_low =
+                vcgeq_u16(vreinterpretq_u16_s16(square_low), threshold);
+            uint16x8_t moving_high =
+                vcgeq_u16(vreinterpretq_u16_s16(square_high), threshold);
+            // the moving mask is all ones, so subtracting it counts up
+            vmoving = vsubq_u16(vmoving, moving_low);
+            vmoving = vsubq_u16(vmoving, moving_high);
+
+            uint16x4_t moving_mask[4] = {
+                vget_low_u16(moving_low), vget_high_u16(moving_low),
+                vget_low_u16(moving_high), vget_high_u16(moving_high)};
+            for (int quad = 0; quad < 4; quad++) {
+                uint32_t *quad_candidate = candidate + index + quad * 4;
+                // sign extension makes the 32 bits mask
+                uint32x4_t mask = vreinterpretq_u32_s32(
+                    vmovl_s16(vreinterpret_s16_u16(moving_mask[quad])));
+                uint32x4_t value =
+                    vorrq_u32(vshrq_n_u32(vld1q_u32(quad_candidate), 1),
+                              vandq_u32(mask, latest_bit));
+                vst1q_u32(quad_candidate, value);
+                vmin = vminq_u32(vmin, value);
+                vmax = vmaxq_u32(vmax, value);
+            }
+        }
 
-    bit_count = bit_value - ((bit_value >> 1) & B[0]);
-    bit_count = ((bit_count >> S[1]) & B[1]) + (bit_count & B[1]);
-    bit_count = ((bit_count >> S[2]) + bit_count) & B[2];
-    bit_count = ((bit_count >> S[3]) + bit_count) & B[3];
-    bit_count = ((bit_count >> S[4]) + bit_count) & B[4];
-    return bit_count;
+        uint32x2_t min_pair =
+            vpmin_u32(vget_low_u32(vmin), vget_high_u32(vmin));
+        uint32x2_t max_pair =
+            vpmax_u32(vget_low_u32(vmax), vget_high_u32(vmax));
+        *min = vget_lane_u32(vpmin_u32(min_pair, min_pair), 0);
+        *max = vget_lane_u32(vpmax_u32(max_pair, max_pair), 0);
+        uint32x4_t moving_sum = vpaddlq_u16(vmoving);
+        moving = vgetq_lane_u32(moving_sum, 0) + vgetq_lane_u32(moving_sum, 1) +
+                 vgetq_lane_u32(moving_sum, 2) + vgetq_lane_u32(moving_sum, 3);
+    }
+#endif  // MOTION_VECTOR_NEON
+    return moving + UpdateCandidateScalar(imv + index, candidate + index,
+                                          count - index, min, max);
 }
 
-bool RaspiMotionVector::Analyse(uint8_t *buffer, size_t len) {
-    RTC_DCHECK(valid_mv_frame_size_ == len) << "Motion Vector size mismatch!";
-    MotionVector *imv = (MotionVector *)buffer;
-    uint32_t base_my, mx, my;
-
-    // vector max/avg
-    double magni_value, magni_avg, magni_sum;
+RaspiMotionVector::MotionScale RaspiMotionVector::GetMotionScale(uint32_t min,
+                                                                 uint32_t max) {
+    MotionScale scale = {min, 0, 0};
+    uint32_t range = max - min;
+    if (range == 0) return scale;  // every motion value will be zero
+
+    int range_bits = 32 - __builtin_clz(range);
+    if (range_bits > kMotionScaleBits)
+        scale.shift = range_bits - kMotionScaleBits;
+    // (value >> shift) <= (range >> shift), so the product with the
+    // reciprocal does not exceed 255 << kMotionScaleBits
+    scale.reciprocal = (255u << kMotionScaleBits) / (range >> scale.shift);
+    return scale;
+}
 
-    // motion max/avg
-    float motion_max, motion_min, motion_avg, motion_sum;
-    float motion_value;
-    int motion_active;
+int RaspiMotionVector::NormalizeMotionScalar(const uint32_t *candidate,
+                                             uint8_t *motion, size_t count,
+                                             const MotionScale &scale) {
+    int active = 0;
+    for (size_t index = 0; index < count; index++) {
+        uint32_t value = candidate[index];
+        uint32_t motion_value = 0;
+        if (static_cast<uint32_t>(__builtin_popcount(value)) >
+            kMotionCutBitThreshold) {
+            motion_value = (((value - scale.min) >> scale.shift) *
+                            scale.reciprocal) >>
+                           kMotionScaleBits;
+            if (motion_value < kMotionCutValue)
+                // remove motion point less then kMotionCutValue
+                motion_value = 0;
+            else
+                active++;
+        }
+        motion[index] = static_cast<uint8_t>(motion_value);
+    }
+    return active;
+}
 
-    magni_avg = magni_value = magni_sum = 0;
-    motion_max = motion_sum = 0;
-    motion_min = std::numeric_limits<uint32_t>::max();
-
-    for (my = 0; my < mvy_; my++) {
-        base_my = my * mvx_;
-        for (mx = 0; mx < mvx_; mx++) {
-            magni_value = std::floor(
-                std::sqrt(imv[base_my + mx].mx_ * imv[base_my + mx].mx_ +
-                          imv[base_my + mx].my_ * imv[base_my + mx].my_));
-            if (magni_value) {
-                motion_value = candidate_[base_my + mx] =
-                    (candidate_[base_my + mx] >> 1) | binary_oper_;
-            } else {
-                motion_value = candidate_[base_my + mx] =
-                    candidate_[base_my + mx] >> 1;
+int RaspiMotionVector::NormalizeMotion(const uint32_t *candidate,
+                                       uint8_t *motion, size_t count,
+                                       const MotionScale &scale) {
+    size_t index = 0;
+    int active = 0;
+#ifdef MOTION_VECTOR_NEON
+    if (count >= kNeonBlockSize) {
+        const uint32x4_t vmin = vdupq_n_u32(scale.min);
+        const int32x4_t vshift = vdupq_n_s32(-scale.shift);
+        const uint32x4_t vreciprocal = vdupq_n_u32(scale.reciprocal);
+        const uint32x4_t bit_threshold = vdupq_n_u32(kMotionCutBitThreshold);
+        const uint32x4_t cut_value = vdupq_n_u32(kMotionCutValue);
+        uint32x4_t vactive = vdupq_n_u32(0);
+
+        for (; index + kNeonBlockSize <= count; index += kNeonBlockSize) {
+            uint16x4_t motion_quad[4];
+            for (int quad = 0; quad < 4; quad++) {
+                uint32x4_t value = vld1q_u32(candidate + index + quad * 4);
+                // popcount of each byte, and pairwise sums up to 32 bits
+                uint32x4_t bits = vpaddlq_u16(
+                    vpaddlq_u8(vcntq_u8(vreinterpretq_u8_u32(value))));
+                uint32x4_t valid = vcgtq_u32(bits, bit_threshold);
+                uint32x4_t motion_value = vshrq_n_u32(
+                    vmulq_u32(vshlq_u32(vsubq_u32(value, vmin), vshift),
+                              vreciprocal),
+                    kMotionScaleBits);
+                valid = vandq_u32(valid, vcgeq_u32(motion_value, cut_value));
+                motion_value = vandq_u32(motion_value, valid);
+                vactive = vsubq_u32(vactive, valid);
+                motion_quad[quad] = vmovn_u32(motion_value);
             }
+            uint8x8_t motion_low =
+                vmovn_u16(vcombine_u16(motion_quad[0], motion_quad[1]));
+            uint8x8_t motion_high =
+                vmovn_u16(vcombine_u16(motion_quad[2], motion_quad[3]));
+            vst1q_u8(motion + index, vcombine_u8(motion_low, motion_high));
+        }
+        active = vgetq_lane_u32(vactive, 0) + vgetq_lane_u32(vactive, 1) +
+                 vgetq_lane_u32(vactive, 2) + vgetq_lane_u32(vactive, 3);
+    }
+#endif  // MOTION_VECTOR_NEON
+    return active + NormalizeMotionScalar(candidate + index, motion + index,
+                                          count - index, scale);
+}
 
-            motion_max = std::max(motion_max, motion_value);
-            motion_min = std::min(motion_min, motion_value);
-            motion_sum += motion_value;
-            magni_sum += magni_value;
+void RaspiMotionVector::InitBackground(const MotionVector *imv,
+                                       BackgroundModel *background,
+                                       size_t count) {
+    for (size_t index = 0; index < count; index++) {
+        uint32_t sad = imv[index].sad >> kSadScaleShift;
+        uint32_t magnitude =
+            std::abs(imv[index].mx_) + std::abs(imv[index].my_);
+        background[index].sad_mean = sad << kBackgroundFractionBits;
+        background[index].sad_variance = 0;
+        background[index].magnitude_mean = magnitude
+                                           << kBackgroundFractionBits;
+        background[index].magnitude_variance = 0;
+    }
+}
+
+int RaspiMotionVector::FilterBackground(const MotionVector *imv,
+                                        MotionVector *filtered,
+                                        BackgroundModel *background,
+                                        size_t count) {
+    int cleared = 0;
+    for (size_t index = 0; index < count; index++) {
+        const MotionVector &mv = imv[index];
+        BackgroundModel &model = background[index];
+        // both of the statistics are updated, no short circuit here
+        bool sad_depart =
+            UpdateBackground(mv.sad >> kSadScaleShift, kMinSadDeviation,
+                             &model.sad_mean, &model.sad_variance);
+        bool magnitude_depart = UpdateBackground(
+            std::abs(mv.mx_) + std::abs(mv.my_), kMinMagnitudeDeviation,
+            &model.magnitude_mean, &model.magnitude_variance);
+        filtered[index] = mv;
+        if (sad_depart || magnitude_depart) continue;
+        if (mv.mx_ || mv.my_) cleared++;
+        filtered[index].mx_ = 0;
+        filtered[index].my_ = 0;
+    }
+    return cleared;
+}
+
+void RaspiMotionVector::ApplyMotionMask(const MotionVector *imv,
+                                        MotionVector *masked,
+                                        const uint8_t *mask, size_t count) {
+    for (size_t index = 0; index < count; index++) {
+        masked[index] = imv[index];
+        if (mask[index] == 0) {
+            masked[index].mx_ = 0;
+            masked[index].my_ = 0;
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Motion vector analysis
+//
+///////////////////////////////////////////////////////////////////////////////
+bool RaspiMotionVector::Analyse(uint8_t *buffer, size_t len) {
+    RTC_DCHECK(valid_mv_frame_size_ == len) << "Motion Vector size mismatch!";
+    const MotionVector *imv = reinterpret_cast<const MotionVector *>(buffer);
+    size_t points = mvx_ * mvy_;
+    uint32_t motion_min = std::numeric_limits<uint32_t>::max();
+    uint32_t motion_max = 0;
+    int motion_active;
+    int64_t stage_start_us = stage_timing_ ? TimeMicros() : 0;
+
+    // excluded points never reach the background model and the blob
+    std::shared_ptr<const std::vector<uint8_t>> mask =
+        std::atomic_load(&motion_mask_);
+    if (mask) {
+        ApplyMotionMask(imv, filtered_imv_.data(), mask->data(), points);
+        imv = filtered_imv_.data();
+    }
+    if (background_enable_) {
+        if (background_initialized_ == false) {
+            InitBackground(imv, background_.data(), points);
+            background_initialized_ = true;
         }
+        background_points_ = FilterBackground(imv, filtered_imv_.data(),
+                                              background_.data(), points);
+        imv = filtered_imv_.data();
     }
-    magni_avg = magni_sum / (mvx_ * mvy_);
-    motion_avg = motion_sum / (mvx_ * mvy_);
+    if (stage_timing_)
+        stage_start_us = AddStageTime(&stage_times_.filter_us, stage_start_us);
+
+    moving_points_ =
+        UpdateCandidate(imv, candidate_, points, &motion_min, &motion_max);
+    if (stage_timing_)
+        stage_start_us =
+            AddStageTime(&stage_times_.candidate_us, stage_start_us);
 
     /* normalize and make final motion */
-    motion_active = 0;
-    for (my = 0; my < mvy_; my++) {
-        base_my = my * mvx_;
-        for (mx = 0; mx < mvx_; mx++) {
-            motion_value = candidate_[base_my + mx];
-            if (BitCount(motion_value) > kMotionCutBitThreshold) {
-                motion_[base_my + mx] =
-                    (uint8_t)std::floor((motion_value - motion_min) /
-                                        (motion_max - motion_min) * 255);
-                if (motion_[base_my + mx] < 3) {
-                    // remove motion point less then 3
-                    motion_[base_my + mx] = 0;
-                } else {
-                    motion_active += 1;
-                }
-            } else
-                motion_[base_my + mx] = 0;
-        };
-    };
+    motion_active = NormalizeMotion(candidate_, motion_, points,
+                                    GetMotionScale(motion_min, motion_max));
+    if (stage_timing_)
+        stage_start_us =
+            AddStageTime(&stage_times_.normalize_us, stage_start_us);
 
     if (enable_observer_callback_ && imv_observer_)
         // Reports the number of active motion point
-        imv_observer_->OnActivePoints(mvx_ * mvy_, motion_active);
+        imv_observer_->OnActivePoints(points, motion_active, moving_points_);
 
-    DEBUG_IMV_FORMAT("MV motion max: %.1f, avg: %.1f, active point: %d, %d%%\n",
-                     motion_max, motion_avg, motion_active,
-                     (int)motion_active * 100 / (mvx_ * mvy_));
+    DEBUG_IMV_FORMAT("MV motion max: %u, moving point: %d, active point: %d, "
+                     "%d%%, background point: %d\n",
+                     motion_max, moving_points_, motion_active,
+                     (int)(motion_active * 100 / points), background_points_);
     DEBUG_IMV_DO(fflush(0));
 
     update_counter_++;
@@ -238,6 +524,7 @@ bool RaspiMotionVector::Analyse(uint8_t *buffer, size_t len) {
             };
             blob_active_updates_ = blob_->GetActiveBlobUpdateCount();
         };
+        if (stage_timing_) AddStageTime(&stage_times_.blob_us, stage_start_us);
     }
     return 0;
 }
@@ -286,3 +573,24 @@ void RaspiMotionVector::SetBlobEnable(bool blob_enable) {
         blob_.reset();
     }
 }
+
+void RaspiMotionVector::SetBackgroundEnable(bool background_enable) {
+    RTC_LOG(INFO) << "Adaptive Background Enable: " << background_enable;
+    background_enable_ = background_enable;
+    background_initialized_ = false;
+    background_points_ = 0;
+    if (background_enable)
+        background_.resize(mvx_ * mvy_);
+    else
+        std::vector<BackgroundModel>().swap(background_);
+}
+
+void RaspiMotionVector::SetMotionZones(const MotionZones &zones) {
+    RTC_LOG(INFO) << "Motion Zones: " << zones.zones().size();
+    std::atomic_store(&motion_mask_, zones.CreateMask(mvx_, mvy_, cell_size_));
+}
+
+void RaspiMotionVector::SetStageTiming(bool stage_timing) {
+    stage_timing_ = stage_timing;
+    stage_times_ = StageTimes();
+}
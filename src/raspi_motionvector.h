@@ -34,6 +34,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <vector>
 
 #include "raspi_motionblob.h"
+#include "raspi_motionzone.h"
 
 struct MotionVector {
     int8_t mx_;
@@ -50,7 +51,11 @@ struct MotionBlobObserver {
 };
 
 struct MotionImvObserver {
-    virtual void OnActivePoints(int total_points, int active_points) = 0;
+    // Called with each analysed frame. The active points have enough motion
+    // in their history, and the moving points have a motion vector in the
+    // frame.
+    virtual void OnActivePoints(int total_points, int active_points,
+                                int moving_points) = 0;
 
    protected:
     virtual ~MotionImvObserver() {}
@@ -65,6 +70,12 @@ class RaspiMotionVector {
     ~RaspiMotionVector();
 
     bool Analyse(uint8_t *buffer, size_t len);
+    // size of the motion vectors of a frame
+    inline size_t GetFrameSize() const { return valid_mv_frame_size_; }
+    inline int GetTotalPoints() const { return mvx_ * mvy_; }
+    // number of points which have a motion vector in the last frame, without
+    // the history used by the active points.
+    inline int GetMovingPoints() const { return moving_points_; }
 
     void GetIMVImage(uint8_t *buffer, size_t buflen);
     void GetMotionImage(uint8_t *buffer, size_t buflen);
@@ -72,28 +83,110 @@ class RaspiMotionVector {
     bool GetBlobImage(uint8_t *buffer, size_t buflen);
 
     void SetBlobEnable(bool blob_enable);
+    // Enables the adaptive background model, the moving points which do not
+    // depart from the background of the point are removed.
+    void SetBackgroundEnable(bool background_enable);
+    // number of moving points removed by the background model in the last
+    // frame
+    inline int GetBackgroundPoints() const { return background_points_; }
+    // Rasterises the motion zones to the mask of the points used in the
+    // motion detection. It can be called while analysing, the mask is
+    // swapped atomically and used from the next frame.
+    void SetMotionZones(const MotionZones &zones);
+
+    // Accumulated processing time of the analysis stages in microseconds,
+    // measured only while the stage timing is enabled.
+    struct StageTimes {
+        int64_t filter_us;  // motion zones and adaptive background
+        int64_t candidate_us;
+        int64_t normalize_us;
+        int64_t blob_us;  // blob labelling, tracking and observers
+    };
+    void SetStageTiming(bool stage_timing);
+    inline const StageTimes &GetStageTimes() const { return stage_times_; }
     void SetMotionActiveTreshold(int max, int min);
     void RegisterBlobObserver(MotionBlobObserver *observer);
     void RegisterImvObserver(MotionImvObserver *observer);
 
+    // Analysis kernels, vectorized with NEON when it is available.
+    // The scalar kernels are the reference of the vectorized kernels, and
+    // both should give the same result bit by bit.
+    //
+    // Shifts the moving state of each point into its candidate bit history,
+    // and updates the min/max of the candidates. Returns the number of
+    // moving points.
+    static int UpdateCandidate(const MotionVector *imv, uint32_t *candidate,
+                               size_t count, uint32_t *min, uint32_t *max);
+    static int UpdateCandidateScalar(const MotionVector *imv,
+                                     uint32_t *candidate, size_t count,
+                                     uint32_t *min, uint32_t *max);
+
+    // Fixed-point scale of the candidates to [0, 255], the candidate is
+    // reduced to 16 bits with the shift and multiplied by the reciprocal.
+    struct MotionScale {
+        uint32_t min;
+        int shift;
+        uint32_t reciprocal;
+    };
+    static MotionScale GetMotionScale(uint32_t min, uint32_t max);
+
+    // Normalizes the candidates which have enough bits in the history to
+    // the motion value. Returns the number of active points.
+    static int NormalizeMotion(const uint32_t *candidate, uint8_t *motion,
+                               size_t count, const MotionScale &scale);
+    static int NormalizeMotionScalar(const uint32_t *candidate,
+                                     uint8_t *motion, size_t count,
+                                     const MotionScale &scale);
+
+    // Running mean and variance of the SAD and the magnitude of a point, in
+    // fixed point with kBackgroundFractionBits.
+    struct BackgroundModel {
+        uint32_t sad_mean;
+        uint32_t sad_variance;
+        uint32_t magnitude_mean;
+        uint32_t magnitude_variance;
+    };
+    // Initializes the background model with the motion vectors.
+    static void InitBackground(const MotionVector *imv,
+                               BackgroundModel *background, size_t count);
+    // Updates the background model incrementally, and copies the motion
+    // vectors to the filtered, clearing the vector of the points whose SAD
+    // and magnitude stay within their own background. Returns the number of
+    // moving points cleared. The imv and the filtered can be the same buffer.
+    static int FilterBackground(const MotionVector *imv,
+                                MotionVector *filtered,
+                                BackgroundModel *background, size_t count);
+
+    // Copies the motion vectors to the masked, clearing the vector of the
+    // points not used in the motion detection. The imv and the masked can
+    // be the same buffer.
+    static void ApplyMotionMask(const MotionVector *imv, MotionVector *masked,
+                                const uint8_t *mask, size_t count);
+
     // disallow copy and assign
     void operator=(const RaspiMotionVector &) = delete;
     RaspiMotionVector(const RaspiMotionVector &) = delete;
 
    private:
-    // bitcount uses the 'Counting bits set, in parallel' algorithm below.
-    // http://graphics.stanford.edu/~seander/bithacks.html#CountBitsSetParallel
-    int BitCount(uint32_t motion_value);
-
     size_t mvx_, mvy_;
+    int cell_size_;  // size of a motion vector in the video coordinates
     size_t valid_mv_frame_size_;
     bool blob_enable_;
+    bool background_enable_;
+    bool background_initialized_;
 
-    uint32_t binary_oper_;
     // motion vector processing buffers
     uint32_t *candidate_;
     uint8_t *motion_;
     uint64_t update_counter_;
+    int moving_points_;
+    int background_points_;
+    std::vector<BackgroundModel> background_;
+    std::vector<MotionVector> filtered_imv_;
+    // accessed only with std::atomic_load/atomic_store
+    std::shared_ptr<const std::vector<uint8_t>> motion_mask_;
+    bool stage_timing_;
+    StageTimes stage_times_;
     uint32_t initial_coolingdown_;
     bool enable_observer_callback_;
 
@@ -0,0 +1,148 @@
+/*
+Copyright (c) 2021, rpi-webrtc-streamer Lyu,KeunChang
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "raspi_motionzone.h"
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <sstream>
+
+#ifdef __STANDALONE__
+#include <glog/logging.h>
+#define RTC_ERROR LOG(ERROR)
+#else
+#include "rtc_base/logging.h"
+#define RTC_ERROR RTC_LOG(LS_ERROR)
+#endif
+
+namespace {
+
+const char kZoneInclude[] = "include";
+const char kZoneExclude[] = "exclude";
+const char kZoneSeparator = ';';
+const char kZoneTypeSeparator = ':';
+const size_t kMinZonePoints = 3;
+
+bool ParseZone(const std::string &text, MotionZones::Zone *zone) {
+    size_t type_end = text.find(kZoneTypeSeparator);
+    if (type_end == std::string::npos) return false;
+
+    std::string type;
+    std::istringstream type_stream(text.substr(0, type_end));
+    type_stream >> type;
+    if (type == kZoneInclude)
+        zone->include = true;
+    else if (type == kZoneExclude)
+        zone->include = false;
+    else
+        return false;
+
+    std::istringstream points(text.substr(type_end + 1));
+    std::string point_text;
+    zone->points.clear();
+    while (points >> point_text) {
+        MotionZones::Point point;
+        char end;
+        if (sscanf(point_text.c_str(), "%d,%d%c", &point.x, &point.y, &end) !=
+            2)
+            return false;
+        zone->points.push_back(point);
+    }
+    return zone->points.size() >= kMinZonePoints;
+}
+
+// Fills the cells of the mask whose center is inside the polygon with the
+// value, using the even-odd rule of the scanline crossing the cell centers.
+void FillZone(const MotionZones::Zone &zone, int mvx, int mvy, int cell_size,
+              uint8_t value, std::vector<uint8_t> *mask) {
+    const std::vector<MotionZones::Point> &points = zone.points;
+    std::vector<double> crossings;
+    for (int sy = 0; sy < mvy; sy++) {
+        // cell center in the video coordinates
+        double center_y = sy * cell_size + cell_size / 2.0;
+        crossings.clear();
+        for (size_t index = 0; index < points.size(); index++) {
+            const MotionZones::Point &from = points[index];
+            const MotionZones::Point &to = points[(index + 1) % points.size()];
+            if ((from.y <= center_y) == (to.y <= center_y)) continue;
+            crossings.push_back(from.x + (center_y - from.y) *
+                                             (to.x - from.x) / (to.y - from.y));
+        }
+        std::sort(crossings.begin(), crossings.end());
+        for (size_t index = 0; index + 1 < crossings.size(); index += 2) {
+            for (int sx = 0; sx < mvx; sx++) {
+                double center_x = sx * cell_size + cell_size / 2.0;
+                if (center_x >= crossings[index] &&
+                    center_x < crossings[index + 1])
+                    (*mask)[sy * mvx + sx] = value;
+            }
+        }
+    }
+}
+
+}  // namespace
+
+MotionZones::MotionZones() {}
+
+MotionZones::~MotionZones() {}
+
+bool MotionZones::Parse(const std::string &zones) {
+    std::vector<Zone> parsed;
+    std::istringstream stream(zones);
+    std::string text;
+    while (std::getline(stream, text, kZoneSeparator)) {
+        if (text.find_first_not_of(" \t") == std::string::npos) continue;
+        Zone zone;
+        if (ParseZone(text, &zone) == false) {
+            RTC_ERROR << "Invalid motion zone: \"" << text << "\"";
+            return false;
+        }
+        parsed.push_back(zone);
+    }
+    zones_.swap(parsed);
+    return true;
+}
+
+std::shared_ptr<const std::vector<uint8_t>> MotionZones::CreateMask(
+    int mvx, int mvy, int cell_size) const {
+    if (zones_.empty()) return nullptr;
+
+    bool has_include =
+        std::any_of(zones_.begin(), zones_.end(),
+                    [](const Zone &zone) { return zone.include; });
+    std::shared_ptr<std::vector<uint8_t>> mask =
+        std::make_shared<std::vector<uint8_t>>(mvx * mvy, has_include ? 0 : 1);
+    // include zones first, so the exclude zones are removed from them
+    for (const Zone &zone : zones_)
+        if (zone.include) FillZone(zone, mvx, mvy, cell_size, 1, mask.get());
+    for (const Zone &zone : zones_)
+        if (!zone.include) FillZone(zone, mvx, mvy, cell_size, 0, mask.get());
+    return mask;
+}
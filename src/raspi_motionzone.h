@@ -0,0 +1,85 @@
+/*
+Copyright (c) 2021, rpi-webrtc-streamer Lyu,KeunChang
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef RASPI_MOTIONZONE_H_
+#define RASPI_MOTIONZONE_H_
+
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// MotionZones
+//
+// Polygons in the motion video coordinates which include or exclude the area
+// from the motion detection. When there is an include zone, only the area of
+// the include zones is used, and the exclude zones are removed from it.
+//
+//  zones := zone [ ';' zone ]*
+//  zone  := ( 'include' | 'exclude' ) ':' point point point [ point ]*
+//  point := x ',' y
+//
+// e.g. "exclude:0,0 320,0 320,200 0,200;exclude:900,400 1024,400 1024,768"
+//
+////////////////////////////////////////////////////////////////////////////////
+class MotionZones {
+   public:
+    struct Point {
+        int x;
+        int y;
+    };
+    struct Zone {
+        bool include;
+        std::vector<Point> points;
+    };
+
+    MotionZones();
+    ~MotionZones();
+
+    // Returns false and keeps the previous zones when the zones string is not
+    // valid. An empty string clears the zones.
+    bool Parse(const std::string &zones);
+    bool empty() const { return zones_.empty(); }
+    const std::vector<Zone> &zones() const { return zones_; }
+
+    // Rasterises the zones to the mask of the motion vector grid, the cell
+    // size is the size of a motion vector in the video coordinates. The mask
+    // is non-zero for the points used in the motion detection, and nullptr
+    // is returned when there is no zone.
+    std::shared_ptr<const std::vector<uint8_t>> CreateMask(int mvx, int mvy,
+                                                           int cell_size) const;
+
+   private:
+    std::vector<Zone> zones_;
+};
+
+#endif  // RASPI_MOTIONZONE_H_
@@ -29,19 +29,48 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "raspi_quality_config.h"
 
+#include <math.h>
+
+#include <algorithm>
+
 #include "limits.h"
 #include "rtc_base/checks.h"
 #include "rtc_base/logging.h"
 
 namespace {
 
-// TODO validate the motion factor related constant values
-const float kKushGaugeConstant = 0.07;
-const int kMaxMontionFactor = 3;
-const float kDefaultMontionFactor = 1.8f;
-
 const int kMaxFrameRate = 30;
 const int kMinFrameRate = 20;
+const int kFrameRateStep = 5;
+
+// H.264 rate model: the bits needed for the same content halve for every
+// 6 QP steps, so a frame of |bpp| bits per pixel at |qp| has the complexity
+// bpp * 2^((qp - kReferenceQp) / 6) at the reference QP.
+const int kReferenceQp = 26;
+const double kQpPerOctave = 6.0;
+const double kMinQp = 10.0;
+const double kMaxQp = 51.0;
+// Complexity used before any frame is reported, roughly a 640x480@30 scene
+// with moderate motion encoded at 900kbps with the reference QP.
+const double kDefaultComplexity = 0.1;
+// Weight of a new frame in the per-resolution complexity estimate.
+const double kComplexityAlpha = 0.05;
+// Number of frames before the learned complexity of a resolution is used
+// in place of the one scaled from other resolutions.
+const int kMinComplexitySamples = 30;
+// Smaller pictures need more bits per pixel for the same content.
+const double kResolutionScaleExponent = 0.25;
+
+// Quality band of the predicted QP.
+const double kUpSwitchQp = 30.0;
+const double kTargetQp = 34.0;
+const double kDownSwitchQp = 38.0;
+const int64_t kMinSwitchIntervalMs = 5000;
+
+const int kAverageQpWindow = 3 * 30;
+
+// Prefix of the verbose log lines replayed by quality_sim
+const char kQualityTrace[] = "QualityTrace";
 
 }  // namespace
 
@@ -49,131 +78,262 @@ QualityConfig::ResolutionConfigEntry::ResolutionConfigEntry(int width,
                                                             int height,
                                                             int max_fps,
                                                             int min_fps)
-    : width_(width), height_(height), max_fps_(max_fps), min_fps_(min_fps) {
-    max_bandwidth_ = static_cast<int>(
-        (width_ * height_ * max_fps * kKushGaugeConstant * kMaxMontionFactor) /
-        1000);
-    min_bandwidth_ = static_cast<int>(
-        (width_ * height_ * min_fps * kKushGaugeConstant) / 1000);
-    average_bandwidth_ =
-        static_cast<int>((max_bandwidth_ + min_bandwidth_) / 2);
-}
+    : width_(width),
+      height_(height),
+      max_fps_(max_fps),
+      min_fps_(min_fps),
+      complexity_(kDefaultComplexity),
+      samples_(0) {}
 
 QualityConfig::QualityConfig()
-    : target_framerate_(25),
+    : clock_(webrtc::Clock::GetRealTimeClock()),
+      target_framerate_(25),
       target_bitrate_(300) /*kbps*/,
-      average_mf_(3 * 30) {
+      average_qp_(kAverageQpWindow),
+      last_switch_time_ms_(0),
+      switch_count_(0) {
     config_media_ = ConfigMediaSingleton::Instance();
     use_dynamic_resolution_ = config_media_->GetVideoDynamicResolution();
+    AddResolutionList(config_media_->GetVideoResolutionList());
+}
+
+QualityConfig::QualityConfig(
+    const std::list<wstreamer::VideoResolution>& resolution_list,
+    webrtc::Clock* clock)
+    : config_media_(nullptr),
+      clock_(clock),
+      target_framerate_(25),
+      target_bitrate_(300) /*kbps*/,
+      average_qp_(kAverageQpWindow),
+      last_switch_time_ms_(0),
+      switch_count_(0),
+      use_dynamic_resolution_(true) {
+    AddResolutionList(resolution_list);
+}
 
-    for (auto resolution : config_media_->GetVideoResolutionList()) {
+QualityConfig::~QualityConfig() {}
+
+void QualityConfig::AddResolutionList(
+    const std::list<wstreamer::VideoResolution>& resolution_list) {
+    for (auto resolution : resolution_list) {
         resolution_config_.push_back(ResolutionConfigEntry(
             resolution.width_, resolution.height_, kMaxFrameRate,
             kMinFrameRate /* min_framerate */));
     }
+    resolution_config_.sort(
+        [](const ResolutionConfigEntry& a, const ResolutionConfigEntry& b) {
+            return a.pixels() < b.pixels();
+        });
 }
 
-QualityConfig::~QualityConfig() {}
-
 void QualityConfig::ReportFrameRate(int framerate) {
-    if (target_framerate_ == framerate) return;
+    webrtc::MutexLock lock(&mutex_);
     target_framerate_ = framerate;
 }
 
 void QualityConfig::ReportTargetBitrate(int bitrate /* kbps */) {
+    webrtc::MutexLock lock(&mutex_);
     target_bitrate_ = bitrate;
 }
 
-void QualityConfig::ReportFrameSize(int frame_length) {
-    int motion_factor;
-    // Moves the decimal point of the moving factor by 1000
-    motion_factor = static_cast<int>(
-        ((frame_length * 8) /
-         (current_res_.width_ * current_res_.height_ * kKushGaugeConstant)) *
-        1000);
-    average_mf_.AddSample(motion_factor);
+///////////////////////////////////////////////////////////////////////////////
+// Key frames are excluded from the model, their size depends on the intra
+// period rather than on the content motion.
+////////////////////////////////////////////////////////////////////////////////
+void QualityConfig::ReportFrameSize(int width, int height, int frame_size,
+                                    int qp, bool is_keyframe) {
+    webrtc::MutexLock lock(&mutex_);
+    RTC_LOG(LS_VERBOSE) << kQualityTrace << " f "
+                        << clock_->TimeInMilliseconds() << " " << width << " "
+                        << height << " " << frame_size << " " << qp << " "
+                        << (is_keyframe ? 1 : 0);
+    if (is_keyframe || qp < 0 || frame_size <= 0) return;
+
+    ResolutionConfigEntry* entry = FindEntry(width, height);
+    if (entry == nullptr) return;
+
+    double bpp = static_cast<double>(frame_size * 8) / entry->pixels();
+    double complexity = bpp * pow(2.0, (qp - kReferenceQp) / kQpPerOctave);
+    if (entry->samples_ == 0)
+        entry->complexity_ = complexity;
+    else
+        entry->complexity_ +=
+            kComplexityAlpha * (complexity - entry->complexity_);
+    entry->samples_++;
+    average_qp_.AddSample(qp);
+}
+
+int QualityConfig::switch_count() const {
+    webrtc::MutexLock lock(&mutex_);
+    return switch_count_;
+}
+
+absl::optional<int> QualityConfig::average_qp() const {
+    webrtc::MutexLock lock(&mutex_);
+    return average_qp_.GetAverageRoundedDown();
+}
+
+QualityConfig::ResolutionConfigEntry* QualityConfig::FindEntry(int width,
+                                                               int height) {
+    for (auto& entry : resolution_config_) {
+        if (entry.width_ == width && entry.height_ == height) return &entry;
+    }
+    return nullptr;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Resolutions without enough samples borrow the complexity of the most
+// sampled resolution, scaled by the pixel ratio.
+////////////////////////////////////////////////////////////////////////////////
+double QualityConfig::GetComplexity(const ResolutionConfigEntry& entry) const {
+    if (entry.samples_ >= kMinComplexitySamples) return entry.complexity_;
+
+    const ResolutionConfigEntry* reference = nullptr;
+    for (const auto& other : resolution_config_) {
+        if (reference == nullptr || other.samples_ > reference->samples_)
+            reference = &other;
+    }
+    if (reference == nullptr || reference->samples_ == 0)
+        return kDefaultComplexity;
+    return reference->complexity_ *
+           pow(static_cast<double>(reference->pixels()) / entry.pixels(),
+               kResolutionScaleExponent);
+}
+
+double QualityConfig::PredictQp(const ResolutionConfigEntry& entry,
+                                int bitrate, int framerate) const {
+    if (bitrate <= 0 || framerate <= 0) return kMaxQp;
+    double target_bpp =
+        (bitrate * 1000.0) / (static_cast<double>(entry.pixels()) * framerate);
+    double qp =
+        kReferenceQp + kQpPerOctave * log2(GetComplexity(entry) / target_bpp);
+    return std::min(std::max(qp, kMinQp), kMaxQp);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Lowers the framerate from the target framerate in steps until the predicted
+// QP is within |max_qp|, but not below the minimum framerate of the entry.
+////////////////////////////////////////////////////////////////////////////////
+int QualityConfig::SelectFramerate(const ResolutionConfigEntry& entry,
+                                   int bitrate, double max_qp) const {
+    int max_fps = std::min(entry.max_fps_, target_framerate_);
+    int min_fps = std::min(entry.min_fps_, max_fps);
+    for (int fps = max_fps; fps > min_fps; fps -= kFrameRateStep) {
+        if (PredictQp(entry, bitrate, fps) <= max_qp) return fps;
+    }
+    return min_fps;
+}
+
+// Returns the largest resolution in the target QP, or the smallest one.
+const QualityConfig::ResolutionConfigEntry* QualityConfig::SelectResolution(
+    int bitrate) const {
+    const ResolutionConfigEntry* candidate = &resolution_config_.front();
+    for (const auto& entry : resolution_config_) {
+        int framerate = SelectFramerate(entry, bitrate, kTargetQp);
+        if (PredictQp(entry, bitrate, framerate) <= kTargetQp)
+            candidate = &entry;
+    }
+    return candidate;
 }
 
 wstreamer::VideoEncodingParams& QualityConfig::GetBestMatch() {
-    return GetBestMatch(target_bitrate_);
+    int target_bitrate;
+    {
+        webrtc::MutexLock lock(&mutex_);
+        target_bitrate = target_bitrate_;
+    }
+    return GetBestMatch(target_bitrate);
 }
 
 wstreamer::VideoEncodingParams& QualityConfig::GetInitialBestMatch() {
     wstreamer::VideoEncodingParams candidate;
     if (use_dynamic_resolution_ == false) {
-        // using fixed resolution
+        webrtc::MutexLock lock(&mutex_);
+        // using fixed resolution, with the bitrate of the target QP
         config_media_->GetFixedVideoResolution(candidate.width_,
                                                candidate.height_);
         candidate.framerate_ = kMaxFrameRate;
         candidate.bitrate_ = static_cast<int>(
             (candidate.width_ * candidate.height_ * kMaxFrameRate *
-             kKushGaugeConstant * kMaxMontionFactor) /
+             kDefaultComplexity /
+             pow(2.0, (kTargetQp - kReferenceQp) / kQpPerOctave)) /
             1000);
         return current_res_ = candidate;
     }
 
-    return GetBestMatch(target_bitrate_);
+    return GetBestMatch();
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-// At present, it is based on the average value of Kush Gauge's 1 and 3 moving
-// factors, but there is no evaluation as to whether it is appropriate.
-// Simply find the nearest target_bitrate at the expected bitrate and change
-// the resolution to the resolution.
+// The current resolution is kept until its predicted QP goes above the down
+// switch threshold, and a larger resolution is taken only when its predicted
+// QP is below the up switch threshold, so the resolution does not oscillate
+// around a single bitrate. Switches are at least kMinSwitchIntervalMs apart.
 ////////////////////////////////////////////////////////////////////////////////
 wstreamer::VideoEncodingParams& QualityConfig::GetBestMatch(
     int target_bitrate) {
     RTC_DCHECK(resolution_config_.size() > 0)
         << "length of resolution config is zero";
-    wstreamer::VideoEncodingParams candidate;
-    float motion_factor;
-    int candidate_diff = std::numeric_limits<int>::max();
-    int diff = 0;
+    webrtc::MutexLock lock(&mutex_);
+    RTC_LOG(LS_VERBOSE) << kQualityTrace << " b "
+                        << clock_->TimeInMilliseconds() << " "
+                        << target_bitrate << " " << target_framerate_;
 
     if (use_dynamic_resolution_ == false) {
         // The encoder does not use the Bitrate Estimation delivered by BWE,
         // but keeps the initially generated resolution.
+        current_res_.framerate_ = target_framerate_;
+        current_res_.bitrate_ = target_bitrate;
         return current_res_;
     };
 
     target_bitrate_ = target_bitrate;
-    absl::optional<int> average_movingfactor =
-        average_mf_.GetAverageRoundedDown();
-    if (average_movingfactor.has_value()) {
-        motion_factor = *average_movingfactor / 1000;
-        if (motion_factor < kDefaultMontionFactor)
-            motion_factor = kDefaultMontionFactor;
-    } else {
-        motion_factor = kDefaultMontionFactor;
-    }
+    int64_t now_ms = clock_->TimeInMilliseconds();
+    const ResolutionConfigEntry* current =
+        FindEntry(current_res_.width_, current_res_.height_);
+    const ResolutionConfigEntry* candidate = current;
 
-    for (auto entry : resolution_config_) {
-        // TODO: need to evaluate average bitrate which is calculated with
-        // motion_factor
-        int avg_bitrate =
-            static_cast<int>((entry.width_ * entry.height_ * 25 *
-                              kKushGaugeConstant * motion_factor) /
-                             1000);
-        diff = abs(avg_bitrate - target_bitrate);
-
-        if (candidate_diff > diff) {
-            candidate.width_ = entry.width_;
-            candidate.height_ = entry.height_;
-            candidate.bitrate_ = target_bitrate_;
-            // TODO: need to check whether to keep the framerate when video
-            // resolution changing
-            candidate.framerate_ = target_framerate_;
-            // candidate.framerate_ = 25;
-            candidate_diff = diff;
+    if (current == nullptr) {
+        candidate = SelectResolution(target_bitrate);
+    } else if (now_ms - last_switch_time_ms_ >= kMinSwitchIntervalMs) {
+        double current_qp = PredictQp(
+            *current, target_bitrate,
+            SelectFramerate(*current, target_bitrate, kDownSwitchQp));
+        if (current_qp > kDownSwitchQp) {
+            candidate = &resolution_config_.front();
+            for (const auto& entry : resolution_config_) {
+                if (entry.pixels() >= current->pixels()) break;
+                if (PredictQp(entry, target_bitrate,
+                              SelectFramerate(entry, target_bitrate,
+                                              kTargetQp)) <= kTargetQp)
+                    candidate = &entry;
+            }
+        } else {
+            for (const auto& entry : resolution_config_) {
+                if (entry.pixels() <= current->pixels()) continue;
+                if (PredictQp(entry, target_bitrate,
+                              SelectFramerate(entry, target_bitrate,
+                                              kUpSwitchQp)) <= kUpSwitchQp)
+                    candidate = &entry;
+            }
         }
     }
 
-    if (current_res_.IsSameResolution(candidate) == false) {
-        current_res_ = candidate;
-        RTC_LOG(INFO) << "BestMatch Resolution changed " << candidate.ToString()
-                      << ", for target bitrate: " << target_bitrate_
-                      << ", moving factor: " << motion_factor;
+    wstreamer::VideoEncodingParams params(
+        candidate->width_, candidate->height_,
+        SelectFramerate(*candidate, target_bitrate, kTargetQp), target_bitrate);
+    if (current_res_.IsSameResolution(params) == false) {
+        if (current != nullptr) switch_count_++;
+        last_switch_time_ms_ = now_ms;
+        absl::optional<int> average_qp = average_qp_.GetAverageRoundedDown();
+        RTC_LOG(INFO) << "BestMatch Resolution changed " << params.ToString()
+                      << ", predicted qp: "
+                      << PredictQp(*candidate, target_bitrate,
+                                   params.framerate_)
+                      << ", average qp: " << average_qp.value_or(-1)
+                      << ", switches: " << switch_count_;
+        average_qp_.Reset();
     }
+    current_res_ = params;
     return current_res_;
 }
-
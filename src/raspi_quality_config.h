@@ -36,16 +36,40 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "absl/types/optional.h"
 #include "config_media.h"
 #include "rtc_base/numerics/moving_average.h"
+#include "rtc_base/synchronization/mutex.h"
 #include "system_wrappers/include/clock.h"
 #include "wstreamer_types.h"
 
-// Currently, Only BWE-based QoS functions are implemented.
+////////////////////////////////////////////////////////////////////////////////
+//
+// QualityConfig
+//
+// Chooses the encoding resolution and framerate for the BWE target bitrate.
+// Each configured resolution keeps a complexity estimate learned from the
+// encoded frame sizes and slice QPs (bits per pixel normalized to a reference
+// QP), so the QP the encoder would settle at can be predicted for any
+// resolution/framerate at the given bitrate. The largest resolution whose
+// predicted QP stays in the quality band is chosen, with hysteresis between
+// the up and down switch thresholds and a minimum dwell time between switches.
+//
+////////////////////////////////////////////////////////////////////////////////
 class QualityConfig {
    public:
     explicit QualityConfig();
+    // Uses the given resolution list and clock instead of the media config,
+    // so the model can be replayed offline(quality_sim). The resolution is
+    // always dynamic, because the fixed resolution comes from the media
+    // config.
+    explicit QualityConfig(
+        const std::list<wstreamer::VideoResolution>& resolution_list,
+        webrtc::Clock* clock);
     ~QualityConfig();
 
-    void ReportFrameSize(int frame_size);
+    // |width| and |height| are the resolution the frame is encoded at, which
+    // may differ from the last best match while the encoder is resized.
+    // |qp| is the slice QP of the frame, negative when unknown.
+    void ReportFrameSize(int width, int height, int frame_size, int qp,
+                         bool is_keyframe);
     void ReportFrameRate(int framerate);
     void ReportTargetBitrate(int bitrate);  // kbps
 
@@ -53,22 +77,42 @@ class QualityConfig {
     wstreamer::VideoEncodingParams& GetBestMatch();
     wstreamer::VideoEncodingParams& GetInitialBestMatch();
 
+    int switch_count() const;
+    absl::optional<int> average_qp() const;
+
    private:
     struct ResolutionConfigEntry {
         ResolutionConfigEntry(int width, int height, int max_fps, int min_fps);
+        inline int pixels() const { return width_ * height_; }
         int width_, height_, max_fps_, min_fps_;
-        int average_bandwidth_, max_bandwidth_, min_bandwidth_;
+        // bits per pixel at the reference QP, learned from the encoded frames
+        double complexity_;
+        int samples_;
     };
+    void AddResolutionList(
+        const std::list<wstreamer::VideoResolution>& resolution_list);
+    ResolutionConfigEntry* FindEntry(int width, int height);
+    double GetComplexity(const ResolutionConfigEntry& entry) const;
+    double PredictQp(const ResolutionConfigEntry& entry, int bitrate,
+                     int framerate) const;
+    int SelectFramerate(const ResolutionConfigEntry& entry, int bitrate,
+                        double max_qp) const;
+    const ResolutionConfigEntry* SelectResolution(int bitrate) const;
+
     // media configuration sigleton reference
     ConfigMedia* config_media_;
+    webrtc::Clock* const clock_;
 
+    mutable webrtc::Mutex mutex_;
+    // sorted by the number of pixels, smallest first
     std::list<ResolutionConfigEntry> resolution_config_;
     int target_framerate_;
     int target_bitrate_;
-    rtc::MovingAverage average_mf_; /* average motion factor */
+    rtc::MovingAverage average_qp_;
     wstreamer::VideoEncodingParams current_res_;
+    int64_t last_switch_time_ms_;
+    int switch_count_;
     bool use_dynamic_resolution_;
-    bool use_initial_resolution_;
 };
 
 #endif  // RPI_QUALITY_CONFIG_H_
@@ -0,0 +1,387 @@
+/*
+Copyright (c) 2021, rpi-webrtc-streamer Lyu,KeunChang
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "recording_index.h"
+
+#include <dirent.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <set>
+
+#include "rtc_base/checks.h"
+#include "rtc_base/logging.h"
+#include "rtc_base/string_encode.h"
+#include "utils.h"
+
+namespace {
+
+constexpr char kJournalFileExtension[] = ".index";
+constexpr char kTemporaryFileNameExtension[] = ".saving";
+constexpr char kImvFileExtension[] = ".imv";
+constexpr char kFilenameTimeFormat[] = "%Y-%m-%d.%H:%M:%S";
+constexpr int kMaxJournalLine = 1024;
+
+bool StartTimeCompare(const RecordingInfo& a, const RecordingInfo& b) {
+    if (a.start_time != b.start_time) return a.start_time < b.start_time;
+    return a.name().compare(b.name()) < 0;
+}
+
+bool HasSuffix(const std::string& name, const std::string& suffix) {
+    return name.size() >= suffix.size() &&
+           name.compare(name.size() - suffix.size(), suffix.size(), suffix) ==
+               0;
+}
+
+}  // namespace
+
+RecordingIndex::RecordingIndex(const std::string& base_path,
+                               const std::string& prefix)
+    : base_path_(base_path),
+      prefix_(prefix),
+      journal_(nullptr),
+      total_size_(0),
+      journal_records_(0),
+      loaded_(false) {
+    if (utils::GetFolderWithTailingDelimiter(base_path, base_path_) == false)
+        base_path_ = base_path + "/";
+    // hidden file, which does not match the prefix of the recordings
+    journal_filename_ = base_path_ + "." + prefix_ + kJournalFileExtension;
+}
+
+RecordingIndex::~RecordingIndex() {
+    webrtc::MutexLock lock(&mutex_);
+    if (journal_) ::fclose(journal_);
+}
+
+bool RecordingIndex::Load() {
+    webrtc::MutexLock lock(&mutex_);
+    return LoadRecordings();
+}
+
+bool RecordingIndex::LoadRecordings() {
+    std::deque<RecordingInfo> recordings;
+    if (ScanDirectory(&recordings) == false) return false;
+    // the recordings being written are not found in the directory
+    for (const RecordingInfo& recording : recordings_)
+        if (recording.active) recordings.push_back(recording);
+    std::sort(recordings.begin(), recordings.end(), StartTimeCompare);
+
+    recordings_.swap(recordings);
+    total_size_ = 0;
+    for (const RecordingInfo& recording : recordings_)
+        total_size_ += recording.size;
+    loaded_ = true;
+    RTC_LOG(INFO) << "Recording index \"" << base_path_ << "\" "
+                  << recordings_.size()
+                  << " recordings, total size: " << total_size_;
+    return WriteJournal();
+}
+
+// Builds the recordings from the files in the directory. The start time and
+// the duration come from the journal, otherwise the start time is taken from
+// the filename.
+bool RecordingIndex::ScanDirectory(std::deque<RecordingInfo>* recordings) {
+    DIR* dirp = ::opendir(base_path_.c_str());
+    if (dirp == nullptr) {
+        RTC_LOG(LS_ERROR) << "Failed to open motion directory : " << base_path_;
+        return false;
+    }
+    std::set<std::string> active_files;
+    for (const RecordingInfo& recording : recordings_) {
+        if (recording.active == false) continue;
+        active_files.insert(recording.video);
+        active_files.insert(recording.imv);
+    }
+    std::map<std::string, size_t> files;
+    for (struct dirent* dirent = ::readdir(dirp); dirent;
+         dirent = ::readdir(dirp)) {
+        std::string name = dirent->d_name;
+        if (name[0] == '.' || name.compare(0, prefix_.size(), prefix_) != 0)
+            continue;
+        std::string filename = name;
+        if (HasSuffix(name, kTemporaryFileNameExtension))
+            filename = name.substr(
+                0, name.size() - strlen(kTemporaryFileNameExtension));
+        // the files are still being written
+        if (active_files.count(filename) > 0) continue;
+        // the file was not closed, e.g. the streamer was terminated
+        if (filename != name &&
+            utils::MoveFile(base_path_ + name, base_path_ + filename))
+            name = filename;
+        files[name] = utils::GetFileSize(base_path_ + name).value_or(0);
+    }
+    ::closedir(dirp);
+
+    // the recordings in the journal which still have the files
+    std::map<std::string, RecordingInfo> journal_recordings;
+    ReadJournal(&journal_recordings);
+    for (auto& it : journal_recordings) {
+        RecordingInfo& recording = it.second;
+        recording.size = 0;
+        for (std::string* filename : {&recording.video, &recording.imv}) {
+            auto file = files.find(*filename);
+            if (file == files.end()) {
+                filename->clear();
+                continue;
+            }
+            recording.size += file->second;
+            files.erase(file);
+        }
+        if (!recording.name().empty()) recordings->push_back(recording);
+    }
+
+    // the files not in the journal are paired with the filename
+    std::map<std::string, RecordingInfo> stem_recordings;
+    for (const auto& file : files) {
+        const std::string& name = file.first;
+        size_t dot = name.rfind('.');
+        if (dot == std::string::npos) continue;
+        RecordingInfo& recording = stem_recordings[name.substr(0, dot)];
+        if (name.compare(dot, std::string::npos, kImvFileExtension) == 0)
+            recording.imv = name;
+        else
+            recording.video = name;
+        recording.size += file.second;
+    }
+    for (auto& it : stem_recordings) {
+        RecordingInfo& recording = it.second;
+        struct tm tm = {};
+        tm.tm_isdst = -1;
+        const char* time_string = it.first.c_str() + prefix_.size() + 1;
+        if (it.first.size() > prefix_.size() &&
+            ::strptime(time_string, kFilenameTimeFormat, &tm) != nullptr) {
+            recording.start_time = ::mktime(&tm);
+        } else {
+            recording.start_time =
+                utils::GetFileChangedTime(base_path_ + recording.name())
+                    .value_or(0);
+        }
+        recording.duration_ms = 0;
+        recordings->push_back(recording);
+    }
+    return true;
+}
+
+void RecordingIndex::ReadJournal(
+    std::map<std::string, RecordingInfo>* recordings) {
+    FILE* journal = ::fopen(journal_filename_.c_str(), "r");
+    if (journal == nullptr) return;  // no journal yet
+
+    char line[kMaxJournalLine];
+    while (::fgets(line, sizeof(line), journal)) {
+        std::string record = line;
+        if (!record.empty() && record.back() == '\n') record.pop_back();
+        std::vector<std::string> fields;
+        rtc::split(record, '\t', &fields);
+        if (fields.size() >= 2 && fields[0] == "-") {
+            recordings->erase(fields[1]);
+            continue;
+        }
+        RecordingInfo recording;
+        int64_t start_time;
+        if (fields.size() < 6 || fields[0] != "+" ||
+            !rtc::FromString(fields[3], &start_time) ||
+            !rtc::FromString(fields[4], &recording.duration_ms) ||
+            !rtc::FromString(fields[5], &recording.size)) {
+            RTC_LOG(LS_WARNING) << "Skipping journal record : " << record;
+            continue;
+        }
+        recording.video = fields[1];
+        recording.imv = fields[2];
+        recording.start_time = static_cast<time_t>(start_time);
+        (*recordings)[recording.name()] = recording;
+    }
+    ::fclose(journal);
+}
+
+// Rewrites the journal with the recordings, and opens it for appending
+bool RecordingIndex::WriteJournal() {
+    if (journal_) ::fclose(journal_);
+    const std::string temporary_filename =
+        journal_filename_ + kTemporaryFileNameExtension;
+    journal_ = ::fopen(temporary_filename.c_str(), "w");
+    if (journal_ == nullptr) {
+        RTC_LOG(LS_ERROR) << "Failed to open journal : " << temporary_filename;
+        return false;
+    }
+    for (const RecordingInfo& recording : recordings_) {
+        ::fprintf(journal_, "+\t%s\t%s\t%lld\t%d\t%zu\n",
+                  recording.video.c_str(), recording.imv.c_str(),
+                  static_cast<long long>(recording.start_time),
+                  recording.duration_ms, recording.size);
+    }
+    ::fclose(journal_);
+    journal_ = nullptr;
+    if (utils::MoveFile(temporary_filename, journal_filename_) == false)
+        return false;
+    journal_records_ = recordings_.size();
+    journal_ = ::fopen(journal_filename_.c_str(), "a");
+    return journal_ != nullptr;
+}
+
+void RecordingIndex::AppendJournal(const RecordingInfo& recording) {
+    char record[kMaxJournalLine];
+    snprintf(record, sizeof(record), "+\t%s\t%s\t%lld\t%d\t%zu\n",
+             recording.video.c_str(), recording.imv.c_str(),
+             static_cast<long long>(recording.start_time),
+             recording.duration_ms, recording.size);
+    AppendJournal(record);
+}
+
+void RecordingIndex::AppendJournal(const char* record) {
+    if (journal_ == nullptr) return;
+    ::fputs(record, journal_);
+    ::fflush(journal_);
+    journal_records_++;
+}
+
+void RecordingIndex::InsertRecording(const RecordingInfo& recording) {
+    // the recordings are added in the start time order unless the wall clock
+    // is changed
+    if (recordings_.empty() ||
+        StartTimeCompare(recordings_.back(), recording)) {
+        recordings_.push_back(recording);
+    } else {
+        recordings_.insert(std::upper_bound(recordings_.begin(),
+                                            recordings_.end(), recording,
+                                            StartTimeCompare),
+                           recording);
+    }
+    total_size_ += recording.size;
+}
+
+void RecordingIndex::OpenRecording(const std::string& video_path,
+                                   const std::string& imv_path,
+                                   time_t start_time) {
+    RecordingInfo recording;
+    recording.video = video_path.substr(video_path.rfind('/') + 1);
+    recording.imv =
+        imv_path.empty() ? "" : imv_path.substr(imv_path.rfind('/') + 1);
+    recording.start_time = start_time;
+    recording.active = true;
+
+    webrtc::MutexLock lock(&mutex_);
+    InsertRecording(recording);
+    AppendJournal(recording);
+}
+
+void RecordingIndex::CloseRecording(const std::string& video_path,
+                                    const std::string& imv_path,
+                                    time_t start_time, int duration_ms) {
+    RecordingInfo recording;
+    recording.video = video_path.substr(video_path.rfind('/') + 1);
+    recording.imv =
+        imv_path.empty() ? "" : imv_path.substr(imv_path.rfind('/') + 1);
+    recording.start_time = start_time;
+    recording.duration_ms = duration_ms;
+    recording.size = utils::GetFileSize(video_path).value_or(0);
+    if (!imv_path.empty())
+        recording.size += utils::GetFileSize(imv_path).value_or(0);
+
+    webrtc::MutexLock lock(&mutex_);
+    // the opened recording is usually the newest one
+    auto it = std::find_if(recordings_.rbegin(), recordings_.rend(),
+                           [&recording](const RecordingInfo& opened) {
+                               return opened.active &&
+                                      opened.name() == recording.name();
+                           });
+    if (it != recordings_.rend()) {
+        total_size_ = total_size_ - it->size + recording.size;
+        *it = recording;
+    } else {
+        InsertRecording(recording);
+    }
+    AppendJournal(recording);
+}
+
+void RecordingIndex::RemoveRecording(const std::string& video_path) {
+    const std::string name = video_path.substr(video_path.rfind('/') + 1);
+    webrtc::MutexLock lock(&mutex_);
+    auto it = std::find_if(
+        recordings_.begin(), recordings_.end(),
+        [&name](const RecordingInfo& recording) {
+            return recording.name() == name;
+        });
+    if (it == recordings_.end()) return;
+    char record[kMaxJournalLine];
+    snprintf(record, sizeof(record), "-\t%s\n", name.c_str());
+    AppendJournal(record);
+    total_size_ -= it->size;
+    recordings_.erase(it);
+}
+
+void RecordingIndex::EvictToSizeLimit(size_t size_limit) {
+    webrtc::MutexLock lock(&mutex_);
+    // the directory could not be scanned when the index was loaded
+    if (loaded_ == false) LoadRecordings();
+    while (recordings_.size() > 0 && recordings_.front().active == false &&
+           (total_size_ - recordings_.front().size) > size_limit) {
+        const RecordingInfo& recording = recordings_.front();
+        RTC_LOG(INFO) << "Removing Video File :" << recording.name();
+        if (!recording.video.empty())
+            utils::DeleteFile(base_path_ + recording.video);
+        if (!recording.imv.empty())
+            utils::DeleteFile(base_path_ + recording.imv);
+
+        char record[kMaxJournalLine];
+        snprintf(record, sizeof(record), "-\t%s\n", recording.name().c_str());
+        AppendJournal(record);
+        total_size_ -= recording.size;
+        recordings_.pop_front();
+    }
+    // compact the journal when the removed and the replaced records
+    // outnumber the recordings
+    if (journal_records_ > 2 * recordings_.size()) WriteJournal();
+}
+
+void RecordingIndex::ListRecordings(time_t from_time, time_t to_time,
+                                    std::vector<RecordingInfo>* recordings) {
+    webrtc::MutexLock lock(&mutex_);
+    RecordingInfo from;
+    from.start_time = from_time;
+    auto it = std::lower_bound(
+        recordings_.begin(), recordings_.end(), from,
+        [](const RecordingInfo& a, const RecordingInfo& b) {
+            return a.start_time < b.start_time;
+        });
+    for (; it != recordings_.end() && it->start_time <= to_time; ++it)
+        recordings->push_back(*it);
+}
+
+size_t RecordingIndex::count() {
+    webrtc::MutexLock lock(&mutex_);
+    return recordings_.size();
+}
+
+size_t RecordingIndex::total_size() {
+    webrtc::MutexLock lock(&mutex_);
+    return total_size_;
+}
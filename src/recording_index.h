@@ -0,0 +1,135 @@
+/*
+Copyright (c) 2021, rpi-webrtc-streamer Lyu,KeunChang
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef RECORDING_INDEX_H_
+#define RECORDING_INDEX_H_
+
+#include <stdio.h>
+
+#include <ctime>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "rtc_base/constructor_magic.h"
+#include "rtc_base/synchronization/mutex.h"
+
+// Motion recording of the video file and the imv file. One of the files may
+// be missing, e.g. the imv file is not saved.
+struct RecordingInfo {
+    std::string video;      // video filename without the directory
+    std::string imv;        // imv filename, empty when there is no imv file
+    time_t start_time = 0;  // wall clock time of the first frame
+    int duration_ms = 0;    // zero when it is not known
+    size_t size = 0;        // total size of the video and imv file
+    bool active = false;    // the files are still being written
+
+    inline const std::string& name() const {
+        return video.empty() ? imv : video;
+    }
+    inline bool has_imv() const { return !imv.empty(); }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// RecordingIndex
+//
+// In-memory catalog of the motion recordings in the start time order. The
+// catalog is built from the directory once when it is loaded, and updated
+// when the recordings are closed and removed, so the retention does not need
+// to scan the directory. The changes are appended to the journal file in the
+// directory, which keeps the start time and the duration that can not be
+// found from the directory. The journal is compacted when it is loaded, and
+// when the removed records outnumber the recordings. A recording is added
+// with the zero duration when it is opened, and the record is appended again
+// when it is closed.
+//
+//  journal := record*
+//  record  := '+' TAB video TAB imv TAB start_time TAB duration_ms TAB size LF
+//           | '-' TAB name LF
+//
+////////////////////////////////////////////////////////////////////////////////
+class RecordingIndex {
+   public:
+    explicit RecordingIndex(const std::string& base_path,
+                            const std::string& prefix);
+    ~RecordingIndex();
+
+    // Builds the catalog from the directory and the journal. The catalog
+    // is loaded again by EvictToSizeLimit when it fails.
+    bool Load();
+
+    // Adds the recording being written, the filenames are the full path of
+    // the files and the imv filename may be empty.
+    void OpenRecording(const std::string& video_path,
+                       const std::string& imv_path, time_t start_time);
+    // Updates the size and the duration of the closed recording, which is
+    // added when it was not opened.
+    void CloseRecording(const std::string& video_path,
+                        const std::string& imv_path, time_t start_time,
+                        int duration_ms);
+
+    // Removes the recording from the catalog, the files are not removed
+    void RemoveRecording(const std::string& video_path);
+
+    // Removes the oldest closed recordings until the total size except the
+    // newest recording is under the size limit.
+    void EvictToSizeLimit(size_t size_limit);
+
+    // Lists the recordings started in [from_time, to_time]
+    void ListRecordings(time_t from_time, time_t to_time,
+                        std::vector<RecordingInfo>* recordings);
+
+    size_t count();
+    size_t total_size();
+
+   private:
+    bool LoadRecordings();
+    bool ScanDirectory(std::deque<RecordingInfo>* recordings);
+    void InsertRecording(const RecordingInfo& recording);
+    void ReadJournal(std::map<std::string, RecordingInfo>* recordings);
+    bool WriteJournal();
+    void AppendJournal(const RecordingInfo& recording);
+    void AppendJournal(const char* record);
+
+    webrtc::Mutex mutex_;
+    std::string base_path_;  // with the tailing delimiter
+    const std::string prefix_;
+    std::string journal_filename_;
+    FILE* journal_;                        // guarded by mutex_
+    std::deque<RecordingInfo> recordings_;  // guarded by mutex_
+    size_t total_size_;                     // guarded by mutex_
+    size_t journal_records_;                // guarded by mutex_
+    bool loaded_;                           // guarded by mutex_
+
+    RTC_DISALLOW_COPY_AND_ASSIGN(RecordingIndex);
+};
+
+#endif  // RECORDING_INDEX_H_
@@ -0,0 +1,264 @@
+/*
+Copyright (c) 2021, rpi-webrtc-streamer Lyu,KeunChang
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Latency of the resolution switch of the live streaming session, measured
+// on the Raspberry PI with the camera. The encoder session is switched
+// between the resolutions in turn, with the resizer(only the resizer output
+// and the encoder input are reconfigured) and without it(the camera and the
+// encoder components are rebuilt).
+//
+// For each switch, the time spent in ReinitEncoder and the time until the
+// first key frame of the new resolution arrives at the frame queue are
+// reported, the latter is the gap seen by the viewer.
+//
+// Usage: resize_bench [-c media_config] [-n rounds]
+//                     [-m resizer|rebuild|all] [resolution ...]
+//
+// Build with 'make resize_bench' in src directory.
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "config_media.h"
+#include "frame_queue.h"
+#include "mmal_wrapper.h"
+#include "rtc_base/time_utils.h"
+
+namespace {
+
+const int kDefaultRounds = 5;
+const int kFramerate = 30;
+const int kBitrate = 2000;  // kbps
+// The first key frame of the new resolution must arrive in this period.
+const int64_t kKeyFrameTimeoutUs = 5 * rtc::kNumMicrosecsPerSec;
+// frames read after the session is opened, to let the camera settle
+const int kWarmupFrames = 60;
+
+const char kModeResizer[] = "resizer";
+const char kModeRebuild[] = "rebuild";
+const char kModeAll[] = "all";
+
+const char *kDefaultResolutions[] = {"1280x720", "640x360", "960x540",
+                                     "320x180"};
+
+struct SwitchResult {
+    std::string resolution;
+    int64_t reinit_us;    // time spent in ReinitEncoder
+    int64_t keyframe_us;  // time until the first key frame
+};
+
+void Usage(const char *program) {
+    fprintf(stderr,
+            "Usage: %s [-c media_config] [-n rounds] "
+            "[-m resizer|rebuild|all] [resolution ...]\n",
+            program);
+    exit(1);
+}
+
+bool ParseResolution(const char *arg, wstreamer::VideoEncodingParams *config) {
+    int width, height;
+    if (sscanf(arg, "%dx%d", &width, &height) != 2 || width <= 0 ||
+        height <= 0)
+        return false;
+    *config = wstreamer::VideoEncodingParams(width, height, kFramerate,
+                                             kBitrate);
+    return true;
+}
+
+// Read the frames until a key frame with SPS arrives, the frames of the
+// previous resolution are queued before ReinitEncoder returns.
+bool WaitKeyFrame(webrtc::FrameSubscriber *subscriber, int64_t start_us,
+                  int64_t *elapsed_us) {
+    while (rtc::TimeMicros() - start_us < kKeyFrameTimeoutUs) {
+        rtc::scoped_refptr<webrtc::FrameBuffer> buffer =
+            subscriber->ReadFront();
+        if (buffer == nullptr) continue;
+        if (buffer->isKeyFrame() && buffer->hasSps()) {
+            *elapsed_us = rtc::TimeMicros() - start_us;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Drain the frames queued so far, so the next key frame belongs to the switch.
+void Drain(webrtc::FrameSubscriber *subscriber) {
+    while (subscriber->ReadFront(false) != nullptr) {
+    }
+}
+
+bool RunMode(const std::string &mode,
+             const std::vector<wstreamer::VideoEncodingParams> &configs,
+             int rounds, std::vector<SwitchResult> *results) {
+    ConfigMedia *config_media = ConfigMediaSingleton::Instance();
+    webrtc::MMALEncoderWrapper *mmal_encoder = webrtc::MMALWrapper::Instance();
+    wstreamer::EncoderSettings settings;
+
+    config_media->SetVideoResizerEnable(mode == kModeResizer);
+    std::unique_ptr<webrtc::FrameSubscriber> subscriber =
+        mmal_encoder->Subscribe("resize_bench");
+    if (mmal_encoder->OpenEncoderSession(
+            webrtc::MMALEncoderWrapper::CLIENT_LIVE, configs.front(),
+            settings) == false) {
+        fprintf(stderr, "Failed to open the encoder session\n");
+        return false;
+    }
+    int64_t elapsed_us;
+    if (WaitKeyFrame(subscriber.get(), rtc::TimeMicros(), &elapsed_us) ==
+        false) {
+        fprintf(stderr, "No key frame after opening the session\n");
+        mmal_encoder->CloseEncoderSession(
+            webrtc::MMALEncoderWrapper::CLIENT_LIVE);
+        return false;
+    }
+    for (int frames = 0; frames < kWarmupFrames; frames++) {
+        if (subscriber->ReadFront() == nullptr) break;
+    }
+
+    bool result = true;
+    for (int round = 0; round < rounds && result; round++) {
+        for (size_t index = 1; index <= configs.size(); index++) {
+            wstreamer::VideoEncodingParams config =
+                configs[index % configs.size()];
+            SwitchResult switch_result;
+
+            Drain(subscriber.get());
+            int64_t start_us = rtc::TimeMicros();
+            if (mmal_encoder->ReinitEncoder(config) == false) {
+                fprintf(stderr, "Failed to switch to %s\n",
+                        config.ToString().c_str());
+                result = false;
+                break;
+            }
+            switch_result.reinit_us = rtc::TimeMicros() - start_us;
+            if (WaitKeyFrame(subscriber.get(), start_us,
+                             &switch_result.keyframe_us) == false) {
+                fprintf(stderr, "No key frame after switching to %s\n",
+                        config.ToString().c_str());
+                result = false;
+                break;
+            }
+            switch_result.resolution = config.ToString();
+            results->push_back(switch_result);
+        }
+    }
+    mmal_encoder->CloseEncoderSession(webrtc::MMALEncoderWrapper::CLIENT_LIVE);
+    return result;
+}
+
+void Report(const std::string &mode, std::vector<SwitchResult> results) {
+    if (results.empty()) return;
+    for (const SwitchResult &result : results) {
+        printf("%-8s %-24s reinit %7.1f ms, key frame %7.1f ms\n",
+               mode.c_str(), result.resolution.c_str(),
+               result.reinit_us / 1000.0, result.keyframe_us / 1000.0);
+    }
+    std::sort(results.begin(), results.end(),
+              [](const SwitchResult &a, const SwitchResult &b) {
+                  return a.keyframe_us < b.keyframe_us;
+              });
+    int64_t total_us = 0;
+    for (const SwitchResult &result : results) total_us += result.keyframe_us;
+    printf("%-8s switches %zu, key frame mean %.1f ms, median %.1f ms, "
+           "max %.1f ms\n",
+           mode.c_str(), results.size(),
+           total_us / 1000.0 / results.size(),
+           results[results.size() / 2].keyframe_us / 1000.0,
+           results.back().keyframe_us / 1000.0);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    std::string config_file;
+    std::string mode = kModeAll;
+    int rounds = kDefaultRounds;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "c:n:m:")) != -1) {
+        switch (opt) {
+            case 'c':
+                config_file = optarg;
+                break;
+            case 'n':
+                rounds = atoi(optarg);
+                break;
+            case 'm':
+                mode = optarg;
+                break;
+            default:
+                Usage(argv[0]);
+        }
+    }
+    if (rounds <= 0) Usage(argv[0]);
+    if (mode != kModeResizer && mode != kModeRebuild && mode != kModeAll)
+        Usage(argv[0]);
+
+    std::vector<wstreamer::VideoEncodingParams> configs;
+    for (int index = optind; index < argc; index++) {
+        wstreamer::VideoEncodingParams config;
+        if (ParseResolution(argv[index], &config) == false) Usage(argv[0]);
+        configs.push_back(config);
+    }
+    if (configs.empty()) {
+        for (const char *resolution : kDefaultResolutions) {
+            wstreamer::VideoEncodingParams config;
+            ParseResolution(resolution, &config);
+            configs.push_back(config);
+        }
+    }
+    if (configs.size() < 2) Usage(argv[0]);
+
+    if (webrtc::MMALWrapper::Instance() == nullptr) {
+        fprintf(stderr, "Failed to get MMALEncoderWrapper\n");
+        return 1;
+    }
+    if (!config_file.empty() &&
+        ConfigMediaSingleton::Instance()->Load(config_file) == false) {
+        fprintf(stderr, "Failed to load the media config: %s\n",
+                config_file.c_str());
+        return 1;
+    }
+
+    for (const std::string &run : {std::string(kModeResizer),
+                                   std::string(kModeRebuild)}) {
+        if (mode != kModeAll && mode != run) continue;
+        std::vector<SwitchResult> results;
+        if (RunMode(run, configs, rounds, &results) == false) return 1;
+        Report(run, results);
+    }
+    return 0;
+}
@@ -0,0 +1,361 @@
+/*
+Copyright (c) 2021, rpi-webrtc-streamer Lyu,KeunChang
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Trace replay of the coalesced frame allocation, to compare the resident
+// memory of FrameSlab with the previous buffer of 3 times the recommended
+// buffer size of the encoder port, malloc'd for each coalesced frame.
+//
+// The frames are split into the parts of the encoder buffer size like MMAL
+// delivers them, and the key frame gets the config part in front, so only the
+// key frames and the frames larger than the buffer are coalesced. The frames
+// are held in flight like the subscribers and the pre-event ring hold them.
+// Each allocator is replayed in its own process, and the peak and the final
+// resident memory of the process and the peak allocated bytes are reported.
+//
+// The frame sizes are read from the 'QualityTrace f' lines of the verbose
+// log of the streamer (see quality_sim), or generated when no trace is given.
+//
+// Usage: slab_bench [-b buffer_size_recommended] [-H held_frames]
+//                   [-n frames] [-m legacy|slab|all] [trace_file]
+//
+// Build with 'make slab_bench' in src directory.
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <deque>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "api/scoped_refptr.h"
+#include "frame_slab.h"
+
+namespace {
+
+const int kDefaultBufferSize = 64 * 1024;  // recommended by the encoder port
+const int kDefaultHeldFrames = 8;
+const int kDefaultFrames = 9000;
+// generated trace: 3 Mbps at 30 fps, key frame every 2 seconds, 8 times
+// larger than the P frame
+const int kTraceBitrateKbps = 3000;
+const int kTraceFramerate = 30;
+const int kTraceKeyFramePeriod = 60;
+const int kTraceKeyFrameRatio = 8;
+const size_t kConfigPartSize = 32;  // SPS and PPS
+
+const char kQualityTrace[] = "QualityTrace";
+const char kModeLegacy[] = "legacy";
+const char kModeSlab[] = "slab";
+const char kModeAll[] = "all";
+
+struct TraceFrame {
+    size_t size;
+    bool keyframe;
+};
+
+struct BenchResult {
+    size_t coalesced;
+    size_t failed;
+    size_t peak_allocated;
+    size_t peak_rss_kb;
+    size_t final_rss_kb;
+};
+
+void Usage(const char *program) {
+    fprintf(stderr,
+            "Usage: %s [-b buffer_size_recommended] [-H held_frames] "
+            "[-n frames] [-m legacy|slab|all] [trace_file]\n",
+            program);
+    exit(1);
+}
+
+bool ReadTrace(const char *filename, std::vector<TraceFrame> *frames) {
+    std::ifstream trace(filename);
+    std::string line;
+    if (trace.is_open() == false) return false;
+    while (std::getline(trace, line)) {
+        size_t pos = line.find(kQualityTrace);
+        if (pos == std::string::npos) continue;
+        std::stringstream record(
+            line.substr(pos + sizeof(kQualityTrace) - 1));
+        std::string type;
+        int64_t time_ms;
+        int width, height, qp, keyframe;
+        TraceFrame frame;
+        record >> type;
+        if (type != "f") continue;
+        if (!(record >> time_ms >> width >> height >> frame.size >> qp >>
+              keyframe))
+            continue;
+        frame.keyframe = keyframe != 0;
+        frames->push_back(frame);
+    }
+    return true;
+}
+
+void GenerateTrace(int count, std::vector<TraceFrame> *frames) {
+    std::mt19937 random(1);
+    size_t frame_size = kTraceBitrateKbps * 1000 / 8 / kTraceFramerate;
+    std::uniform_int_distribution<size_t> size_dist(frame_size / 2,
+                                                    frame_size * 3 / 2);
+    for (int index = 0; index < count; index++) {
+        TraceFrame frame;
+        frame.keyframe = index % kTraceKeyFramePeriod == 0;
+        frame.size = size_dist(random);
+        if (frame.keyframe) frame.size *= kTraceKeyFrameRatio;
+        frames->push_back(frame);
+    }
+}
+
+// Reads the VmHWM and VmRSS of the process in KB
+void ReadRss(size_t *peak_rss_kb, size_t *rss_kb) {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0)
+            *peak_rss_kb = strtoul(line.c_str() + 6, nullptr, 10);
+        else if (line.compare(0, 6, "VmRSS:") == 0)
+            *rss_kb = strtoul(line.c_str() + 6, nullptr, 10);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Coalesced frame allocators
+//
+////////////////////////////////////////////////////////////////////////////////
+struct Block {
+    uint8_t *data;
+    size_t capacity;
+};
+
+class FrameAllocator {
+   public:
+    virtual ~FrameAllocator() {}
+    // Allocates the block for the first part and appends the rest of the
+    // parts, returns false when the frame is dropped.
+    virtual bool Coalesce(const std::vector<size_t> &parts, Block *block) = 0;
+    virtual void Release(const Block &block) = 0;
+    virtual size_t allocated() const = 0;
+};
+
+// Previous FrameQueue: the buffer of 3 times the recommended size
+class LegacyAllocator : public FrameAllocator {
+   public:
+    explicit LegacyAllocator(size_t buffer_size)
+        : buffer_size_(buffer_size), allocated_(0) {}
+
+    bool Coalesce(const std::vector<size_t> &parts, Block *block) override {
+        size_t length = 0;
+        for (size_t part : parts) length += part;
+        if (length > buffer_size_) return false;
+        block->data = static_cast<uint8_t *>(malloc(buffer_size_));
+        block->capacity = buffer_size_;
+        memset(block->data, 0xa5, length);
+        allocated_ += buffer_size_;
+        return true;
+    }
+    void Release(const Block &block) override {
+        free(block.data);
+        allocated_ -= block.capacity;
+    }
+    size_t allocated() const override { return allocated_; }
+
+   private:
+    const size_t buffer_size_;
+    size_t allocated_;
+};
+
+// FrameBuffer allocated from FrameSlab and grown with the appended parts
+class SlabAllocator : public FrameAllocator {
+   public:
+    SlabAllocator() : slab_(new webrtc::FrameSlab()) {}
+
+    bool Coalesce(const std::vector<size_t> &parts, Block *block) override {
+        size_t length = 0;
+        block->data = slab_->Allocate(parts[0], &block->capacity);
+        if (block->data == nullptr) return false;
+        for (size_t part : parts) {
+            uint8_t *data = slab_->Grow(block->data, length, length + part,
+                                        &block->capacity);
+            if (data == nullptr) {
+                slab_->Free(block->data, block->capacity);
+                return false;
+            }
+            block->data = data;
+            memset(block->data + length, 0xa5, part);
+            length += part;
+        }
+        return true;
+    }
+    void Release(const Block &block) override {
+        slab_->Free(block.data, block.capacity);
+    }
+    size_t allocated() const override { return slab_->allocated(); }
+
+   private:
+    rtc::scoped_refptr<webrtc::FrameSlab> slab_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Benchmark
+//
+////////////////////////////////////////////////////////////////////////////////
+BenchResult Replay(FrameAllocator *allocator,
+                   const std::vector<TraceFrame> &frames, size_t buffer_size,
+                   size_t held_frames) {
+    BenchResult result = {0, 0, 0, 0, 0};
+    // the held frames, the single part frames are the MMAL buffers
+    std::deque<Block> held;
+
+    for (const TraceFrame &frame : frames) {
+        std::vector<size_t> parts;
+        if (frame.keyframe) parts.push_back(kConfigPartSize);
+        for (size_t offset = 0; offset < frame.size; offset += buffer_size)
+            parts.push_back(std::min(buffer_size, frame.size - offset));
+
+        Block block = {nullptr, 0};
+        if (parts.size() > 1) {
+            result.coalesced++;
+            if (allocator->Coalesce(parts, &block) == false) result.failed++;
+        }
+        held.push_back(block);
+        if (held.size() > held_frames) {
+            if (held.front().data) allocator->Release(held.front());
+            held.pop_front();
+        }
+        result.peak_allocated =
+            std::max(result.peak_allocated, allocator->allocated());
+    }
+    for (const Block &block : held)
+        if (block.data) allocator->Release(block);
+    ReadRss(&result.peak_rss_kb, &result.final_rss_kb);
+    return result;
+}
+
+// Replays in the child process, so the peak resident memory of the process is
+// not shared by the allocators.
+bool RunMode(const std::string &mode, const std::vector<TraceFrame> &frames,
+             size_t buffer_size, size_t held_frames) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return false;
+    }
+    if (pid == 0) {
+        BenchResult result;
+        if (mode == kModeLegacy) {
+            LegacyAllocator allocator(buffer_size * 3);
+            result = Replay(&allocator, frames, buffer_size, held_frames);
+        } else {
+            SlabAllocator allocator;
+            result = Replay(&allocator, frames, buffer_size, held_frames);
+        }
+        printf("%-6s %6zu coalesced %4zu failed  peak allocated %7zu KB  "
+               "peak rss %6zu KB  final rss %6zu KB\n",
+               mode.c_str(), result.coalesced, result.failed,
+               result.peak_allocated / 1024, result.peak_rss_kb,
+               result.final_rss_kb);
+        fflush(stdout);
+        _exit(0);
+    }
+    int status;
+    if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "Failed to run %s\n", mode.c_str());
+        return false;
+    }
+    return true;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    int buffer_size = kDefaultBufferSize;
+    int held_frames = kDefaultHeldFrames;
+    int frame_count = kDefaultFrames;
+    std::string mode = kModeAll;
+    std::vector<TraceFrame> frames;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "b:H:n:m:")) != -1) {
+        switch (opt) {
+            case 'b':
+                buffer_size = atoi(optarg);
+                break;
+            case 'H':
+                held_frames = atoi(optarg);
+                break;
+            case 'n':
+                frame_count = atoi(optarg);
+                break;
+            case 'm':
+                mode = optarg;
+                break;
+            default:
+                Usage(argv[0]);
+        }
+    }
+    if (argc - optind > 1 || buffer_size <= 0 || held_frames < 0 ||
+        frame_count <= 0)
+        Usage(argv[0]);
+    if (mode != kModeLegacy && mode != kModeSlab && mode != kModeAll)
+        Usage(argv[0]);
+
+    if (optind < argc) {
+        if (ReadTrace(argv[optind], &frames) == false) {
+            fprintf(stderr, "Failed to open %s\n", argv[optind]);
+            return 1;
+        }
+    } else {
+        GenerateTrace(frame_count, &frames);
+    }
+    printf("%zu frames, buffer size %d, %d frames held\n", frames.size(),
+           buffer_size, held_frames);
+
+    std::vector<std::string> modes;
+    if (mode == kModeAll)
+        modes = {kModeLegacy, kModeSlab};
+    else
+        modes = {mode};
+    for (const std::string &bench_mode : modes)
+        if (RunMode(bench_mode, frames, buffer_size, held_frames) == false)
+            return 1;
+    return 0;
+}
@@ -0,0 +1,310 @@
+/*
+Copyright (c) 2021, rpi-webrtc-streamer Lyu,KeunChang
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Latency benchmark of the frame handoff from the MMAL callback thread to a
+// frame subscriber. The frames are pushed at the frame rate and the time from
+// the push to the pop in the consumer thread is measured, with the SpscRing
+// woken up by the eventfd like FrameSubscriber, and with the previous locked
+// frame queue woken up by the event with the 10 ms wait period.
+//
+// The time spent in the push is measured too, it blocks the MMAL callback
+// thread. The consumer can spend some time on each frame to see the latency
+// while the consumer is busy, like the drain thread passing the frame to
+// WebRTC.
+//
+// Usage: spsc_bench [-n frames] [-c ring_capacity] [-w work_us]
+//                   [-m legacy|spsc|all]
+//
+// Build with 'make spsc_bench' in src directory.
+
+#include <getopt.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "spsc_ring.h"
+
+namespace {
+
+const int kDefaultFrames = 300;  // per frame rate
+const int kDefaultRingCapacity = 8;
+const int kFrameRates[] = {30, 60, 90};
+
+// same with the wait period of the ReadFront
+const int kEventWaitPeriod = 100;        // ms
+const int kLegacyEventWaitPeriod = 10;  // ms
+
+const char kModeLegacy[] = "legacy";
+const char kModeSpsc[] = "spsc";
+const char kModeAll[] = "all";
+
+struct BenchFrame {
+    int64_t pushed_us = 0;
+};
+
+int64_t TimeMicros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+void BusyWait(int work_us) {
+    int64_t end_us = TimeMicros() + work_us;
+    while (TimeMicros() < end_us) {
+    }
+}
+
+void Usage(const char *program) {
+    fprintf(stderr,
+            "Usage: %s [-n frames] [-c ring_capacity] [-w work_us] "
+            "[-m legacy|spsc|all]\n",
+            program);
+    exit(1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Frame handoff
+//
+////////////////////////////////////////////////////////////////////////////////
+class FrameHandoff {
+   public:
+    virtual ~FrameHandoff() {}
+    // Returns false when the frame is dropped
+    virtual bool Push(const BenchFrame &frame) = 0;
+    // Returns false when there is no frame until the wait period
+    virtual bool Pop(BenchFrame *frame) = 0;
+};
+
+// Previous FrameQueue: the deque guarded by the mutex, and the auto reset
+// event which is waited for 10 ms when the queue is empty.
+class LegacyHandoff : public FrameHandoff {
+   public:
+    explicit LegacyHandoff(size_t capacity)
+        : capacity_(capacity), signaled_(false) {}
+
+    bool Push(const BenchFrame &frame) override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (frames_.size() >= capacity_) return false;
+        frames_.push_back(frame);
+        signaled_ = true;
+        cond_.notify_one();
+        return true;
+    }
+
+    bool Pop(BenchFrame *frame) override {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (frames_.empty()) {
+            cond_.wait_for(lock,
+                           std::chrono::milliseconds(kLegacyEventWaitPeriod),
+                           [this] { return signaled_; });
+            signaled_ = false;
+        }
+        if (frames_.empty()) return false;
+        *frame = frames_.front();
+        frames_.pop_front();
+        return true;
+    }
+
+   private:
+    const size_t capacity_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    bool signaled_;
+    std::deque<BenchFrame> frames_;
+};
+
+// FrameSubscriber: the lock-free ring, and the eventfd written after the push
+class SpscHandoff : public FrameHandoff {
+   public:
+    explicit SpscHandoff(size_t capacity)
+        : ring_(capacity), event_fd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {}
+    ~SpscHandoff() override { close(event_fd_); }
+
+    bool Push(const BenchFrame &frame) override {
+        if (ring_.Push(frame) == false) return false;
+        uint64_t count = 1;
+        if (write(event_fd_, &count, sizeof(count)) < 0) perror("eventfd");
+        return true;
+    }
+
+    bool Pop(BenchFrame *frame) override {
+        if (ring_.Pop(frame)) return true;
+        struct pollfd pfd = {event_fd_, POLLIN, 0};
+        if (poll(&pfd, 1, kEventWaitPeriod) <= 0) return false;
+        uint64_t count;
+        if (read(event_fd_, &count, sizeof(count)) < 0 && errno != EAGAIN)
+            perror("eventfd");
+        return ring_.Pop(frame);
+    }
+
+   private:
+    SpscRing<BenchFrame> ring_;
+    int event_fd_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Benchmark
+//
+////////////////////////////////////////////////////////////////////////////////
+struct BenchResult {
+    int received;
+    int dropped;
+    std::vector<int64_t> latency_us;
+    std::vector<int64_t> push_us;
+};
+
+BenchResult RunHandoff(FrameHandoff *handoff, int fps, int frames,
+                       int work_us) {
+    BenchResult result = {0, 0, {}, {}};
+    std::atomic<bool> done(false);
+    result.latency_us.reserve(frames);
+    result.push_us.reserve(frames);
+
+    std::thread consumer([&] {
+        BenchFrame frame;
+        while (true) {
+            if (handoff->Pop(&frame) == false) {
+                if (done) return;
+                continue;
+            }
+            result.latency_us.push_back(TimeMicros() - frame.pushed_us);
+            result.received++;
+            if (work_us) BusyWait(work_us);
+        }
+    });
+
+    auto period = std::chrono::microseconds(1000000 / fps);
+    auto next = std::chrono::steady_clock::now();
+    for (int count = 0; count < frames; count++) {
+        next += period;
+        std::this_thread::sleep_until(next);
+        BenchFrame frame;
+        frame.pushed_us = TimeMicros();
+        if (handoff->Push(frame) == false) result.dropped++;
+        result.push_us.push_back(TimeMicros() - frame.pushed_us);
+    }
+    done = true;
+    consumer.join();
+    return result;
+}
+
+int64_t Percentile(const std::vector<int64_t> &sorted, double percent) {
+    if (sorted.empty()) return 0;
+    size_t index = static_cast<size_t>(percent / 100 * (sorted.size() - 1));
+    return sorted[index];
+}
+
+void PrintResult(const char *mode, int fps, BenchResult *result) {
+    std::vector<int64_t> &latency = result->latency_us;
+    std::vector<int64_t> &push = result->push_us;
+    std::sort(latency.begin(), latency.end());
+    std::sort(push.begin(), push.end());
+    printf("%-6s %3d fps %5d frames %4d dropped  latency us p50 %6lld "
+           "p90 %6lld p99 %6lld p99.9 %6lld max %6lld  push us p99 %5lld "
+           "max %5lld\n",
+           mode, fps, result->received, result->dropped,
+           static_cast<long long>(Percentile(latency, 50)),
+           static_cast<long long>(Percentile(latency, 90)),
+           static_cast<long long>(Percentile(latency, 99)),
+           static_cast<long long>(Percentile(latency, 99.9)),
+           static_cast<long long>(latency.empty() ? 0 : latency.back()),
+           static_cast<long long>(Percentile(push, 99)),
+           static_cast<long long>(push.empty() ? 0 : push.back()));
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    int frames = kDefaultFrames;
+    int capacity = kDefaultRingCapacity;
+    int work_us = 0;
+    std::string mode = kModeAll;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:c:w:m:")) != -1) {
+        switch (opt) {
+            case 'n':
+                frames = atoi(optarg);
+                break;
+            case 'c':
+                capacity = atoi(optarg);
+                break;
+            case 'w':
+                work_us = atoi(optarg);
+                break;
+            case 'm':
+                mode = optarg;
+                break;
+            default:
+                Usage(argv[0]);
+        }
+    }
+    if (argc != optind || frames <= 0 || capacity <= 0 || work_us < 0)
+        Usage(argv[0]);
+    if (mode != kModeLegacy && mode != kModeSpsc && mode != kModeAll)
+        Usage(argv[0]);
+
+    printf("%d frames per frame rate, ring capacity %d, consumer work %d us\n",
+           frames, capacity, work_us);
+    std::vector<std::string> modes;
+    if (mode == kModeAll)
+        modes = {kModeLegacy, kModeSpsc};
+    else
+        modes = {mode};
+    for (int fps : kFrameRates) {
+        for (const std::string &bench_mode : modes) {
+            if (bench_mode == kModeLegacy) {
+                LegacyHandoff handoff(capacity);
+                BenchResult result =
+                    RunHandoff(&handoff, fps, frames, work_us);
+                PrintResult(kModeLegacy, fps, &result);
+            } else {
+                SpscHandoff handoff(capacity);
+                BenchResult result =
+                    RunHandoff(&handoff, fps, frames, work_us);
+                PrintResult(kModeSpsc, fps, &result);
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,109 @@
+/*
+Copyright (c) 2021, rpi-webrtc-streamer Lyu,KeunChang
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SPSC_RING_H_
+#define SPSC_RING_H_
+
+#include <stddef.h>
+
+#include <atomic>
+#include <utility>
+#include <vector>
+
+#include "rtc_base/checks.h"
+#include "rtc_base/constructor_magic.h"
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// SPSC Ring
+//
+// Bounded lock-free ring for single producer and single consumer.
+// Push must be called only in the producer thread and Pop must be called only
+// in the consumer thread.
+//
+////////////////////////////////////////////////////////////////////////////////
+template <typename T>
+class SpscRing {
+   public:
+    explicit SpscRing(size_t capacity)
+        : slots_(capacity + 1), head_(0), tail_(0) {
+        RTC_DCHECK(capacity > 0);
+    }
+
+    // Returns false when the ring is full
+    bool Push(T item) {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        const size_t next = Next(tail);
+        if (next == head_.load(std::memory_order_acquire)) return false;
+        slots_[tail] = std::move(item);
+        tail_.store(next, std::memory_order_release);
+        return true;
+    }
+
+    // Returns false when the ring is empty
+    bool Pop(T* item) {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire)) return false;
+        *item = std::move(slots_[head]);
+        slots_[head] = T();
+        head_.store(Next(head), std::memory_order_release);
+        return true;
+    }
+
+    // Returns the front item without removing it, or nullptr when the ring
+    // is empty. It must be called only in the consumer thread.
+    const T* Front() const {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire)) return nullptr;
+        return &slots_[head];
+    }
+
+    // The size is approximate when it is called out of producer/consumer
+    size_t size() const {
+        const size_t head = head_.load(std::memory_order_acquire);
+        const size_t tail = tail_.load(std::memory_order_acquire);
+        return tail >= head ? tail - head : tail + slots_.size() - head;
+    }
+    inline bool empty() const { return size() == 0; }
+    inline size_t capacity() const { return slots_.size() - 1; }
+
+   private:
+    inline size_t Next(size_t index) const {
+        return index + 1 == slots_.size() ? 0 : index + 1;
+    }
+
+    std::vector<T> slots_;
+    // head_ is written by consumer and tail_ is written by producer
+    alignas(64) std::atomic<size_t> head_;
+    alignas(64) std::atomic<size_t> tail_;
+
+    RTC_DISALLOW_COPY_AND_ASSIGN(SpscRing);
+};
+
+#endif  // SPSC_RING_H_
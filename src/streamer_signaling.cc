@@ -111,6 +111,19 @@ bool SignalingChannelHelper::IsSignalingSessionActive() {
     return streamsession_active_;
 }
 
+bool SignalingChannelHelper::SetMotionZones(const std::string& zones) {
+    RTC_LOG(INFO) << __FUNCTION__;
+    RTC_DCHECK(proxy_ != nullptr);
+    return proxy_->SetMotionZones(zones);
+}
+
+bool SignalingChannelHelper::ListRecordings(
+    time_t from_time, time_t to_time, std::vector<RecordingInfo>* recordings) {
+    RTC_LOG(INFO) << __FUNCTION__;
+    RTC_DCHECK(proxy_ != nullptr);
+    return proxy_->ListRecordings(from_time, to_time, recordings);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // StreamerProxy
 ////////////////////////////////////////////////////////////////////////////////
@@ -119,6 +132,8 @@ StreamerProxy::StreamerProxy(RaspiMotionHolder* motion_holder)
       signaling_inbound_(nullptr),
       motion_holder_(motion_holder),
       active_peer_id_(0) {
+    // Motion detection keeps running during the live streaming, both of them
+    // share the encoder session.
     if (motion_holder_) {
         RTC_LOG(INFO) << __FUNCTION__ << "Starting the RaspiMotion";
         motion_holder_->Start();
@@ -161,12 +176,6 @@ bool StreamerProxy::StartStremerSignaling(SignalingOutbound* outbound,
         RTC_LOG(INFO) << "Streamer already occupied by another socket server";
         return false;
     } else {
-        // need to stop the motion detection feature before signaling message
-        // exchanging
-        if (motion_holder_) {
-            RTC_LOG(INFO) << __FUNCTION__ << "Stopping the RaspiMotion";
-            motion_holder_->Stop();
-        }
         active_peer_id_ = peer_id;
         active_signaling_outbound_ = outbound;
         signaling_inbound_->OnPeerConnected(peer_id, config);
@@ -184,12 +193,6 @@ bool StreamerProxy::StartStremerSignaling(SignalingOutbound* outbound,
         RTC_LOG(INFO) << "Streamer already occupied by another socket server";
         return false;
     } else {
-        // need to stop the motion detection feature before signaling message
-        // exchanging
-        if (motion_holder_) {
-            RTC_LOG(INFO) << __FUNCTION__ << "Stopping the RaspiMotion";
-            motion_holder_->Stop();
-        }
         active_peer_id_ = peer_id;
         active_signaling_outbound_ = outbound;
         signaling_inbound_->OnMessageFromPeer(peer_id, message);
@@ -204,13 +207,6 @@ void StreamerProxy::StopStreamerSignaling(SignalingOutbound* outbound,
         active_signaling_outbound_ = nullptr;
         active_peer_id_ = 0;
         signaling_inbound_->OnPeerDisconnected(peer_id);
-
-        // need to start the motion detection feature after signaling message
-        // disconnection
-        if (motion_holder_) {
-            RTC_LOG(INFO) << __FUNCTION__ << "Starting the RaspiMotion";
-            motion_holder_->Start();
-        }
     }
 }
 
@@ -222,3 +218,17 @@ void StreamerProxy::MessageFromPeer(int peer_id, const std::string& message) {
 }
 
 void StreamerProxy::MessageSent(int err) { RTC_LOG(INFO) << __FUNCTION__; }
+
+bool StreamerProxy::SetMotionZones(const std::string& zones) {
+    RTC_LOG(INFO) << __FUNCTION__ << ", zones: " << zones;
+    if (motion_holder_ == nullptr) return false;
+    return motion_holder_->SetMotionZones(zones);
+}
+
+bool StreamerProxy::ListRecordings(time_t from_time, time_t to_time,
+                                   std::vector<RecordingInfo>* recordings) {
+    RTC_LOG(INFO) << __FUNCTION__ << ", from: " << from_time
+                  << ", to: " << to_time;
+    if (motion_holder_ == nullptr) return false;
+    return motion_holder_->ListRecordings(from_time, to_time, recordings);
+}
@@ -31,6 +31,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define STREAMER_SIGNALING_H_
 
 #include <memory>
+#include <vector>
 
 #include "config_motion.h"
 #include "raspi_motion.h"
@@ -78,6 +79,9 @@ class SignalingChannelHelper : public SignalingOutbound {
     void MessageFromPeer(const std::string& message);
     int GetActivePeerId();
     bool IsSignalingSessionActive();
+    bool SetMotionZones(const std::string& zones);
+    bool ListRecordings(time_t from_time, time_t to_time,
+                        std::vector<RecordingInfo>* recordings);
 
    private:
     bool streamsession_active_;
@@ -99,6 +103,11 @@ class StreamerProxy : public SignalingOutbound {
     void StopStreamerSignaling(SignalingOutbound* outbound, int peer_id);
     void MessageFromPeer(int peer_id, const std::string& message);
     void MessageSent(int err);
+    // returns false when the zones is not valid or motion is not enabled
+    bool SetMotionZones(const std::string& zones);
+    // returns false when motion detection has not been started
+    bool ListRecordings(time_t from_time, time_t to_time,
+                        std::vector<RecordingInfo>* recordings);
     // SignalingOutbound
     void SetSignalingInbound(SignalingInbound* inbound) override;
     bool SendMessageToPeer(const int peer_id,
@@ -47,6 +47,10 @@ namespace {
 
 const char *kProtocolHandlerName = "websocket-http";
 
+// libwebsockets checks the timeouts of connections(e.g. ping/pong, http
+// keep-alive) once per second.
+const int kServiceTimeoutCheckPeriodMs = 1000;
+
 const struct lws_protocol_vhost_options mjs_extension = {
     nullptr,          /* "next" pvo linked-list */
     nullptr,          /* "child" pvo linked-list */
@@ -61,6 +65,13 @@ const struct lws_protocol_vhost_options h264_extension = {
     "video/h264"    /* mimetype to use */
 };
 
+const struct lws_protocol_vhost_options mp4_extension = {
+    &h264_extension, /* "next" pvo linked-list */
+    nullptr,         /* "child" pvo linked-list */
+    ".mp4",          /* file suffix to match */
+    "video/mp4"      /* mimetype to use */
+};
+
 /* list of supported protocols and callbacks */
 struct lws_protocols protocols[] = {
     /* first protocol must always be HTTP handler */
@@ -96,6 +107,7 @@ LibWebSocketServer::LibWebSocketServer() {
     context_ = nullptr;
     vhost_ = nullptr;
     web_mounts_ = nullptr;
+    socket_server_ = nullptr;
 }
 
 void LibWebSocketServer::Log(int level, const char *line) {
@@ -251,8 +263,8 @@ bool LibWebSocketServer::AddHttpWebMount(const std::string &mountpoint,
     http_mount->def = buf;
 
     http_mount->origin_protocol = LWSMPRO_FILE;
-    // adding h.264 mine type extension
-    http_mount->extra_mimetypes = &h264_extension;
+    // adding h.264 and mp4 mime type extensions
+    http_mount->extra_mimetypes = &mp4_extension;
 
     RTC_LOG(INFO) << absl::StrFormat("mount point : %s, orig: %s, default: %s",
                                      http_mount->mountpoint, http_mount->origin,
@@ -274,6 +286,96 @@ bool LibWebSocketServer::RunLoop(int timeout) {
     return !lws_service(context_, timeout);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+//
+// External poll integration with socket server
+//
+////////////////////////////////////////////////////////////////////////////////
+void LibWebSocketServer::AttachSocketServer(
+    rtc::PhysicalSocketServer *socket_server) {
+    for (auto &dispatcher : poll_dispatchers_) {
+        dispatcher.second->Detach();
+        detached_dispatchers_.push_back(std::move(dispatcher.second));
+    }
+    poll_dispatchers_.clear();
+
+    socket_server_ = socket_server;
+    if (socket_server_ == nullptr) {
+        detached_dispatchers_.clear();
+        return;
+    }
+
+    // the listening socket is already created in Init
+    for (auto &poll_fd : poll_fds_) {
+        AddPollFd(poll_fd.first, poll_fd.second);
+    }
+}
+
+void LibWebSocketServer::AddPollFd(int fd, short events) {
+    poll_fds_[fd] = events;
+    if (socket_server_ == nullptr) return;
+
+    auto it = poll_dispatchers_.find(fd);
+    if (it != poll_dispatchers_.end()) {
+        it->second->SetEvents(events);
+        return;
+    }
+    poll_dispatchers_[fd].reset(new PollDispatcher(
+        socket_server_, fd, events,
+        [this](int fd, short revents) { OnPollEvent(fd, revents); }));
+}
+
+void LibWebSocketServer::DeletePollFd(int fd) {
+    poll_fds_.erase(fd);
+
+    auto it = poll_dispatchers_.find(fd);
+    if (it == poll_dispatchers_.end()) return;
+    // socket server may refer the dispatcher in the current wait cycle,
+    // so the dispatcher will be deleted in the next wait cycle.
+    it->second->Detach();
+    detached_dispatchers_.push_back(std::move(it->second));
+    poll_dispatchers_.erase(it);
+}
+
+void LibWebSocketServer::ChangePollFd(int fd, short events) {
+    auto poll_fd = poll_fds_.find(fd);
+    if (poll_fd == poll_fds_.end()) return;
+    poll_fd->second = events;
+
+    auto it = poll_dispatchers_.find(fd);
+    if (it != poll_dispatchers_.end()) it->second->SetEvents(events);
+}
+
+void LibWebSocketServer::OnPollEvent(int fd, short revents) {
+    struct lws_pollfd pollfd;
+    pollfd.fd = fd;
+    pollfd.events = poll_fds_.count(fd) ? poll_fds_[fd] : 0;
+    pollfd.revents = revents;
+    if (lws_service_fd(context_, &pollfd) < 0) {
+        RTC_LOG(LS_ERROR) << "Failed to service libwebsockets fd: " << fd;
+    }
+}
+
+int LibWebSocketServer::GetNextTimeout(int cms) {
+    detached_dispatchers_.clear();
+    if (context_ == nullptr || socket_server_ == nullptr) return cms;
+
+    int timeout = MinTimeout(cms, kServiceTimeoutCheckPeriodMs);
+    // returns zero when there is a connection which needs forced service
+    return lws_service_adjust_timeout(context_, timeout, 0);
+}
+
+void LibWebSocketServer::ProcessTimeout() {
+    if (context_ == nullptr || socket_server_ == nullptr) return;
+
+    // service the connections which have buffered rx data without poll event
+    while (lws_service_adjust_timeout(context_, 1, 0) == 0) {
+        lws_service_tsi(context_, -1, 0);
+    }
+    // passing nullptr only runs the timeout checking of libwebsockets
+    lws_service_fd(context_, nullptr);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 //
 // WebSocket Handler
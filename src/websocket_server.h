@@ -34,12 +34,14 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <deque>
 #include <list>
 #include <map>
+#include <memory>
 #include <string>
 #include <vector>
 
 // __RWS_VERSION__ defined in Makefile
 #define WEBSOCKET_SERVER_NAME __RWS_VERSION__
 
+#include "poll_dispatcher.h"
 #include "websocket_handler.h"
 #include "websocket_server_internal.h"
 
@@ -105,7 +107,7 @@ struct WSInternalHandlerConfig : public WebSocketHandler {
     bool Close(int sockid, int reason_code, const std::string &message);
 };
 
-class LibWebSocketServer : public WebSocketMessage {
+class LibWebSocketServer : public WebSocketMessage, public PollEventSource {
    public:
     enum DEBUG_LEVEL {
         DEBUG_LEVEL_ERR,
@@ -131,6 +133,15 @@ class LibWebSocketServer : public WebSocketMessage {
                          const std::string default_file = "index.html");
     bool Init(int port);
     bool RunLoop(int timeout);
+
+    // Registers the sockets of libwebsockets in the socket server, so the
+    // connections are serviced by the socket server events instead of the
+    // RunLoop. Passing nullptr removes the sockets from the socket server.
+    void AttachSocketServer(rtc::PhysicalSocketServer *socket_server);
+
+    // PollEventSource
+    int GetNextTimeout(int cms) override;
+    void ProcessTimeout() override;
     void LogLevel(DEBUG_LEVEL level);
     void LogLevel(DEBUG_LEVEL level, bool log_redirect);
     static void Log(int level, const char *line);
@@ -151,7 +162,14 @@ class LibWebSocketServer : public WebSocketMessage {
     bool GetFileMapping(const std::string path, std::string &file_mapping);
     WSInternalHandlerConfig *GetWebsocketHandler(const char *path);
 
+    // external poll interfaces called by libwebsockets callback
+    void AddPollFd(int fd, short events);
+    void DeletePollFd(int fd);
+    void ChangePollFd(int fd, short events);
+
    private:
+    void OnPollEvent(int fd, short revents);
+
     std::list<WSInternalHandlerConfig> wshandler_config_;
     std::vector<lws_http_mount *> vector_http_mounts_;
 
@@ -161,6 +179,12 @@ class LibWebSocketServer : public WebSocketMessage {
     struct lws_http_mount *web_mounts_;
     int port_;
     DEBUG_LEVEL debug_level_;
+
+    // sockets of libwebsockets and the dispatchers in the socket server
+    rtc::PhysicalSocketServer *socket_server_;
+    std::map<int, short> poll_fds_;
+    std::map<int, std::unique_ptr<PollDispatcher>> poll_dispatchers_;
+    std::vector<std::unique_ptr<PollDispatcher>> detached_dispatchers_;
 };
 
 #endif  // WEBSOCKET_SERVER_H_
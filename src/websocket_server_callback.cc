@@ -58,6 +58,11 @@ struct msg {
 #define INTERNAL__GET_WSSINSTANCE \
     reinterpret_cast<LibWebSocketServer *>(lws_context_user(vhd->context))
 
+// vhd is not available in the poll fd callbacks of listening socket
+#define INTERNAL__GET_CONTEXT_WSSINSTANCE   \
+    reinterpret_cast<LibWebSocketServer *>( \
+        lws_context_user(lws_get_context(wsi)))
+
 #define INTERNAL__GET_HTTPHANDLER                                           \
     (reinterpret_cast<LibWebSocketServer *>(lws_context_user(vhd->context)) \
          ->GetHttpHandler(pss->uri_path_))
@@ -115,6 +120,33 @@ int LibWebSocketServer::CallbackLibWebsockets(struct lws *wsi,
             lwsl_info("LWS_CALLBACK_EVENT_WAIT_CANCELLED\n");
             break;
 
+            //
+            // External poll support, the sockets of libwebsockets are
+            // serviced in the socket server of signaling thread
+            //
+        case LWS_CALLBACK_ADD_POLL_FD: {
+            struct lws_pollargs *pa = (struct lws_pollargs *)in;
+            INTERNAL__GET_CONTEXT_WSSINSTANCE->AddPollFd(pa->fd, pa->events);
+        }
+            return 0;
+
+        case LWS_CALLBACK_DEL_POLL_FD: {
+            struct lws_pollargs *pa = (struct lws_pollargs *)in;
+            INTERNAL__GET_CONTEXT_WSSINSTANCE->DeletePollFd(pa->fd);
+        }
+            return 0;
+
+        case LWS_CALLBACK_CHANGE_MODE_POLL_FD: {
+            struct lws_pollargs *pa = (struct lws_pollargs *)in;
+            INTERNAL__GET_CONTEXT_WSSINSTANCE->ChangePollFd(pa->fd, pa->events);
+        }
+            return 0;
+
+        case LWS_CALLBACK_LOCK_POLL:
+        case LWS_CALLBACK_UNLOCK_POLL:
+            // all of the libwebsockets service is done in signaling thread
+            return 0;
+
             //
             // WebSocket Callback Processing
             //
@@ -0,0 +1,44 @@
+#!/bin/bash
+#
+# Measures the CPU time used by webrtc-streamer while no client is connected.
+#
+# Usage: idle_cpu_check.sh [webrtc-streamer binary] [seconds]
+#
+STREAMER=${1:-/opt/rws/webrtc-streamer}
+DURATION=${2:-60}
+CLK_TCK=$(getconf CLK_TCK)
+
+if [ ! -x "$STREAMER" ]; then
+    echo "webrtc-streamer binary not found: $STREAMER"
+    exit 1
+fi
+
+cd "$(dirname "$STREAMER")" || exit 1
+"$STREAMER" > /dev/null 2>&1 &
+PID=$!
+
+# waiting for the start-up of streamer
+sleep 5
+if ! kill -0 $PID 2> /dev/null; then
+    echo "webrtc-streamer exited during start-up"
+    exit 1
+fi
+
+# utime(14) and stime(15) of /proc/<pid>/stat in clock ticks
+cpu_ticks() {
+    awk '{ print $14 + $15 }' /proc/$PID/stat
+}
+
+START_TICKS=$(cpu_ticks)
+sleep "$DURATION"
+END_TICKS=$(cpu_ticks)
+
+kill $PID
+wait $PID 2> /dev/null
+
+awk -v ticks=$((END_TICKS - START_TICKS)) -v hz="$CLK_TCK" \
+    -v duration="$DURATION" 'BEGIN {
+    cpu = ticks / hz;
+    printf("idle %d sec: cpu time %.2f sec, cpu load %.2f%%\n",
+           duration, cpu, cpu * 100 / duration);
+}'
@@ -283,15 +283,16 @@ def load_config(config_filename):
     logger.debug("Notification Hour Schedule: %s" % _LOADED_NOTI_SCHEDULE_HOUR )
 
 def get_h264_dir_filelist(h264_file_path):
-    """ Create a list of H.264 files created by RWS.
+    """ Create a list of video files created by RWS.
 
-    Create a list of files with the h.264 extension in the H.264 directoy 
-    specified in the config file.
+    Create a list of files with the h.264 or mp4 extension in the H.264
+    directoy specified in the config file. The mp4 file keeps its extension,
+    since it does not need the converting.
     """
     h264_file_list = [w.replace('.h264', '') for w in 
         [f for f in os.listdir(h264_file_path) 
             if os.path.isfile(os.path.join(h264_file_path, f)) \
-                    and f.find('.h264') != -1 and f.find('saving') == -1 ]]
+                    and (f.endswith('.h264') or f.endswith('.mp4')) ]]
     return h264_file_list
 
 def get_newly_added_filelist():
@@ -651,8 +652,16 @@ def jobqueue_callback_video_file(bot, job):
                 # If MP4 Upload is enabled, H264 file will be converted to MP4 
                 # video which is temporarily converted attached 
                 # to telegram message
-                result, temp_filename = convert_to_mp4(
-                        _PROG_CONFIG[PROG_CONFIG_KEY_H264_PATH], media_filename )
+                if media_filename.endswith('.mp4'):
+                    # RWS saves the mp4 file, so it is sent without converting
+                    result = True
+                    temp_filename = os.path.join(
+                            _PROG_CONFIG[PROG_CONFIG_KEY_H264_PATH],
+                            media_filename)
+                else:
+                    result, temp_filename = convert_to_mp4(
+                            _PROG_CONFIG[PROG_CONFIG_KEY_H264_PATH],
+                            media_filename )
                 logger.info(
                         'chat id %s, noti disable: %s, trying to upload video file %s' 
                         % (_CHAT_ID, disable_noti, media_filename) )
@@ -669,7 +678,8 @@ def jobqueue_callback_video_file(bot, job):
             else:
                 logger.debug(
                         "File uploaded successfully, file: {}".format(media_filename))
-                remove_mp4(temp_filename)
+                if not media_filename.endswith('.mp4'):
+                    remove_mp4(temp_filename)
         else:
             # MP4 Upload is not enabled, so, sending the only telegram message 
             # of H264 file name 